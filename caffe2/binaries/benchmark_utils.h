@@ -0,0 +1,73 @@
+#ifndef CAFFE2_BINARIES_BENCHMARK_UTILS_H_
+#define CAFFE2_BINARIES_BENCHMARK_UTILS_H_
+
+// Helpers shared by the operator benchmarks in caffe2/binaries. They are
+// inline since every source file of this directory is its own binary.
+
+#include <algorithm>
+#include <random>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+
+namespace caffe2 {
+
+// Returns the tensor of blob name in ws, resized to dims.
+inline TensorCPU* CreateTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  return tensor;
+}
+
+// Creates a float tensor of dims in blob name of ws, with values drawn
+// uniformly from [min, max).
+inline TensorCPU* FillTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    const float min,
+    const float max,
+    std::mt19937* gen) {
+  auto* tensor = CreateTensor(ws, name, dims);
+  std::uniform_real_distribution<float> value(min, max);
+  std::generate(
+      tensor->mutable_data<float>(),
+      tensor->mutable_data<float>() + tensor->size(),
+      [&] { return value(*gen); });
+  return tensor;
+}
+
+// Returns the average time in seconds of running the operators defs in order,
+// over iter runs that follow warmup untimed ones.
+inline double SecondsPerRun(
+    Workspace* ws,
+    const vector<OperatorDef>& defs,
+    const int warmup,
+    const int iter) {
+  vector<unique_ptr<OperatorBase>> ops;
+  for (const auto& def : defs) {
+    ops.push_back(CreateOperator(def, ws));
+    CAFFE_ENFORCE(ops.back());
+  }
+  auto run = [&] {
+    for (auto& op : ops) {
+      CAFFE_ENFORCE(op->Run());
+    }
+  };
+  for (int i = 0; i < warmup; ++i) {
+    run();
+  }
+  Timer timer;
+  for (int i = 0; i < iter; ++i) {
+    run();
+  }
+  return timer.Seconds() / iter;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_BINARIES_BENCHMARK_UTILS_H_
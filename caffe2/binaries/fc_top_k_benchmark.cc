@@ -0,0 +1,70 @@
+// Benchmarks the output layer of a language model at inference: FC and
+// Softmax over the whole vocabulary, against FCTopK keeping the k most
+// probable words, on random inputs and weights.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 16, "Number of rows.");
+CAFFE2_DEFINE_int(hidden_size, 256, "Size of the input of the layer.");
+CAFFE2_DEFINE_int(vocab_size, 65536, "Number of outputs of the layer.");
+CAFFE2_DEFINE_int(k, 10, "Number of outputs to keep.");
+CAFFE2_DEFINE_int(block_size, 4096, "Number of outputs computed at once.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+int Benchmark() {
+  Workspace ws;
+  std::mt19937 gen(FLAGS_seed);
+  FillTensor(&ws, "X", {FLAGS_batch_size, FLAGS_hidden_size}, -0.1, 0.1, &gen);
+  FillTensor(&ws, "W", {FLAGS_vocab_size, FLAGS_hidden_size}, -0.1, 0.1, &gen);
+  FillTensor(&ws, "b", {FLAGS_vocab_size}, -0.1, 0.1, &gen);
+  const double unfused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+           "FC", "", vector<string>{"X", "W", "b"}, vector<string>{"Y"}),
+       CreateOperatorDef(
+           "Softmax", "", vector<string>{"Y"}, vector<string>{"P"})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double fused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "FCTopK",
+          "",
+          vector<string>{"X", "W", "b"},
+          vector<string>{"values", "indices"},
+          vector<Argument>{MakeArgument("k", FLAGS_k),
+                           MakeArgument("block_size", FLAGS_block_size),
+                           MakeArgument<string>("normalize", "full")})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  printf(
+      "%d rows, %d x %d weights: FC and Softmax %.3f ms, "
+      "FCTopK %.3f ms (%.2fx)\n",
+      FLAGS_batch_size,
+      FLAGS_vocab_size,
+      FLAGS_hidden_size,
+      unfused * 1e3,
+      fused * 1e3,
+      unfused / fused);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
@@ -0,0 +1,132 @@
+// Benchmarks the Int8FC and Int8Conv operators against FC and Conv at
+// inference, on random inputs and weights. The int8 timings include neither
+// the quantization of the input nor the dequantization of the output, which a
+// quantized net only does at the boundaries of chains of Int8 operators.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 32, "Number of rows of the FC input.");
+CAFFE2_DEFINE_int(input_size, 1024, "Size of the input of the FC.");
+CAFFE2_DEFINE_int(output_size, 1024, "Number of outputs of the FC.");
+CAFFE2_DEFINE_int(channels, 64, "Number of input and output channels.");
+CAFFE2_DEFINE_int(image_size, 56, "Height and width of the Conv images.");
+CAFFE2_DEFINE_string(order, "NCHW", "The order of the Conv images.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+// Times type on X, W and b and its int8 version int8_type on X quantized over
+// [-1, 1], with the given arguments.
+void Compare(
+    Workspace* ws,
+    const string& name,
+    const string& type,
+    const string& int8_type,
+    const vector<Argument>& args) {
+  CAFFE_ENFORCE(ws->RunOperatorOnce(CreateOperatorDef(
+      "Int8Quantize",
+      "",
+      vector<string>{"X"},
+      vector<string>{"X_int8"},
+      vector<Argument>{MakeArgument<float>("Y_scale", 2.f / 255),
+                       MakeArgument<int>("Y_zero_point", 128)})));
+  const double float_seconds = SecondsPerRun(
+      ws,
+      {CreateOperatorDef(
+          type, "", vector<string>{"X", "W", "b"}, vector<string>{"Y"}, args)},
+      FLAGS_warmup,
+      FLAGS_iter);
+  vector<Argument> int8_args = args;
+  int8_args.push_back(MakeArgument<float>("Y_scale", 0.1));
+  int8_args.push_back(MakeArgument<int>("Y_zero_point", 128));
+  const double int8_seconds = SecondsPerRun(
+      ws,
+      {CreateOperatorDef(
+          int8_type,
+          "",
+          vector<string>{"X_int8", "W", "b"},
+          vector<string>{"Y_int8"},
+          int8_args)},
+      FLAGS_warmup,
+      FLAGS_iter);
+  printf(
+      "%s: %s %.3f ms, %s %.3f ms (%.2fx)\n",
+      name.c_str(),
+      type.c_str(),
+      float_seconds * 1e3,
+      int8_type.c_str(),
+      int8_seconds * 1e3,
+      float_seconds / int8_seconds);
+}
+
+} // namespace
+
+int Benchmark() {
+  std::mt19937 gen(FLAGS_seed);
+  {
+    Workspace ws;
+    FillTensor(&ws, "X", {FLAGS_batch_size, FLAGS_input_size}, -1, 1, &gen);
+    FillTensor(&ws, "W", {FLAGS_output_size, FLAGS_input_size}, -1, 1, &gen);
+    FillTensor(&ws, "b", {FLAGS_output_size}, -1, 1, &gen);
+    char name[64];
+    snprintf(
+        name,
+        sizeof(name),
+        "FC %d x %d x %d",
+        FLAGS_batch_size,
+        FLAGS_input_size,
+        FLAGS_output_size);
+    Compare(&ws, name, "FC", "Int8FC", {});
+  }
+  {
+    Workspace ws;
+    const bool nchw = FLAGS_order == "NCHW";
+    const int C = FLAGS_channels;
+    const int S = FLAGS_image_size;
+    const vector<TIndex> X_dims =
+        nchw ? vector<TIndex>{1, C, S, S} : vector<TIndex>{1, S, S, C};
+    const vector<TIndex> W_dims =
+        nchw ? vector<TIndex>{C, C, 3, 3} : vector<TIndex>{C, 3, 3, C};
+    FillTensor(&ws, "X", X_dims, -1, 1, &gen);
+    FillTensor(&ws, "W", W_dims, -1, 1, &gen);
+    FillTensor(&ws, "b", {C}, -1, 1, &gen);
+    char name[64];
+    snprintf(
+        name,
+        sizeof(name),
+        "Conv 3x3 %s %d x %d x %d",
+        FLAGS_order.c_str(),
+        C,
+        S,
+        S);
+    Compare(
+        &ws,
+        name,
+        "Conv",
+        "Int8Conv",
+        {MakeArgument<int>("kernel", 3),
+         MakeArgument<int>("pad", 1),
+         MakeArgument<string>("order", FLAGS_order)});
+  }
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
@@ -0,0 +1,90 @@
+// Calibrates the int8 quantization of a net: runs the predict net over the
+// sample inputs of a db, records the range of every activation, and writes the
+// predict net with its FC and Conv operators replaced by their Int8 versions
+// (see QuantizeForInference in caffe2/core/inference_transforms.h).
+//
+// Every entry of the db is a TensorProtos holding one tensor per blob of
+// --input, in order, as written by make_image_db and friends.
+
+#include <memory>
+
+#include "caffe2/core/blob_serialization.h"
+#include "caffe2/core/db.h"
+#include "caffe2/core/inference_transforms.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/string_utils.h"
+
+CAFFE2_DEFINE_string(init_net, "", "The given net to initialize parameters.");
+CAFFE2_DEFINE_string(predict_net, "", "The given net to quantize.");
+CAFFE2_DEFINE_string(
+    input,
+    "data",
+    "Comma-separated names of the input blobs fed from the db.");
+CAFFE2_DEFINE_string(input_db, "", "The db of sample inputs.");
+CAFFE2_DEFINE_string(input_db_type, "leveldb", "The type of the input db.");
+CAFFE2_DEFINE_int(iter, 100, "The number of db entries to calibrate over.");
+CAFFE2_DEFINE_string(output_net, "", "The path of the quantized net.");
+CAFFE2_DEFINE_bool(text_output, false, "Whether to write the net as text.");
+
+namespace caffe2 {
+
+int Calibrate() {
+  CAFFE_ENFORCE(!FLAGS_predict_net.empty(), "Use --predict_net=/path/to/net.");
+  CAFFE_ENFORCE(!FLAGS_input_db.empty(), "Use --input_db=/path/to/db.");
+  CAFFE_ENFORCE(!FLAGS_output_net.empty(), "Use --output_net=/path/to/net.");
+  Workspace ws;
+  NetDef net;
+  if (!FLAGS_init_net.empty()) {
+    CAFFE_ENFORCE(ReadProtoFromFile(FLAGS_init_net, &net));
+    CAFFE_ENFORCE(ws.RunNetOnce(net));
+  }
+  CAFFE_ENFORCE(ReadProtoFromFile(FLAGS_predict_net, &net));
+  const vector<string> inputs = split(',', FLAGS_input);
+
+  std::unique_ptr<db::DB> in_db(
+      db::CreateDB(FLAGS_input_db_type, FLAGS_input_db, db::READ));
+  CAFFE_ENFORCE(in_db, "Cannot open db ", FLAGS_input_db);
+  std::unique_ptr<db::Cursor> cursor(in_db->NewCursor());
+  TensorDeserializer<CPUContext> deserializer;
+  ActivationRanges ranges;
+  int entries = 0;
+  for (; entries < FLAGS_iter && cursor->Valid(); ++entries) {
+    TensorProtos protos;
+    CAFFE_ENFORCE(protos.ParseFromString(cursor->value()));
+    CAFFE_ENFORCE_EQ(
+        protos.protos_size(),
+        inputs.size(),
+        "Entry ",
+        cursor->key(),
+        " does not have one tensor per input");
+    for (int i = 0; i < inputs.size(); ++i) {
+      CAFFE_ENFORCE(deserializer.Deserialize(
+          protos.protos(i),
+          ws.CreateBlob(inputs[i])->GetMutable<TensorCPU>()));
+    }
+    RecordActivationRanges(net, &ws, &ranges);
+    cursor->Next();
+  }
+  CAFFE_ENFORCE_GT(entries, 0, "The input db is empty");
+  LOG(INFO) << "Recorded the ranges of " << ranges.size() << " blobs over "
+            << entries << " inputs.";
+
+  const int replaced = QuantizeForInference(&net, ranges);
+  LOG(INFO) << "Quantized " << replaced << " operators.";
+  if (FLAGS_text_output) {
+    WriteProtoToTextFile(net, FLAGS_output_net);
+  } else {
+    WriteProtoToBinaryFile(net, FLAGS_output_net);
+  }
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Calibrate();
+}
@@ -0,0 +1,73 @@
+// Benchmarks LRN and its gradient on random inputs, by default with the shape
+// and the arguments of the first LRN of AlexNet.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 32, "Number of images.");
+CAFFE2_DEFINE_int(channels, 96, "Number of channels.");
+CAFFE2_DEFINE_int(size, 55, "Height and width of the images.");
+CAFFE2_DEFINE_int(window, 5, "The size of the window of channels.");
+CAFFE2_DEFINE_double(beta, 0.75, "The exponent of LRN.");
+CAFFE2_DEFINE_string(order, "NCHW", "The storage order, NCHW or NHWC.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+int Benchmark() {
+  Workspace ws;
+  std::mt19937 gen(FLAGS_seed);
+  const int N = FLAGS_batch_size, C = FLAGS_channels, S = FLAGS_size;
+  const vector<TIndex> shape = FLAGS_order == "NCHW"
+      ? vector<TIndex>{N, C, S, S}
+      : vector<TIndex>{N, S, S, C};
+  FillTensor(&ws, "X", shape, -1, 1, &gen);
+  FillTensor(&ws, "dY", shape, -1, 1, &gen);
+  const vector<Argument> args{MakeArgument("size", FLAGS_window),
+                              MakeArgument("alpha", 1e-4f),
+                              MakeArgument<float>("beta", FLAGS_beta),
+                              MakeArgument("order", FLAGS_order)};
+  const double forward = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "LRN", "", vector<string>{"X"}, vector<string>{"Y", "scale"}, args)},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double backward = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "LRNGradient",
+          "",
+          vector<string>{"X", "Y", "scale", "dY"},
+          vector<string>{"dX"},
+          args)},
+      FLAGS_warmup,
+      FLAGS_iter);
+  printf(
+      "%s %d x %d x %d x %d: forward %.3f ms, backward %.3f ms\n",
+      FLAGS_order.c_str(),
+      N,
+      C,
+      S,
+      S,
+      forward * 1e3,
+      backward * 1e3);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
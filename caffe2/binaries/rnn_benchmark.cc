@@ -0,0 +1,359 @@
+// Benchmarks the per-timestep overhead of RecurrentNetwork on an LSTM. Runs
+// the LSTM over a sequence with RecurrentNetwork, and then runs its step net
+// alone for as many steps on fixed blobs, which is the math of every timestep
+// without the bookkeeping of the recurrent op. The difference between the two
+// per timestep is the overhead of RecurrentNetwork. Then runs the fused LSTM
+// op over the same sequence, with an input of hidden_size projected by the op
+// itself, and compares a stack of num_layers such layers run by StackedLSTM
+// with a chain of as many LSTM ops. Last, runs the fused LSTM op on sequences
+// of random lengths between 1 and seq_length, padded and packed.
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 1, "Batch size.");
+CAFFE2_DEFINE_int(hidden_size, 32, "Size of the hidden state of the LSTM.");
+CAFFE2_DEFINE_int(seq_length, 20, "Number of timesteps.");
+CAFFE2_DEFINE_int(num_layers, 4, "Number of layers of the stacked LSTM.");
+CAFFE2_DEFINE_int(warmup, 10, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 1000, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+// The step net of an LSTM: gates_t = FC(hidden_t_prev) + input_t, followed by
+// LSTMUnit.
+NetDef LSTMStepNet() {
+  NetDef net;
+  net.set_name("lstm_step");
+  net.set_type("simple");
+  for (const char* input :
+       {"input_t",
+        "seq_lengths",
+        "timestep",
+        "hidden_t_prev",
+        "cell_t_prev",
+        "gates_t_w",
+        "gates_t_b"}) {
+    net.add_external_input(input);
+  }
+  auto* fc = net.add_op();
+  fc->CopyFrom(CreateOperatorDef(
+      "FC",
+      "",
+      vector<string>{"hidden_t_prev", "gates_t_w", "gates_t_b"},
+      vector<string>{"gates_t"}));
+  fc->add_arg()->CopyFrom(MakeArgument("axis", 2));
+  net.add_op()->CopyFrom(CreateOperatorDef(
+      "Sum",
+      "",
+      vector<string>{"gates_t", "input_t"},
+      vector<string>{"gates_t"}));
+  net.add_op()->CopyFrom(CreateOperatorDef(
+      "LSTMUnit",
+      "",
+      vector<string>{"cell_t_prev", "gates_t", "seq_lengths", "timestep"},
+      vector<string>{"hidden_t", "cell_t"}));
+  return net;
+}
+
+OperatorDef RecurrentNetworkDef(const NetDef& step_net) {
+  auto def = CreateOperatorDef(
+      "RecurrentNetwork",
+      "",
+      vector<string>{"input",
+                     "seq_lengths",
+                     "gates_t_w",
+                     "gates_t_b",
+                     "hidden_input",
+                     "cell_input"},
+      vector<string>{
+          "output", "hidden", "cell", "hidden_output", "cell_output"});
+  const int d = FLAGS_hidden_size;
+  def.add_arg()->CopyFrom(MakeArgument("step_net", ProtoDebugString(step_net)));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "recurrent_states", vector<string>{"hidden", "cell"}));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "recurrent_inputs", vector<string>{"hidden_input", "cell_input"}));
+  def.add_arg()->CopyFrom(MakeArgument("recurrent_sizes", vector<int>{d, d}));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "link_internal",
+      vector<string>{"hidden_t_prev",
+                     "hidden_t",
+                     "cell_t_prev",
+                     "cell_t",
+                     "gates_t",
+                     "input_t"}));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "link_external",
+      vector<string>{"hidden", "hidden", "cell", "cell", "gates", "input"}));
+  def.add_arg()->CopyFrom(
+      MakeArgument("link_offset", vector<int>{0, 1, 0, 1, 0, 0}));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "alias_src", vector<string>{"hidden", "hidden", "cell"}));
+  def.add_arg()->CopyFrom(MakeArgument(
+      "alias_dst", vector<string>{"output", "hidden_output", "cell_output"}));
+  def.add_arg()->CopyFrom(MakeArgument("alias_offset", vector<int>{1, -1, -1}));
+  def.add_arg()->CopyFrom(MakeArgument("scratch", vector<string>{"gates"}));
+  def.add_arg()->CopyFrom(MakeArgument("scratch_sizes", vector<int>{4 * d}));
+  return def;
+}
+
+} // namespace
+
+int Benchmark() {
+  const int n = FLAGS_batch_size;
+  const int d = FLAGS_hidden_size;
+  const int T = FLAGS_seq_length;
+  std::mt19937 gen(FLAGS_seed);
+  const NetDef step_net = LSTMStepNet();
+
+  Workspace ws;
+  FillTensor(&ws, "input", {T, n, 4 * d}, -1, 1, &gen);
+  FillTensor(&ws, "hidden_input", {1, n, d}, -1, 1, &gen);
+  FillTensor(&ws, "cell_input", {1, n, d}, -1, 1, &gen);
+  FillTensor(&ws, "gates_t_w", {4 * d, d}, -1, 1, &gen);
+  FillTensor(&ws, "gates_t_b", {4 * d}, -1, 1, &gen);
+  auto* seq_lengths = ws.CreateBlob("seq_lengths")->GetMutable<TensorCPU>();
+  seq_lengths->Resize(n);
+  std::fill(
+      seq_lengths->mutable_data<int>(),
+      seq_lengths->mutable_data<int>() + n,
+      T);
+  unique_ptr<OperatorBase> rnn(
+      CreateOperator(RecurrentNetworkDef(step_net), &ws));
+  CAFFE_ENFORCE(rnn);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(rnn->Run());
+  }
+  Timer timer;
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(rnn->Run());
+  }
+  const double rnn_seconds = timer.Seconds() / FLAGS_iter / T;
+
+  // The step net alone, on blobs of a single timestep.
+  Workspace step_ws(&ws);
+  FillTensor(&step_ws, "input_t", {1, n, 4 * d}, -1, 1, &gen);
+  FillTensor(&step_ws, "hidden_t_prev", {1, n, d}, -1, 1, &gen);
+  FillTensor(&step_ws, "cell_t_prev", {1, n, d}, -1, 1, &gen);
+  auto* timestep = step_ws.CreateBlob("timestep")->GetMutable<TensorCPU>();
+  timestep->Resize(1);
+  timestep->mutable_data<int>()[0] = 0;
+  NetBase* net = step_ws.CreateNet(step_net);
+  CAFFE_ENFORCE(net);
+  for (int i = 0; i < FLAGS_warmup * T; ++i) {
+    CAFFE_ENFORCE(net->Run());
+  }
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter * T; ++i) {
+    CAFFE_ENFORCE(net->Run());
+  }
+  const double step_seconds = timer.Seconds() / FLAGS_iter / T;
+
+  // The fused LSTM op, which also projects the input.
+  FillTensor(&ws, "lstm_input", {T, n, d}, -1, 1, &gen);
+  FillTensor(&ws, "lstm_input_w", {4 * d, d}, -1, 1, &gen);
+  unique_ptr<OperatorBase> lstm(CreateOperator(
+      CreateOperatorDef(
+          "LSTM",
+          "",
+          vector<string>{"lstm_input",
+                         "seq_lengths",
+                         "lstm_input_w",
+                         "gates_t_w",
+                         "gates_t_b",
+                         "hidden_input",
+                         "cell_input"},
+          vector<string>{
+              "lstm_output", "lstm_hidden_output", "lstm_cell_output"}),
+      &ws));
+  CAFFE_ENFORCE(lstm);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(lstm->Run());
+  }
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(lstm->Run());
+  }
+  const double lstm_seconds = timer.Seconds() / FLAGS_iter / T;
+
+  // A stack of LSTM layers, as a chain of LSTM ops and as a StackedLSTM.
+  const int L = FLAGS_num_layers;
+  NetDef chain;
+  chain.set_name("lstm_chain");
+  chain.set_type("simple");
+  vector<string> stacked_inputs{"lstm_input",
+                                "seq_lengths",
+                                "stacked_hidden_input",
+                                "stacked_cell_input"};
+  FillTensor(&ws, "stacked_hidden_input", {L, n, d}, -1, 1, &gen);
+  FillTensor(&ws, "stacked_cell_input", {L, n, d}, -1, 1, &gen);
+  for (int l = 0; l < L; ++l) {
+    const string layer = caffe2::to_string(l);
+    FillTensor(&ws, "layer_input_w_" + layer, {4 * d, d}, -1, 1, &gen);
+    FillTensor(&ws, "layer_recurrent_w_" + layer, {4 * d, d}, -1, 1, &gen);
+    FillTensor(&ws, "layer_b_" + layer, {4 * d}, -1, 1, &gen);
+    stacked_inputs.push_back("layer_input_w_" + layer);
+    stacked_inputs.push_back("layer_recurrent_w_" + layer);
+    stacked_inputs.push_back("layer_b_" + layer);
+    chain.add_op()->CopyFrom(CreateOperatorDef(
+        "LSTM",
+        "",
+        vector<string>{l == 0 ? "lstm_input"
+                              : "layer_output_" + caffe2::to_string(l - 1),
+                       "seq_lengths",
+                       "layer_input_w_" + layer,
+                       "layer_recurrent_w_" + layer,
+                       "layer_b_" + layer,
+                       "hidden_input",
+                       "cell_input"},
+        vector<string>{"layer_output_" + layer,
+                       "layer_hidden_output_" + layer,
+                       "layer_cell_output_" + layer}));
+  }
+  NetBase* chain_net = ws.CreateNet(chain);
+  CAFFE_ENFORCE(chain_net);
+  unique_ptr<OperatorBase> stacked(CreateOperator(
+      CreateOperatorDef(
+          "StackedLSTM",
+          "",
+          stacked_inputs,
+          vector<string>{"stacked_output",
+                         "stacked_hidden_output",
+                         "stacked_cell_output"}),
+      &ws));
+  CAFFE_ENFORCE(stacked);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(chain_net->Run());
+    CAFFE_ENFORCE(stacked->Run());
+  }
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(chain_net->Run());
+  }
+  const double chain_seconds = timer.Seconds() / FLAGS_iter / T;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(stacked->Run());
+  }
+  const double stacked_seconds = timer.Seconds() / FLAGS_iter / T;
+
+  // Sequences of random lengths, padded to the longest one and packed.
+  auto* random_lengths =
+      ws.CreateBlob("random_lengths")->GetMutable<TensorCPU>();
+  random_lengths->Resize(n);
+  std::uniform_int_distribution<int> length(1, T);
+  std::generate(
+      random_lengths->mutable_data<int>(),
+      random_lengths->mutable_data<int>() + n,
+      [&] { return length(gen); });
+  const int total = std::accumulate(
+      random_lengths->data<int>(), random_lengths->data<int>() + n, 0);
+  FillTensor(&ws, "segments", {total, d}, -1, 1, &gen);
+  NetDef packed;
+  packed.set_name("lstm_packed");
+  packed.set_type("simple");
+  packed.add_op()->CopyFrom(CreateOperatorDef(
+      "PackSequences",
+      "",
+      vector<string>{"random_lengths", "segments"},
+      vector<string>{"packed_input", "batch_sizes"}));
+  auto* packed_lstm = packed.add_op();
+  packed_lstm->CopyFrom(CreateOperatorDef(
+      "LSTM",
+      "",
+      vector<string>{"packed_input",
+                     "batch_sizes",
+                     "lstm_input_w",
+                     "gates_t_w",
+                     "gates_t_b",
+                     "hidden_input",
+                     "cell_input"},
+      vector<string>{
+          "packed_output", "packed_hidden_output", "packed_cell_output"}));
+  packed_lstm->add_arg()->CopyFrom(MakeArgument("packed", true));
+  packed.add_op()->CopyFrom(CreateOperatorDef(
+      "UnpackSequences",
+      "",
+      vector<string>{"random_lengths", "packed_output"},
+      vector<string>{"unpacked_output"}));
+  NetBase* packed_net = ws.CreateNet(packed);
+  CAFFE_ENFORCE(packed_net);
+  unique_ptr<OperatorBase> padded(CreateOperator(
+      CreateOperatorDef(
+          "LSTM",
+          "",
+          vector<string>{"lstm_input",
+                         "random_lengths",
+                         "lstm_input_w",
+                         "gates_t_w",
+                         "gates_t_b",
+                         "hidden_input",
+                         "cell_input"},
+          vector<string>{
+              "padded_output", "padded_hidden_output", "padded_cell_output"}),
+      &ws));
+  CAFFE_ENFORCE(padded);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(packed_net->Run());
+    CAFFE_ENFORCE(padded->Run());
+  }
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(padded->Run());
+  }
+  const double padded_seconds = timer.Seconds() / FLAGS_iter;
+  timer.Start();
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(packed_net->Run());
+  }
+  const double packed_seconds = timer.Seconds() / FLAGS_iter;
+
+  printf(
+      "LSTM, batch %d, hidden %d, %d timesteps: RecurrentNetwork %.2f us "
+      "per timestep, step net alone %.2f us, overhead %.2f us per timestep\n",
+      n,
+      d,
+      T,
+      rnn_seconds * 1e6,
+      step_seconds * 1e6,
+      (rnn_seconds - step_seconds) * 1e6);
+  printf(
+      "Fused LSTM op, with the input projection: %.2f us per timestep\n",
+      lstm_seconds * 1e6);
+  printf(
+      "%d layers: chain of LSTM ops %.2f us per timestep, "
+      "StackedLSTM %.2f us\n",
+      L,
+      chain_seconds * 1e6,
+      stacked_seconds * 1e6);
+  printf(
+      "%d timesteps out of %d padded: padded LSTM %.2f us, packed LSTM with "
+      "PackSequences and UnpackSequences %.2f us\n",
+      total,
+      n * T,
+      padded_seconds * 1e6,
+      packed_seconds * 1e6);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
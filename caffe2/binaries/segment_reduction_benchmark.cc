@@ -0,0 +1,123 @@
+// Benchmarks the sorted and unsorted segment reduction ops on a ranking batch:
+// a batch of queries, each with a variable number of candidate rows, reduced
+// per query. Runs the op once with --num_threads and once sequentially, and
+// reports both.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_string(
+    op,
+    "SortedSegmentSum",
+    "Segment op to benchmark, e.g. SortedSegmentSum, UnsortedSegmentSum, "
+    "SparseSortedSegmentWeightedSum or SortedSegmentRangeMax.");
+CAFFE2_DEFINE_int(num_segments, 8192, "Number of queries in the batch.");
+CAFFE2_DEFINE_int(average_length, 64, "Average number of rows per query.");
+CAFFE2_DEFINE_int(block_size, 64, "Number of features per row.");
+CAFFE2_DEFINE_int(num_rows, 1000000, "Rows of DATA for the Sparse ops.");
+CAFFE2_DEFINE_int(
+    num_threads,
+    0,
+    "num_threads argument of the op; 0 uses the CPU thread pool.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+bool StartsWith(const string& s, const string& prefix) {
+  return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+// Fills the inputs and returns the input names of --op.
+vector<string> FillInputs(Workspace* ws) {
+  std::mt19937 gen(FLAGS_seed);
+  std::uniform_real_distribution<float> value(-1, 1);
+  std::uniform_int_distribution<int> length(1, 2 * FLAGS_average_length - 1);
+  vector<int> segment_ids;
+  for (int s = 0; s < FLAGS_num_segments; ++s) {
+    segment_ids.insert(segment_ids.end(), length(gen), s);
+  }
+  const TIndex n = segment_ids.size();
+  const bool sparse = StartsWith(FLAGS_op, "Sparse");
+  const bool unsorted = FLAGS_op.find("Unsorted") != string::npos;
+  if (unsorted) {
+    std::shuffle(segment_ids.begin(), segment_ids.end(), gen);
+  }
+
+  const TIndex data_rows = sparse ? FLAGS_num_rows : n;
+  auto* data = CreateTensor(ws, "data", {data_rows, FLAGS_block_size});
+  std::generate(
+      data->mutable_data<float>(),
+      data->mutable_data<float>() + data->size(),
+      [&] { return value(gen); });
+  auto* ids = CreateTensor(ws, "segment_ids", {n});
+  std::copy(segment_ids.begin(), segment_ids.end(), ids->mutable_data<int>());
+
+  vector<string> inputs{"data"};
+  if (FLAGS_op.find("WeightedSum") != string::npos) {
+    auto* scalars = CreateTensor(ws, "scalars", {n});
+    std::generate(
+        scalars->mutable_data<float>(),
+        scalars->mutable_data<float>() + n,
+        [&] { return value(gen); });
+    inputs.push_back("scalars");
+  }
+  if (sparse) {
+    auto* indices = CreateTensor(ws, "indices", {n});
+    std::uniform_int_distribution<TIndex> index(0, data_rows - 1);
+    std::generate(
+        indices->mutable_data<TIndex>(),
+        indices->mutable_data<TIndex>() + n,
+        [&] { return index(gen); });
+    inputs.push_back("indices");
+  }
+  inputs.push_back("segment_ids");
+  return inputs;
+}
+
+} // namespace
+
+int Benchmark() {
+  Workspace ws;
+  const vector<string> inputs = FillInputs(&ws);
+  auto def =
+      CreateOperatorDef(FLAGS_op, "", inputs, vector<string>{"output"});
+  def.add_arg()->CopyFrom(MakeArgument("num_threads", 1));
+  const double sequential =
+      SecondsPerRun(&ws, {def}, FLAGS_warmup, FLAGS_iter);
+  def.mutable_arg(0)->set_i(FLAGS_num_threads);
+  const double parallel =
+      SecondsPerRun(&ws, {def}, FLAGS_warmup, FLAGS_iter);
+  const double rows = ws.GetBlob("segment_ids")->Get<TensorCPU>().size();
+  printf(
+      "%s, %d segments, %.0f rows of %d: sequential %.3f ms, "
+      "num_threads=%d %.3f ms (%.2fx), %.1f M rows/s\n",
+      FLAGS_op.c_str(),
+      FLAGS_num_segments,
+      rows,
+      FLAGS_block_size,
+      sequential * 1e3,
+      FLAGS_num_threads,
+      parallel * 1e3,
+      sequential / parallel,
+      rows / parallel / 1e6);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
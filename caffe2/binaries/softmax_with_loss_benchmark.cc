@@ -0,0 +1,104 @@
+// Benchmarks a training step of a softmax classifier: Softmax,
+// LabelCrossEntropy and AveragedLoss with their gradients, against
+// SoftmaxWithLoss and its gradient, on random logits and labels.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 128, "Number of rows.");
+CAFFE2_DEFINE_int(num_classes, 32768, "Number of classes.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+void FillInputs(Workspace* ws) {
+  std::mt19937 gen(FLAGS_seed);
+  FillTensor(
+      ws, "logits", {FLAGS_batch_size, FLAGS_num_classes}, -5, 5, &gen);
+  std::uniform_int_distribution<int> label(0, FLAGS_num_classes - 1);
+  auto* labels = CreateTensor(ws, "labels", {FLAGS_batch_size});
+  std::generate(
+      labels->mutable_data<int>(),
+      labels->mutable_data<int>() + FLAGS_batch_size,
+      [&] { return label(gen); });
+  CreateTensor(ws, "loss_grad", {})->mutable_data<float>()[0] = 1;
+}
+
+} // namespace
+
+int Benchmark() {
+  Workspace ws;
+  FillInputs(&ws);
+  const double unfused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+           "Softmax",
+           "",
+           vector<string>{"logits"},
+           vector<string>{"softmax"}),
+       CreateOperatorDef(
+           "LabelCrossEntropy",
+           "",
+           vector<string>{"softmax", "labels"},
+           vector<string>{"xent"}),
+       CreateOperatorDef(
+           "AveragedLoss", "", vector<string>{"xent"}, vector<string>{"loss"}),
+       CreateOperatorDef(
+           "AveragedLossGradient",
+           "",
+           vector<string>{"xent", "loss_grad"},
+           vector<string>{"xent_grad"}),
+       CreateOperatorDef(
+           "LabelCrossEntropyGradient",
+           "",
+           vector<string>{"softmax", "labels", "xent_grad"},
+           vector<string>{"softmax_grad"}),
+       CreateOperatorDef(
+           "SoftmaxGradient",
+           "",
+           vector<string>{"softmax", "softmax_grad"},
+           vector<string>{"logits_grad"})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double fused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+           "SoftmaxWithLoss",
+           "",
+           vector<string>{"logits", "labels"},
+           vector<string>{"softmax", "loss"}),
+       CreateOperatorDef(
+           "SoftmaxWithLossGradient",
+           "",
+           vector<string>{"logits", "labels", "softmax", "loss_grad"},
+           vector<string>{"logits_grad"})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  printf(
+      "%d rows of %d classes: unfused %.3f ms, fused %.3f ms (%.2fx)\n",
+      FLAGS_batch_size,
+      FLAGS_num_classes,
+      unfused * 1e3,
+      fused * 1e3,
+      unfused / fused);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
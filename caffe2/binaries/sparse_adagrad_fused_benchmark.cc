@@ -0,0 +1,103 @@
+// Benchmarks an embedding update step: SparseLengthsSumGradient followed by
+// SparseAdagrad, against SparseAdagradFusedWithSparseLengthsSumGradient, on a
+// table with a batch of bags of random ids.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(num_rows, 1000000, "Rows of the embedding table.");
+CAFFE2_DEFINE_int(block_size, 64, "Number of features per row.");
+CAFFE2_DEFINE_int(batch_size, 2048, "Number of bags per step.");
+CAFFE2_DEFINE_int(average_length, 40, "Average number of ids per bag.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+void FillInputs(Workspace* ws) {
+  std::mt19937 gen(FLAGS_seed);
+  std::uniform_real_distribution<float> value(-1, 1);
+  auto fill = [&](TensorCPU* tensor, const float offset) {
+    std::generate(
+        tensor->mutable_data<float>(),
+        tensor->mutable_data<float>() + tensor->size(),
+        [&] { return offset + value(gen); });
+  };
+  fill(CreateTensor(ws, "param", {FLAGS_num_rows, FLAGS_block_size}), 0);
+  fill(CreateTensor(ws, "moment", {FLAGS_num_rows, FLAGS_block_size}), 2);
+  fill(CreateTensor(ws, "grad", {FLAGS_batch_size, FLAGS_block_size}), 0);
+  CreateTensor(ws, "lr", {1})->mutable_data<float>()[0] = -0.01;
+
+  std::uniform_int_distribution<int> length(1, 2 * FLAGS_average_length - 1);
+  auto* lengths = CreateTensor(ws, "lengths", {FLAGS_batch_size});
+  int n = 0;
+  for (int i = 0; i < FLAGS_batch_size; ++i) {
+    n += lengths->mutable_data<int>()[i] = length(gen);
+  }
+  std::uniform_int_distribution<TIndex> id(0, FLAGS_num_rows - 1);
+  auto* indices = CreateTensor(ws, "indices", {n});
+  std::generate(
+      indices->mutable_data<TIndex>(),
+      indices->mutable_data<TIndex>() + n,
+      [&] { return id(gen); });
+}
+
+} // namespace
+
+int Benchmark() {
+  Workspace ws;
+  FillInputs(&ws);
+  const double unfused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+           "SparseLengthsSumGradient",
+           "",
+           vector<string>{"grad", "lengths"},
+           vector<string>{"indices_grad"}),
+       CreateOperatorDef(
+           "SparseAdagrad",
+           "",
+           vector<string>{"param", "moment", "indices", "indices_grad", "lr"},
+           vector<string>{"param", "moment"})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double fused = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "SparseAdagradFusedWithSparseLengthsSumGradient",
+          "",
+          vector<string>{"param", "moment", "indices", "grad", "lr", "lengths"},
+          vector<string>{"param", "moment"})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double n = ws.GetBlob("indices")->Get<TensorCPU>().size();
+  printf(
+      "%d bags, %.0f ids, rows of %d: unfused %.3f ms, fused %.3f ms "
+      "(%.2fx), %.1f M ids/s\n",
+      FLAGS_batch_size,
+      n,
+      FLAGS_block_size,
+      unfused * 1e3,
+      fused * 1e3,
+      unfused / fused,
+      n / fused / 1e6);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
@@ -0,0 +1,171 @@
+// Benchmarks SparseLengthsSum / SparseLengthsWeightedSum on a synthetic
+// embedding table, with either uniformly distributed indices or indices that
+// follow a Zipf distribution, as the ids of recommendation features usually
+// do. The table can be stored in float, float16 or row-wise quantized uint8.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(num_embeddings, 1000000, "Number of rows of the table.");
+CAFFE2_DEFINE_int(embedding_dim, 64, "Number of columns of the table.");
+CAFFE2_DEFINE_int(batch_size, 512, "Number of segments per run.");
+CAFFE2_DEFINE_int(average_length, 40, "Average number of indices per segment.");
+CAFFE2_DEFINE_string(
+    distribution,
+    "zipf",
+    "Distribution of the indices: uniform or zipf.");
+CAFFE2_DEFINE_double(zipf_alpha, 1.1, "Exponent of the Zipf distribution.");
+CAFFE2_DEFINE_bool(weighted, false, "Benchmark SparseLengthsWeightedSum.");
+CAFFE2_DEFINE_string(
+    data_type,
+    "float",
+    "Type of the table: float, float16 or uint8 (row-wise quantized).");
+CAFFE2_DEFINE_int(warmup, 5, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 100, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+// Returns the cumulative distribution of a Zipf distribution over n ranks.
+vector<double> ZipfCDF(const int n, const double alpha) {
+  vector<double> cdf(n);
+  double sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += 1. / std::pow(i + 1, alpha);
+    cdf[i] = sum;
+  }
+  for (auto& c : cdf) {
+    c /= sum;
+  }
+  return cdf;
+}
+
+void FillInputs(Workspace* ws) {
+  std::mt19937 gen(FLAGS_seed);
+  const int n = FLAGS_num_embeddings;
+  auto* data = CreateTensor(ws, "data", {n, FLAGS_embedding_dim});
+  std::uniform_real_distribution<float> value(-1, 1);
+  std::generate(
+      data->mutable_data<float>(),
+      data->mutable_data<float>() + data->size(),
+      [&] { return value(gen); });
+
+  auto* lengths = CreateTensor(ws, "lengths", {FLAGS_batch_size});
+  std::uniform_int_distribution<int> length(0, 2 * FLAGS_average_length);
+  TIndex num_indices = 0;
+  for (int i = 0; i < FLAGS_batch_size; ++i) {
+    lengths->mutable_data<int>()[i] = length(gen);
+    num_indices += lengths->data<int>()[i];
+  }
+
+  auto* indices = CreateTensor(ws, "indices", {num_indices});
+  TIndex* index_data = indices->mutable_data<TIndex>();
+  if (FLAGS_distribution == "uniform") {
+    std::uniform_int_distribution<TIndex> index(0, n - 1);
+    std::generate(index_data, index_data + num_indices, [&] {
+      return index(gen);
+    });
+  } else {
+    CAFFE_ENFORCE_EQ(FLAGS_distribution, "zipf", "Unknown distribution");
+    const vector<double> cdf = ZipfCDF(n, FLAGS_zipf_alpha);
+    std::uniform_real_distribution<double> u(0, 1);
+    // Scatter the popular ranks over the table, as hashed ids would be.
+    std::generate(index_data, index_data + num_indices, [&] {
+      const TIndex rank =
+          std::lower_bound(cdf.begin(), cdf.end() - 1, u(gen)) - cdf.begin();
+      return (rank * 2654435761LL) % n;
+    });
+  }
+
+  auto* weights = CreateTensor(ws, "weights", {num_indices});
+  std::generate(
+      weights->mutable_data<float>(),
+      weights->mutable_data<float>() + num_indices,
+      [&] { return value(gen); });
+}
+
+// Converts the float table to --data_type and returns the inputs of the op.
+vector<string> PrepareInputs(Workspace* ws) {
+  vector<string> inputs;
+  if (FLAGS_data_type == "float16") {
+    CAFFE_ENFORCE(ws->RunOperatorOnce(CreateOperatorDef(
+        "FloatToHalf", "", vector<string>{"data"}, vector<string>{"table"})));
+    inputs.push_back("table");
+  } else if (FLAGS_data_type == "uint8") {
+    CAFFE_ENFORCE(ws->RunOperatorOnce(CreateOperatorDef(
+        "FloatToRowwiseQuantized8Bits",
+        "",
+        vector<string>{"data"},
+        vector<string>{"table", "scale_bias"})));
+    inputs.push_back("table");
+  } else {
+    CAFFE_ENFORCE_EQ(FLAGS_data_type, "float", "Unknown data type");
+    inputs.push_back("data");
+  }
+  if (FLAGS_weighted) {
+    inputs.push_back("weights");
+  }
+  inputs.push_back("indices");
+  inputs.push_back("lengths");
+  if (FLAGS_data_type == "uint8") {
+    inputs.push_back("scale_bias");
+  }
+  return inputs;
+}
+
+} // namespace
+
+int Benchmark() {
+  Workspace ws;
+  FillInputs(&ws);
+  const string type = string(FLAGS_weighted ? "SparseLengthsWeightedSum"
+                                            : "SparseLengthsSum") +
+      (FLAGS_data_type == "uint8" ? "8BitsRowwise" : "");
+  const auto def =
+      CreateOperatorDef(type, "", PrepareInputs(&ws), vector<string>{"output"});
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  CAFFE_ENFORCE(op);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  Timer timer;
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  const double seconds = timer.Seconds() / FLAGS_iter;
+  const double num_indices = ws.GetBlob("indices")->Get<TensorCPU>().size();
+  const auto& table = ws.GetBlob(def.input(0))->Get<TensorCPU>();
+  const double bytes = num_indices * FLAGS_embedding_dim * table.itemsize();
+  printf(
+      "%s, %s %s indices, dim %d, %d segments, %.0f indices: "
+      "%.3f ms per run, %.1f M lookups/s, %.2f GB/s of rows\n",
+      def.type().c_str(),
+      FLAGS_data_type.c_str(),
+      FLAGS_distribution.c_str(),
+      FLAGS_embedding_dim,
+      FLAGS_batch_size,
+      num_indices,
+      seconds * 1e3,
+      num_indices / seconds / 1e6,
+      bytes / seconds / 1e9);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
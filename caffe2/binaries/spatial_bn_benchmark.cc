@@ -0,0 +1,75 @@
+// Benchmarks a training step of SpatialBN, the forward op and its gradient,
+// on random inputs.
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/binaries/benchmark_utils.h"
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(batch_size, 32, "Number of images.");
+CAFFE2_DEFINE_int(channels, 64, "Number of channels.");
+CAFFE2_DEFINE_int(size, 56, "Height and width of the images.");
+CAFFE2_DEFINE_string(order, "NCHW", "The storage order, NCHW or NHWC.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+int Benchmark() {
+  Workspace ws;
+  std::mt19937 gen(FLAGS_seed);
+  const int N = FLAGS_batch_size, C = FLAGS_channels, S = FLAGS_size;
+  const vector<TIndex> shape = FLAGS_order == "NCHW"
+      ? vector<TIndex>{N, C, S, S}
+      : vector<TIndex>{N, S, S, C};
+  FillTensor(&ws, "X", shape, 0.5, 1.5, &gen);
+  FillTensor(&ws, "dY", shape, 0.5, 1.5, &gen);
+  for (const string name : {"scale", "bias", "mean", "var"}) {
+    FillTensor(&ws, name, {C}, 0.5, 1.5, &gen);
+  }
+  const auto order = MakeArgument("order", FLAGS_order);
+  const double forward = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "SpatialBN",
+          "",
+          vector<string>{"X", "scale", "bias", "mean", "var"},
+          vector<string>{"Y", "mean", "var", "saved_mean", "saved_inv_std"},
+          vector<Argument>{order})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  const double backward = SecondsPerRun(
+      &ws,
+      {CreateOperatorDef(
+          "SpatialBNGradient",
+          "",
+          vector<string>{"X", "scale", "dY", "saved_mean", "saved_inv_std"},
+          vector<string>{"dX", "dscale", "dbias"},
+          vector<Argument>{order})},
+      FLAGS_warmup,
+      FLAGS_iter);
+  printf(
+      "%s %d x %d x %d x %d: forward %.3f ms, backward %.3f ms\n",
+      FLAGS_order.c_str(),
+      N,
+      C,
+      S,
+      S,
+      forward * 1e3,
+      backward * 1e3);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
@@ -0,0 +1,110 @@
+// Benchmarks Unique and FindDuplicateElements on a batch of sparse ids, with
+// either uniformly distributed ids or ids that follow a Zipf distribution, as
+// the ids of recommendation features usually do.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "caffe2/core/init.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/timer.h"
+#include "caffe2/utils/proto_utils.h"
+
+CAFFE2_DEFINE_int(num_ids, 4000000, "Number of ids per run.");
+CAFFE2_DEFINE_int(id_range, 10000000, "Number of distinct possible ids.");
+CAFFE2_DEFINE_string(
+    distribution,
+    "zipf",
+    "Distribution of the ids: uniform or zipf.");
+CAFFE2_DEFINE_double(zipf_alpha, 1.1, "Exponent of the Zipf distribution.");
+CAFFE2_DEFINE_string(
+    op,
+    "Unique",
+    "Operator to benchmark: Unique or FindDuplicateElements.");
+CAFFE2_DEFINE_bool(remapping, true, "Have Unique output the remapping.");
+CAFFE2_DEFINE_int(warmup, 3, "The number of iterations to warm up.");
+CAFFE2_DEFINE_int(iter, 20, "The number of iterations to run.");
+CAFFE2_DEFINE_int(seed, 1701, "Random seed.");
+
+namespace caffe2 {
+
+namespace {
+
+// Returns the cumulative distribution of a Zipf distribution over n ranks.
+vector<double> ZipfCDF(const int n, const double alpha) {
+  vector<double> cdf(n);
+  double sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += 1. / std::pow(i + 1, alpha);
+    cdf[i] = sum;
+  }
+  for (auto& c : cdf) {
+    c /= sum;
+  }
+  return cdf;
+}
+
+void FillIds(Workspace* ws) {
+  std::mt19937 gen(FLAGS_seed);
+  auto* ids = ws->CreateBlob("ids")->GetMutable<TensorCPU>();
+  ids->Resize(FLAGS_num_ids);
+  TIndex* id_data = ids->mutable_data<TIndex>();
+  if (FLAGS_distribution == "uniform") {
+    std::uniform_int_distribution<TIndex> id(0, FLAGS_id_range - 1);
+    std::generate(id_data, id_data + FLAGS_num_ids, [&] { return id(gen); });
+  } else {
+    CAFFE_ENFORCE_EQ(FLAGS_distribution, "zipf", "Unknown distribution");
+    const vector<double> cdf = ZipfCDF(FLAGS_id_range, FLAGS_zipf_alpha);
+    std::uniform_real_distribution<double> u(0, 1);
+    // Scatter the popular ranks over the id space, as hashed ids would be.
+    std::generate(id_data, id_data + FLAGS_num_ids, [&] {
+      const TIndex rank =
+          std::lower_bound(cdf.begin(), cdf.end() - 1, u(gen)) - cdf.begin();
+      return (rank * 2654435761LL) % FLAGS_id_range;
+    });
+  }
+}
+
+} // namespace
+
+int Benchmark() {
+  Workspace ws;
+  FillIds(&ws);
+  vector<string> outputs{"output"};
+  if (FLAGS_op == "Unique" && FLAGS_remapping) {
+    outputs.push_back("remapping");
+  }
+  const auto def =
+      CreateOperatorDef(FLAGS_op, "", vector<string>{"ids"}, outputs);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  CAFFE_ENFORCE(op);
+  for (int i = 0; i < FLAGS_warmup; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  Timer timer;
+  for (int i = 0; i < FLAGS_iter; ++i) {
+    CAFFE_ENFORCE(op->Run());
+  }
+  const double seconds = timer.Seconds() / FLAGS_iter;
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  printf(
+      "%s, %s ids, %d ids, %d outputs: %.3f ms per run, %.1f M ids/s\n",
+      FLAGS_op.c_str(),
+      FLAGS_distribution.c_str(),
+      FLAGS_num_ids,
+      static_cast<int>(output.size()),
+      seconds * 1e3,
+      FLAGS_num_ids / seconds / 1e6);
+  return 0;
+}
+
+} // namespace caffe2
+
+int main(int argc, char** argv) {
+  caffe2::GlobalInit(&argc, &argv);
+  return caffe2::Benchmark();
+}
@@ -9,6 +9,7 @@
 #include "caffe2/core/typeid.h"
 #include "caffe2/proto/caffe2.pb.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/philox_random.h"
 
 namespace caffe2 {
 
@@ -100,6 +101,18 @@ class CPUContext final {
     return *random_generator_.get();
   }
 
+  // Returns a generator positioned at the first unused block of the Philox
+  // stream of the context, and reserves enough blocks for n values so that the
+  // next call draws fresh numbers. Unlike RandGenerator(), the returned
+  // generator can be copied and skipped ahead to fill parts of an output in
+  // parallel (see ParallelForPhilox), and for a given seed the numbers do not
+  // depend on the number of threads.
+  inline PhiloxRandom PhiloxGenerator(size_t n) {
+    PhiloxRandom generator(static_cast<uint32_t>(random_seed_), philox_offset_);
+    philox_offset_ += (n + 3) / 4;
+    return generator;
+  }
+
   inline static void* New(size_t nbytes) {
     return GetCPUAllocator()->New(nbytes);
   }
@@ -136,6 +149,8 @@ class CPUContext final {
   // TODO(jiayq): instead of hard-coding a generator, make it more flexible.
   int random_seed_{1701};
   std::unique_ptr<std::mt19937> random_generator_;
+  // The first block of the Philox stream not handed out yet.
+  uint64_t philox_offset_{0};
 };
 
 template<>
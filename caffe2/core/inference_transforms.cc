@@ -0,0 +1,573 @@
+#include "caffe2/core/inference_transforms.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/quantization.h"
+
+namespace caffe2 {
+
+namespace {
+
+bool IsCPUOp(const NetDef& net, const OperatorDef& op) {
+  const DeviceOption& option =
+      op.has_device_option() ? op.device_option() : net.device_option();
+  return option.device_type() == CPU;
+}
+
+bool IsExternalOutput(const NetDef& net, const string& name) {
+  return std::find(
+             net.external_output().begin(), net.external_output().end(), name) !=
+      net.external_output().end();
+}
+
+// Returns the index of the only operator after `producer` that reads the
+// single output of `producer`, or -1 if there is no such operator, if there
+// are several of them, or if the output stays visible as an external output of
+// the net. Operators marked as removed are ignored.
+int FindSoleConsumer(
+    const NetDef& net,
+    const int producer,
+    const vector<bool>& removed) {
+  if (net.op(producer).output_size() != 1) {
+    return -1;
+  }
+  const string& output = net.op(producer).output(0);
+  int consumer = -1;
+  bool overwritten = false;
+  for (int i = producer + 1; i < net.op_size() && !overwritten; ++i) {
+    if (removed[i]) {
+      continue;
+    }
+    const auto& op = net.op(i);
+    for (const auto& input : op.input()) {
+      if (input == output) {
+        if (consumer != -1 && consumer != i) {
+          return -1;
+        }
+        consumer = i;
+      }
+    }
+    for (const auto& op_output : op.output()) {
+      overwritten |= op_output == output;
+    }
+  }
+  if (!overwritten && IsExternalOutput(net, output)) {
+    return -1;
+  }
+  return consumer;
+}
+
+// Returns the float CPU tensor stored in blob `name`, or nullptr if there is
+// none.
+TensorCPU* GetFloatTensor(Workspace* ws, const string& name) {
+  Blob* blob = ws->GetBlob(name);
+  if (!blob || !blob->IsType<TensorCPU>()) {
+    return nullptr;
+  }
+  auto* tensor = blob->GetMutable<TensorCPU>();
+  if (!tensor->IsType<float>()) {
+    return nullptr;
+  }
+  return tensor;
+}
+
+// Returns whether an operator strictly between `begin` and `end` that is not
+// marked as removed reads or writes blob `name`.
+bool IsUsedBetween(
+    const NetDef& net,
+    const int begin,
+    const int end,
+    const string& name,
+    const vector<bool>& removed) {
+  for (int i = begin + 1; i < end; ++i) {
+    if (removed[i]) {
+      continue;
+    }
+    const auto& op = net.op(i);
+    if (std::count(op.input().begin(), op.input().end(), name) ||
+        std::count(op.output().begin(), op.output().end(), name)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Copies the weight `input` of operator `idx` to a new blob of ws, rewires the
+// operator to read from it and returns the copy. Weights are never folded in
+// place: they may be read by other operators or nets, or live in a parent
+// workspace shared with other predictors.
+TensorCPU* CopyWeight(
+    NetDef* net,
+    const int idx,
+    const int input,
+    Workspace* ws) {
+  const string name = net->op(idx).input(input);
+  string folded_name = name + "_bn_folded";
+  for (int i = 1; ws->HasBlob(folded_name); ++i) {
+    folded_name = name + "_bn_folded_" + caffe2::to_string(i);
+  }
+  auto* folded = ws->CreateBlob(folded_name)->GetMutable<TensorCPU>();
+  folded->CopyFrom(*GetFloatTensor(ws, name));
+  net->mutable_op(idx)->set_input(input, folded_name);
+  // Nets that list their external inputs are checked against them.
+  if (net->external_input_size()) {
+    net->add_external_input(folded_name);
+  }
+  return folded;
+}
+
+// Returns whether an operator after `producer` reads blob `name` before it is
+// overwritten, or whether it stays visible as an external output of the net.
+bool IsReadAfter(const NetDef& net, const int producer, const string& name) {
+  for (int i = producer + 1; i < net.op_size(); ++i) {
+    const auto& op = net.op(i);
+    for (const auto& input : op.input()) {
+      if (input == name) {
+        return true;
+      }
+    }
+    for (const auto& output : op.output()) {
+      if (output == name) {
+        return false;
+      }
+    }
+  }
+  return IsExternalOutput(net, name);
+}
+
+// Returns whether operator `producer` can write the output of operator
+// `consumer` in its place: no operator in between may read or write it, and
+// the producer must not read it.
+bool CanMoveOutput(
+    const NetDef& net,
+    const int producer,
+    const int consumer,
+    const vector<bool>& removed) {
+  const string& output = net.op(consumer).output(0);
+  const auto& inputs = net.op(producer).input();
+  return !std::count(inputs.begin(), inputs.end(), output) &&
+      !IsUsedBetween(net, producer, consumer, output, removed);
+}
+
+void RemoveOps(NetDef* net, const vector<bool>& removed) {
+  auto* ops = net->mutable_op();
+  int kept = 0;
+  for (int i = 0; i < ops->size(); ++i) {
+    if (!removed[i]) {
+      if (kept != i) {
+        ops->SwapElements(kept, i);
+      }
+      ++kept;
+    }
+  }
+  while (ops->size() > kept) {
+    ops->RemoveLast();
+  }
+}
+
+// The operator types that FusedElementwise can evaluate as a node.
+const std::set<string>& FusableElementwiseTypes() {
+  static const std::set<string> types{
+      "Add", "Sub", "Mul", "Div", "Negative", "Relu", "Sigmoid", "Tanh", "Exp"};
+  return types;
+}
+
+bool IsBinaryElementwise(const string& type) {
+  return type == "Add" || type == "Sub" || type == "Mul" || type == "Div";
+}
+
+// Builds the arguments of a FusedElementwise operator from a chain of
+// elementwise operators, each of which reads the output of the previous one.
+class ElementwiseChain {
+ public:
+  // Appends op to the chain. Returns false, leaving the chain unchanged, if op
+  // cannot be appended.
+  bool Append(const OperatorDef& op) {
+    if (op.output_size() != 1 ||
+        op.input_size() != (IsBinaryElementwise(op.type()) ? 2 : 1)) {
+      return false;
+    }
+    const ElementwiseChain backup = *this;
+    int operands[2] = {Operand(op.input(0), false, -1), -1};
+    if (IsBinaryElementwise(op.type())) {
+      ArgumentHelper args(op);
+      const bool broadcast = args.GetSingleArgument<int>("broadcast", 0);
+      int axis = args.GetSingleArgument<int>("axis", -1);
+      const string axis_str = args.GetSingleArgument<string>("axis_str", "");
+      if (broadcast && axis_str.size()) {
+        axis = args.GetSingleArgument<string>("order", "NCHW").find(axis_str);
+      }
+      operands[1] = Operand(op.input(1), broadcast, axis);
+    }
+    // Every operator but the first has to read the output of the chain, and
+    // the output of the chain is never broadcast.
+    const bool reads_output =
+        operands[0] == output_ || operands[1] == output_;
+    if (operands[0] < 0 || (operands[1] < 0 && op.input_size() == 2) ||
+        (!nodes_.empty() && !reads_output)) {
+      *this = backup;
+      return false;
+    }
+    nodes_.push_back(op.type());
+    node_inputs_.push_back(operands[0]);
+    node_inputs_.push_back(operands[1]);
+    output_ = kNodeBase + nodes_.size() - 1;
+    output_name_ = op.output(0);
+    return true;
+  }
+
+  int size() const {
+    return nodes_.size();
+  }
+
+  const vector<string>& inputs() const {
+    return inputs_;
+  }
+
+  OperatorDef MakeOperatorDef(const OperatorDef& last) const {
+    // Node operands are numbered after the inputs of the fused operator.
+    vector<int> node_inputs(node_inputs_);
+    for (auto& operand : node_inputs) {
+      if (operand >= kNodeBase) {
+        operand = operand - kNodeBase + inputs_.size();
+      }
+    }
+    OperatorDef def = CreateOperatorDef(
+        "FusedElementwise",
+        last.name(),
+        inputs_,
+        vector<string>{output_name_},
+        vector<Argument>{MakeArgument("nodes", nodes_),
+                         MakeArgument("node_inputs", node_inputs),
+                         MakeArgument("broadcast", broadcast_),
+                         MakeArgument("axis", axis_)});
+    if (last.has_device_option()) {
+      def.mutable_device_option()->CopyFrom(last.device_option());
+    }
+    return def;
+  }
+
+ private:
+  // Operand indices at or above kNodeBase refer to nodes while building.
+  static constexpr int kNodeBase = 1 << 20;
+
+  // Returns the operand index of blob name, read with the given broadcast
+  // settings, or -1 if the chain output would have to be broadcast.
+  int Operand(const string& name, const bool broadcast, const int axis) {
+    if (!nodes_.empty() && name == output_name_) {
+      return broadcast ? -1 : output_;
+    }
+    for (int i = 0; i < inputs_.size(); ++i) {
+      if (inputs_[i] == name && broadcast_[i] == broadcast &&
+          axis_[i] == (broadcast ? axis : -1)) {
+        return i;
+      }
+    }
+    inputs_.push_back(name);
+    broadcast_.push_back(broadcast);
+    axis_.push_back(broadcast ? axis : -1);
+    return inputs_.size() - 1;
+  }
+
+  vector<string> inputs_;
+  vector<int> broadcast_;
+  vector<int> axis_;
+  vector<string> nodes_;
+  vector<int> node_inputs_;
+  int output_ = -1;
+  string output_name_;
+};
+
+constexpr int ElementwiseChain::kNodeBase;
+
+bool IsFusableElementwise(const NetDef& net, const OperatorDef& op) {
+  return IsCPUOp(net, op) && op.engine().empty() &&
+      FusableElementwiseTypes().count(op.type());
+}
+
+}  // namespace
+
+int FoldSpatialBN(NetDef* net, Workspace* ws) {
+  vector<bool> removed(net->op_size(), false);
+  int folded = 0;
+  for (int i = 0; i < net->op_size(); ++i) {
+    const auto& op = net->op(i);
+    if (removed[i] || !IsCPUOp(*net, op) ||
+        (op.type() != "Conv" && op.type() != "FC") || op.input_size() != 3) {
+      continue;
+    }
+    const int j = FindSoleConsumer(*net, i, removed);
+    if (j < 0) {
+      continue;
+    }
+    const auto& bn = net->op(j);
+    ArgumentHelper bn_args(bn);
+    if (bn.type() != "SpatialBN" || !IsCPUOp(*net, bn) ||
+        !bn_args.GetSingleArgument<int>("is_test", 0) || bn.input_size() != 5 ||
+        bn.output_size() != 1 || bn.input(0) != op.output(0) ||
+        !CanMoveOutput(*net, i, j, removed)) {
+      continue;
+    }
+    // The channels that SpatialBN normalizes must be the output channels of
+    // the weight, which are always its first dimension.
+    ArgumentHelper op_args(op);
+    const string bn_order = bn_args.GetSingleArgument<string>("order", "NCHW");
+    if (op.type() == "Conv") {
+      if (op_args.GetSingleArgument<string>("order", "NCHW") != bn_order) {
+        continue;
+      }
+    } else if (
+        bn_order != "NHWC" && op_args.GetSingleArgument<int>("axis", 1) != 1) {
+      // With NCHW, SpatialBN normalizes axis 1, which is only the output
+      // channel axis of FC for a 2D output.
+      continue;
+    }
+
+    auto* filter = GetFloatTensor(ws, op.input(1));
+    auto* bias = GetFloatTensor(ws, op.input(2));
+    auto* scale = GetFloatTensor(ws, bn.input(1));
+    auto* bn_bias = GetFloatTensor(ws, bn.input(2));
+    auto* mean = GetFloatTensor(ws, bn.input(3));
+    auto* var = GetFloatTensor(ws, bn.input(4));
+    if (!filter || !bias || !scale || !bn_bias || !mean || !var ||
+        filter->ndim() < 1) {
+      VLOG(1) << "Not folding " << bn.type() << " into " << op.type()
+              << ": the weights are not initialized float CPU tensors.";
+      continue;
+    }
+    const int C = filter->dim32(0);
+    if (bias->size() != C || scale->size() != C || bn_bias->size() != C ||
+        mean->size() != C || var->size() != C) {
+      continue;
+    }
+
+    const float epsilon = bn_args.GetSingleArgument<float>("epsilon", 1e-5);
+    const string bn_output = bn.output(0);
+    filter = CopyWeight(net, i, 1, ws);
+    bias = CopyWeight(net, i, 2, ws);
+    const int filter_dim = filter->size() / C;
+    float* filter_data = filter->mutable_data<float>();
+    float* bias_data = bias->mutable_data<float>();
+    for (int c = 0; c < C; ++c) {
+      const float s =
+          scale->data<float>()[c] / std::sqrt(var->data<float>()[c] + epsilon);
+      for (int k = 0; k < filter_dim; ++k) {
+        filter_data[c * filter_dim + k] *= s;
+      }
+      bias_data[c] =
+          (bias_data[c] - mean->data<float>()[c]) * s + bn_bias->data<float>()[c];
+    }
+    net->mutable_op(i)->set_output(0, bn_output);
+    removed[j] = true;
+    ++folded;
+  }
+  RemoveOps(net, removed);
+  return folded;
+}
+
+int FuseConvRelu(NetDef* net) {
+  vector<bool> removed(net->op_size(), false);
+  int fused = 0;
+  for (int i = 0; i < net->op_size(); ++i) {
+    const auto& op = net->op(i);
+    if (removed[i] || op.type() != "Conv" || op.engine().size() ||
+        !IsCPUOp(*net, op)) {
+      continue;
+    }
+    const int j = FindSoleConsumer(*net, i, removed);
+    if (j < 0) {
+      continue;
+    }
+    const auto& relu = net->op(j);
+    if (relu.type() != "Relu" || !IsCPUOp(*net, relu) ||
+        relu.input_size() != 1 || relu.output_size() != 1 ||
+        !CanMoveOutput(*net, i, j, removed)) {
+      continue;
+    }
+    const string relu_output = relu.output(0);
+    auto* conv = net->mutable_op(i);
+    conv->set_type("ConvRelu");
+    conv->set_output(0, relu_output);
+    removed[j] = true;
+    ++fused;
+  }
+  RemoveOps(net, removed);
+  return fused;
+}
+
+int FuseElementwise(NetDef* net) {
+  vector<bool> removed(net->op_size(), false);
+  int num_removed = 0;
+  for (int i = 0; i < net->op_size(); ++i) {
+    if (removed[i] || !IsFusableElementwise(*net, net->op(i))) {
+      continue;
+    }
+    ElementwiseChain chain;
+    if (!chain.Append(net->op(i))) {
+      continue;
+    }
+    vector<int> members{i};
+    while (true) {
+      const int last = members.back();
+      const int j = FindSoleConsumer(*net, last, removed);
+      if (j < 0 || !IsFusableElementwise(*net, net->op(j))) {
+        break;
+      }
+      // The fused operator runs in place of the last operator of the chain,
+      // so the inputs read by the chain so far must not change in between.
+      bool inputs_overwritten = false;
+      for (int k = last + 1; k < j && !inputs_overwritten; ++k) {
+        for (const auto& output : net->op(k).output()) {
+          inputs_overwritten |= !removed[k] &&
+              std::count(chain.inputs().begin(), chain.inputs().end(), output);
+        }
+      }
+      if (inputs_overwritten || !chain.Append(net->op(j))) {
+        break;
+      }
+      members.push_back(j);
+    }
+    if (chain.size() < 2) {
+      continue;
+    }
+    const int last = members.back();
+    *net->mutable_op(last) = chain.MakeOperatorDef(net->op(last));
+    for (int k = 0; k + 1 < members.size(); ++k) {
+      removed[members[k]] = true;
+    }
+    num_removed += members.size() - 1;
+  }
+  RemoveOps(net, removed);
+  return num_removed;
+}
+
+void OptimizeForInference(NetDef* net, Workspace* ws) {
+  const int folded = FoldSpatialBN(net, ws);
+  const int fused = FuseConvRelu(net);
+  const int elementwise = FuseElementwise(net);
+  VLOG(1) << "Inference transforms on net " << net->name() << ": folded "
+          << folded << " SpatialBN ops, fused " << fused
+          << " Conv + Relu ops, removed " << elementwise
+          << " ops by fusing elementwise chains.";
+}
+
+void RecordActivationRanges(
+    const NetDef& net,
+    Workspace* ws,
+    ActivationRanges* ranges) {
+  auto record = [&](const string& name) {
+    const TensorCPU* tensor = GetFloatTensor(ws, name);
+    if (!tensor || tensor->size() == 0) {
+      return;
+    }
+    ConstEigenVectorArrayMap<float> values(
+        tensor->data<float>(), tensor->size());
+    const float min = values.minCoeff();
+    const float max = values.maxCoeff();
+    auto it = ranges->find(name);
+    if (it == ranges->end()) {
+      ranges->emplace(name, std::make_pair(min, max));
+    } else {
+      it->second.first = std::min(it->second.first, min);
+      it->second.second = std::max(it->second.second, max);
+    }
+  };
+  for (const auto& input : net.external_input()) {
+    record(input);
+  }
+  for (const auto& def : net.op()) {
+    auto op = CreateOperator(def, ws);
+    CAFFE_ENFORCE(
+        op->Run(), "Failed to run ", def.type(), " while recording ranges");
+    for (const auto& output : def.output()) {
+      record(output);
+    }
+  }
+}
+
+int QuantizeForInference(NetDef* net, const ActivationRanges& ranges) {
+  static const std::map<string, string> kInt8Types = {
+      {"FC", "Int8FC"}, {"Conv", "Int8Conv"}, {"ConvRelu", "Int8ConvRelu"}};
+  auto params = [&](const string& name) {
+    const auto& range = ranges.at(name);
+    return ChooseQuantizationParams(range.first, range.second);
+  };
+  auto quantization_args = [&](const string& name) {
+    const auto quantization = params(name);
+    return vector<Argument>{
+        MakeArgument<float>("Y_scale", quantization.scale),
+        MakeArgument<int>("Y_zero_point", quantization.zero_point)};
+  };
+
+  // The Int8TensorCPU blob that holds the current value of a float blob.
+  std::map<string, string> quantized;
+  vector<OperatorDef> ops;
+  int replaced = 0;
+  for (const auto& op : net->op()) {
+    const auto type = kInt8Types.find(op.type());
+    if (type == kInt8Types.end() || !IsCPUOp(*net, op) ||
+        !op.engine().empty() || op.input_size() != 3 || op.output_size() != 1 ||
+        !ranges.count(op.input(0)) || !ranges.count(op.output(0))) {
+      ops.push_back(op);
+      for (const auto& output : op.output()) {
+        quantized.erase(output);
+      }
+      continue;
+    }
+    const string& input = op.input(0);
+    if (!quantized.count(input)) {
+      const string input_int8 = input + "_int8";
+      ops.push_back(CreateOperatorDef(
+          "Int8Quantize",
+          "",
+          vector<string>{input},
+          vector<string>{input_int8},
+          quantization_args(input),
+          op.device_option(),
+          ""));
+      quantized[input] = input_int8;
+    }
+    const string& output = op.output(0);
+    const string output_int8 = output + "_int8";
+    OperatorDef int8_op = op;
+    int8_op.set_type(type->second);
+    int8_op.set_input(0, quantized[input]);
+    int8_op.set_output(0, output_int8);
+    for (const auto& arg : quantization_args(output)) {
+      *int8_op.add_arg() = arg;
+    }
+    ops.push_back(int8_op);
+    ops.push_back(CreateOperatorDef(
+        "Int8Dequantize",
+        "",
+        vector<string>{output_int8},
+        vector<string>{output},
+        vector<Argument>(),
+        op.device_option(),
+        ""));
+    quantized[output] = output_int8;
+    ++replaced;
+  }
+
+  net->clear_op();
+  for (const auto& op : ops) {
+    *net->add_op() = op;
+  }
+  // Drops the Int8Dequantize operators whose float outputs are not needed.
+  vector<bool> removed(net->op_size(), false);
+  for (int i = 0; i < net->op_size(); ++i) {
+    removed[i] = net->op(i).type() == "Int8Dequantize" &&
+        !IsReadAfter(*net, i, net->op(i).output(0));
+  }
+  RemoveOps(net, removed);
+  return replaced;
+}
+
+}  // namespace caffe2
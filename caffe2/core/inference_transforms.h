@@ -0,0 +1,72 @@
+#ifndef CAFFE2_CORE_INFERENCE_TRANSFORMS_H_
+#define CAFFE2_CORE_INFERENCE_TRANSFORMS_H_
+
+#include <map>
+#include <utility>
+
+#include "caffe2/core/workspace.h"
+#include "caffe2/proto/caffe2.pb.h"
+
+namespace caffe2 {
+
+// Inference transforms rewrite a NetDef that is only going to be run forward
+// (e.g. by the Predictor) into a cheaper equivalent one. They only touch CPU
+// operators, and they only fuse an operator with the one reading its output if
+// nothing else (including the net's external outputs) needs that output, and
+// if no operator in between uses the output of the fused pair.
+
+// Folds SpatialBN operators in test mode (is_test=1) into the Conv or FC
+// operator that produces their input: with s = scale / sqrt(var + epsilon),
+// the filter of output channel c is multiplied by s[c] and the bias becomes
+// (bias[c] - mean[c]) * s[c] + bn_bias[c]. The weights are read from ws, so
+// the init net must have been run already. They are never modified in place,
+// since other nets or a parent workspace may share them: the folded weights
+// are written to new "<name>_bn_folded" blobs of ws instead. Returns the
+// number of folded SpatialBN operators.
+int FoldSpatialBN(NetDef* net, Workspace* ws);
+
+// Replaces a Conv operator followed by a Relu on its output with a single
+// ConvRelu operator. Only Conv operators with the default engine are fused.
+// Returns the number of fused pairs.
+int FuseConvRelu(NetDef* net);
+
+// Replaces chains of elementwise operators (Add, Sub, Mul, Div, Negative,
+// Relu, Sigmoid, Tanh and Exp), where each operator reads the output of the
+// previous one, with a single FusedElementwise operator that does not
+// materialize the intermediate tensors. Broadcast operands of binary operators
+// are supported as long as they are not computed by the chain itself. Returns
+// the number of operators that were removed.
+int FuseElementwise(NetDef* net);
+
+// Applies all of the transforms above to net.
+void OptimizeForInference(NetDef* net, Workspace* ws);
+
+// The [min, max] range of the values of float blobs over sample inputs, as
+// recorded by RecordActivationRanges.
+using ActivationRanges = std::map<string, std::pair<float, float>>;
+
+// Runs the operators of net once, in order, in ws (whose inputs and weights
+// must have been set up already), and widens the recorded range of every float
+// CPU tensor that is an external input of the net or an output of one of its
+// operators. Calling it over a set of sample inputs calibrates the
+// quantization of the activations for QuantizeForInference.
+void RecordActivationRanges(
+    const NetDef& net,
+    Workspace* ws,
+    ActivationRanges* ranges);
+
+// Replaces the FC, Conv and ConvRelu operators whose input and output have a
+// recorded range with Int8FC, Int8Conv and Int8ConvRelu. Each activation is
+// quantized with ChooseQuantizationParams (see utils/quantization.h) over its
+// range. An Int8Quantize is added before the first quantized operator that
+// reads a float blob, and an Int8Dequantize after every quantized operator
+// whose output is still read as a float, so that chains of quantized
+// operators pass their Int8TensorCPU outputs to each other directly. Only
+// operators with the default engine are replaced. Returns the number of
+// replaced operators. The quantized net is meant to be run with the same
+// weights, which the Int8 operators quantize on their first run.
+int QuantizeForInference(NetDef* net, const ActivationRanges& ranges);
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_CORE_INFERENCE_TRANSFORMS_H_
@@ -0,0 +1,310 @@
+#include <cmath>
+
+#include "caffe2/core/inference_transforms.h"
+#include "caffe2/core/net.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+void AddInput(
+    const vector<TIndex>& shape,
+    const float offset,
+    const string& name,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = std::sin(i * 0.7f) + offset;
+  }
+}
+
+NetDef ConvBNReluNet(Workspace* ws) {
+  AddInput({2, 3, 5, 5}, 0, "X", ws);
+  AddInput({4, 3, 3, 3}, 0, "W", ws);
+  AddInput({4}, 0, "b", ws);
+  AddInput({4}, 1.5, "scale", ws);
+  AddInput({4}, 0, "bn_bias", ws);
+  AddInput({4}, 0.2, "mean", ws);
+  AddInput({4}, 2, "var", ws);
+  NetDef net;
+  net.set_name("conv_bn_relu");
+  *net.add_op() = CreateOperatorDef(
+      "Conv",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"Y"},
+      vector<Argument>{MakeArgument<int>("kernel", 3),
+                       MakeArgument<int>("pad", 1)});
+  *net.add_op() = CreateOperatorDef(
+      "SpatialBN",
+      "",
+      vector<string>{"Y", "scale", "bn_bias", "mean", "var"},
+      vector<string>{"Z"},
+      vector<Argument>{MakeArgument<int>("is_test", 1)});
+  *net.add_op() = CreateOperatorDef(
+      "Relu", "", vector<string>{"Z"}, vector<string>{"Z"});
+  net.add_external_output("Z");
+  return net;
+}
+
+TensorCPU RunAndFetch(const NetDef& net, const string& output, Workspace* ws) {
+  CAFFE_ENFORCE(ws->RunNetOnce(net));
+  return TensorCPU(ws->GetBlob(output)->Get<TensorCPU>());
+}
+
+// Returns net with op inserted after its first operator.
+NetDef InsertAfterFirst(const NetDef& net, const OperatorDef& op) {
+  NetDef result = net;
+  result.clear_op();
+  for (int i = 0; i < net.op_size(); ++i) {
+    *result.add_op() = net.op(i);
+    if (i == 0) {
+      *result.add_op() = op;
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+TEST(InferenceTransformsTest, FoldsBNAndFusesRelu) {
+  Workspace ws;
+  NetDef net = ConvBNReluNet(&ws);
+  const TensorCPU expected = RunAndFetch(net, "Z", &ws);
+
+  OptimizeForInference(&net, &ws);
+  ASSERT_EQ(net.op_size(), 1);
+  EXPECT_EQ(net.op(0).type(), "ConvRelu");
+  EXPECT_EQ(net.op(0).output(0), "Z");
+  ws.GetBlob("Z")->Reset();
+  const TensorCPU actual = RunAndFetch(net, "Z", &ws);
+  ASSERT_EQ(actual.dims(), expected.dims());
+  int num_zeros = 0;
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(actual.data<float>()[i], expected.data<float>()[i], 1e-4);
+    num_zeros += expected.data<float>()[i] == 0;
+  }
+  // Make sure that the test actually exercises the ReLU.
+  EXPECT_GT(num_zeros, 0);
+  EXPECT_LT(num_zeros, expected.size());
+}
+
+TEST(InferenceTransformsTest, KeepsOutputsThatAreStillNeeded) {
+  Workspace ws;
+  NetDef net = ConvBNReluNet(&ws);
+  net.add_external_output("Y");
+  EXPECT_EQ(FoldSpatialBN(&net, &ws), 0);
+  EXPECT_EQ(FuseConvRelu(&net), 0);
+  EXPECT_EQ(net.op_size(), 3);
+}
+
+TEST(InferenceTransformsTest, DoesNotModifySharedWeights) {
+  Workspace ws;
+  NetDef net = ConvBNReluNet(&ws);
+  // A second Conv reading the same filter.
+  *net.add_op() = CreateOperatorDef(
+      "Conv",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"Y2"},
+      vector<Argument>{MakeArgument<int>("kernel", 3)});
+  const TensorCPU filter(ws.GetBlob("W")->Get<TensorCPU>());
+  EXPECT_EQ(FoldSpatialBN(&net, &ws), 1);
+  EXPECT_EQ(net.op(0).input(1), "W_bn_folded");
+  EXPECT_EQ(net.op(0).input(2), "b_bn_folded");
+  const auto& W = ws.GetBlob("W")->Get<TensorCPU>();
+  for (int i = 0; i < W.size(); ++i) {
+    EXPECT_EQ(W.data<float>()[i], filter.data<float>()[i]);
+  }
+}
+
+TEST(InferenceTransformsTest, DoesNotModifyParentWeights) {
+  Workspace parent;
+  NetDef net = ConvBNReluNet(&parent);
+  Workspace ws(&parent);
+  const TensorCPU filter(parent.GetBlob("W")->Get<TensorCPU>());
+  EXPECT_EQ(FoldSpatialBN(&net, &ws), 1);
+  EXPECT_EQ(net.op(0).input(1), "W_bn_folded");
+  EXPECT_FALSE(parent.HasBlob("W_bn_folded"));
+  const auto& W = parent.GetBlob("W")->Get<TensorCPU>();
+  for (int i = 0; i < W.size(); ++i) {
+    EXPECT_EQ(W.data<float>()[i], filter.data<float>()[i]);
+  }
+
+  // Folding the same weights again uses new blobs.
+  NetDef other = ConvBNReluNet(&parent);
+  EXPECT_EQ(FoldSpatialBN(&other, &ws), 1);
+  EXPECT_EQ(other.op(0).input(1), "W_bn_folded_1");
+}
+
+TEST(InferenceTransformsTest, KeepsOutputsUsedInBetween) {
+  Workspace ws;
+  const NetDef net = ConvBNReluNet(&ws);
+  // Reads the old value of Z between the Conv and the SpatialBN.
+  NetDef reading = InsertAfterFirst(
+      net,
+      CreateOperatorDef(
+          "Copy", "", vector<string>{"Z"}, vector<string>{"Z_old"}));
+  EXPECT_EQ(FoldSpatialBN(&reading, &ws), 0);
+  EXPECT_EQ(reading.op_size(), 4);
+
+  // Overwrites Z between the Conv and the SpatialBN.
+  NetDef writing = InsertAfterFirst(
+      net,
+      CreateOperatorDef("Copy", "", vector<string>{"X"}, vector<string>{"Z"}));
+  EXPECT_EQ(FoldSpatialBN(&writing, &ws), 0);
+  EXPECT_EQ(writing.op_size(), 4);
+
+  // The same for a Conv and the Relu reading its output.
+  NetDef conv_relu = net;
+  conv_relu.mutable_op()->DeleteSubrange(1, 1);
+  conv_relu.mutable_op(1)->set_input(0, "Y");
+  writing = InsertAfterFirst(
+      conv_relu,
+      CreateOperatorDef("Copy", "", vector<string>{"X"}, vector<string>{"Z"}));
+  EXPECT_EQ(FuseConvRelu(&writing), 0);
+  EXPECT_EQ(FuseConvRelu(&conv_relu), 1);
+}
+
+TEST(InferenceTransformsTest, FusesElementwiseChains) {
+  Workspace ws;
+  AddInput({2, 3, 4, 4}, 0, "X", &ws);
+  AddInput({3}, 1, "scale", &ws);
+  AddInput({2, 3, 4, 4}, 0.5, "shift", &ws);
+  NetDef net;
+  net.set_name("elementwise");
+  // Y = Tanh(X * scale + shift) * X, with scale broadcast along the channels.
+  *net.add_op() = CreateOperatorDef(
+      "Mul",
+      "",
+      vector<string>{"X", "scale"},
+      vector<string>{"T"},
+      vector<Argument>{MakeArgument<int>("broadcast", 1),
+                       MakeArgument<string>("axis_str", "C")});
+  *net.add_op() = CreateOperatorDef(
+      "Add", "", vector<string>{"T", "shift"}, vector<string>{"T"});
+  *net.add_op() =
+      CreateOperatorDef("Tanh", "", vector<string>{"T"}, vector<string>{"U"});
+  *net.add_op() = CreateOperatorDef(
+      "Mul", "", vector<string>{"X", "U"}, vector<string>{"Y"});
+  // U is still needed, so the last two operators cannot be fused.
+  *net.add_op() = CreateOperatorDef(
+      "Sigmoid", "", vector<string>{"U"}, vector<string>{"V"});
+  net.add_external_output("Y");
+  net.add_external_output("V");
+  const TensorCPU expected = RunAndFetch(net, "Y", &ws);
+  const TensorCPU expected_v = RunAndFetch(net, "V", &ws);
+
+  EXPECT_EQ(FuseElementwise(&net), 2);
+  ASSERT_EQ(net.op_size(), 3);
+  EXPECT_EQ(net.op(0).type(), "FusedElementwise");
+  EXPECT_EQ(net.op(0).output(0), "U");
+  ws.GetBlob("Y")->Reset();
+  ws.GetBlob("V")->Reset();
+  const TensorCPU actual = RunAndFetch(net, "Y", &ws);
+  const TensorCPU actual_v = RunAndFetch(net, "V", &ws);
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(actual.data<float>()[i], expected.data<float>()[i], 1e-5);
+    EXPECT_NEAR(actual_v.data<float>()[i], expected_v.data<float>()[i], 1e-5);
+  }
+}
+
+TEST(InferenceTransformsTest, FusesBroadcastOfTheFirstOperand) {
+  Workspace ws;
+  AddInput({1, 4}, 0, "X", &ws);
+  AddInput({3, 4}, 0.5, "Y", &ws);
+  NetDef net;
+  net.set_name("broadcast");
+  // X is broadcast along the rows of Y.
+  *net.add_op() = CreateOperatorDef(
+      "Add",
+      "",
+      vector<string>{"X", "Y"},
+      vector<string>{"T"},
+      vector<Argument>{MakeArgument<int>("broadcast", 1)});
+  *net.add_op() =
+      CreateOperatorDef("Relu", "", vector<string>{"T"}, vector<string>{"Z"});
+  net.add_external_output("Z");
+  const TensorCPU expected = RunAndFetch(net, "Z", &ws);
+  ASSERT_EQ(expected.dims(), (vector<TIndex>{3, 4}));
+
+  OptimizeForInference(&net, &ws);
+  ASSERT_EQ(net.op_size(), 1);
+  EXPECT_EQ(net.op(0).type(), "FusedElementwise");
+  ws.GetBlob("Z")->Reset();
+  const TensorCPU actual = RunAndFetch(net, "Z", &ws);
+  ASSERT_EQ(actual.dims(), expected.dims());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(actual.data<float>()[i], expected.data<float>()[i]);
+  }
+}
+
+TEST(InferenceTransformsTest, QuantizesConvAndFC) {
+  Workspace ws;
+  AddInput({2, 3, 6, 6}, 0, "X", &ws);
+  AddInput({8, 3, 3, 3}, 0, "W", &ws);
+  AddInput({8}, 0, "b", &ws);
+  AddInput({5, 8 * 6 * 6}, 0, "W_fc", &ws);
+  AddInput({5}, 0.5, "b_fc", &ws);
+  NetDef net;
+  net.set_name("conv_relu_fc");
+  for (const string input : {"X", "W", "b", "W_fc", "b_fc"}) {
+    net.add_external_input(input);
+  }
+  *net.add_op() = CreateOperatorDef(
+      "ConvRelu",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"Y"},
+      vector<Argument>{MakeArgument<int>("kernel", 3),
+                       MakeArgument<int>("pad", 1)});
+  *net.add_op() = CreateOperatorDef(
+      "FC", "", vector<string>{"Y", "W_fc", "b_fc"}, vector<string>{"Z"});
+  net.add_external_output("Z");
+
+  // Calibrates over a few inputs, and keeps the result for the last one.
+  ActivationRanges ranges;
+  for (int i = 0; i < 3; ++i) {
+    AddInput({2, 3, 6, 6}, 0.1 * i, "X", &ws);
+    RecordActivationRanges(net, &ws, &ranges);
+  }
+  ASSERT_EQ(ranges.count("X"), 1);
+  EXPECT_NEAR(ranges["X"].first, -1, 0.01);
+  EXPECT_NEAR(ranges["X"].second, 1.2, 0.01);
+  EXPECT_EQ(ranges["Y"].first, 0);
+  const TensorCPU expected(ws.GetBlob("Z")->Get<TensorCPU>());
+
+  NetDef quantized = net;
+  EXPECT_EQ(QuantizeForInference(&quantized, ranges), 2);
+  // Y is only read by the Int8FC, so it is not dequantized.
+  ASSERT_EQ(quantized.op_size(), 4);
+  EXPECT_EQ(quantized.op(0).type(), "Int8Quantize");
+  EXPECT_EQ(quantized.op(1).type(), "Int8ConvRelu");
+  EXPECT_EQ(quantized.op(2).type(), "Int8FC");
+  EXPECT_EQ(quantized.op(2).input(0), quantized.op(1).output(0));
+  EXPECT_EQ(quantized.op(3).type(), "Int8Dequantize");
+  EXPECT_EQ(quantized.op(3).output(0), "Z");
+  ws.GetBlob("Z")->Reset();
+  const TensorCPU actual = RunAndFetch(quantized, "Z", &ws);
+  ASSERT_EQ(actual.dims(), expected.dims());
+  const float range = ranges["Z"].second - ranges["Z"].first;
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(actual.data<float>()[i], expected.data<float>()[i],
+                0.02 * range);
+  }
+
+  // With Y needed as a float, its Int8Dequantize is kept.
+  quantized = net;
+  quantized.add_external_output("Y");
+  EXPECT_EQ(QuantizeForInference(&quantized, ranges), 2);
+  ASSERT_EQ(quantized.op_size(), 5);
+  EXPECT_EQ(quantized.op(2).type(), "Int8Dequantize");
+  EXPECT_EQ(quantized.op(2).output(0), "Y");
+}
+
+}  // namespace caffe2
@@ -8,6 +8,7 @@
 #include "caffe2/core/operator.h"
 #include "caffe2/core/timer.h"
 #include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/thread_pool.h"
 
 CAFFE2_DEFINE_bool(
     caffe2_disable_chaining,
@@ -557,7 +558,13 @@ void DAGNetBase::WorkerFunction() {
         idx,
         ".");
     const auto& chain = execution_chains_[idx];
-    bool this_success = RunAt(execution_chains_[idx]);
+    bool this_success = false;
+    {
+      // While running the chain this worker occupies a core, which intra-op
+      // parallel loops need to know about to avoid oversubscription.
+      InterOpWorkerScope inter_op_scope;
+      this_success = RunAt(execution_chains_[idx]);
+    }
     if (!this_success) {
       LOG(ERROR) << "Operator chain failed: "
                  << ProtoDebugString(operator_nodes_[idx].operator_->def());
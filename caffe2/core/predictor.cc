@@ -1,5 +1,7 @@
 #include "caffe2/core/predictor.h"
 
+#include "caffe2/core/inference_transforms.h"
+
 namespace caffe2 {
 
 namespace {
@@ -34,10 +36,14 @@ TensorCPU* extractOutputTensor(Workspace* ws, const std::string& name) {
 Predictor::Predictor(
     const NetDef& init_net,
     const NetDef& run_net,
-    Workspace* parent)
+    Workspace* parent,
+    bool optimize_for_inference)
     : run_net_(run_net), ws_(parent) {
   CAFFE_ENFORCE(ws_.RunNetOnce(init_net));
-  CAFFE_ENFORCE(ws_.CreateNet(run_net));
+  if (optimize_for_inference) {
+    OptimizeForInference(&run_net_, &ws_);
+  }
+  CAFFE_ENFORCE(ws_.CreateNet(run_net_));
 }
 
 void Predictor::run(const TensorVector& inputs, TensorVector* outputs) {
@@ -9,11 +9,14 @@ class Predictor {
  public:
   using TensorVector = std::vector<TensorCPU*>;
   // Runs the `init_net` once, then saves the `run_net` to be executed
-  // in `::run`
+  // in `::run`. If `optimize_for_inference` is set, the inference transforms
+  // (see core/inference_transforms.h) are applied to `run_net` after
+  // `init_net` has been run.
   Predictor(
       const NetDef& init_net,
       const NetDef& run_net,
-      Workspace* parent = nullptr);
+      Workspace* parent = nullptr,
+      bool optimize_for_inference = false);
 
   // Executes `run_net` on the inputs.
   // The first `inputs.size()` inputs from run_net::external_inputs
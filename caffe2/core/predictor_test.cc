@@ -116,6 +116,106 @@ TEST_F(PredictorTest, SimpleBatchSized) {
   EXPECT_TRUE(output.front()->dims().size() == 2);
   EXPECT_TRUE(output.front()->dim(0) == 1);
   EXPECT_TRUE(output.front()->dim(1) == 10);
-  EXPECT_NEAR(output.front()->data<float>()[4], 0.1209, 1E-4);
+  EXPECT_NEAR(output.front()->data<float>()[4], 1.9743, 1E-4);
+}
+
+const char* convBNInitSpec = R"DOC(
+        name: "init"
+        type: "dag"
+        op {
+          type: "ConstantFill"
+          output: "data"
+          arg { name: "shape" ints: 1 ints: 1 ints: 3 ints: 3 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "W"
+          arg { name: "shape" ints: 2 ints: 1 ints: 1 ints: 1 }
+          arg { name: "values" floats: 3.0 floats: -1.5 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "b"
+          arg { name: "shape" ints: 2 }
+          arg { name: "values" floats: 0.5 floats: 1.0 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "scale"
+          arg { name: "shape" ints: 2 }
+          arg { name: "values" floats: 2.0 floats: 0.5 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "bias"
+          arg { name: "shape" ints: 2 }
+          arg { name: "values" floats: 0.25 floats: -1.0 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "mean"
+          arg { name: "shape" ints: 2 }
+          arg { name: "values" floats: 1.0 floats: 0.0 }
+        }
+        op {
+          type: "GivenTensorFill"
+          output: "var"
+          arg { name: "shape" ints: 2 }
+          arg { name: "values" floats: 4.0 floats: 0.25 }
+        }
+)DOC";
+
+const char* convBNPredictSpec = R"DOC(
+        name: "conv_bn"
+        type: "simple"
+        external_input: "data"
+        external_input: "W"
+        external_input: "b"
+        external_input: "scale"
+        external_input: "bias"
+        external_input: "mean"
+        external_input: "var"
+        external_output: "z"
+        op {
+          type: "Conv"
+          input: "data"
+          input: "W"
+          input: "b"
+          output: "y"
+          arg { name: "kernel" i: 1 }
+        }
+        op {
+          type: "SpatialBN"
+          input: "y"
+          input: "scale"
+          input: "bias"
+          input: "mean"
+          input: "var"
+          output: "z"
+          arg { name: "is_test" i: 1 }
+        }
+)DOC";
+
+TEST_F(PredictorTest, OptimizeForInferenceKeepsOutputs) {
+  const auto init = parseNetDef(convBNInitSpec);
+  const auto predict = parseNetDef(convBNPredictSpec);
+  Predictor plain(init, predict);
+  Predictor optimized(init, predict, nullptr, true);
+  EXPECT_EQ(plain.def().op_size(), 2);
+  EXPECT_EQ(optimized.def().op_size(), 1);
+
+  auto inputData = randomTensor({1, 1, 3, 3}, ctx_.get());
+  Predictor::TensorVector input{inputData->template GetMutable<TensorCPU>()};
+  Predictor::TensorVector expected, actual;
+  plain.run(input, &expected);
+  optimized.run(input, &actual);
+  ASSERT_EQ(actual.size(), 1);
+  ASSERT_EQ(actual.front()->dims(), expected.front()->dims());
+  for (int i = 0; i < expected.front()->size(); ++i) {
+    EXPECT_NEAR(
+        actual.front()->data<float>()[i],
+        expected.front()->data<float>()[i],
+        1e-4);
+  }
 }
 }
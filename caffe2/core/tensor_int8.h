@@ -0,0 +1,22 @@
+#ifndef CAFFE2_CORE_TENSOR_INT8_H_
+#define CAFFE2_CORE_TENSOR_INT8_H_
+
+#include <cstdint>
+
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// Int8TensorCPU is the blob type of quantized activations: t holds uint8
+// values q, which stand for the real values scale * (q - zero_point). It is
+// produced by Int8Quantize and by the Int8 operators, and converted back to a
+// float TensorCPU by Int8Dequantize.
+struct Int8TensorCPU {
+  float scale{1.0};
+  int32_t zero_point{0};
+  TensorCPU t;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_CORE_TENSOR_INT8_H_
@@ -4,6 +4,10 @@ namespace caffe2 {
 namespace {
 
 REGISTER_CPU_OPERATOR(BatchMatMul, BatchMatMulOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    BatchMatMul,
+    PACKED,
+    BatchMatMulOp<float, CPUContext, PackedEngine>);
 
 OPERATOR_SCHEMA(BatchMatMul)
     .NumInputs(2)
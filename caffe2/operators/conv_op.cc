@@ -5,6 +5,7 @@ namespace caffe2 {
 namespace {
 REGISTER_CPU_OPERATOR(Conv, ConvOp<float, CPUContext>);
 REGISTER_CPU_OPERATOR(ConvGradient, ConvGradientOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR(ConvRelu, ConvOp<float, CPUContext, true>);
 
 OPERATOR_SCHEMA(Conv)
   .NumInputs(3)
@@ -35,6 +36,21 @@ why they are separate files.
   "stride size, and pad lengths."
   "");
 
+OPERATOR_SCHEMA(ConvRelu)
+  .NumInputs(3)
+  .NumOutputs(1)
+  .SetDoc(R"DOC(
+ConvRelu computes max(Conv(X, filter, bias), 0) with the same arguments and
+inputs as the Conv operator. The ReLU is applied to each image right after its
+convolution output is computed, which saves the extra pass over the activation
+that a separate Relu operator needs. It is mostly created by the inference
+transforms (see core/inference_transforms.h) rather than by hand.
+  )DOC")
+  .Input(0, "X", "Input data blob, see Conv.")
+  .Input(1, "filter", "The filter blob, see Conv.")
+  .Input(2, "bias", "The 1D bias blob, see Conv.")
+  .Output(0, "Y", "The rectified convolution output.");
+
 OPERATOR_SCHEMA(ConvGradient).NumInputs(3).NumOutputs(2, 3);
 
 class GetConvGradient : public GradientMakerBase {
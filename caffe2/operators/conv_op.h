@@ -4,10 +4,14 @@
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/operators/conv_pool_op_base.h"
+#include "caffe2/utils/math.h"
 
 namespace caffe2 {
 
-template <typename T, class Context>
+// If FuseRelu is true, the operator computes max(conv(X), 0), applying the
+// ReLU to each image right after its output is computed (ConvRelu). This is
+// currently only supported for CPUContext.
+template <typename T, class Context, bool FuseRelu = false>
 class ConvOp final : public ConvPoolOpBase<Context> {
  public:
   USE_CONV_POOL_BASE_FUNCTIONS(Context);
@@ -19,6 +23,11 @@ class ConvOp final : public ConvPoolOpBase<Context> {
   bool RunOnDeviceWithOrderNHWC() override;
 
  private:
+  void ApplyRelu(const int n, T* Ydata) {
+    EigenVectorArrayMap<T> Y_vec(Ydata, n);
+    Y_vec = Y_vec.cwiseMax(static_cast<T>(0));
+  }
+
   Tensor<Context> col_buffer_;
   Tensor<Context> bias_multiplier_;
   // Input: X, W, b
@@ -15,8 +15,8 @@ CAFFE2_DECLARE_bool(caffe2_force_shared_col_buffer);
 
 namespace caffe2 {
 
-template <typename T, class Context>
-bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
+template <typename T, class Context, bool FuseRelu>
+bool ConvOp<T, Context, FuseRelu>::RunOnDeviceWithOrderNCHW() {
   const Tensor<Context>& X = Input(INPUT);
   auto& filter = Input(FILTER);
   auto& bias = Input(BIAS);
@@ -107,6 +107,9 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
           1,
           Ydata,
           &context_);
+      if (FuseRelu) {
+        ApplyRelu(output_offset, Ydata);
+      }
       Xdata += input_offset;
       Ydata += output_offset;
     }
@@ -121,8 +124,8 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNCHW() {
 }
 
 // The implementations.
-template <typename T, class Context>
-bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
+template <typename T, class Context, bool FuseRelu>
+bool ConvOp<T, Context, FuseRelu>::RunOnDeviceWithOrderNHWC() {
   const Tensor<Context>& X = Input(INPUT);
   auto& filter = Input(FILTER);
   auto& bias = Input(BIAS);
@@ -174,6 +177,9 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
         CblasNoTrans, CblasNoTrans, N * H * W, M, 1, 1,
         bias_multiplier_.template data<T>(), bias.template data<T>(), 1, Ydata,
         &context_);
+    if (FuseRelu) {
+      ApplyRelu(N * H * W * M, Ydata);
+    }
   } else {
     if (bias_multiplier_.size() != output_image_size) {
       // If the helper bias multiplier is not M, reshape and fill it with one.
@@ -232,6 +238,9 @@ bool ConvOp<T, Context>::RunOnDeviceWithOrderNHWC() {
             1,
             Ydata,
             &context_);
+        if (FuseRelu) {
+          ApplyRelu(output_offset, Ydata);
+        }
         Xdata += input_offset;
         Ydata += output_offset;
       }
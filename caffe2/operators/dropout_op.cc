@@ -1,7 +1,17 @@
 #include "caffe2/operators/dropout_op.h"
 
+#include <algorithm>
+
+#include "caffe2/utils/philox_random.h"
+
 namespace caffe2 {
 
+namespace {
+// Random values drawn at once, a multiple of 4 so that every batch but the
+// last starts on a block of the Philox stream.
+constexpr size_t kMaskBatchSize = 256;
+} // namespace
+
 template <>
 bool DropoutOp<float, CPUContext>::RunOnDevice() {
   auto& X = Input(0);
@@ -18,17 +28,28 @@ bool DropoutOp<float, CPUContext>::RunOnDevice() {
     return true;
   } else {
     float scale = 1. / (1. - ratio_);
-    // mask=true means keep, and mask=false means not keep, so we will
-    // generate probability depending on 1-ratio.
-    std::bernoulli_distribution dist(1. - ratio_);
+    // mask=true means keep, and mask=false means not keep, so we keep the
+    // elements whose 32 random bits are below (1 - ratio) * 2^32. The mask is
+    // drawn from the Philox stream of the context in parallel.
+    const uint64_t threshold =
+        static_cast<uint64_t>((1. - ratio_) * 4294967296.);
     const float* Xdata = X.data<float>();
     float* Ydata = Y->mutable_data<float>();
     bool* mask_data = mask->mutable_data<bool>();
-    auto& gen = context_.RandGenerator();
-    for (int i = 0; i < X.size(); ++i) {
-      mask_data[i] = dist(gen);
-      Ydata[i] = Xdata[i] * scale * mask_data[i];
-    }
+    ParallelForPhilox(
+        X.size(),
+        context_.PhiloxGenerator(X.size()),
+        [&](PhiloxRandom* generator, const size_t begin, const size_t end) {
+          uint32_t bits[kMaskBatchSize];
+          for (size_t i = begin; i < end; i += kMaskBatchSize) {
+            const size_t size = std::min(kMaskBatchSize, end - i);
+            generator->Generate(size, bits);
+            for (size_t j = 0; j < size; ++j) {
+              mask_data[i + j] = bits[j] < threshold;
+              Ydata[i + j] = Xdata[i + j] * scale * mask_data[i + j];
+            }
+          }
+        });
     return true;
   }
 }
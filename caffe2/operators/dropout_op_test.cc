@@ -0,0 +1,47 @@
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static void RunDropout(const int seed, Workspace* ws) {
+  auto def = CreateOperatorDef(
+      "Dropout",
+      "",
+      vector<string>{"X"},
+      vector<string>{"Y", "mask"},
+      vector<Argument>{MakeArgument("ratio", 0.3f)});
+  def.mutable_device_option()->set_random_seed(seed);
+  ASSERT_TRUE(ws->RunOperatorOnce(def));
+}
+
+TEST(DropoutTest, MaskAndScale) {
+  const int size = 100003;
+  Workspace ws;
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(size);
+  for (int i = 0; i < size; ++i) {
+    X->mutable_data<float>()[i] = i % 17 - 8;
+  }
+  RunDropout(3, &ws);
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  const auto& mask = ws.GetBlob("mask")->Get<TensorCPU>();
+  int kept = 0;
+  for (int i = 0; i < size; ++i) {
+    const float expected = mask.data<bool>()[i] ? (i % 17 - 8) / 0.7f : 0;
+    ASSERT_FLOAT_EQ(Y.data<float>()[i], expected) << i;
+    kept += mask.data<bool>()[i];
+  }
+  EXPECT_NEAR(kept, 0.7 * size, 0.01 * size);
+
+  // The same seed draws the same mask, and another seed a different one.
+  const vector<bool> first(mask.data<bool>(), mask.data<bool>() + size);
+  RunDropout(3, &ws);
+  EXPECT_EQ(
+      vector<bool>(mask.data<bool>(), mask.data<bool>() + size), first);
+  RunDropout(4, &ws);
+  EXPECT_NE(
+      vector<bool>(mask.data<bool>(), mask.data<bool>() + size), first);
+}
+
+} // namespace caffe2
@@ -1,6 +1,10 @@
 #ifndef CAFFE2_OPERATORS_ELEMENTWISE_OP_H_
 #define CAFFE2_OPERATORS_ELEMENTWISE_OP_H_
 
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
@@ -88,6 +92,91 @@ using UnaryElementwiseOp = UnaryElementwiseWithArgsOp<
     WithDefaultConstructor<Functor>,
     OutputType>;
 
+/**
+ * BroadcastPlan describes C = op(A, B) under numpy-style broadcasting: the
+ * shapes of A and B are aligned to the right (or, if axis is not -1, B is
+ * aligned to start at dimension axis of A), and every dimension where one of
+ * them has size 1 is broadcast. The output dimensions are then coalesced:
+ * dimensions of size 1 are dropped and adjacent dimensions along which A and B
+ * are both either broadcast or not are merged, so that dims holds as few
+ * dimensions as possible, with the element strides of A and B along each of
+ * them (0 when broadcast).
+ */
+struct BroadcastPlan {
+  BroadcastPlan(
+      const vector<TIndex>& a_shape,
+      const vector<TIndex>& b_shape,
+      const int axis) {
+    const int a_ndim = a_shape.size();
+    int b_ndim = b_shape.size();
+    vector<TIndex> b_aligned(b_shape);
+    if (axis != -1) {
+      CAFFE_ENFORCE(
+          axis >= 0 && axis + b_ndim <= a_ndim,
+          "Broadcast axis should be in the range of the number "
+          "of dimensions of the first input.");
+      b_aligned.resize(a_ndim - axis, 1);
+      b_ndim = b_aligned.size();
+    }
+    const int ndim = std::max(a_ndim, b_ndim);
+    vector<TIndex> a_dims(ndim, 1), b_dims(ndim, 1);
+    std::copy(a_shape.begin(), a_shape.end(), a_dims.end() - a_ndim);
+    std::copy(b_aligned.begin(), b_aligned.end(), b_dims.end() - b_ndim);
+    c_dims.resize(ndim);
+    for (int i = 0; i < ndim; ++i) {
+      CAFFE_ENFORCE(
+          a_dims[i] == b_dims[i] || a_dims[i] == 1 || b_dims[i] == 1,
+          "Broadcast dimension mismatch at dimension ",
+          i,
+          ": ",
+          a_dims[i],
+          " vs ",
+          b_dims[i]);
+      c_dims[i] = std::max(a_dims[i], b_dims[i]);
+    }
+    // Coalesce from the innermost dimension outwards.
+    size = 1;
+    size_t a_stride = 1, b_stride = 1;
+    for (int i = ndim - 1; i >= 0; --i) {
+      if (c_dims[i] == 1) {
+        continue;
+      }
+      const bool a_full = a_dims[i] != 1;
+      const bool b_full = b_dims[i] != 1;
+      if (!dims.empty() && a_full == (a_strides.back() != 0) &&
+          b_full == (b_strides.back() != 0)) {
+        dims.back() *= c_dims[i];
+      } else {
+        dims.push_back(c_dims[i]);
+        a_strides.push_back(a_full ? a_stride : 0);
+        b_strides.push_back(b_full ? b_stride : 0);
+      }
+      a_stride *= a_dims[i];
+      b_stride *= b_dims[i];
+      size *= c_dims[i];
+    }
+    if (dims.empty()) {
+      dims.push_back(1);
+      a_strides.push_back(1);
+      b_strides.push_back(1);
+    }
+    std::reverse(dims.begin(), dims.end());
+    std::reverse(a_strides.begin(), a_strides.end());
+    std::reverse(b_strides.begin(), b_strides.end());
+  }
+
+  // Whether A is not broadcast along any dimension.
+  bool IsAFull() const {
+    return std::find(a_strides.begin(), a_strides.end(), 0) == a_strides.end();
+  }
+
+  vector<TIndex> c_dims;
+  size_t size;
+  vector<size_t> dims;
+  vector<size_t> a_strides;
+  vector<size_t> b_strides;
+};
+
 /**
  * Performs a binary operation (e.g. +, - or /) with optional broadcast support.
  *
@@ -95,11 +184,12 @@ using UnaryElementwiseOp = UnaryElementwiseWithArgsOp<
  *
  * If AllowBroadcast=false tensors has to be of exactly the same shape.
  *
- * If AllowBroadcast=true it support limited broadcasting of the right-hand-side
- * argument to match the shape of left-hand-side argument. Only suffix matching
- * is supported for now, 1-dim expansion doesn't work yet. More precisely
- * tensors A and B can be operated on iff
- *   `shape(A)[-len(shape(B)):] == * shape(B)`
+ * If AllowBroadcast=true it supports numpy-style broadcasting of both
+ * arguments, as described in BroadcastPlan. The common cases where B is a
+ * scalar or a contiguous block of the dimensions of A map to a single call of
+ * the functor; the other ones run the functor on every contiguous row of the
+ * innermost dimension, so broadcasting never materializes an expanded copy of
+ * the inputs.
  */
 template <
     typename InputTypes,
@@ -156,51 +246,119 @@ class BinaryElementwiseOp : public Operator<Context> {
     CAFFE_ENFORCE(
         &B != C || !enable_broadcast_,
         "In-place is allowed only with the first tensor when broadcasting");
-    C->ResizeLike(A);
-    const T* Adata = A.template data<T>();
-    const T* Bdata = B.template data<T>();
-    auto* Cdata =
-        C->template mutable_data<typename TypeMap::template type<T>>();
+    using R = typename TypeMap::template type<T>;
     if (!enable_broadcast_) {
       CAFFE_ENFORCE(
           A.dims() == B.dims(),
           "Dimension mismatch - did you forget to set broadcast=1?");
-      functor_.template Run<false>(A.size(), Adata, Bdata, Cdata, &context_);
+      C->ResizeLike(A);
+      functor_.template Run<false>(
+          A.size(),
+          A.template data<T>(),
+          B.template data<T>(),
+          C->template mutable_data<R>(),
+          &context_);
     } else if (B.size() == 1) {
-      functor_.template Run<true>(A.size(), Adata, Bdata, Cdata, &context_);
+      C->ResizeLike(A);
+      functor_.template Run<true>(
+          A.size(),
+          A.template data<T>(),
+          B.template data<T>(),
+          C->template mutable_data<R>(),
+          &context_);
     } else {
+      const BroadcastPlan plan(A.dims(), B.dims(), axis_);
       CAFFE_ENFORCE(
-          A.ndim() > B.ndim(),
-          "If you are doing broadcasting, input1 should have "
-          "a smaller number of dimensions.");
-      const int axis = (axis_ == -1 ? A.ndim() - B.ndim() : axis_);
-      CAFFE_ENFORCE(
-          axis >= 0 && axis < A.ndim(),
-          "Broadcast axis should be in the range of the number "
-          "of dimensions of the first input.");
-      size_t pre = 1, n = 1, post = 1;
-      for (int i = 0; i < axis; ++i) {
-        pre *= A.dim(i);
+          &A != C || plan.c_dims == A.dims(),
+          "In-place computation on the first tensor requires the output to "
+          "have its shape.");
+      C->Resize(plan.c_dims);
+      RunWithBroadcastPlan(
+          plan,
+          A.template data<T>(),
+          B.template data<T>(),
+          C->template mutable_data<R>());
+    }
+    return true;
+  }
+
+ private:
+  template <typename T, typename R>
+  void RunWithBroadcastPlan(
+      const BroadcastPlan& plan,
+      const T* Adata,
+      const T* Bdata,
+      R* Cdata) {
+    const int ndim = plan.dims.size();
+    const bool a_inner = plan.a_strides.back() != 0;
+    const bool b_inner = plan.b_strides.back() != 0;
+    // The patterns that the functors handle in a single call, which cover
+    // the limited broadcasting that used to be the only one supported.
+    if (ndim == 1 && a_inner && b_inner) {
+      functor_.template Run<false>(
+          plan.dims[0], Adata, Bdata, Cdata, &context_);
+      return;
+    }
+    if (plan.IsAFull()) {
+      if (ndim == 2 && !plan.b_strides[0] && b_inner) {
+        functor_.RunWithBroadcast(
+            Adata, Bdata, Cdata, plan.dims[0], plan.dims[1], &context_);
+        return;
       }
-      for (int i = 0; i < B.ndim(); ++i) {
-        CAFFE_ENFORCE(
-            A.dim(i + axis) == B.dim(i), "Broadcast dimension mismatch.");
-        n *= B.dim(i);
+      if (ndim == 2 && plan.b_strides[0] && !b_inner) {
+        functor_.RunWithBroadcast2(
+            Adata, Bdata, Cdata, 1, plan.dims[0], plan.dims[1], &context_);
+        return;
       }
-      for (int i = axis + B.ndim(); i < A.ndim(); ++i) {
-        post *= A.dim(i);
+      if (ndim == 3 && !plan.b_strides[0] && plan.b_strides[1] && !b_inner) {
+        functor_.RunWithBroadcast2(
+            Adata,
+            Bdata,
+            Cdata,
+            plan.dims[0],
+            plan.dims[1],
+            plan.dims[2],
+            &context_);
+        return;
+      }
+    }
+    // General case: walk the outer dimensions with precomputed strides and
+    // run the functor on every contiguous row of the innermost dimension.
+    CAFFE_ENFORCE(
+        (std::is_same<Context, CPUContext>::value),
+        "General broadcasting is only implemented on CPU.");
+    const size_t inner = plan.dims.back();
+    const size_t rows = plan.size / inner;
+    // If A is constant along the row, it is expanded into a row buffer.
+    std::unique_ptr<T[]> a_row(a_inner ? nullptr : new T[inner]);
+    vector<size_t> index(ndim - 1, 0);
+    size_t a_offset = 0, b_offset = 0;
+    for (size_t row = 0; row < rows; ++row) {
+      const T* a = Adata + a_offset;
+      if (!a_inner) {
+        std::fill(a_row.get(), a_row.get() + inner, *a);
+        a = a_row.get();
       }
-      if (post == 1) {
-        functor_.RunWithBroadcast(Adata, Bdata, Cdata, pre, n, &context_);
+      if (b_inner) {
+        functor_.template Run<false>(
+            inner, a, Bdata + b_offset, Cdata + row * inner, &context_);
       } else {
-        functor_.RunWithBroadcast2(
-            Adata, Bdata, Cdata, pre, n, post, &context_);
+        functor_.template Run<true>(
+            inner, a, Bdata + b_offset, Cdata + row * inner, &context_);
+      }
+      for (int d = ndim - 2; d >= 0; --d) {
+        a_offset += plan.a_strides[d];
+        b_offset += plan.b_strides[d];
+        if (++index[d] < plan.dims[d]) {
+          break;
+        }
+        a_offset -= plan.a_strides[d] * plan.dims[d];
+        b_offset -= plan.b_strides[d] * plan.dims[d];
+        index[d] = 0;
       }
     }
-    return true;
   }
 
- private:
   bool enable_broadcast_;
   int axis_;
   string axis_str_;
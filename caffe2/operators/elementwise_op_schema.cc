@@ -5,12 +5,14 @@
 namespace caffe2 {
 
 const char* kBroadcastDoc = R"DOC(
-If necessary the right-hand-side argument will be broadcasted to match the
-shape of left-hand-side argument. When broadcasting is specified, the second
-tensor can either be of size 1 (a scalar value), or having its shape as a
-contiguous subset of the first tensor's shape. The starting of the mutually
-equal shape is specified by the argument "axis", and if it is not set, suffix
-matching is assumed. 1-dim expansion doesn't work yet.
+If necessary the arguments will be broadcast to a common shape, following the
+numpy broadcasting rules. When broadcasting is specified, the shapes of the
+two tensors are aligned to the right, and along every dimension they must
+either be equal or one of them must be 1, in which case that tensor is
+repeated along the dimension. The output has the broadcast shape, except that
+a second tensor of size 1 (a scalar value) always yields the shape of the
+first tensor. If the argument "axis" is set, the shape of the second tensor is
+instead aligned to start at that dimension of the first tensor.
 
 For example, the following tensor shapes are supported (with broadcast=1):
 
@@ -19,6 +21,11 @@ For example, the following tensor shapes are supported (with broadcast=1):
   shape(A) = (2, 3, 4, 5), shape(B) = (4, 5)
   shape(A) = (2, 3, 4, 5), shape(B) = (3, 4), with axis=1
   shape(A) = (2, 3, 4, 5), shape(B) = (2), with axis=0
+  shape(A) = (2, 3, 4, 5), shape(B) = (3, 1, 5)
+  shape(A) = (2, 1, 4, 1), shape(B) = (3, 1, 5), giving shape(C) = (2, 3, 4, 5)
+
+Broadcasting never materializes an expanded copy of the inputs. The gradients
+only support the cases where the first tensor has the shape of the output.
 
 Argument `broadcast=1` needs to be passed to enable broadcasting.
 )DOC";
@@ -26,7 +33,7 @@ Argument `broadcast=1` needs to be passed to enable broadcasting.
 std::function<void(OpSchema&)> MathDocGenerator(const char* name) {
   return [=](OpSchema& schema) {
     string doc = R"DOC(
-Performs element-wise binary {name} (with limited broadcast support).
+Performs element-wise binary {name} (with broadcast support).
 {broadcast_doc})DOC";
     ReplaceAll(doc, "{name}", name);
     ReplaceAll(doc, "{broadcast_doc}", kBroadcastDoc);
@@ -44,7 +51,8 @@ Performs element-wise binary {name} (with limited broadcast support).
         "B",
         "Second operand. With broadcasting can be of smaller size than A. "
         "If broadcasting is disabled it should be of the same size.");
-    schema.Output(0, "C", "Result, has same dimensions and type as A");
+    schema.Output(
+        0, "C", "Result, has the broadcast dimensions and the type of A");
   };
 }
 
@@ -167,7 +175,7 @@ REGISTER_GRADIENT(Div, GetDivGradient);
 std::function<void(OpSchema&)> ComparisonDocGenerator(const char* name) {
   return [=](OpSchema& schema) {
     string doc = R"DOC(
-Performs element-wise comparison `{name}` (with limited broadcast support).
+Performs element-wise comparison `{name}` (with broadcast support).
 {broadcast_doc})DOC";
     ReplaceAll(doc, "{name}", name);
     ReplaceAll(doc, "{broadcast_doc}", kBroadcastDoc);
@@ -203,7 +211,7 @@ CAFFE2_SCHEMA_FOR_BINARY_COMPARISON_OP(EQ, "==");
 std::function<void(OpSchema&)> LogicalDocGenerator(const char* name) {
   return [=](OpSchema& schema) {
     string doc = R"DOC(
-Performs element-wise logical operation `{name}` (with limited broadcast support).
+Performs element-wise logical operation `{name}` (with broadcast support).
 Both input operands should be of type `bool`.
 {broadcast_doc})DOC";
     ReplaceAll(doc, "{name}", name);
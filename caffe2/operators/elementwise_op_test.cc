@@ -36,3 +36,89 @@ TEST(ElementwiseTest, Not) {
 TEST(ElementwiseTest, EQ) {
   elementwiseEQ<caffe2::CPUContext>();
 }
+
+namespace {
+
+// Runs C = Sub(A, B) with broadcast=1 and compares it with a naive
+// evaluation of the numpy broadcasting rules.
+void CheckBroadcastSub(
+    const std::vector<caffe2::TIndex>& a_dims,
+    const std::vector<caffe2::TIndex>& b_dims,
+    const std::vector<caffe2::TIndex>& c_dims,
+    const int axis = -1) {
+  caffe2::Workspace ws;
+  auto fill = [&](const std::string& name,
+                  const std::vector<caffe2::TIndex>& dims,
+                  const float scale) {
+    auto* tensor = ws.CreateBlob(name)->GetMutable<caffe2::TensorCPU>();
+    tensor->Resize(dims);
+    for (int i = 0; i < tensor->size(); ++i) {
+      tensor->mutable_data<float>()[i] = scale * i;
+    }
+    return tensor;
+  };
+  const auto* A = fill("X", a_dims, 1);
+  const auto* B = fill("Y", b_dims, 0.01);
+  auto def = DefineOperator<caffe2::CPUContext>("Sub");
+  auto* arg = def.add_arg();
+  arg->set_name("broadcast");
+  arg->set_i(1);
+  if (axis != -1) {
+    arg = def.add_arg();
+    arg->set_name("axis");
+    arg->set_i(axis);
+  }
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& C = ws.GetBlob("Z")->Get<caffe2::TensorCPU>();
+  ASSERT_EQ(C.dims(), c_dims);
+
+  // Dimensions of A and B aligned with the ones of C.
+  const int ndim = c_dims.size();
+  std::vector<caffe2::TIndex> a(ndim, 1), b(ndim, 1);
+  std::copy(a_dims.begin(), a_dims.end(), a.end() - a_dims.size());
+  const int b_end = axis == -1 ? ndim : axis + b_dims.size();
+  std::copy(b_dims.begin(), b_dims.end(), b.begin() + b_end - b_dims.size());
+  for (int i = 0; i < C.size(); ++i) {
+    int a_index = 0, b_index = 0, rest = i, a_stride = 1, b_stride = 1;
+    for (int d = ndim - 1; d >= 0; --d) {
+      const int c_index = rest % c_dims[d];
+      rest /= c_dims[d];
+      a_index += (a[d] == 1 ? 0 : c_index) * a_stride;
+      b_index += (b[d] == 1 ? 0 : c_index) * b_stride;
+      a_stride *= a[d];
+      b_stride *= b[d];
+    }
+    EXPECT_FLOAT_EQ(
+        C.data<float>()[i], A->data<float>()[a_index] - B->data<float>()[b_index])
+        << i;
+  }
+}
+
+} // namespace
+
+TEST(ElementwiseCPUTest, BroadcastSub) {
+  // Limited broadcasting of B.
+  CheckBroadcastSub({2, 3, 4, 5}, {1}, {2, 3, 4, 5});
+  CheckBroadcastSub({2, 3, 4, 5}, {4, 5}, {2, 3, 4, 5});
+  CheckBroadcastSub({2, 3, 4, 5}, {3, 4}, {2, 3, 4, 5}, 1);
+  CheckBroadcastSub({2, 3, 4, 5}, {2}, {2, 3, 4, 5}, 0);
+  CheckBroadcastSub({2, 3, 4, 5}, {3}, {2, 3, 4, 5}, 1);
+  // Numpy-style broadcasting.
+  CheckBroadcastSub({2, 3, 4, 5}, {3, 1, 5}, {2, 3, 4, 5});
+  CheckBroadcastSub({2, 3, 4, 5}, {2, 3, 4, 5}, {2, 3, 4, 5});
+  CheckBroadcastSub({2, 1, 4, 1}, {3, 1, 5}, {2, 3, 4, 5});
+  CheckBroadcastSub({4, 1}, {1, 6}, {4, 6});
+  CheckBroadcastSub({1}, {7}, {7});
+  CheckBroadcastSub({5}, {3, 1}, {3, 5});
+}
+
+TEST(ElementwiseCPUTest, BroadcastMismatch) {
+  caffe2::Workspace ws;
+  FillTensor<caffe2::CPUContext, int32_t, int32_t>(&ws, "X", {2, 3}, {});
+  FillTensor<caffe2::CPUContext, int32_t, int32_t>(&ws, "Y", {2}, {});
+  auto def = DefineOperator<caffe2::CPUContext>("Add");
+  auto* arg = def.add_arg();
+  arg->set_name("broadcast");
+  arg->set_i(1);
+  EXPECT_THROW(ws.RunOperatorOnce(def), caffe2::EnforceNotMet);
+}
@@ -0,0 +1,222 @@
+#include "caffe2/operators/fc_top_k_op.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+struct Candidate {
+  float value;
+  TIndex index;
+};
+
+// Larger values first, and lower indices first among equal values, so that
+// the selection does not depend on the blocks.
+inline bool Better(const Candidate& a, const Candidate& b) {
+  return a.value > b.value || (a.value == b.value && a.index < b.index);
+}
+
+// The top k and the log-sum-exp state of every row within a block of columns.
+struct BlockResult {
+  // The number of candidates per row, k or the size of the block if smaller.
+  int k;
+  // The candidates of every row, in no particular order.
+  std::vector<Candidate> candidates;
+  std::vector<float> max;
+  std::vector<float> sum;
+};
+
+} // namespace
+
+FCTopKOp::FCTopKOp(const OperatorDef& operator_def, Workspace* ws)
+    : Operator<CPUContext>(operator_def, ws),
+      OP_SINGLE_ARG(int, "axis", axis_, 1),
+      OP_SINGLE_ARG(int, "k", k_, 1),
+      OP_SINGLE_ARG(int, "block_size", blockSize_, 4096) {
+  CAFFE_ENFORCE_GT(k_, 0, "k must be positive");
+  CAFFE_ENFORCE_GT(blockSize_, 0, "block_size must be positive");
+  const string normalize =
+      OperatorBase::GetSingleArgument<string>("normalize", "none");
+  if (normalize == "none") {
+    normalize_ = Normalize::NONE;
+  } else if (normalize == "full") {
+    normalize_ = Normalize::FULL;
+  } else if (normalize == "top_k") {
+    normalize_ = Normalize::TOP_K;
+  } else {
+    CAFFE_THROW("Unknown normalize: ", normalize);
+  }
+}
+
+bool FCTopKOp::RunOnDevice() {
+  const auto& X = Input(INPUT);
+  const auto& W = Input(WEIGHT);
+  const auto& b = Input(BIAS);
+  CAFFE_ENFORCE_EQ(W.ndim(), 2, "WEIGHT must be N x K");
+  const auto canonical_axis = X.canonical_axis_index(axis_);
+  const int M = X.size_to_dim(canonical_axis);
+  const int K = X.size_from_dim(canonical_axis);
+  const int N = W.dim32(0);
+  CAFFE_ENFORCE_EQ(W.dim32(1), K, "WEIGHT must be N x K");
+  CAFFE_ENFORCE_EQ(b.size(), N, "BIAS must have N entries");
+  CAFFE_ENFORCE_LE(k_, N, "k is larger than the number of outputs");
+
+  auto outputDims = X.dims();
+  outputDims.resize(canonical_axis + 1);
+  outputDims[canonical_axis] = k_;
+  auto* values = Output(VALUES);
+  auto* indices = Output(INDICES);
+  values->Resize(outputDims);
+  indices->Resize(outputDims);
+  float* valuesData = values->mutable_data<float>();
+  TIndex* indicesData = indices->mutable_data<TIndex>();
+  if (M == 0) {
+    return true;
+  }
+
+  const float* Xdata = X.data<float>();
+  const float* Wdata = W.data<float>();
+  const float* bdata = b.data<float>();
+  const int numBlocks = (N + blockSize_ - 1) / blockSize_;
+  std::vector<BlockResult> results(numBlocks);
+  ThreadPool::Default()->Run(
+      [&](const size_t block) {
+        const int begin = block * blockSize_;
+        const int size = std::min(blockSize_, N - begin);
+        const int k = std::min(k_, size);
+        std::vector<float> logits(M * size);
+        for (int i = 0; i < M; ++i) {
+          std::copy(bdata + begin, bdata + begin + size, &logits[i * size]);
+        }
+        math::Gemm<float, CPUContext>(
+            CblasNoTrans,
+            CblasTrans,
+            M,
+            size,
+            K,
+            1,
+            Xdata,
+            Wdata + static_cast<TIndex>(begin) * K,
+            1,
+            logits.data(),
+            &context_);
+
+        auto& result = results[block];
+        result.candidates.resize(M * k);
+        result.k = k;
+        result.max.resize(M);
+        result.sum.resize(M);
+        for (int i = 0; i < M; ++i) {
+          const float* row = &logits[i * size];
+          // A heap of the best k so far, with the worst of them on top.
+          Candidate* heap = &result.candidates[i * k];
+          for (int j = 0; j < k; ++j) {
+            heap[j] = Candidate{row[j], begin + j};
+          }
+          std::make_heap(heap, heap + k, Better);
+          for (int j = k; j < size; ++j) {
+            const Candidate candidate{row[j], begin + j};
+            if (Better(candidate, heap[0])) {
+              std::pop_heap(heap, heap + k, Better);
+              heap[k - 1] = candidate;
+              std::push_heap(heap, heap + k, Better);
+            }
+          }
+          if (normalize_ == Normalize::FULL) {
+            ConstEigenVectorArrayMap<float> rowArray(row, size);
+            const float max = rowArray.maxCoeff();
+            result.max[i] = max;
+            result.sum[i] = (rowArray - max).exp().sum();
+          }
+        }
+      },
+      numBlocks);
+
+  // Merges the blocks in order, so that the result does not depend on the
+  // threads.
+  std::vector<Candidate> merged;
+  for (int i = 0; i < M; ++i) {
+    merged.clear();
+    float max = -FLT_MAX;
+    for (const auto& result : results) {
+      const Candidate* row = &result.candidates[i * result.k];
+      merged.insert(merged.end(), row, row + result.k);
+      if (normalize_ == Normalize::FULL) {
+        max = std::max(max, result.max[i]);
+      }
+    }
+    std::partial_sort(
+        merged.begin(), merged.begin() + k_, merged.end(), Better);
+    float logSumExp = 0;
+    if (normalize_ == Normalize::FULL) {
+      float sum = 0;
+      for (const auto& result : results) {
+        sum += result.sum[i] * std::exp(result.max[i] - max);
+      }
+      logSumExp = max + std::log(sum);
+    } else if (normalize_ == Normalize::TOP_K) {
+      // The top k are sorted, so the first one is their max.
+      float sum = 0;
+      for (int j = 0; j < k_; ++j) {
+        sum += std::exp(merged[j].value - merged[0].value);
+      }
+      logSumExp = merged[0].value + std::log(sum);
+    }
+    for (int j = 0; j < k_; ++j) {
+      valuesData[i * k_ + j] = normalize_ == Normalize::NONE
+          ? merged[j].value
+          : std::exp(merged[j].value - logSumExp);
+      indicesData[i * k_ + j] = merged[j].index;
+    }
+  }
+  return true;
+}
+
+namespace {
+
+REGISTER_CPU_OPERATOR(FCTopK, FCTopKOp);
+OPERATOR_SCHEMA(FCTopK)
+    .NumInputs(3)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Computes the k largest outputs of the fully connected layer Y = X * W^T + b
+for every row of X, as FC followed by a top k would, without materializing Y:
+the outputs are computed in blocks of block_size columns that are split
+across the CPU thread pool, and only the top k of every row are kept. This is
+meant for inference over large output spaces, such as the next word of a
+language model.
+
+The values are returned in decreasing order, ties broken by the lower index.
+With normalize set to "full" they are the probabilities of the softmax of
+the whole row of Y, computed with a log-sum-exp that is accumulated over the
+blocks; with "top_k" they are the softmax of the top k only.
+)DOC")
+    .Arg("k", "(int, default 1) The number of outputs to keep per row.")
+    .Arg(
+        "axis",
+        "(int, default 1) Describes the axis of the input data X, as for FC.")
+    .Arg(
+        "block_size",
+        "(int, default 4096) The number of outputs computed at once.")
+    .Arg(
+        "normalize",
+        "(string, default \"none\") \"none\" for the outputs of the layer, "
+        "\"full\" for their softmax probabilities, \"top_k\" for the softmax "
+        "of the top k.")
+    .Input(0, "X", "Input of the layer, as for FC")
+    .Input(1, "W", "N x K weights, as for FC")
+    .Input(2, "b", "N biases, as for FC")
+    .Output(0, "values", "M x k largest outputs, in decreasing order")
+    .Output(1, "indices", "M x k int64 indices of the largest outputs");
+NO_GRADIENT(FCTopK);
+
+} // namespace
+
+} // namespace caffe2
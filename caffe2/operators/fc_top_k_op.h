@@ -0,0 +1,42 @@
+#ifndef CAFFE2_OPERATORS_FC_TOP_K_OP_H_
+#define CAFFE2_OPERATORS_FC_TOP_K_OP_H_
+
+#include <string>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// FCTopKOp computes the k largest outputs of a fully connected layer for
+// every row, for inference over large output spaces such as the vocabulary of
+// a language model, without materializing the M x N outputs. The outputs are
+// computed in blocks of block_size columns, one GEMM per block, and the blocks
+// are split across the CPU thread pool. Every block keeps a heap of the top k
+// of every row, and, to normalize, the max and the sum of the exponentials of
+// every row, which are merged in the order of the blocks.
+class FCTopKOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  FCTopKOp(const OperatorDef& operator_def, Workspace* ws);
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(INPUT, WEIGHT, BIAS);
+  OUTPUT_TAGS(VALUES, INDICES);
+
+ private:
+  enum class Normalize { NONE, FULL, TOP_K };
+
+  int axis_;
+  int k_;
+  int blockSize_;
+  Normalize normalize_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_FC_TOP_K_OP_H_
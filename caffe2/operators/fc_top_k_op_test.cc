@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static void AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+}
+
+// Checks FCTopK against FC followed by a sort of every row, with a last block
+// that is smaller than the others.
+static void CheckFCTopK(const string& normalize, const int blockSize) {
+  Workspace ws;
+  std::mt19937 gen(7);
+  const int M = 6, K = 20, N = 1000, k = 7;
+  AddInput({M, K}, "X", &gen, &ws);
+  AddInput({N, K}, "W", &gen, &ws);
+  AddInput({N}, "b", &gen, &ws);
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "FC", "", vector<string>{"X", "W", "b"}, vector<string>{"Y"})));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "FCTopK",
+      "",
+      vector<string>{"X", "W", "b"},
+      vector<string>{"values", "indices"},
+      vector<Argument>{MakeArgument("k", k),
+                       MakeArgument("block_size", blockSize),
+                       MakeArgument("normalize", normalize)})));
+
+  const float* Y = ws.GetBlob("Y")->Get<TensorCPU>().data<float>();
+  const auto& values = ws.GetBlob("values")->Get<TensorCPU>();
+  const auto& indices = ws.GetBlob("indices")->Get<TensorCPU>();
+  ASSERT_EQ(values.dims(), (vector<TIndex>{M, k}));
+  ASSERT_EQ(indices.dims(), (vector<TIndex>{M, k}));
+  for (int i = 0; i < M; ++i) {
+    const float* row = Y + i * N;
+    vector<int> order(N);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](int a, int b) {
+      return row[a] > row[b];
+    });
+    double logSumExp = 0;
+    if (normalize != "none") {
+      const int count = normalize == "full" ? N : k;
+      double sum = 0;
+      for (int j = 0; j < count; ++j) {
+        sum += std::exp(row[order[j]] - row[order[0]]);
+      }
+      logSumExp = row[order[0]] + std::log(sum);
+    }
+    for (int j = 0; j < k; ++j) {
+      EXPECT_EQ(indices.data<TIndex>()[i * k + j], order[j]) << i << " " << j;
+      const double expected = normalize == "none"
+          ? row[order[j]]
+          : std::exp(row[order[j]] - logSumExp);
+      EXPECT_NEAR(values.data<float>()[i * k + j], expected, 1e-5)
+          << i << " " << j;
+    }
+  }
+}
+
+TEST(FCTopKTest, Logits) {
+  CheckFCTopK("none", 128);
+  CheckFCTopK("none", 4096);
+}
+
+TEST(FCTopKTest, Softmax) {
+  CheckFCTopK("full", 128);
+  CheckFCTopK("full", 5);
+}
+
+TEST(FCTopKTest, TopKSoftmax) {
+  CheckFCTopK("top_k", 300);
+}
+
+} // namespace caffe2
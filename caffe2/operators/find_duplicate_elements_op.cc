@@ -10,9 +10,9 @@ OPERATOR_SCHEMA(FindDuplicateElements)
     .NumInputs(1)
     .NumOutputs(1)
     .SetDoc(R"DOC(
-Shrink the data tensor by removing data blocks with given zero-based indices in
-the outermost dimension of the tensor. Indices are not assumed in any order or
-unique but with the range [0, blocks_size). Indices could be empty.
+Returns the positions of the elements of a 1-D tensor that are equal to an
+earlier element, in increasing order. int32 and int64 data is deduplicated in
+parallel, by partitioning it by a hash of the values.
   )DOC")
     .Input(0, "data", "a 1-D tensor.")
     .Output(
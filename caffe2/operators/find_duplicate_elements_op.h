@@ -1,12 +1,15 @@
 #ifndef CAFFE2_OPERATORS_FIND_DUPLICATE_ELEMENTS_OP_H
 #define CAFFE2_OPERATORS_FIND_DUPLICATE_ELEMENTS_OP_H
 
+#include <limits>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/tensor.h"
+#include "caffe2/utils/radix_unique.h"
 
 namespace caffe2 {
 
@@ -26,7 +29,47 @@ class FindDuplicateElementsOp final : public Operator<Context> {
   bool DoRunWithType() {
     const auto& data = Input(0);
     CAFFE_ENFORCE(data.ndim() == 1, "data should be 1-D.");
+    if (data.dims()[0] <= std::numeric_limits<int>::max()) {
+      return DoRunWithIndices<T>(UsesRadixUnique<T>());
+    }
+    return DoRunWithIndices<T>(std::false_type());
+  }
+
+ private:
+  // Ids are deduplicated with RadixPartitionedUnique, which runs in parallel.
+  template <typename T>
+  using UsesRadixUnique = std::integral_constant<
+      bool,
+      std::is_same<T, int32_t>::value || std::is_same<T, int64_t>::value>;
+
+  template <typename T>
+  bool DoRunWithIndices(std::true_type) {
+    const auto& data = Input(0);
+    const int n = data.dims()[0];
+    std::vector<T> unique;
+    std::vector<int> remapping(n);
+    std::vector<int> first_positions;
+    RadixPartitionedUnique(
+        data.template data<T>(),
+        n,
+        &unique,
+        remapping.data(),
+        &first_positions);
+
+    auto* output = Output(0);
+    output->Resize(n - unique.size());
+    auto* out_ptr = output->template mutable_data<int64_t>();
+    for (int j = 0; j < n; ++j) {
+      if (first_positions[remapping[j]] != j) {
+        *out_ptr++ = j;
+      }
+    }
+    return true;
+  }
 
+  template <typename T>
+  bool DoRunWithIndices(std::false_type) {
+    const auto& data = Input(0);
     const auto* data_ptr = data.template data<T>();
     std::unordered_map<T, int64_t> dict;
     std::vector<int64_t> dupIndices;
@@ -5,6 +5,14 @@ namespace {
 
 REGISTER_CPU_OPERATOR(FC, FullyConnectedOp<float, CPUContext>);
 REGISTER_CPU_OPERATOR(FCGradient, FullyConnectedGradientOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    FC,
+    PACKED,
+    FullyConnectedOp<float, CPUContext, PackedEngine>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    FCGradient,
+    PACKED,
+    FullyConnectedGradientOp<float, CPUContext, PackedEngine>);
 
 OPERATOR_SCHEMA(FC)
   .NumInputs(3)
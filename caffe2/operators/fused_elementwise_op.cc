@@ -0,0 +1,387 @@
+#include "caffe2/operators/fused_elementwise_op.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <numeric>
+#include <type_traits>
+
+#include "caffe2/operators/elementwise_op.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+// Number of elements of a block. All the intermediate values of a block
+// should comfortably fit in L1/L2.
+constexpr size_t kBlockSize = 1024;
+// Number of blocks handed to a thread at once.
+constexpr size_t kBlocksPerChunk = 16;
+
+struct NodeTypeInfo {
+  const char* name;
+  FusedElementwiseOp::NodeType type;
+  bool binary;
+};
+
+const NodeTypeInfo kNodeTypes[] = {
+    {"Add", FusedElementwiseOp::ADD, true},
+    {"Sub", FusedElementwiseOp::SUB, true},
+    {"Mul", FusedElementwiseOp::MUL, true},
+    {"Div", FusedElementwiseOp::DIV, true},
+    {"Negative", FusedElementwiseOp::NEGATIVE, false},
+    {"Relu", FusedElementwiseOp::RELU, false},
+    {"Sigmoid", FusedElementwiseOp::SIGMOID, false},
+    {"Tanh", FusedElementwiseOp::TANH, false},
+    {"Exp", FusedElementwiseOp::EXP, false},
+};
+
+const NodeTypeInfo* FindNodeType(const string& name) {
+  for (const auto& info : kNodeTypes) {
+    if (name == info.name) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+// An input seen from the output: for a broadcast input, dims and strides are
+// the coalesced output dimensions and the strides of the input along them, as
+// computed by BroadcastPlan.
+template <typename T>
+struct InputView {
+  const T* data;
+  bool broadcast;
+  vector<size_t> dims;
+  vector<size_t> strides;
+};
+
+// Copies elements [begin, begin + len) of the broadcast input, as seen from
+// the output, to out.
+template <typename T>
+void ExpandBroadcast(
+    const InputView<T>& input,
+    const size_t begin,
+    const size_t len,
+    T* out) {
+  const size_t inner = input.dims.back();
+  const size_t end = begin + len;
+  for (size_t pos = begin; pos < end;) {
+    // Offset in the input of the row of the output containing pos.
+    size_t row = pos / inner;
+    size_t offset = 0;
+    for (int d = input.dims.size() - 2; d >= 0; --d) {
+      offset += (row % input.dims[d]) * input.strides[d];
+      row /= input.dims[d];
+    }
+    const size_t column = pos % inner;
+    const size_t run = std::min(end - pos, inner - column);
+    if (input.strides.back()) {
+      memcpy(out, input.data + offset + column, run * sizeof(T));
+    } else {
+      std::fill(out, out + run, input.data[offset]);
+    }
+    out += run;
+    pos += run;
+  }
+}
+
+template <typename T>
+void RunTranscendental(
+    const FusedElementwiseOp::NodeType type,
+    const size_t n,
+    const T* x,
+    T* y,
+    std::true_type /* is_floating_point */) {
+  ConstEigenVectorArrayMap<T> X(x, n);
+  EigenVectorArrayMap<T> Y(y, n);
+  switch (type) {
+    case FusedElementwiseOp::SIGMOID:
+      Y = (T(1) + (-X).exp()).inverse();
+      break;
+    case FusedElementwiseOp::TANH:
+      // tanh(x) = 2 * sigmoid(2x) - 1, which stays within [-1, 1] even when
+      // exp overflows.
+      Y = T(2) * (T(1) + (T(-2) * X).exp()).inverse() - T(1);
+      break;
+    case FusedElementwiseOp::EXP:
+      Y = X.exp();
+      break;
+    default:
+      CAFFE_THROW("Not a transcendental node type: ", type);
+  }
+}
+
+template <typename T>
+void RunTranscendental(
+    const FusedElementwiseOp::NodeType type,
+    const size_t,
+    const T*,
+    T*,
+    std::false_type /* is_floating_point */) {
+  CAFFE_THROW("Node type ", type, " is only supported for floating point.");
+}
+
+template <typename T>
+void RunNode(
+    const FusedElementwiseOp::NodeType type,
+    const size_t n,
+    const T* a,
+    const T* b,
+    T* y) {
+  ConstEigenVectorArrayMap<T> A(a, n);
+  EigenVectorArrayMap<T> Y(y, n);
+  switch (type) {
+    case FusedElementwiseOp::ADD:
+      Y = A + ConstEigenVectorArrayMap<T>(b, n);
+      break;
+    case FusedElementwiseOp::SUB:
+      Y = A - ConstEigenVectorArrayMap<T>(b, n);
+      break;
+    case FusedElementwiseOp::MUL:
+      Y = A * ConstEigenVectorArrayMap<T>(b, n);
+      break;
+    case FusedElementwiseOp::DIV:
+      Y = A / ConstEigenVectorArrayMap<T>(b, n);
+      break;
+    case FusedElementwiseOp::NEGATIVE:
+      Y = -A;
+      break;
+    case FusedElementwiseOp::RELU:
+      Y = A.cwiseMax(T(0));
+      break;
+    default:
+      RunTranscendental(
+          type, n, a, y, typename std::is_floating_point<T>::type());
+  }
+}
+
+} // namespace
+
+FusedElementwiseOp::FusedElementwiseOp(
+    const OperatorDef& operator_def,
+    Workspace* ws)
+    : Operator<CPUContext>(operator_def, ws),
+      broadcast_(GetRepeatedArgument<int>("broadcast")),
+      axis_(GetRepeatedArgument<int>("axis")) {
+  const auto types = GetRepeatedArgument<string>("nodes");
+  const auto operands = GetRepeatedArgument<int>("node_inputs");
+  CAFFE_ENFORCE(types.size() > 0, "FusedElementwise needs at least one node.");
+  CAFFE_ENFORCE_EQ(
+      operands.size(),
+      2 * types.size(),
+      "node_inputs should have two entries per node.");
+  if (broadcast_.empty()) {
+    broadcast_.resize(InputSize(), 0);
+  }
+  if (axis_.empty()) {
+    axis_.resize(InputSize(), -1);
+  }
+  CAFFE_ENFORCE_EQ(broadcast_.size(), InputSize());
+  CAFFE_ENFORCE_EQ(axis_.size(), InputSize());
+  CAFFE_ENFORCE(!broadcast_[0], "Input 0 defines the output shape.");
+  for (int i = 0; i < types.size(); ++i) {
+    const NodeTypeInfo* info = FindNodeType(types[i]);
+    CAFFE_ENFORCE(info, "Unsupported node type ", types[i]);
+    Node node;
+    node.type = info->type;
+    for (int k = 0; k < 2; ++k) {
+      node.operands[k] = operands[2 * i + k];
+      const bool needed = k == 0 || info->binary;
+      if (needed) {
+        CAFFE_ENFORCE(
+            node.operands[k] >= 0 && node.operands[k] < InputSize() + i,
+            "Operand ",
+            k,
+            " of node ",
+            i,
+            " should be an input or an earlier node.");
+      } else {
+        CAFFE_ENFORCE_EQ(node.operands[k], -1, "Unary node with two operands.");
+      }
+    }
+    nodes_.push_back(node);
+  }
+}
+
+bool FusedElementwiseOp::IsSupportedType(const string& type) {
+  return FindNodeType(type) != nullptr;
+}
+
+bool FusedElementwiseOp::RunOnDevice() {
+  return DispatchHelper<TensorTypes<float, double, int32_t, int64_t>>::call(
+      this, Input(0));
+}
+
+template <typename T>
+bool FusedElementwiseOp::DoRunWithType() {
+  const int num_inputs = InputSize();
+  const int num_nodes = nodes_.size();
+
+  // The shape of every operand, following the nodes as the unfused operators
+  // would, and the shape of every input aligned to the right of the output:
+  // a broadcast input with an axis is padded with trailing dimensions of size
+  // 1 up to the rank of the operand it is combined with. An empty aligned
+  // shape stands for a scalar.
+  vector<vector<TIndex>> shapes(num_inputs + num_nodes);
+  vector<vector<TIndex>> aligned(num_inputs);
+  vector<bool> padded(num_inputs, false);
+  for (int i = 0; i < num_inputs; ++i) {
+    shapes[i] = Input(i).dims();
+    if (!broadcast_[i] || Input(i).size() != 1) {
+      aligned[i] = shapes[i];
+    }
+  }
+  for (int k = 0; k < num_nodes; ++k) {
+    const int a = nodes_[k].operands[0];
+    const int b = nodes_[k].operands[1];
+    auto& shape = shapes[num_inputs + k];
+    if (b < 0) {
+      shape = shapes[a];
+    } else if (b < num_inputs && broadcast_[b]) {
+      if (Input(b).size() == 1) {
+        shape = shapes[a];
+        continue;
+      }
+      shape = BroadcastPlan(shapes[a], shapes[b], axis_[b]).c_dims;
+      if (axis_[b] != -1) {
+        vector<TIndex> b_aligned(shapes[b]);
+        b_aligned.resize(shapes[a].size() - axis_[b], 1);
+        CAFFE_ENFORCE(
+            !padded[b] || aligned[b] == b_aligned,
+            "Broadcast input ",
+            b,
+            " is aligned differently by two nodes.");
+        aligned[b] = b_aligned;
+        padded[b] = true;
+      }
+    } else {
+      CAFFE_ENFORCE(
+          shapes[a] == shapes[b],
+          "The operands of node ",
+          k,
+          " should have the same shape, or the second one be broadcast.");
+      shape = shapes[a];
+    }
+  }
+  const vector<TIndex>& output_dims = shapes.back();
+  const size_t size = std::accumulate(
+      output_dims.begin(),
+      output_dims.end(),
+      size_t(1),
+      std::multiplies<size_t>());
+
+  // Every input that does not have the shape of the output is expanded along
+  // it block by block.
+  vector<InputView<T>> inputs(num_inputs);
+  int num_broadcast = 0;
+  for (int i = 0; i < num_inputs; ++i) {
+    const auto& X = Input(i);
+    auto& view = inputs[i];
+    view.data = X.template data<T>();
+    vector<TIndex> full(aligned[i]);
+    full.insert(full.begin(), output_dims.size() - full.size(), 1);
+    view.broadcast = aligned[i].empty() || full != output_dims;
+    CAFFE_ENFORCE(
+        &X != Output(0) || !view.broadcast,
+        "The output cannot be an input that is broadcast.");
+    if (!view.broadcast) {
+      continue;
+    }
+    ++num_broadcast;
+    if (aligned[i].empty()) {
+      view.dims = {std::max<size_t>(size, 1)};
+      view.strides = {0};
+      continue;
+    }
+    const BroadcastPlan plan(output_dims, aligned[i], -1);
+    view.dims = plan.dims;
+    view.strides = plan.b_strides;
+  }
+
+  auto* Y = Output(0);
+  Y->Resize(output_dims);
+  T* Ydata = Y->template mutable_data<T>();
+
+  const size_t chunk_size = kBlockSize * kBlocksPerChunk;
+  const size_t num_chunks = (size + chunk_size - 1) / chunk_size;
+  ThreadPool::Default()->Run(
+      [&](size_t chunk) {
+        // Scratch for the expanded broadcast inputs and the nodes except the
+        // last one, which writes straight to the output.
+        vector<T> scratch((num_broadcast + num_nodes - 1) * kBlockSize);
+        vector<const T*> operands(num_inputs + num_nodes);
+        const size_t chunk_end = std::min(size, (chunk + 1) * chunk_size);
+        for (size_t begin = chunk * chunk_size; begin < chunk_end;
+             begin += kBlockSize) {
+          const size_t len = std::min(kBlockSize, chunk_end - begin);
+          T* buffer = scratch.data();
+          for (int i = 0; i < num_inputs; ++i) {
+            if (inputs[i].broadcast) {
+              ExpandBroadcast(inputs[i], begin, len, buffer);
+              operands[i] = buffer;
+              buffer += kBlockSize;
+            } else {
+              operands[i] = inputs[i].data + begin;
+            }
+          }
+          for (int i = 0; i < num_nodes; ++i) {
+            const Node& node = nodes_[i];
+            T* out = i + 1 == num_nodes ? Ydata + begin : buffer + i * kBlockSize;
+            RunNode<T>(
+                node.type,
+                len,
+                operands[node.operands[0]],
+                node.operands[1] >= 0 ? operands[node.operands[1]] : nullptr,
+                out);
+            operands[num_inputs + i] = out;
+          }
+        }
+      },
+      num_chunks);
+  return true;
+}
+
+namespace {
+REGISTER_CPU_OPERATOR(FusedElementwise, FusedElementwiseOp);
+
+OPERATOR_SCHEMA(FusedElementwise)
+    .NumInputs(1, INT_MAX)
+    .NumOutputs(1)
+    .AllowInplace([](int in, int out) { return true; })
+    .SetDoc(R"DOC(
+Evaluates a DAG of elementwise operators (Add, Sub, Mul, Div, Negative, Relu,
+Sigmoid, Tanh and Exp) in a single multithreaded pass over the data, without
+materializing the intermediate tensors. This is usually created by the
+FuseElementwise net transform from a chain of such operators, but can be
+written by hand as well.
+
+Operand k of a node refers to input k of the operator if k is smaller than the
+number of inputs, and to node (k - number of inputs) otherwise. The output is
+the value of the last node. The second operand of a binary node either has
+the shape of the first one, or is an input that is combined with it as with the
+broadcast and axis arguments of the binary elementwise operators, where both
+operands may be broadcast. The output has the shape that the unfused operators
+would compute.
+Sigmoid, Tanh and Exp are only supported for floating point inputs.
+)DOC")
+    .Arg("nodes", "The operator type of every node, in topological order.")
+    .Arg(
+        "node_inputs",
+        "Two operand indices per node; the second one is -1 for unary nodes.")
+    .Arg(
+        "broadcast",
+        "Per input, 1 if the input is broadcast along the output (default 0).")
+    .Arg(
+        "axis",
+        "Per input, the broadcast axis as in Add (default -1, suffix "
+        "matching).")
+    .Input(0, "X", "The first input; more inputs may follow.")
+    .Output(0, "Y", "The value of the last node.");
+
+SHOULD_NOT_DO_GRADIENT(FusedElementwise);
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,57 @@
+#ifndef CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
+#define CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// FusedElementwiseOp evaluates a small DAG of elementwise operators in a
+// single pass over memory: the output is computed block by block, and every
+// intermediate value of a block lives in a small scratch buffer that stays in
+// cache instead of in a full size tensor.
+//
+// The DAG is given by the "nodes" argument, which lists the operator type of
+// every node, and the "node_inputs" argument, which lists two operands per
+// node (the second one is -1 for unary nodes). Operand k refers to input k of
+// the operator if k < InputSize(), and to node k - InputSize() otherwise;
+// nodes may only refer to earlier nodes. The output is the value of the last
+// node.
+//
+// The second operand of a binary node either has the shape of the first one,
+// or, if it is an input whose entry of the "broadcast" argument is 1, is
+// combined with it with the semantics of the broadcast and "axis" arguments of
+// BinaryElementwiseOp. As there, both operands may be broadcast, so the output
+// has the shape that the unfused operators would compute, which may be larger
+// than the shape of every input.
+class FusedElementwiseOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  FusedElementwiseOp(const OperatorDef& operator_def, Workspace* ws);
+
+  bool RunOnDevice() override;
+
+  template <typename T>
+  bool DoRunWithType();
+
+  enum NodeType { ADD, SUB, MUL, DIV, NEGATIVE, RELU, SIGMOID, TANH, EXP };
+
+  // Returns true if operators of the given type can be a node of the DAG.
+  static bool IsSupportedType(const string& type);
+
+ private:
+  struct Node {
+    NodeType type;
+    int operands[2];
+  };
+
+  vector<Node> nodes_;
+  vector<int> broadcast_;
+  vector<int> axis_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_FUSED_ELEMENTWISE_OP_H_
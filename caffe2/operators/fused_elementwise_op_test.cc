@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cmath>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+template <typename T>
+static TensorCPU* AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  T* data = tensor->mutable_data<T>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = static_cast<T>((i % 11) - 5) / 2;
+  }
+  return tensor;
+}
+
+// Computes Y = Mul(X, B) * Sigmoid(Mul(X, B)) + S, where B is broadcast along
+// axis 1 of X and S is a scalar. The output spans several chunks.
+TEST(FusedElementwiseTest, BroadcastDAG) {
+  Workspace ws;
+  const int N = 4, C = 3, D = 5000;
+  const auto* X = AddInput<float>({N, C, D}, "X", &ws);
+  const auto* B = AddInput<float>({C}, "B", &ws);
+  auto* S = AddInput<float>({1}, "S", &ws);
+  S->mutable_data<float>()[0] = 0.25f;
+  const auto def = CreateOperatorDef(
+      "FusedElementwise",
+      "",
+      vector<string>{"X", "B", "S"},
+      vector<string>{"Y"},
+      vector<Argument>{
+          MakeArgument("nodes", vector<string>{"Mul", "Sigmoid", "Mul", "Add"}),
+          MakeArgument("node_inputs", vector<int>{0, 1, 3, -1, 3, 4, 5, 2}),
+          MakeArgument("broadcast", vector<int>{0, 1, 1}),
+          MakeArgument("axis", vector<int>{-1, 1, -1})});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), X->dims());
+  for (int i = 0; i < X->size(); ++i) {
+    const float x = X->data<float>()[i] * B->data<float>()[(i / D) % C];
+    const float expected = x / (1 + std::exp(-x)) + 0.25f;
+    EXPECT_NEAR(Y.data<float>()[i], expected, 1e-5) << i;
+  }
+}
+
+TEST(FusedElementwiseTest, NumpyBroadcast) {
+  Workspace ws;
+  const int N = 2, C = 3, D = 700;
+  const auto* X = AddInput<float>({N, C, D}, "X", &ws);
+  const auto* B = AddInput<float>({C, 1}, "B", &ws);
+  const auto* E = AddInput<float>({N, 1, D}, "E", &ws);
+  // Y = (X - B) * E
+  const auto def = CreateOperatorDef(
+      "FusedElementwise",
+      "",
+      vector<string>{"X", "B", "E"},
+      vector<string>{"Y"},
+      vector<Argument>{
+          MakeArgument("nodes", vector<string>{"Sub", "Mul"}),
+          MakeArgument("node_inputs", vector<int>{0, 1, 3, 2}),
+          MakeArgument("broadcast", vector<int>{0, 1, 1})});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  for (int i = 0; i < X->size(); ++i) {
+    const float expected =
+        (X->data<float>()[i] - B->data<float>()[(i / D) % C]) *
+        E->data<float>()[(i / (C * D)) * D + i % D];
+    EXPECT_FLOAT_EQ(Y.data<float>()[i], expected) << i;
+  }
+}
+
+// Y = Relu(X + B) * S, where B extends the shape of X as in Add with
+// broadcast=1, and S is padded from axis 1.
+TEST(FusedElementwiseTest, BroadcastExtendsFirstInput) {
+  Workspace ws;
+  const int N = 3, C = 4, D = 5;
+  const auto* X = AddInput<float>({1, C, D}, "X", &ws);
+  const auto* B = AddInput<float>({N, 1, D}, "B", &ws);
+  const auto* S = AddInput<float>({C}, "S", &ws);
+  const auto def = CreateOperatorDef(
+      "FusedElementwise",
+      "",
+      vector<string>{"X", "B", "S"},
+      vector<string>{"Y"},
+      vector<Argument>{
+          MakeArgument("nodes", vector<string>{"Add", "Relu", "Mul"}),
+          MakeArgument("node_inputs", vector<int>{0, 1, 3, -1, 4, 2}),
+          MakeArgument("broadcast", vector<int>{0, 1, 1}),
+          MakeArgument("axis", vector<int>{-1, -1, 1})});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), (vector<TIndex>{N, C, D}));
+  for (int i = 0; i < Y.size(); ++i) {
+    const int n = i / (C * D), c = i / D % C, d = i % D;
+    const float sum = X->data<float>()[c * D + d] + B->data<float>()[n * D + d];
+    EXPECT_FLOAT_EQ(
+        Y.data<float>()[i], std::max(sum, 0.f) * S->data<float>()[c])
+        << i;
+  }
+}
+
+TEST(FusedElementwiseTest, IntegerInPlace) {
+  Workspace ws;
+  const auto* X = AddInput<int>({3, 7}, "X", &ws);
+  const vector<int> x(X->data<int>(), X->data<int>() + X->size());
+  AddInput<int>({7}, "B", &ws);
+  // X = -(X * X - B)
+  const auto def = CreateOperatorDef(
+      "FusedElementwise",
+      "",
+      vector<string>{"X", "B"},
+      vector<string>{"X"},
+      vector<Argument>{
+          MakeArgument("nodes", vector<string>{"Mul", "Sub", "Negative"}),
+          MakeArgument("node_inputs", vector<int>{0, 0, 2, 1, 3, -1}),
+          MakeArgument("broadcast", vector<int>{0, 1})});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& Y = ws.GetBlob("X")->Get<TensorCPU>();
+  const auto& B = ws.GetBlob("B")->Get<TensorCPU>();
+  for (int i = 0; i < Y.size(); ++i) {
+    EXPECT_EQ(Y.data<int>()[i], -(x[i] * x[i] - B.data<int>()[i % 7]));
+  }
+
+  // Transcendental nodes are only defined for floating point.
+  const auto sigmoid = CreateOperatorDef(
+      "FusedElementwise",
+      "",
+      vector<string>{"X"},
+      vector<string>{"Z"},
+      vector<Argument>{MakeArgument("nodes", vector<string>{"Sigmoid"}),
+                       MakeArgument("node_inputs", vector<int>{0, -1})});
+  EXPECT_THROW(ws.RunOperatorOnce(sigmoid), EnforceNotMet);
+}
+
+} // namespace caffe2
@@ -0,0 +1,85 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/fp16.h"
+
+namespace caffe2 {
+
+namespace {
+
+class FloatToHalfCPU : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  FloatToHalfCPU(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float* x = X.data<float>();
+    float16* y = Y->mutable_data<float16>();
+    for (TIndex i = 0; i < X.size(); ++i) {
+      y[i] = FloatToFp16(x[i]);
+    }
+    return true;
+  }
+};
+
+class HalfToFloatCPU : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  HalfToFloatCPU(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override {
+    auto& X = Input(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X);
+    const float16* x = X.data<float16>();
+    float* y = Y->mutable_data<float>();
+    for (TIndex i = 0; i < X.size(); ++i) {
+      y[i] = Fp16ToFloat(x[i]);
+    }
+    return true;
+  }
+};
+
+REGISTER_CPU_OPERATOR(FloatToHalf, FloatToHalfCPU);
+REGISTER_CPU_OPERATOR(HalfToFloat, HalfToFloatCPU);
+
+OPERATOR_SCHEMA(FloatToHalf)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Converts a float tensor to float16, rounding to nearest even. Values beyond
+the float16 range become infinities.
+)DOC");
+OPERATOR_SCHEMA(HalfToFloat)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc("Converts a float16 tensor to float.");
+
+class GetFloatToHalfGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "HalfToFloat", "",
+        vector<string>{GO(0)},
+        vector<string>{GI(0)});
+  }
+};
+REGISTER_GRADIENT(FloatToHalf, GetFloatToHalfGradient);
+
+class GetHalfToFloatGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "FloatToHalf", "",
+        vector<string>{GO(0)},
+        vector<string>{GI(0)});
+  }
+};
+REGISTER_GRADIENT(HalfToFloat, GetHalfToFloatGradient);
+
+} // namespace
+} // namespace caffe2
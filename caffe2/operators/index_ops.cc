@@ -2,11 +2,13 @@
 #include <limits>
 #include <mutex>
 #include <sstream>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 #include "caffe2/core/blob_serialization.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/core/tensor.h"
+#include "caffe2/utils/concurrent_hash_index.h"
 
 namespace caffe2 {
 namespace {
@@ -35,24 +37,25 @@ struct IndexBase {
 
   const TypeMeta& Type() const { return meta_; }
 
-  TIndexValue Size() {
-    std::lock_guard<std::mutex> guard(dictMutex_);
-    return nextId_;
-  }
+  virtual TIndexValue Size() = 0;
 
  protected:
   int64_t maxElements_;
   TypeMeta meta_;
-  TIndexValue nextId_{1}; // guarded by dictMutex_
   std::atomic<bool> frozen_{false};
-  std::mutex dictMutex_;
 };
 
-template<typename T>
+// Index of string keys: a hash map guarded by a mutex.
+template <typename T, typename Enable = void>
 struct Index: IndexBase {
   explicit Index(TIndexValue maxElements)
     : IndexBase(maxElements, TypeMeta::Make<T>()) {}
 
+  TIndexValue Size() override {
+    std::lock_guard<std::mutex> guard(dictMutex_);
+    return nextId_;
+  }
+
   void Get(const T* keys, TIndexValue* values, size_t numKeys) {
     if (frozen_) {
       FrozenGet(keys, values, numKeys);
@@ -113,6 +116,42 @@ struct Index: IndexBase {
   }
 
   std::unordered_map<T, TIndexValue> dict_;
+  TIndexValue nextId_{1}; // guarded by dictMutex_
+  std::mutex dictMutex_;
+};
+
+// Index of integer keys: a ConcurrentHashIndex, so that IndexGet can run from
+// many threads at once without serializing on a lock.
+template <typename T>
+struct Index<T, typename std::enable_if<std::is_integral<T>::value>::type>
+    : IndexBase {
+  explicit Index(TIndexValue maxElements)
+      : IndexBase(maxElements, TypeMeta::Make<T>()), dict_(maxElements) {}
+
+  TIndexValue Size() override {
+    return dict_.Size();
+  }
+
+  void Get(const T* keys, TIndexValue* values, size_t numKeys) {
+    dict_.Get(keys, values, numKeys, !frozen_);
+  }
+
+  bool Load(const T* keys, size_t numKeys) {
+    dict_.Load(keys, numKeys);
+    return true;
+  }
+
+  template <typename Ctx>
+  bool Store(Tensor<Ctx>* out) {
+    dict_.Store([out](TIndexValue size) {
+      out->Resize(size);
+      return out->template mutable_data<T>();
+    });
+    return true;
+  }
+
+ private:
+  ConcurrentHashIndex<T> dict_;
 };
 
 // TODO(azzolini): support sizes larger than int32
@@ -279,6 +318,9 @@ Given an index handle and a tensor of keys, return an Int tensor of same shape
 containing the indices for each of the keys. If the index is frozen, unknown
 entries are given index 0. Otherwise, new entries are added into the index.
 If an insert is necessary but max_elements has been reached, fail.
+
+IndexGet can run concurrently on the same index. Lookups in int32 and int64
+indices take no lock, so they scale with the number of threads.
 )DOC")
   .Input(0, "handle", "Pointer to an Index instance.")
   .Input(1, "keys", "Tensor of keys to be looked up.")
@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <cstring>
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor_int8.h"
+#include "caffe2/operators/conv_pool_op_base.h"
+#include "caffe2/utils/int8_gemm.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+// Int8ConvOp is the quantized Conv operator (Int8ConvRelu if FuseRelu is
+// true): X and Y are Int8TensorCPU and the filter and bias are the float
+// parameters of the Conv layer. Every image is unfolded into one row of
+// kernel_h * kernel_w * C quantized values per output pixel, padded with the
+// zero point of X, and multiplied with the filter by Int8Gemm, which
+// requantizes the outputs. The filter is quantized per output channel and
+// packed on the first run, so the operator assumes that it never changes
+// afterwards.
+template <bool FuseRelu>
+class Int8ConvOp final : public ConvPoolOpBase<CPUContext> {
+ public:
+  USE_CONV_POOL_BASE_FUNCTIONS(CPUContext);
+  Int8ConvOp(const OperatorDef& operator_def, Workspace* ws)
+      : ConvPoolOpBase<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(float, "Y_scale", Y_scale_, 1),
+        OP_SINGLE_ARG(int, "Y_zero_point", Y_zero_point_, 0) {
+    CAFFE_ENFORCE_GT(Y_scale_, 0, "Y_scale must be positive");
+    CAFFE_ENFORCE(
+        Y_zero_point_ >= 0 && Y_zero_point_ <= 255,
+        "Y_zero_point must be in [0, 255]");
+  }
+
+  bool RunOnDeviceWithOrderNCHW() override {
+    return RunWithOrder(true);
+  }
+  bool RunOnDeviceWithOrderNHWC() override {
+    return RunWithOrder(false);
+  }
+
+ private:
+  bool RunWithOrder(const bool nchw) {
+    const auto& X = OperatorBase::Input<Int8TensorCPU>(INPUT);
+    const auto& filter = Input(FILTER);
+    const auto& bias = Input(BIAS);
+    auto* Y = OperatorBase::Output<Int8TensorCPU>(0);
+    CAFFE_ENFORCE_EQ(X.t.ndim(), 4);
+    const int N = X.t.dim32(0);
+    const int C = X.t.dim32(nchw ? 1 : 3);
+    const int H = X.t.dim32(nchw ? 2 : 1);
+    const int W = X.t.dim32(nchw ? 3 : 2);
+    CAFFE_ENFORCE_EQ(filter.ndim(), 4);
+    const int M = filter.dim32(0);
+    CAFFE_ENFORCE_EQ(filter.dim32(nchw ? 1 : 3), C);
+    CAFFE_ENFORCE_EQ(filter.dim32(nchw ? 2 : 1), kernel_h_);
+    CAFFE_ENFORCE_EQ(filter.dim32(nchw ? 3 : 2), kernel_w_);
+    CAFFE_ENFORCE_EQ(bias.ndim(), 1);
+    CAFFE_ENFORCE_EQ(bias.dim32(0), M);
+    ConvPoolOpBase<CPUContext>::SetOutputSize(X.t, &(Y->t), M);
+    Y->scale = Y_scale_;
+    Y->zero_point = Y_zero_point_;
+    const int output_h = Y->t.dim32(nchw ? 2 : 1);
+    const int output_w = Y->t.dim32(nchw ? 3 : 2);
+    const int output_image_size = output_h * output_w;
+    // The filter rows are laid out like the unfolded rows: (C, kH, kW) in
+    // NCHW and (kH, kW, C) in NHWC.
+    const int K = C * kernel_h_ * kernel_w_;
+    if (packed_filter_.empty() || packed_filter_.N() != M ||
+        packed_filter_.K() != K) {
+      packed_filter_.Pack(M, K, filter.template data<float>(), K);
+    }
+
+    rows_.Resize(output_image_size, K);
+    if (nchw) {
+      gemm_output_.Resize(output_image_size, M);
+    }
+    const uint8_t* Xdata = X.t.template data<uint8_t>();
+    uint8_t* Ydata = Y->t.template mutable_data<uint8_t>();
+    const int input_image_size = C * H * W;
+    for (int n = 0; n < N; ++n) {
+      const uint8_t* image = Xdata + static_cast<size_t>(n) * input_image_size;
+      uint8_t* rows = rows_.mutable_data<uint8_t>();
+      const uint8_t padding = static_cast<uint8_t>(X.zero_point);
+      ThreadPool::Default()->Run(
+          [&](const size_t oh) {
+            for (int ow = 0; ow < output_w; ++ow) {
+              uint8_t* row =
+                  rows + (static_cast<size_t>(oh) * output_w + ow) * K;
+              if (nchw) {
+                UnfoldNCHW(image, C, H, W, oh, ow, padding, row);
+              } else {
+                UnfoldNHWC(image, C, H, W, oh, ow, padding, row);
+              }
+            }
+          },
+          output_h);
+      uint8_t* output =
+          Ydata + static_cast<size_t>(n) * output_image_size * M;
+      math::Int8Gemm(
+          output_image_size,
+          M,
+          K,
+          rows,
+          K,
+          QuantizationParams{X.scale, X.zero_point},
+          packed_filter_,
+          bias.template data<float>(),
+          QuantizationParams{Y_scale_, Y_zero_point_},
+          FuseRelu,
+          nchw ? gemm_output_.mutable_data<uint8_t>() : output,
+          M,
+          &context_);
+      if (nchw) {
+        // The gemm computes one row of channels per pixel.
+        const uint8_t* pixels = gemm_output_.data<uint8_t>();
+        for (int i = 0; i < output_image_size; ++i) {
+          for (int m = 0; m < M; ++m) {
+            output[static_cast<size_t>(m) * output_image_size + i] =
+                pixels[static_cast<size_t>(i) * M + m];
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  // Writes the C x kernel_h x kernel_w input values of output pixel (oh, ow)
+  // of an NCHW image to row.
+  void UnfoldNCHW(
+      const uint8_t* image,
+      const int C,
+      const int H,
+      const int W,
+      const int oh,
+      const int ow,
+      const uint8_t padding,
+      uint8_t* row) const {
+    for (int c = 0; c < C; ++c) {
+      const uint8_t* plane = image + static_cast<size_t>(c) * H * W;
+      for (int kh = 0; kh < kernel_h_; ++kh) {
+        const int ih = oh * stride_h_ - pad_t_ + kh * dilation_h_;
+        for (int kw = 0; kw < kernel_w_; ++kw) {
+          const int iw = ow * stride_w_ - pad_l_ + kw * dilation_w_;
+          *row++ = ih >= 0 && ih < H && iw >= 0 && iw < W ? plane[ih * W + iw]
+                                                          : padding;
+        }
+      }
+    }
+  }
+
+  // Writes the kernel_h x kernel_w x C input values of output pixel (oh, ow)
+  // of an NHWC image to row.
+  void UnfoldNHWC(
+      const uint8_t* image,
+      const int C,
+      const int H,
+      const int W,
+      const int oh,
+      const int ow,
+      const uint8_t padding,
+      uint8_t* row) const {
+    for (int kh = 0; kh < kernel_h_; ++kh) {
+      const int ih = oh * stride_h_ - pad_t_ + kh * dilation_h_;
+      for (int kw = 0; kw < kernel_w_; ++kw) {
+        const int iw = ow * stride_w_ - pad_l_ + kw * dilation_w_;
+        if (ih >= 0 && ih < H && iw >= 0 && iw < W) {
+          std::memcpy(row, image + (static_cast<size_t>(ih) * W + iw) * C, C);
+        } else {
+          std::memset(row, padding, C);
+        }
+        row += C;
+      }
+    }
+  }
+
+  float Y_scale_;
+  int Y_zero_point_;
+  Tensor<CPUContext> rows_;
+  Tensor<CPUContext> gemm_output_;
+  math::Int8GemmMatrixB packed_filter_;
+  INPUT_TAGS(INPUT, FILTER, BIAS);
+};
+
+namespace {
+
+REGISTER_CPU_OPERATOR(Int8Conv, Int8ConvOp<false>);
+REGISTER_CPU_OPERATOR(Int8ConvRelu, Int8ConvOp<true>);
+
+OPERATOR_SCHEMA(Int8Conv)
+    .NumInputs(3)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+The quantized version of Conv, for inference, with the same arguments for the
+kernel, strides, pads, dilations and order. X and Y are Int8TensorCPU (see
+Int8Quantize) and filter and bias are the float parameters of the Conv layer.
+The filter is quantized symmetrically to int8 with one scale per output channel
+and packed on the first run; the operator assumes that it does not change
+afterwards. Padding uses the zero point of X, which stands for 0 exactly. The
+products are accumulated in int32 and requantized to Y_scale and Y_zero_point.
+The operator is mostly created by QuantizeForInference (see
+core/inference_transforms.h).
+)DOC")
+    .Arg("Y_scale", "(float, default 1) The scale of the output.")
+    .Arg("Y_zero_point", "(int, default 0) The zero point of the output.")
+    .Input(0, "X", "Quantized input data, see Conv.")
+    .Input(1, "filter", "The float filter blob, see Conv.")
+    .Input(2, "bias", "The 1D float bias blob, see Conv.")
+    .Output(0, "Y", "Quantized output of the convolution.");
+
+OPERATOR_SCHEMA(Int8ConvRelu)
+    .NumInputs(3)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Int8ConvRelu computes max(Int8Conv(X, filter, bias), 0) with the same arguments
+and inputs as Int8Conv, clamping the outputs at Y_zero_point while they are
+requantized. It is the quantized version of ConvRelu.
+)DOC")
+    .Input(0, "X", "Quantized input data, see Conv.")
+    .Input(1, "filter", "The float filter blob, see Conv.")
+    .Input(2, "bias", "The 1D float bias blob, see Conv.")
+    .Output(0, "Y", "Quantized rectified output of the convolution.");
+
+NO_GRADIENT(Int8Conv);
+NO_GRADIENT(Int8ConvRelu);
+
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,109 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor_int8.h"
+#include "caffe2/utils/int8_gemm.h"
+
+namespace caffe2 {
+
+// Int8FCOp is the quantized FC operator: X and Y are Int8TensorCPU and W and b
+// are the float weights and bias of the FC layer. W is quantized per output
+// and packed on the first run, so like PackedFC the operator is stateful and
+// assumes that W never changes afterwards. The products are accumulated in
+// int32 and requantized to the scale and zero point of Y, with the bias and
+// the optional ReLU applied in the same pass.
+class Int8FCOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8FCOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(int, "axis", axis_, 1),
+        OP_SINGLE_ARG(int, "relu", relu_, 0),
+        OP_SINGLE_ARG(float, "Y_scale", Y_scale_, 1),
+        OP_SINGLE_ARG(int, "Y_zero_point", Y_zero_point_, 0) {
+    CAFFE_ENFORCE_GT(Y_scale_, 0, "Y_scale must be positive");
+    CAFFE_ENFORCE(
+        Y_zero_point_ >= 0 && Y_zero_point_ <= 255,
+        "Y_zero_point must be in [0, 255]");
+  }
+
+  bool RunOnDevice() override {
+    const auto& X = OperatorBase::Input<Int8TensorCPU>(INPUT);
+    const auto& W = Input(WEIGHT);
+    const auto& b = Input(BIAS);
+    auto* Y = OperatorBase::Output<Int8TensorCPU>(0);
+    CAFFE_ENFORCE_EQ(W.ndim(), 2, "WEIGHT must be N x K");
+    CAFFE_ENFORCE_EQ(b.ndim(), 1, "BIAS must be a vector");
+    const auto canonical_axis = X.t.canonical_axis_index(axis_);
+    const int M = X.t.size_to_dim(canonical_axis);
+    const int K = X.t.size_from_dim(canonical_axis);
+    const int N = W.dim32(0);
+    CAFFE_ENFORCE_EQ(W.dim32(1), K, "WEIGHT must be N x K");
+    CAFFE_ENFORCE_EQ(b.size(), N, "BIAS must have N entries");
+    if (packed_W_.empty() || packed_W_.N() != N || packed_W_.K() != K) {
+      packed_W_.Pack(N, K, W.data<float>(), K);
+    }
+
+    Y_shape_cache_ = X.t.dims();
+    Y_shape_cache_.resize(canonical_axis + 1);
+    Y_shape_cache_[canonical_axis] = N;
+    Y->t.Resize(Y_shape_cache_);
+    Y->scale = Y_scale_;
+    Y->zero_point = Y_zero_point_;
+    math::Int8Gemm(
+        M,
+        N,
+        K,
+        X.t.data<uint8_t>(),
+        K,
+        QuantizationParams{X.scale, X.zero_point},
+        packed_W_,
+        b.data<float>(),
+        QuantizationParams{Y_scale_, Y_zero_point_},
+        relu_,
+        Y->t.mutable_data<uint8_t>(),
+        N,
+        &context_);
+    return true;
+  }
+
+ protected:
+  INPUT_TAGS(INPUT, WEIGHT, BIAS);
+
+ private:
+  int axis_;
+  bool relu_;
+  float Y_scale_;
+  int Y_zero_point_;
+  vector<TIndex> Y_shape_cache_;
+  math::Int8GemmMatrixB packed_W_;
+};
+
+namespace {
+
+REGISTER_CPU_OPERATOR(Int8FC, Int8FCOp);
+
+OPERATOR_SCHEMA(Int8FC)
+    .NumInputs(3)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+The quantized version of FC, for inference: Y = act(X * W^T + b) where X and Y
+are Int8TensorCPU (see Int8Quantize) and W and b are the float weights and bias
+of the FC layer. W is quantized symmetrically to int8 with one scale per output
+and packed on the first run; as with PackedFC, the operator assumes that W does
+not change afterwards. The uint8 x int8 products are accumulated exactly in
+int32 and requantized to Y_scale and Y_zero_point. The operator is mostly
+created by QuantizeForInference (see core/inference_transforms.h).
+)DOC")
+    .Arg("axis", "(int, default 1) Describes the axis of the input, as for FC.")
+    .Arg("relu", "(int, default 0) If 1, applies ReLU to the output.")
+    .Arg("Y_scale", "(float, default 1) The scale of the output.")
+    .Arg("Y_zero_point", "(int, default 0) The zero point of the output.")
+    .Input(0, "X", "Quantized input of the layer, flattened to 2D at axis")
+    .Input(1, "W", "(N x K) float weights, as for FC")
+    .Input(2, "b", "N float biases, as for FC")
+    .Output(0, "Y", "Quantized output of the layer");
+NO_GRADIENT(Int8FC);
+
+} // namespace
+
+} // namespace caffe2
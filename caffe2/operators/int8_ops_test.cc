@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor_int8.h"
+#include "caffe2/utils/proto_utils.h"
+#include "caffe2/utils/quantization.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static void AddInput(
+    const vector<TIndex>& shape,
+    const float min,
+    const float max,
+    const string& name,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(min, max);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+}
+
+static const TensorCPU& Float(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>();
+}
+
+static QuantizationParams RangeParams(const TensorCPU& tensor) {
+  const float* data = tensor.data<float>();
+  return ChooseQuantizationParams(
+      *std::min_element(data, data + tensor.size()),
+      *std::max_element(data, data + tensor.size()));
+}
+
+// Quantizes float blob name to name_int8 and writes its dequantized value to
+// name_fake, the input that the float operator sees in the Int8 operator.
+static void QuantizeInput(const string& name, Workspace* ws) {
+  const auto params = RangeParams(Float(ws, name));
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(
+      "Int8Quantize",
+      "",
+      vector<string>{name},
+      vector<string>{name + "_int8"},
+      vector<Argument>{MakeArgument("Y_scale", params.scale),
+                       MakeArgument("Y_zero_point", params.zero_point)})));
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(
+      "Int8Dequantize",
+      "",
+      vector<string>{name + "_int8"},
+      vector<string>{name + "_fake"})));
+}
+
+// Writes to name_fake the weights that the Int8 operators use: every row of
+// the first dimension rounded to its 255 levels in [-max, max].
+static void FakeQuantizeWeight(const string& name, Workspace* ws) {
+  const auto& W = Float(ws, name);
+  auto* fake = ws->CreateBlob(name + "_fake")->GetMutable<TensorCPU>();
+  fake->ResizeLike(W);
+  const int rows = W.dim32(0);
+  const int size = W.size() / rows;
+  for (int i = 0; i < rows; ++i) {
+    const float* row = W.data<float>() + i * size;
+    float max = 0;
+    for (int k = 0; k < size; ++k) {
+      max = std::max(max, std::abs(row[k]));
+    }
+    const float scale = max / 127;
+    const float inverse_scale = 1 / scale;
+    for (int k = 0; k < size; ++k) {
+      fake->mutable_data<float>()[i * size + k] =
+          std::nearbyint(row[k] * inverse_scale) * scale;
+    }
+  }
+}
+
+// Runs the float operator type on the fake quantized X and W, and its Int8
+// version on the quantized X with the range of the float output, and checks
+// that the dequantized result only differs by the rounding of the output.
+static void CheckInt8Op(
+    const string& type,
+    const string& int8_type,
+    const vector<Argument>& args,
+    Workspace* ws) {
+  QuantizeInput("X", ws);
+  FakeQuantizeWeight("W", ws);
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(
+      type, "", vector<string>{"X_fake", "W_fake", "b"}, vector<string>{"Y"},
+      args)));
+  const auto params = RangeParams(Float(ws, "Y"));
+  vector<Argument> int8_args = args;
+  int8_args.push_back(MakeArgument("Y_scale", params.scale));
+  int8_args.push_back(MakeArgument("Y_zero_point", params.zero_point));
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(
+      int8_type,
+      "",
+      vector<string>{"X_int8", "W", "b"},
+      vector<string>{"Y_int8"},
+      int8_args)));
+  const auto& Y_int8 = ws->GetBlob("Y_int8")->Get<Int8TensorCPU>();
+  EXPECT_EQ(Y_int8.scale, params.scale);
+  EXPECT_EQ(Y_int8.zero_point, params.zero_point);
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(
+      "Int8Dequantize", "", vector<string>{"Y_int8"}, vector<string>{"Z"})));
+  const auto& Y = Float(ws, "Y");
+  const auto& Z = Float(ws, "Z");
+  ASSERT_EQ(Z.dims(), Y.dims());
+  for (int i = 0; i < Y.size(); ++i) {
+    // Half a step for the output, and a little for the rounding of the bias.
+    ASSERT_NEAR(Z.data<float>()[i], Y.data<float>()[i], 0.6 * params.scale)
+        << i;
+  }
+}
+
+TEST(Int8Test, QuantizeDequantize) {
+  Workspace ws;
+  std::mt19937 gen(1);
+  AddInput({7, 33}, -1, 3, "X", &gen, &ws);
+  const auto params = RangeParams(Float(&ws, "X"));
+  EXPECT_NEAR(params.scale, 4.f / 255, 0.1f / 255);
+  EXPECT_NEAR(params.zero_point, 64, 1);
+  QuantizeInput("X", &ws);
+  const auto& X = Float(&ws, "X");
+  const auto& X_fake = Float(&ws, "X_fake");
+  ASSERT_EQ(X_fake.dims(), X.dims());
+  for (int i = 0; i < X.size(); ++i) {
+    ASSERT_NEAR(X_fake.data<float>()[i], X.data<float>()[i],
+                0.501 * params.scale);
+  }
+
+  // 0 is exact, and values out of the range saturate.
+  const float values[] = {0, 100, -100};
+  uint8_t q[3];
+  Quantize(values, 3, params, q);
+  EXPECT_EQ(q[0], params.zero_point);
+  EXPECT_EQ(q[1], 255);
+  EXPECT_EQ(q[2], 0);
+}
+
+TEST(Int8Test, FC) {
+  Workspace ws;
+  std::mt19937 gen(2);
+  // Sizes that are not multiples of the tiles and of the padding of K.
+  AddInput({35, 70}, -1, 2, "X", &gen, &ws);
+  AddInput({101, 70}, -0.5, 0.5, "W", &gen, &ws);
+  AddInput({101}, -1, 1, "b", &gen, &ws);
+  CheckInt8Op("FC", "Int8FC", {}, &ws);
+}
+
+TEST(Int8Test, FCRelu) {
+  Workspace ws;
+  std::mt19937 gen(3);
+  AddInput({2, 3, 17}, -1, 2, "X", &gen, &ws);
+  AddInput({9, 17}, -0.5, 0.5, "W", &gen, &ws);
+  AddInput({9}, -1, 1, "b", &gen, &ws);
+  const vector<Argument> args{MakeArgument("axis", 2)};
+  CheckInt8Op("FC", "Int8FC", args, &ws);
+
+  const auto params = RangeParams(Float(&ws, "Y"));
+  vector<Argument> relu_args = args;
+  relu_args.push_back(MakeArgument("relu", 1));
+  relu_args.push_back(MakeArgument("Y_scale", params.scale));
+  relu_args.push_back(MakeArgument("Y_zero_point", params.zero_point));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "Int8FC",
+      "",
+      vector<string>{"X_int8", "W", "b"},
+      vector<string>{"Y_relu"},
+      relu_args)));
+  const auto& Y = ws.GetBlob("Y_int8")->Get<Int8TensorCPU>();
+  const auto& Y_relu = ws.GetBlob("Y_relu")->Get<Int8TensorCPU>();
+  EXPECT_EQ(Y_relu.t.dims(), (vector<TIndex>{2, 3, 9}));
+  for (int i = 0; i < Y.t.size(); ++i) {
+    EXPECT_EQ(
+        Y_relu.t.data<uint8_t>()[i],
+        std::max<int>(Y.t.data<uint8_t>()[i], params.zero_point));
+  }
+}
+
+TEST(Int8Test, ConvNCHW) {
+  Workspace ws;
+  std::mt19937 gen(4);
+  AddInput({2, 5, 11, 9}, -1, 2, "X", &gen, &ws);
+  AddInput({19, 5, 3, 3}, -0.5, 0.5, "W", &gen, &ws);
+  AddInput({19}, -1, 1, "b", &gen, &ws);
+  CheckInt8Op(
+      "Conv",
+      "Int8Conv",
+      {MakeArgument("kernel", 3),
+       MakeArgument("pad", 1),
+       MakeArgument("stride", 2)},
+      &ws);
+}
+
+TEST(Int8Test, ConvNHWC) {
+  Workspace ws;
+  std::mt19937 gen(5);
+  AddInput({2, 8, 10, 6}, -1, 2, "X", &gen, &ws);
+  AddInput({7, 3, 2, 6}, -0.5, 0.5, "W", &gen, &ws);
+  AddInput({7}, -1, 1, "b", &gen, &ws);
+  CheckInt8Op(
+      "Conv",
+      "Int8Conv",
+      {MakeArgument("kernel_h", 3),
+       MakeArgument("kernel_w", 2),
+       MakeArgument("pad_t", 1),
+       MakeArgument("pad_l", 2),
+       MakeArgument("order", string("NHWC"))},
+      &ws);
+}
+
+TEST(Int8Test, ConvRelu) {
+  Workspace ws;
+  std::mt19937 gen(6);
+  AddInput({1, 4, 7, 7}, -1, 2, "X", &gen, &ws);
+  AddInput({6, 4, 3, 3}, -0.5, 0.5, "W", &gen, &ws);
+  AddInput({6}, -1, 1, "b", &gen, &ws);
+  CheckInt8Op(
+      "ConvRelu", "Int8ConvRelu", {MakeArgument("kernel", 3)}, &ws);
+  const auto& Y = ws.GetBlob("Y_int8")->Get<Int8TensorCPU>();
+  EXPECT_EQ(Y.zero_point, 0);
+}
+
+} // namespace caffe2
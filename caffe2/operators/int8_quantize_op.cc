@@ -0,0 +1,96 @@
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor_int8.h"
+#include "caffe2/utils/quantization.h"
+
+namespace caffe2 {
+
+// Quantizes a float tensor to an Int8TensorCPU with the given parameters.
+class Int8QuantizeOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8QuantizeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(float, "Y_scale", Y_scale_, 1),
+        OP_SINGLE_ARG(int, "Y_zero_point", Y_zero_point_, 0) {
+    CAFFE_ENFORCE_GT(Y_scale_, 0, "Y_scale must be positive");
+    CAFFE_ENFORCE(
+        Y_zero_point_ >= 0 && Y_zero_point_ <= 255,
+        "Y_zero_point must be in [0, 255]");
+  }
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    auto* Y = OperatorBase::Output<Int8TensorCPU>(0);
+    Y->scale = Y_scale_;
+    Y->zero_point = Y_zero_point_;
+    Y->t.ResizeLike(X);
+    Quantize(
+        X.data<float>(),
+        X.size(),
+        QuantizationParams{Y_scale_, Y_zero_point_},
+        Y->t.mutable_data<uint8_t>());
+    return true;
+  }
+
+ private:
+  float Y_scale_;
+  int Y_zero_point_;
+};
+
+// Converts an Int8TensorCPU back to a float tensor.
+class Int8DequantizeOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Int8DequantizeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override {
+    const auto& X = OperatorBase::Input<Int8TensorCPU>(0);
+    auto* Y = Output(0);
+    Y->ResizeLike(X.t);
+    Dequantize(
+        X.t.data<uint8_t>(),
+        X.t.size(),
+        QuantizationParams{X.scale, X.zero_point},
+        Y->mutable_data<float>());
+    return true;
+  }
+};
+
+namespace {
+
+REGISTER_CPU_OPERATOR(Int8Quantize, Int8QuantizeOp);
+REGISTER_CPU_OPERATOR(Int8Dequantize, Int8DequantizeOp);
+
+OPERATOR_SCHEMA(Int8Quantize)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Quantizes a float tensor to uint8: Y = clamp(round(X / Y_scale) + Y_zero_point,
+0, 255). The output is an Int8TensorCPU (see core/tensor_int8.h) that carries
+its scale and zero point, for the Int8 operators. The parameters are usually
+chosen from the range of X recorded over sample inputs, see
+QuantizeForInference in core/inference_transforms.h.
+)DOC")
+    .Arg("Y_scale", "(float, default 1) The scale of the output.")
+    .Arg("Y_zero_point", "(int, default 0) The zero point of the output.")
+    .Input(0, "X", "The float tensor to quantize.")
+    .Output(0, "Y", "The quantized Int8TensorCPU.");
+
+OPERATOR_SCHEMA(Int8Dequantize)
+    .NumInputs(1)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Converts an Int8TensorCPU back to a float tensor: Y = scale * (X - zero_point),
+with the scale and zero point carried by X.
+)DOC")
+    .Input(0, "X", "The quantized Int8TensorCPU.")
+    .Output(0, "Y", "The float tensor.");
+
+NO_GRADIENT(Int8Quantize);
+NO_GRADIENT(Int8Dequantize);
+
+} // namespace
+
+} // namespace caffe2
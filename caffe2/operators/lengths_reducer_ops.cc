@@ -0,0 +1,266 @@
+#include "caffe2/operators/lengths_reducer_ops.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+
+bool FloatToRowwiseQuantized8BitsOp::RunOnDevice() {
+  auto& input = Input(0);
+  auto* output = Output(0);
+  auto* scale_bias = Output(1);
+  CAFFE_ENFORCE_GT(input.ndim(), 0, "Input must be at least 1-D");
+  const TIndex rows = input.dim(0);
+  const TIndex block_size = input.size_from_dim(1);
+  output->ResizeLike(input);
+  scale_bias->Resize(rows, 2);
+  const float* in = input.data<float>();
+  uint8_t* out = output->mutable_data<uint8_t>();
+  float* sb = scale_bias->mutable_data<float>();
+  for (TIndex r = 0; r < rows; ++r) {
+    const float* row = in + r * block_size;
+    uint8_t* q = out + r * block_size;
+    float min = 0;
+    float max = 0;
+    if (block_size > 0) {
+      const auto range = std::minmax_element(row, row + block_size);
+      min = *range.first;
+      max = *range.second;
+    }
+    const float scale = (max - min) / 255.f;
+    const float inv_scale = max > min ? 255.f / (max - min) : 0.f;
+    for (TIndex k = 0; k < block_size; ++k) {
+      q[k] = static_cast<uint8_t>(std::min(
+          255.f, std::max(0.f, std::nearbyint((row[k] - min) * inv_scale))));
+    }
+    sb[2 * r] = scale;
+    sb[2 * r + 1] = min;
+  }
+  return true;
+}
+
+bool Rowwise8BitQuantizedToFloatOp::RunOnDevice() {
+  auto& input = Input(0);
+  auto& scale_bias = Input(1);
+  auto* output = Output(0);
+  CAFFE_ENFORCE_GT(input.ndim(), 0, "Input must be at least 1-D");
+  const TIndex rows = input.dim(0);
+  const TIndex block_size = input.size_from_dim(1);
+  CAFFE_ENFORCE_EQ(2, scale_bias.ndim(), "SCALE_BIAS must be a matrix");
+  CAFFE_ENFORCE_EQ(rows, scale_bias.dim(0), "SCALE_BIAS needs a row per slice");
+  CAFFE_ENFORCE_EQ(2, scale_bias.dim(1), "SCALE_BIAS must have 2 columns");
+  output->ResizeLike(input);
+  const uint8_t* in = input.data<uint8_t>();
+  const float* sb = scale_bias.data<float>();
+  float* out = output->mutable_data<float>();
+  for (TIndex r = 0; r < rows; ++r) {
+    const float scale = sb[2 * r];
+    const float bias = sb[2 * r + 1];
+    for (TIndex k = 0; k < block_size; ++k) {
+      out[r * block_size + k] = scale * in[r * block_size + k] + bias;
+    }
+  }
+  return true;
+}
+
+namespace {
+
+// Gradient of SparseLengthsMean with respect to the gathered slices: every
+// slice of segment m receives the output gradient of m divided by its length.
+class LengthsMeanGradientOp : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  LengthsMeanGradientOp(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override {
+    auto& segmentGrads = Input(0);
+    auto& lengthsInput = Input(1);
+    auto* dataGrads = Output(0);
+    CAFFE_ENFORCE_EQ(1, lengthsInput.ndim(), "LENGTHS must be a vector");
+    CAFFE_ENFORCE_EQ(segmentGrads.dim(0), lengthsInput.dim(0));
+    const int* lengths = lengthsInput.data<int>();
+    TIndex dataSize = 0;
+    for (TIndex m = 0; m < lengthsInput.dim(0); ++m) {
+      dataSize += lengths[m];
+    }
+    vector<TIndex> shape = segmentGrads.dims();
+    shape[0] = dataSize;
+    dataGrads->Resize(shape);
+    const TIndex block_size = segmentGrads.size_from_dim(1);
+    const float* in = segmentGrads.data<float>();
+    float* out = dataGrads->mutable_data<float>();
+    for (TIndex m = 0; m < lengthsInput.dim(0); ++m) {
+      const float inv_length = 1.f / std::max(lengths[m], 1);
+      for (int i = 0; i < lengths[m]; ++i) {
+        math::Scale<float, CPUContext>(
+            block_size, inv_length, in + m * block_size, out, &context_);
+        out += block_size;
+      }
+    }
+    return true;
+  }
+};
+
+class GetSparseLengthsMeanGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    using Op = CPUSparseLengthsReductionOp<false, true, false>;
+    vector<OperatorDef> r{CreateOperatorDef(
+        "LengthsMeanGradient",
+        "",
+        vector<string>{GO(0), I(Op::LENGTHS)},
+        vector<string>{GI_V(0)})};
+    SetSparse(0, I(Op::INDICES), GI_V(0));
+    return r;
+  }
+};
+
+REGISTER_CPU_OPERATOR(
+    SparseLengthsMean,
+    CPUSparseLengthsReductionOp<false, true, false>);
+REGISTER_CPU_OPERATOR(LengthsMeanGradient, LengthsMeanGradientOp);
+REGISTER_CPU_OPERATOR(
+    SparseLengthsSum8BitsRowwise,
+    CPUSparseLengthsReductionOp<false, false, true>);
+REGISTER_CPU_OPERATOR(
+    SparseLengthsWeightedSum8BitsRowwise,
+    CPUSparseLengthsReductionOp<true, false, true>);
+REGISTER_CPU_OPERATOR(
+    SparseLengthsMean8BitsRowwise,
+    CPUSparseLengthsReductionOp<false, true, true>);
+REGISTER_CPU_OPERATOR(
+    FloatToRowwiseQuantized8Bits,
+    FloatToRowwiseQuantized8BitsOp);
+REGISTER_CPU_OPERATOR(
+    Rowwise8BitQuantizedToFloat,
+    Rowwise8BitQuantizedToFloatOp);
+
+OPERATOR_SCHEMA(SparseLengthsMean)
+    .NumInputs(3)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Pulls in slices of DATA, groups them into segments defined by LENGTHS and
+averages each segment. Same as SparseLengthsSum divided by the length of each
+segment; empty segments produce zeros.
+
+DATA may be a float or a float16 tensor; the output is float.
+)DOC")
+    .Input(0, "DATA", "Input tensor, slices of which are aggregated.")
+    .Input(
+        1,
+        "INDICES",
+        "Integer vector containing indices of the first dimension of DATA for "
+        "the slices that are being aggregated")
+    .Input(
+        2,
+        "LENGTHS",
+        "Non negative vector with sum of elements equal to INDICES length")
+    .Output(
+        0,
+        "OUTPUT",
+        "Aggregated output tensor. Has the first dimension of len(LENGTHS).");
+OPERATOR_SCHEMA(LengthsMeanGradient).NumInputs(2).NumOutputs(1);
+REGISTER_GRADIENT(SparseLengthsMean, GetSparseLengthsMeanGradient);
+
+OPERATOR_SCHEMA(SparseLengthsSum8BitsRowwise)
+    .NumInputs(4)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Variation of SparseLengthsSum for a row-wise quantized uint8 DATA, as produced
+by FloatToRowwiseQuantized8Bits. Slice r of DATA stands for
+SCALE_BIAS[r][0] * DATA[r] + SCALE_BIAS[r][1]; slices are dequantized as they
+are read and summed in float.
+)DOC")
+    .Input(0, "DATA", "uint8 tensor, slices of which are aggregated.")
+    .Input(
+        1,
+        "INDICES",
+        "Integer vector containing indices of the first dimension of DATA for "
+        "the slices that are being aggregated")
+    .Input(
+        2,
+        "LENGTHS",
+        "Non negative vector with sum of elements equal to INDICES length")
+    .Input(3, "SCALE_BIAS", "Matrix of size len(DATA) x 2 of scales and biases")
+    .Output(0, "OUTPUT", "Float output with the first dimension of len(LENGTHS)");
+SHOULD_NOT_DO_GRADIENT(SparseLengthsSum8BitsRowwise);
+
+OPERATOR_SCHEMA(SparseLengthsWeightedSum8BitsRowwise)
+    .NumInputs(5)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Variation of SparseLengthsWeightedSum for a row-wise quantized uint8 DATA, as
+produced by FloatToRowwiseQuantized8Bits. Slice r of DATA stands for
+SCALE_BIAS[r][0] * DATA[r] + SCALE_BIAS[r][1].
+)DOC")
+    .Input(0, "DATA", "uint8 tensor, slices of which are aggregated.")
+    .Input(
+        1,
+        "SCALARS",
+        "Scalar multipliers for the input slices. Must be a vector with the "
+        "length matching the length of INDICES")
+    .Input(
+        2,
+        "INDICES",
+        "Integer vector containing indices of the first dimension of DATA for "
+        "the slices that are being aggregated")
+    .Input(
+        3,
+        "LENGTHS",
+        "Non negative vector with sum of elements equal to INDICES length")
+    .Input(4, "SCALE_BIAS", "Matrix of size len(DATA) x 2 of scales and biases")
+    .Output(0, "OUTPUT", "Float output with the first dimension of len(LENGTHS)");
+SHOULD_NOT_DO_GRADIENT(SparseLengthsWeightedSum8BitsRowwise);
+
+OPERATOR_SCHEMA(SparseLengthsMean8BitsRowwise)
+    .NumInputs(4)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Variation of SparseLengthsMean for a row-wise quantized uint8 DATA, as produced
+by FloatToRowwiseQuantized8Bits. Slice r of DATA stands for
+SCALE_BIAS[r][0] * DATA[r] + SCALE_BIAS[r][1].
+)DOC")
+    .Input(0, "DATA", "uint8 tensor, slices of which are aggregated.")
+    .Input(
+        1,
+        "INDICES",
+        "Integer vector containing indices of the first dimension of DATA for "
+        "the slices that are being aggregated")
+    .Input(
+        2,
+        "LENGTHS",
+        "Non negative vector with sum of elements equal to INDICES length")
+    .Input(3, "SCALE_BIAS", "Matrix of size len(DATA) x 2 of scales and biases")
+    .Output(0, "OUTPUT", "Float output with the first dimension of len(LENGTHS)");
+SHOULD_NOT_DO_GRADIENT(SparseLengthsMean8BitsRowwise);
+
+OPERATOR_SCHEMA(FloatToRowwiseQuantized8Bits)
+    .NumInputs(1)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Quantizes every slice of the first dimension of a float tensor to uint8 with
+its own scale and bias: scale = (max - min) / 255, bias = min. Used to shrink
+embedding tables 4x for the SparseLengths*8BitsRowwise ops.
+)DOC")
+    .Input(0, "input", "Float tensor to quantize")
+    .Output(0, "quantized_output", "uint8 tensor of the same shape")
+    .Output(1, "scale_bias", "Matrix of size len(input) x 2");
+SHOULD_NOT_DO_GRADIENT(FloatToRowwiseQuantized8Bits);
+
+OPERATOR_SCHEMA(Rowwise8BitQuantizedToFloat)
+    .NumInputs(2)
+    .NumOutputs(1)
+    .SetDoc(R"DOC(
+Inverse of FloatToRowwiseQuantized8Bits: computes
+scale_bias[r][0] * quantized_input[r] + scale_bias[r][1] for every slice r.
+)DOC")
+    .Input(0, "quantized_input", "uint8 tensor")
+    .Input(1, "scale_bias", "Matrix of size len(quantized_input) x 2")
+    .Output(0, "output", "Float tensor of the same shape");
+SHOULD_NOT_DO_GRADIENT(Rowwise8BitQuantizedToFloat);
+
+} // namespace
+} // namespace caffe2
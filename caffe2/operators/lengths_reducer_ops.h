@@ -0,0 +1,141 @@
+#ifndef CAFFE2_OPERATORS_LENGTHS_REDUCER_OPS_H_
+#define CAFFE2_OPERATORS_LENGTHS_REDUCER_OPS_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/embedding_lookup.h"
+
+namespace caffe2 {
+
+/**
+ * @brief SparseLengths reductions over embedding tables stored in reduced
+ * precision.
+ *
+ * DATA is a float or float16 table, or a row-wise quantized uint8 table if
+ * ROWWISE_8BIT is set, in which case the last input is SCALE_BIAS, a
+ * len(DATA) x 2 float tensor holding the scale and the bias of each row.
+ * Slices are converted to float as they are read and pooled in float with
+ * EmbeddingLookup.
+ *
+ * Inputs: DATA, [WEIGHTS if USE_WEIGHT], INDICES, LENGTHS,
+ *         [SCALE_BIAS if ROWWISE_8BIT]
+ * Output: float tensor with the first dimension of len(LENGTHS)
+ */
+template <bool USE_WEIGHT, bool USE_MEAN, bool ROWWISE_8BIT>
+class CPUSparseLengthsReductionOp : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  USE_DISPATCH_HELPER;
+
+  static_assert(
+      !(USE_WEIGHT && USE_MEAN),
+      "Weighted mean of the slices is not supported");
+
+  CPUSparseLengthsReductionOp(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override {
+    if (ROWWISE_8BIT) { // static if
+      return DispatchHelper<TensorTypes<uint8_t>>::call(this, Input(DATA));
+    }
+    return DispatchHelper<TensorTypes<float, float16>>::call(this, Input(DATA));
+  }
+
+  enum {
+    DATA = 0,
+    WEIGHTS = 1,
+    INDICES = 1 + USE_WEIGHT,
+    LENGTHS = 2 + USE_WEIGHT,
+    SCALE_BIAS = 3 + USE_WEIGHT,
+  };
+
+ private:
+  template <typename InType>
+  bool DoRunWithType() {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>, InType>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename InType, typename IndexType>
+  bool DoRunWithType() {
+    auto& data = Input(DATA);
+    auto& indices = Input(INDICES);
+    auto& lengths = Input(LENGTHS);
+    auto* output = Output(0);
+    CAFFE_ENFORCE_GT(data.ndim(), 0, "DATA must be at least 1-D");
+    CAFFE_ENFORCE_EQ(1, indices.ndim(), "INDICES must be a vector");
+    CAFFE_ENFORCE_EQ(1, lengths.ndim(), "LENGTHS must be a vector");
+
+    const float* weights = nullptr;
+    if (USE_WEIGHT) { // static if
+      auto& weightsInput = Input(WEIGHTS);
+      CAFFE_ENFORCE_EQ(1, weightsInput.ndim(), "WEIGHTS must be a vector");
+      CAFFE_ENFORCE_EQ(
+          weightsInput.size(),
+          indices.size(),
+          "WEIGHTS should have the same length as INDICES");
+      weights = weightsInput.template data<float>();
+    }
+    const float* scale_bias = nullptr;
+    if (ROWWISE_8BIT) { // static if
+      auto& scaleBias = Input(SCALE_BIAS);
+      CAFFE_ENFORCE_EQ(2, scaleBias.ndim(), "SCALE_BIAS must be a matrix");
+      CAFFE_ENFORCE_EQ(
+          scaleBias.dim(0), data.dim(0), "SCALE_BIAS needs a row per slice");
+      CAFFE_ENFORCE_EQ(2, scaleBias.dim(1), "SCALE_BIAS must have 2 columns");
+      scale_bias = scaleBias.template data<float>();
+    }
+
+    vector<TIndex> shape = data.dims();
+    shape[0] = lengths.dim(0);
+    output->Resize(shape);
+    EmbeddingLookup(
+        data.size_from_dim(1),
+        lengths.dim(0),
+        indices.size(),
+        data.dim(0),
+        data.template data<InType>(),
+        indices.template data<IndexType>(),
+        lengths.template data<int>(),
+        weights,
+        scale_bias,
+        USE_MEAN,
+        output->template mutable_data<float>());
+    return true;
+  }
+};
+
+/**
+ * @brief Quantizes each slice of a float tensor along the first dimension to
+ * uint8 with its own scale and bias:
+ *
+ *   scale = (max - min) / 255, bias = min, q = round((x - bias) / scale)
+ *
+ * Outputs the quantized tensor and a len(DATA) x 2 tensor of scales and
+ * biases, as consumed by the SparseLengths*8BitsRowwise ops.
+ */
+class FloatToRowwiseQuantized8BitsOp : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  FloatToRowwiseQuantized8BitsOp(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override;
+};
+
+/**
+ * @brief Converts a row-wise quantized uint8 tensor and its scales and biases
+ * back to float.
+ */
+class Rowwise8BitQuantizedToFloatOp : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  Rowwise8BitQuantizedToFloatOp(const OperatorDef& def, Workspace* ws)
+      : Operator<CPUContext>(def, ws) {}
+
+  bool RunOnDevice() override;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LENGTHS_REDUCER_OPS_H_
@@ -0,0 +1,192 @@
+#include <cmath>
+#include <limits>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/fp16.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+TensorCPU* CreateTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<T>();
+  return tensor;
+}
+
+const TensorCPU& GetTensor(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>();
+}
+
+// Fills a random float table "data", 100 indices in "indices" split into 10
+// segments in "lengths", and weights in "weights".
+void FillInputs(Workspace* ws, const int block_size) {
+  std::mt19937 gen(block_size);
+  std::uniform_real_distribution<float> value(-2, 2);
+  std::uniform_int_distribution<TIndex> index(0, 49);
+  auto* data = CreateTensor<float>(ws, "data", {50, block_size});
+  for (int i = 0; i < data->size(); ++i) {
+    data->mutable_data<float>()[i] = value(gen);
+  }
+  auto* indices = CreateTensor<TIndex>(ws, "indices", {100});
+  auto* weights = CreateTensor<float>(ws, "weights", {100});
+  for (int i = 0; i < 100; ++i) {
+    indices->mutable_data<TIndex>()[i] = index(gen);
+    weights->mutable_data<float>()[i] = value(gen);
+  }
+  auto* lengths = CreateTensor<int>(ws, "lengths", {10});
+  const int kLengths[] = {0, 5, 20, 1, 14, 10, 10, 0, 30, 10};
+  for (int i = 0; i < 10; ++i) {
+    lengths->mutable_data<int>()[i] = kLengths[i];
+  }
+}
+
+void RunOp(
+    Workspace* ws,
+    const string& type,
+    const vector<string>& inputs,
+    const vector<string>& outputs) {
+  ASSERT_TRUE(ws->RunOperatorOnce(CreateOperatorDef(type, "", inputs, outputs)));
+}
+
+void ExpectNear(const TensorCPU& a, const TensorCPU& b, const float tolerance) {
+  ASSERT_EQ(a.dims(), b.dims());
+  for (int i = 0; i < a.size(); ++i) {
+    EXPECT_NEAR(a.data<float>()[i], b.data<float>()[i], tolerance) << i;
+  }
+}
+
+} // namespace
+
+TEST(LengthsReducerOpsTest, Fp16Conversions) {
+  const float kInf = std::numeric_limits<float>::infinity();
+  const float values[] = {
+      0, -0.f, 1, -2.5f, 65504, 1e5, -kInf, 6.1035156e-05f, 5.96e-08f};
+  const uint16_t bits[] = {
+      0x0000, 0x8000, 0x3C00, 0xC100, 0x7BFF, 0x7C00, 0xFC00, 0x0400, 0x0001};
+  for (int i = 0; i < 9; ++i) {
+    EXPECT_EQ(bits[i], FloatToFp16(values[i]).x) << values[i];
+  }
+  EXPECT_TRUE(std::isnan(Fp16ToFloat(FloatToFp16(std::nanf("")))));
+  // Every finite half survives the round trip through float.
+  for (uint32_t h = 0; h < 0x10000; ++h) {
+    float16 x;
+    x.x = static_cast<uint16_t>(h);
+    const float f = Fp16ToFloat(x);
+    if (std::isfinite(f)) {
+      EXPECT_EQ(x.x, FloatToFp16(f).x) << h;
+    }
+  }
+  // Ties round to even.
+  EXPECT_EQ(0x3C00, FloatToFp16(1 + std::ldexp(1.f, -11)).x);
+  EXPECT_EQ(0x3C02, FloatToFp16(1 + 3 * std::ldexp(1.f, -11)).x);
+}
+
+TEST(LengthsReducerOpsTest, SparseLengthsSumFp16) {
+  for (const int block_size : {32, 5}) {
+    Workspace ws;
+    FillInputs(&ws, block_size);
+    RunOp(&ws, "FloatToHalf", {"data"}, {"data_fp16"});
+    RunOp(&ws, "HalfToFloat", {"data_fp16"}, {"data_rounded"});
+    ExpectNear(GetTensor(&ws, "data"), GetTensor(&ws, "data_rounded"), 1e-3);
+
+    RunOp(&ws, "SparseLengthsSum", {"data_fp16", "indices", "lengths"}, {"y"});
+    RunOp(
+        &ws, "SparseLengthsSum", {"data_rounded", "indices", "lengths"}, {"z"});
+    ExpectNear(GetTensor(&ws, "y"), GetTensor(&ws, "z"), 1e-4);
+
+    RunOp(
+        &ws,
+        "SparseLengthsWeightedSum",
+        {"data_fp16", "weights", "indices", "lengths"},
+        {"y"});
+    RunOp(
+        &ws,
+        "SparseLengthsWeightedSum",
+        {"data_rounded", "weights", "indices", "lengths"},
+        {"z"});
+    ExpectNear(GetTensor(&ws, "y"), GetTensor(&ws, "z"), 1e-4);
+  }
+}
+
+TEST(LengthsReducerOpsTest, SparseLengthsMean) {
+  Workspace ws;
+  FillInputs(&ws, 16);
+  RunOp(&ws, "SparseLengthsMean", {"data", "indices", "lengths"}, {"mean"});
+  RunOp(&ws, "SparseLengthsSum", {"data", "indices", "lengths"}, {"sum"});
+  const auto& mean = GetTensor(&ws, "mean");
+  const auto& sum = GetTensor(&ws, "sum");
+  const auto& lengths = GetTensor(&ws, "lengths");
+  ASSERT_EQ(mean.dims(), sum.dims());
+  for (int m = 0; m < 10; ++m) {
+    const int length = std::max(lengths.data<int>()[m], 1);
+    for (int k = 0; k < 16; ++k) {
+      EXPECT_NEAR(
+          mean.data<float>()[m * 16 + k],
+          sum.data<float>()[m * 16 + k] / length,
+          1e-5);
+    }
+  }
+
+  RunOp(&ws, "FloatToHalf", {"data"}, {"data_fp16"});
+  RunOp(
+      &ws, "SparseLengthsMean", {"data_fp16", "indices", "lengths"}, {"y"});
+  ExpectNear(GetTensor(&ws, "y"), mean, 1e-3);
+}
+
+TEST(LengthsReducerOpsTest, SparseLengths8BitsRowwise) {
+  Workspace ws;
+  FillInputs(&ws, 64);
+  RunOp(
+      &ws,
+      "FloatToRowwiseQuantized8Bits",
+      {"data"},
+      {"data_uint8", "scale_bias"});
+  RunOp(
+      &ws,
+      "Rowwise8BitQuantizedToFloat",
+      {"data_uint8", "scale_bias"},
+      {"data_rounded"});
+  // Quantization error is at most half a step, (max - min) / 510 <= 4 / 510.
+  ExpectNear(GetTensor(&ws, "data"), GetTensor(&ws, "data_rounded"), 0.008);
+
+  RunOp(
+      &ws,
+      "SparseLengthsSum8BitsRowwise",
+      {"data_uint8", "indices", "lengths", "scale_bias"},
+      {"y"});
+  RunOp(
+      &ws, "SparseLengthsSum", {"data_rounded", "indices", "lengths"}, {"z"});
+  ExpectNear(GetTensor(&ws, "y"), GetTensor(&ws, "z"), 1e-4);
+
+  RunOp(
+      &ws,
+      "SparseLengthsWeightedSum8BitsRowwise",
+      {"data_uint8", "weights", "indices", "lengths", "scale_bias"},
+      {"y"});
+  RunOp(
+      &ws,
+      "SparseLengthsWeightedSum",
+      {"data_rounded", "weights", "indices", "lengths"},
+      {"z"});
+  ExpectNear(GetTensor(&ws, "y"), GetTensor(&ws, "z"), 1e-4);
+
+  RunOp(
+      &ws,
+      "SparseLengthsMean8BitsRowwise",
+      {"data_uint8", "indices", "lengths", "scale_bias"},
+      {"y"});
+  RunOp(
+      &ws, "SparseLengthsMean", {"data_rounded", "indices", "lengths"}, {"z"});
+  ExpectNear(GetTensor(&ws, "y"), GetTensor(&ws, "z"), 1e-4);
+}
+
+} // namespace caffe2
@@ -1,10 +1,110 @@
 #include "caffe2/operators/local_response_normalization_op.h"
 
+#include <algorithm>
+
+#include "caffe2/utils/thread_pool.h"
+
 namespace caffe2 {
 
+namespace {
+
+// The number of pixels in every task of the NCHW loops, whose window sums are
+// kept for a block of pixels at a time.
+constexpr int kPixelsPerBlock = 1024;
+// The minimum number of elements in every task of the NHWC loops.
+constexpr int kMinElementsPerTask = 1 << 14;
+
+// Runs fn(begin, end) on ranges of [0, n) across the CPU thread pool, with
+// enough rows of width elements in every range to amortize the dispatch.
+template <typename Fn>
+void ForEachRowRange(const int n, const int width, Fn fn) {
+  const int rowsPerTask = std::max(1, kMinElementsPerTask / std::max(width, 1));
+  const int tasks = (n + rowsPerTask - 1) / rowsPerTask;
+  if (tasks <= 1) {
+    fn(0, n);
+    return;
+  }
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const int begin = task * rowsPerTask;
+        fn(begin, std::min(n, begin + rowsPerTask));
+      },
+      tasks);
+}
+
+// Runs fn(n, begin, end) on blocks [begin, end) of the H * W pixels of every
+// image n across the CPU thread pool.
+template <typename Fn>
+void ForEachPixelBlock(const int N, const int HxW, Fn fn) {
+  const int blocks = (HxW + kPixelsPerBlock - 1) / kPixelsPerBlock;
+  if (N * blocks == 0) {
+    return;
+  }
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const int n = task / blocks;
+        const int begin = (task % blocks) * kPixelsPerBlock;
+        fn(n, begin, std::min(HxW, begin + kPixelsPerBlock));
+      },
+      N * blocks);
+}
+
+// Computes Y = X * S^-beta over n elements with Eigen's vectorized functions,
+// using square roots for the usual values of beta instead of pow.
+void MulPowNegBeta(
+    const int n,
+    const float* X,
+    const float* S,
+    const float beta,
+    float* Y) {
+  ConstEigenVectorArrayMap<float> X_arr(X, n);
+  ConstEigenVectorArrayMap<float> S_arr(S, n);
+  EigenVectorArrayMap<float> Y_arr(Y, n);
+  if (beta == 0.75f) {
+    Y_arr = X_arr * S_arr.rsqrt() * S_arr.rsqrt().sqrt();
+  } else if (beta == 0.5f) {
+    Y_arr = X_arr * S_arr.rsqrt();
+  } else if (beta == 1.f) {
+    Y_arr = X_arr / S_arr;
+  } else {
+#if defined(__AVX2__)
+    // Eigen's log and exp beat its pow with AVX2, but not with SSE only.
+    Y_arr = X_arr * (S_arr.log() * -beta).exp();
+#else
+    Y_arr = X_arr * S_arr.pow(-beta);
+#endif
+  }
+}
+
+// Computes, for every channel c of a row of C channels, the sum of the values
+// over the window [c - pre_pad, c + post_pad]. The contiguous channels of
+// NHWC rows are added as shifted vectors rather than kept in a running sum,
+// whose dependency from one channel to the next would not vectorize.
+void WindowSum(
+    const int C,
+    const int pre_pad,
+    const int post_pad,
+    const float* values,
+    float* window) {
+  ConstEigenVectorArrayMap<float> values_arr(values, C);
+  EigenVectorArrayMap<float> window_arr(window, C);
+  window_arr = values_arr;
+  for (int k = 1; k <= post_pad && k < C; ++k) {
+    window_arr.head(C - k) += values_arr.tail(C - k);
+  }
+  for (int k = 1; k <= pre_pad && k < C; ++k) {
+    window_arr.tail(C - k) += values_arr.head(C - k);
+  }
+}
+
+} // namespace
+
+// The window of channel c spans channels [c - pre_pad_, c + post_pad]. In NCHW
+// its sum over a block of pixels is kept up to date while walking the
+// channels, adding the plane that enters it and subtracting the one that
+// leaves it, so that no padded copy of the input is needed.
 template<>
 bool LRNOp<float, CPUContext>::RunOnDeviceWithOrderNCHW() {
-  // Note(Yangqing): this one is copied from my Caffe implementation.
   auto& X = Input(0);
   auto* Y = Output(0);
   auto* scale = Output(1);
@@ -13,57 +113,51 @@ bool LRNOp<float, CPUContext>::RunOnDeviceWithOrderNCHW() {
   const int C = X.dim32(1);
   const int H = X.dim32(2);
   const int W = X.dim32(3);
-  const int image_size = C * H * W;
+  const int HxW = H * W;
   const float* Xdata = X.data<float>();
   Y->ResizeLike(X);
   scale->ResizeLike(X);
   float* Ydata = Y->mutable_data<float>();
   float* scale_data = scale->mutable_data<float>();
-  math::Set<float, CPUContext>(X.size(), bias_, scale_data, &context_);
-  TensorCPU padded_square(
-      vector<TIndex>{C + size_ - 1, H, W});
-  float* padded_square_data = padded_square.mutable_data<float>();
-  math::Set<float, CPUContext>(padded_square.size(), 0., padded_square_data,
-                               &context_);
   const float alpha_over_size = alpha_ / size_;
-  // go through the images
-  for (int n = 0; n < N; ++n) {
-    // compute the padded square
-    math::Sqr<float, CPUContext>(image_size, Xdata + image_size * n,
-                                 padded_square_data + pre_pad_ * H * W,
-                                 &context_);
-    // Create the first channel scale
-    for (int c = 0; c < size_; ++c) {
-      math::Axpy<float, CPUContext>(
-          H * W, alpha_over_size, padded_square_data + c * H * W,
-          scale_data + image_size * n, &context_);
+  const int post_pad = size_ - 1 - pre_pad_;
+
+  // Every task walks the channels of a block of pixels of an image.
+  ForEachPixelBlock(N, HxW, [&](const int n, const int begin, const int end) {
+    const int len = end - begin;
+    const int offset = n * C * HxW + begin;
+    auto square = [&](const int c) {
+      return ConstEigenVectorArrayMap<float>(Xdata + offset + c * HxW, len)
+          .square();
+    };
+    Eigen::Array<float, Eigen::Dynamic, 1> window =
+        Eigen::Array<float, Eigen::Dynamic, 1>::Zero(len);
+    for (int c = 0; c < std::min(post_pad, C); ++c) {
+      window += square(c);
     }
-    for (int c = 1; c < C; ++c) {
-      float* this_scale_slice = scale_data + n * image_size + c * H * W;
-      // copy previous scale
-      context_.Copy<float, CPUContext, CPUContext>(
-          H * W, this_scale_slice - H * W, this_scale_slice);
-      // add head
-      math::Axpy<float, CPUContext>(
-          H * W, alpha_over_size, padded_square_data + (c + size_ - 1) * H * W,
-          this_scale_slice, &context_);
-      // subtract tail
-      const float negative_aos = -alpha_over_size;
-      math::Axpy<float, CPUContext>(
-          H * W, -alpha_over_size, padded_square_data + (c - 1) * H * W,
-          this_scale_slice, &context_);
+    for (int c = 0; c < C; ++c) {
+      if (c + post_pad < C) {
+        window += square(c + post_pad);
+      }
+      const int channel_offset = offset + c * HxW;
+      EigenVectorArrayMap<float>(scale_data + channel_offset, len) =
+          window * alpha_over_size + bias_;
+      MulPowNegBeta(
+          len,
+          Xdata + channel_offset,
+          scale_data + channel_offset,
+          beta_,
+          Ydata + channel_offset);
+      if (c >= pre_pad_) {
+        window -= square(c - pre_pad_);
+      }
     }
-  }
-  math::Powx<float, CPUContext>(
-      X.size(), scale_data, -beta_, Ydata, &context_);
-  math::Mul<float, CPUContext>(X.size(), Ydata, Xdata, Ydata, &context_);
+  });
   return true;
 }
 
 template<>
 bool LRNOp<float, CPUContext>::RunOnDeviceWithOrderNHWC() {
-  // Note(Yangqing): This one is copied from my Decaf implementation. How many
-  // variants have I written...?
   auto& X = Input(0);
   auto* Y = Output(0);
   auto* scale = Output(1);
@@ -78,34 +172,29 @@ bool LRNOp<float, CPUContext>::RunOnDeviceWithOrderNHWC() {
   scale->ResizeLike(X);
   float* Ydata = Y->mutable_data<float>();
   float* scale_data = scale->mutable_data<float>();
-
-  TensorCPU padded_square(vector<TIndex>(1, C + size_ - 1));
-  float* padded_square_data = padded_square.mutable_data<float>();
-  math::Set<float, CPUContext>(padded_square.size(), 0., padded_square_data,
-                               &context_);
   const float alpha_over_size = alpha_ / size_;
+  const int post_pad = size_ - 1 - pre_pad_;
 
-  for (int n = 0; n < num_rows; ++n) {
-    for (int c = 0; c < C; ++c) {
-      padded_square_data[c + pre_pad_] =
-          Xdata[n * C + c] * Xdata[n * C + c] * alpha_over_size;
-    }
-    float accum_scale = 0.;
-    for (int i = 0; i < size_ - 1; ++i) {
-      accum_scale += padded_square_data[i];
+  ForEachRowRange(num_rows, C, [&](const int begin, const int end) {
+    vector<float> square(C);
+    for (int n = begin; n < end; ++n) {
+      const float* x = Xdata + n * C;
+      float* s = scale_data + n * C;
+      EigenVectorArrayMap<float>(square.data(), C) =
+          ConstEigenVectorArrayMap<float>(x, C).square();
+      WindowSum(C, pre_pad_, post_pad, square.data(), s);
+      EigenVectorArrayMap<float> s_arr(s, C);
+      s_arr = s_arr * alpha_over_size + bias_;
+      MulPowNegBeta(C, x, s, beta_, Ydata + n * C);
     }
-    for (int c = 0; c < C; ++c) {
-      accum_scale += padded_square_data[c + size_ - 1];
-      scale_data[n * C + c] = bias_ + accum_scale;
-      accum_scale -= padded_square_data[c];
-    }
-  }
-  math::Powx<float, CPUContext>(
-      X.size(), scale_data, -beta_, Ydata, &context_);
-  math::Mul<float, CPUContext>(X.size(), Ydata, Xdata, Ydata, &context_);
+  });
   return true;
 }
 
+// dX = dY * scale^-beta - 2 * alpha * beta / size * X * the sum of
+// dY * Y / scale over the channels whose window holds the channel, that is the
+// transposed window [c - post_pad, c + pre_pad_]. The two only differ for an
+// even size.
 template <>
 bool LRNGradientOp<float, CPUContext>::RunOnDeviceWithOrderNCHW() {
   auto& X = Input(0);
@@ -118,7 +207,7 @@ bool LRNGradientOp<float, CPUContext>::RunOnDeviceWithOrderNCHW() {
   const int C = X.dim32(1);
   const int H = X.dim32(2);
   const int W = X.dim32(3);
-  const int image_size = C * H * W;
+  const int HxW = H * W;
   // Loosely checking the size, assuming that the shapes will be the same as
   // long as the sizes check out.
   DCHECK_EQ(X.size(), Y.size());
@@ -131,48 +220,42 @@ bool LRNGradientOp<float, CPUContext>::RunOnDeviceWithOrderNCHW() {
   const float* scale_data = scale.data<float>();
   const float* dYdata = dY.data<float>();
   float* dXdata = dX->mutable_data<float>();
-
-  TensorCPU padded_ratio(
-      vector<TIndex>{C + size_ - 1, H, W});
-  float* padded_ratio_data = padded_ratio.mutable_data<float>();
-  math::Set<float, CPUContext>(padded_ratio.size(), 0., padded_ratio_data,
-                               &context_);
-  TensorCPU accum_ratio(vector<TIndex>{H, W});
-  float* accum_ratio_data = accum_ratio.mutable_data<float>();
-
-
   const float cache_ratio = 2. * alpha_ * beta_ / size_;
-  const int inverse_pre_pad = size_ - (size_ + 1) / 2;
-
-  int offset = 0;
-  for (int n = 0; n < N; ++n) {
-    // first, compute diff_i * y_i / s_i
-    math::Mul<float, CPUContext>(
-        image_size, dYdata + offset, Ydata + offset,
-        padded_ratio_data + inverse_pre_pad * H * W, &context_);
-    math::Div<float, CPUContext>(
-        image_size, padded_ratio_data + inverse_pre_pad * H * W,
-        scale_data + offset,
-        padded_ratio_data + inverse_pre_pad * H * W, &context_);
-    // Now, compute the accumulated ratios and the bottom diff
-    math::Set<float, CPUContext>(accum_ratio.size(), 0., accum_ratio_data,
-                                 &context_);
-    for (int c = 0; c < size_ - 1; ++c) {
-      math::Axpy<float, CPUContext>(H * W, 1,
-                                    padded_ratio_data + c * H * W,
-                                    accum_ratio_data, &context_);
+  const int post_pad = size_ - 1 - pre_pad_;
+
+  ForEachPixelBlock(N, HxW, [&](const int n, const int begin, const int end) {
+    const int len = end - begin;
+    const int offset = n * C * HxW + begin;
+    auto ratio = [&](const int c) {
+      const int channel_offset = offset + c * HxW;
+      return ConstEigenVectorArrayMap<float>(dYdata + channel_offset, len) *
+          ConstEigenVectorArrayMap<float>(Ydata + channel_offset, len) /
+          ConstEigenVectorArrayMap<float>(scale_data + channel_offset, len);
+    };
+    Eigen::Array<float, Eigen::Dynamic, 1> window =
+        Eigen::Array<float, Eigen::Dynamic, 1>::Zero(len);
+    for (int c = 0; c < std::min(pre_pad_, C); ++c) {
+      window += ratio(c);
     }
     for (int c = 0; c < C; ++c) {
-      for (int hw = 0; hw < H * W; ++hw) {
-        accum_ratio_data[hw] += padded_ratio_data[(c + size_ - 1) * H * W + hw];
-        dXdata[offset] =
-            dYdata[offset] * pow(scale_data[offset], -beta_) -
-            cache_ratio * accum_ratio_data[hw] * Xdata[offset];
-        accum_ratio_data[hw] -= padded_ratio_data[c * H * W + hw];
-        ++offset;
+      if (c + pre_pad_ < C) {
+        window += ratio(c + pre_pad_);
+      }
+      const int channel_offset = offset + c * HxW;
+      MulPowNegBeta(
+          len,
+          dYdata + channel_offset,
+          scale_data + channel_offset,
+          beta_,
+          dXdata + channel_offset);
+      EigenVectorArrayMap<float>(dXdata + channel_offset, len) -=
+          ConstEigenVectorArrayMap<float>(Xdata + channel_offset, len) *
+          window * cache_ratio;
+      if (c >= post_pad) {
+        window -= ratio(c - post_pad);
       }
     }
-  }
+  });
   return true;
 }
 
@@ -194,36 +277,33 @@ bool LRNGradientOp<float, CPUContext>::RunOnDeviceWithOrderNHWC() {
   DCHECK_EQ(X.size(), scale.size());
   DCHECK_EQ(X.size(), dY.size());
   dX->ResizeLike(X);
-  TensorCPU padded_ratio(vector<TIndex>(1, C + size_ - 1));
-  float* padded_ratio_data = padded_ratio.mutable_data<float>();
-  math::Set<float, CPUContext>(padded_ratio.size(), 0., padded_ratio_data,
-                               &context_);
   // the ratio 2*alpha*beta/size
   const float cache_ratio = 2. * alpha_ * beta_ / size_;
   const int num_rows = N * H * W;
+  const int post_pad = size_ - 1 - pre_pad_;
   const float* Xdata = X.data<float>();
   const float* Ydata = Y.data<float>();
   const float* scale_data = scale.data<float>();
   const float* dYdata = dY.data<float>();
   float* dXdata = dX->mutable_data<float>();
-  for (int n = 0; n < num_rows; ++n) {
-    const int offset = n * C;
-    for (int c = 0; c < C; ++c) {
-      padded_ratio_data[c + pre_pad_] =
-          Ydata[offset + c] * dYdata[offset + c] / scale_data[offset + c];
-    }
-    float accum_ratio = 0.;
-    for (int c = 0; c < size_ - 1; ++c) {
-      accum_ratio += padded_ratio_data[c];
-    }
-    for (int c = 0; c < C; ++c) {
-      accum_ratio += padded_ratio_data[c + size_ - 1];
-      dXdata[offset + c] =
-          dYdata[offset + c] * pow(scale_data[offset + c], -beta_) -
-          cache_ratio * Xdata[offset + c] * accum_ratio;
-      accum_ratio -= padded_ratio_data[c];
+
+  ForEachRowRange(num_rows, C, [&](const int begin, const int end) {
+    vector<float> ratio(C);
+    vector<float> window(C);
+    for (int n = begin; n < end; ++n) {
+      const int offset = n * C;
+      EigenVectorArrayMap<float>(ratio.data(), C) =
+          ConstEigenVectorArrayMap<float>(Ydata + offset, C) *
+          ConstEigenVectorArrayMap<float>(dYdata + offset, C) /
+          ConstEigenVectorArrayMap<float>(scale_data + offset, C);
+      WindowSum(C, post_pad, pre_pad_, ratio.data(), window.data());
+      MulPowNegBeta(
+          C, dYdata + offset, scale_data + offset, beta_, dXdata + offset);
+      EigenVectorArrayMap<float>(dXdata + offset, C) -=
+          ConstEigenVectorArrayMap<float>(Xdata + offset, C) *
+          ConstEigenVectorArrayMap<float>(window.data(), C) * cache_ratio;
     }
-  }
+  });
   return true;
 }
 
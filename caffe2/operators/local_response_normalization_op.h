@@ -22,7 +22,6 @@ class LRNOpBase : public Operator<Context> {
             OperatorBase::GetSingleArgument<string>("order", "NHWC"))),
         pre_pad_((size_ - 1) / 2) {
     DCHECK_GT(size_, 0);
-    DCHECK_EQ(size_ % 2, 1);
     DCHECK_GT(alpha_, 0);
     DCHECK_GT(beta_, 0);
   }
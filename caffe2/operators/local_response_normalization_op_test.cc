@@ -0,0 +1,128 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static void AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(-2, 2);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+}
+
+static const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+// Checks LRN and its gradient against their definitions computed in double.
+static void CheckLRN(
+    const string& order,
+    const int N,
+    const int C,
+    const int H,
+    const int W,
+    const int size,
+    const float beta) {
+  Workspace ws;
+  std::mt19937 gen(5);
+  const bool nchw = order == "NCHW";
+  const vector<TIndex> shape =
+      nchw ? vector<TIndex>{N, C, H, W} : vector<TIndex>{N, H, W, C};
+  AddInput(shape, "X", &gen, &ws);
+  AddInput(shape, "dY", &gen, &ws);
+  const float alpha = 0.3, bias = 1.5;
+  const vector<Argument> args{MakeArgument("size", size),
+                              MakeArgument("alpha", alpha),
+                              MakeArgument("beta", beta),
+                              MakeArgument("bias", bias),
+                              MakeArgument("order", order)};
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "LRN", "", vector<string>{"X"}, vector<string>{"Y", "scale"}, args)));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "LRNGradient",
+      "",
+      vector<string>{"X", "Y", "scale", "dY"},
+      vector<string>{"dX"},
+      args)));
+
+  // The window of channel c is [c - pre_pad, c + post_pad], which is not
+  // symmetric for an even size.
+  const int HxW = H * W, pre_pad = (size - 1) / 2,
+            post_pad = size - 1 - pre_pad;
+  auto index = [&](int n, int c, int i) {
+    return nchw ? (n * C + c) * HxW + i : (n * HxW + i) * C + c;
+  };
+  const float* X = Data(&ws, "X");
+  const float* dY = Data(&ws, "dY");
+  vector<double> scale(N * C * HxW);
+  for (int n = 0; n < N; ++n) {
+    for (int i = 0; i < HxW; ++i) {
+      for (int c = 0; c < C; ++c) {
+        double sum = 0;
+        for (int j = std::max(0, c - pre_pad);
+             j <= std::min(C - 1, c + post_pad);
+             ++j) {
+          sum += X[index(n, j, i)] * X[index(n, j, i)];
+        }
+        scale[index(n, c, i)] = bias + alpha / size * sum;
+      }
+    }
+  }
+  for (int n = 0; n < N; ++n) {
+    for (int i = 0; i < HxW; ++i) {
+      for (int c = 0; c < C; ++c) {
+        const int k = index(n, c, i);
+        const double y = X[k] * std::pow(scale[k], -beta);
+        EXPECT_NEAR(Data(&ws, "scale")[k], scale[k], 1e-5);
+        EXPECT_NEAR(Data(&ws, "Y")[k], y, 1e-5);
+        // The channels l whose window holds c.
+        double ratio = 0;
+        for (int j = std::max(0, c - post_pad);
+             j <= std::min(C - 1, c + pre_pad);
+             ++j) {
+          const int l = index(n, j, i);
+          ratio += dY[l] * X[l] * std::pow(scale[l], -beta) / scale[l];
+        }
+        const double dX = dY[k] * std::pow(scale[k], -beta) -
+            2 * alpha * beta / size * X[k] * ratio;
+        EXPECT_NEAR(Data(&ws, "dX")[k], dX, 1e-5);
+      }
+    }
+  }
+}
+
+TEST(LRNTest, NCHW) {
+  // More pixels than a block, to cover a partial one.
+  CheckLRN("NCHW", 2, 7, 33, 33, 5, 0.75);
+  CheckLRN("NCHW", 1, 4, 3, 5, 3, 0.6);
+  CheckLRN("NCHW", 2, 2, 3, 3, 5, 1);
+}
+
+TEST(LRNTest, NCHWEvenSize) {
+  CheckLRN("NCHW", 2, 7, 3, 5, 4, 0.75);
+  CheckLRN("NCHW", 1, 3, 3, 3, 2, 0.6);
+}
+
+TEST(LRNTest, NHWC) {
+  CheckLRN("NHWC", 2, 9, 5, 7, 5, 0.75);
+  CheckLRN("NHWC", 1, 4, 3, 5, 3, 0.6);
+  CheckLRN("NHWC", 2, 2, 3, 3, 5, 0.5);
+}
+
+TEST(LRNTest, NHWCEvenSize) {
+  CheckLRN("NHWC", 2, 7, 3, 5, 4, 0.75);
+  CheckLRN("NHWC", 1, 3, 3, 3, 2, 0.6);
+}
+
+} // namespace caffe2
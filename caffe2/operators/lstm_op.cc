@@ -0,0 +1,642 @@
+#include "caffe2/operators/lstm_op.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+// tanh on [-9, 9] as a ratio of an odd polynomial of degree 13 and an even
+// polynomial of degree 6, accurate to a few ulps; tanh is +/-1 in float
+// outside of that range. sigmoid(x) is 0.5 + 0.5 * tanh(x / 2).
+constexpr float kTanhClamp = 9.f;
+constexpr float kAlpha1 = 4.89352455891786e-03f;
+constexpr float kAlpha3 = 6.37261928875436e-04f;
+constexpr float kAlpha5 = 1.48572235717979e-05f;
+constexpr float kAlpha7 = 5.12229709037114e-08f;
+constexpr float kAlpha9 = -8.60467152213735e-11f;
+constexpr float kAlpha11 = 2.00018790482477e-13f;
+constexpr float kAlpha13 = -2.76076847742355e-16f;
+constexpr float kBeta0 = 4.89352518554385e-03f;
+constexpr float kBeta2 = 2.26843463243900e-03f;
+constexpr float kBeta4 = 1.18534705686654e-04f;
+constexpr float kBeta6 = 1.19825839466702e-06f;
+
+inline float FastTanh(float x) {
+  x = std::max(-kTanhClamp, std::min(kTanhClamp, x));
+  const float x2 = x * x;
+  float p = x2 * kAlpha13 + kAlpha11;
+  p = x2 * p + kAlpha9;
+  p = x2 * p + kAlpha7;
+  p = x2 * p + kAlpha5;
+  p = x2 * p + kAlpha3;
+  p = x2 * p + kAlpha1;
+  p = x * p;
+  float q = x2 * kBeta6 + kBeta4;
+  q = x2 * q + kBeta2;
+  q = x2 * q + kBeta0;
+  return p / q;
+}
+
+inline float FastSigmoid(const float x) {
+  return 0.5f + 0.5f * FastTanh(0.5f * x);
+}
+
+#if defined(__AVX__)
+inline __m256 MulAdd(const __m256 a, const __m256 b, const __m256 c) {
+#if defined(__FMA__)
+  return _mm256_fmadd_ps(a, b, c);
+#else
+  return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+inline __m256 FastTanh(__m256 x) {
+  x = _mm256_max_ps(
+      _mm256_set1_ps(-kTanhClamp),
+      _mm256_min_ps(_mm256_set1_ps(kTanhClamp), x));
+  const __m256 x2 = _mm256_mul_ps(x, x);
+  __m256 p = MulAdd(x2, _mm256_set1_ps(kAlpha13), _mm256_set1_ps(kAlpha11));
+  p = MulAdd(x2, p, _mm256_set1_ps(kAlpha9));
+  p = MulAdd(x2, p, _mm256_set1_ps(kAlpha7));
+  p = MulAdd(x2, p, _mm256_set1_ps(kAlpha5));
+  p = MulAdd(x2, p, _mm256_set1_ps(kAlpha3));
+  p = MulAdd(x2, p, _mm256_set1_ps(kAlpha1));
+  p = _mm256_mul_ps(x, p);
+  __m256 q = MulAdd(x2, _mm256_set1_ps(kBeta6), _mm256_set1_ps(kBeta4));
+  q = MulAdd(x2, q, _mm256_set1_ps(kBeta2));
+  q = MulAdd(x2, q, _mm256_set1_ps(kBeta0));
+  return _mm256_div_ps(p, q);
+}
+
+inline __m256 FastSigmoid(const __m256 x) {
+  const __m256 half = _mm256_set1_ps(0.5f);
+  return MulAdd(half, FastTanh(_mm256_mul_ps(half, x)), half);
+}
+#endif
+
+} // namespace
+
+namespace detail {
+
+void LSTMGates(
+    const int N,
+    const int D,
+    const int t,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    float* C,
+    float* H) {
+  for (int n = 0; n < N; ++n) {
+    if (seqLengths != nullptr && t >= seqLengths[n]) {
+      std::fill(H, H + D, 0.f);
+      std::memcpy(C, C_prev, D * sizeof(float));
+    } else {
+      int d = 0;
+#if defined(__AVX__)
+      for (; d + 8 <= D; d += 8) {
+        const __m256 i = FastSigmoid(_mm256_loadu_ps(X + d));
+        const __m256 f = FastSigmoid(_mm256_loadu_ps(X + D + d));
+        const __m256 o = FastSigmoid(_mm256_loadu_ps(X + 2 * D + d));
+        const __m256 g = FastTanh(_mm256_loadu_ps(X + 3 * D + d));
+        const __m256 c =
+            MulAdd(f, _mm256_loadu_ps(C_prev + d), _mm256_mul_ps(i, g));
+        _mm256_storeu_ps(C + d, c);
+        _mm256_storeu_ps(H + d, _mm256_mul_ps(o, FastTanh(c)));
+      }
+#endif
+      for (; d < D; ++d) {
+        const float i = FastSigmoid(X[d]);
+        const float f = FastSigmoid(X[D + d]);
+        const float o = FastSigmoid(X[2 * D + d]);
+        const float g = FastTanh(X[3 * D + d]);
+        const float c = f * C_prev[d] + i * g;
+        C[d] = c;
+        H[d] = o * FastTanh(c);
+      }
+    }
+    C_prev += D;
+    X += 4 * D;
+    C += D;
+    H += D;
+  }
+}
+
+} // namespace detail
+
+namespace {
+
+// Sets the gates (M x 4D) to the projection of the input X (M x I) by W_x
+// (4D x I), plus the bias b.
+void ProjectInput(
+    const int M,
+    const int G,
+    const int I,
+    const float* X,
+    const float* W_x,
+    const float* b,
+    float* gates,
+    CPUContext* context) {
+  for (int r = 0; r < M; ++r) {
+    context->Copy<float, CPUContext, CPUContext>(G, b, gates + r * G);
+  }
+  math::Gemm<float, CPUContext>(
+      CblasNoTrans, CblasTrans, M, G, I, 1, X, W_x, 1, gates, context);
+}
+
+// Runs timestep t of a layer: adds the projection of the previous hidden state
+// to the gates, which hold the projection of the input, and applies them.
+void LSTMStep(
+    const int N,
+    const int D,
+    const int t,
+    const int maxLength,
+    const int32_t* seqLengths,
+    const float* W_h,
+    const float* H_prev,
+    const float* C_prev,
+    float* gates,
+    float* C,
+    float* H,
+    CPUContext* context) {
+  // Past the longest sequence the gates are not used.
+  if (t < maxLength) {
+    math::Gemm<float, CPUContext>(
+        CblasNoTrans,
+        CblasTrans,
+        N,
+        4 * D,
+        D,
+        1,
+        H_prev,
+        W_h,
+        1,
+        gates,
+        context);
+  }
+  detail::LSTMGates(N, D, t, C_prev, gates, seqLengths, C, H);
+}
+
+int MaxLength(const TensorCPU& seqLengths) {
+  const int32_t* lengths = seqLengths.data<int32_t>();
+  return seqLengths.size() > 0
+      ? *std::max_element(lengths, lengths + seqLengths.size())
+      : 0;
+}
+
+} // namespace
+
+bool LSTMOp::RunOnDevice() {
+  if (packed_) {
+    return RunPacked();
+  }
+  const auto& X = Input(INPUT);
+  const auto& seqLengths = Input(SEQ_LENGTHS);
+  const auto& W_x = Input(INPUT_WEIGHT);
+  const auto& W_h = Input(RECURRENT_WEIGHT);
+  const auto& b = Input(BIAS);
+  const auto& H_0 = Input(HIDDEN_INPUT);
+  const auto& C_0 = Input(CELL_INPUT);
+  CAFFE_ENFORCE_EQ(X.ndim(), 3, "INPUT must be T x N x input_size");
+  const int T = X.dim32(0);
+  const int N = X.dim32(1);
+  const int I = X.dim32(2);
+  CAFFE_ENFORCE_EQ(H_0.ndim(), 3, "HIDDEN_INPUT must be 1 x N x D");
+  const int D = H_0.dim32(2);
+  const int G = 4 * D;
+  CAFFE_ENFORCE_EQ(H_0.dim32(0), 1);
+  CAFFE_ENFORCE_EQ(H_0.dim32(1), N);
+  CAFFE_ENFORCE(C_0.dims() == H_0.dims(), "CELL_INPUT must be 1 x N x D");
+  CAFFE_ENFORCE_EQ(seqLengths.size(), N, "SEQ_LENGTHS must have N entries");
+  CAFFE_ENFORCE_EQ(W_x.ndim(), 2);
+  CAFFE_ENFORCE_EQ(W_x.dim32(0), G, "INPUT_WEIGHT must be 4D x input_size");
+  CAFFE_ENFORCE_EQ(W_x.dim32(1), I, "INPUT_WEIGHT must be 4D x input_size");
+  CAFFE_ENFORCE_EQ(W_h.ndim(), 2);
+  CAFFE_ENFORCE_EQ(W_h.dim32(0), G, "RECURRENT_WEIGHT must be 4D x D");
+  CAFFE_ENFORCE_EQ(W_h.dim32(1), D, "RECURRENT_WEIGHT must be 4D x D");
+  CAFFE_ENFORCE_EQ(b.size(), G, "BIAS must have 4D entries");
+
+  auto* output = Output(OUTPUT);
+  auto* H_T = Output(HIDDEN_OUTPUT);
+  auto* C_T = Output(CELL_OUTPUT);
+  output->Resize(T, N, D);
+  H_T->Resize(1, N, D);
+  C_T->Resize(1, N, D);
+  const int32_t* lengths = seqLengths.data<int32_t>();
+  float* out = output->mutable_data<float>();
+  float* c = C_T->mutable_data<float>();
+  context_.Copy<float, CPUContext, CPUContext>(
+      N * D, C_0.data<float>(), c);
+  if (T == 0) {
+    context_.Copy<float, CPUContext, CPUContext>(
+        N * D, H_0.data<float>(), H_T->mutable_data<float>());
+    return true;
+  }
+
+  // The input projection of all the timesteps, plus the bias.
+  gates_.Resize(T, N, G);
+  float* gates = gates_.mutable_data<float>();
+  ProjectInput(
+      T * N,
+      G,
+      I,
+      X.data<float>(),
+      W_x.data<float>(),
+      b.data<float>(),
+      gates,
+      &context_);
+
+  const int maxLength = MaxLength(seqLengths);
+  cell_.Resize(N, D);
+  float* c_prev = cell_.mutable_data<float>();
+  const float* h_prev = H_0.data<float>();
+  for (int t = 0; t < T; ++t) {
+    float* h = out + t * N * D;
+    std::swap(c, c_prev);
+    LSTMStep(
+        N,
+        D,
+        t,
+        maxLength,
+        lengths,
+        W_h.data<float>(),
+        h_prev,
+        c_prev,
+        gates + t * N * G,
+        c,
+        h,
+        &context_);
+    h_prev = h;
+  }
+  context_.Copy<float, CPUContext, CPUContext>(
+      N * D, h_prev, H_T->mutable_data<float>());
+  if (c != C_T->mutable_data<float>()) {
+    context_.Copy<float, CPUContext, CPUContext>(
+        N * D, c, C_T->mutable_data<float>());
+  }
+  return true;
+}
+
+bool LSTMOp::RunPacked() {
+  const auto& X = Input(INPUT);
+  const auto& batchSizes = Input(SEQ_LENGTHS);
+  const auto& W_x = Input(INPUT_WEIGHT);
+  const auto& W_h = Input(RECURRENT_WEIGHT);
+  const auto& b = Input(BIAS);
+  const auto& H_0 = Input(HIDDEN_INPUT);
+  const auto& C_0 = Input(CELL_INPUT);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "Packed INPUT must be total_length x I");
+  const int I = X.dim32(1);
+  CAFFE_ENFORCE_EQ(H_0.ndim(), 3, "HIDDEN_INPUT must be 1 x N x D");
+  CAFFE_ENFORCE_EQ(H_0.dim32(0), 1);
+  const int N = H_0.dim32(1);
+  const int D = H_0.dim32(2);
+  const int G = 4 * D;
+  CAFFE_ENFORCE(C_0.dims() == H_0.dims(), "CELL_INPUT must be 1 x N x D");
+  CAFFE_ENFORCE_EQ(batchSizes.ndim(), 1, "BATCH_SIZES must be 1-D");
+  const int T = batchSizes.dim32(0);
+  const int* bs = batchSizes.data<int>();
+  TIndex totalLength = 0;
+  for (int t = 0; t < T; ++t) {
+    CAFFE_ENFORCE(
+        bs[t] > 0 && bs[t] <= (t == 0 ? N : bs[t - 1]),
+        "BATCH_SIZES must be positive, non-increasing and at most N");
+    totalLength += bs[t];
+  }
+  CAFFE_ENFORCE_EQ(totalLength, X.dim(0), "BATCH_SIZES must sum to INPUT");
+  CAFFE_ENFORCE_EQ(W_x.ndim(), 2);
+  CAFFE_ENFORCE_EQ(W_x.dim32(0), G, "INPUT_WEIGHT must be 4D x input_size");
+  CAFFE_ENFORCE_EQ(W_x.dim32(1), I, "INPUT_WEIGHT must be 4D x input_size");
+  CAFFE_ENFORCE_EQ(W_h.ndim(), 2);
+  CAFFE_ENFORCE_EQ(W_h.dim32(0), G, "RECURRENT_WEIGHT must be 4D x D");
+  CAFFE_ENFORCE_EQ(W_h.dim32(1), D, "RECURRENT_WEIGHT must be 4D x D");
+  CAFFE_ENFORCE_EQ(b.size(), G, "BIAS must have 4D entries");
+
+  auto* output = Output(OUTPUT);
+  auto* H_T = Output(HIDDEN_OUTPUT);
+  auto* C_T = Output(CELL_OUTPUT);
+  output->Resize(totalLength, D);
+  H_T->CopyFrom(H_0, &context_);
+  C_T->CopyFrom(C_0, &context_);
+  float* out = output->mutable_data<float>();
+  float* h_last = H_T->mutable_data<float>();
+  float* c = C_T->mutable_data<float>();
+  gates_.Resize(totalLength, G);
+  float* gates = gates_.mutable_data<float>();
+  ProjectInput(
+      totalLength,
+      G,
+      I,
+      X.data<float>(),
+      W_x.data<float>(),
+      b.data<float>(),
+      gates,
+      &context_);
+
+  // The sequences that are active at timestep t are the first bs[t] ones, so
+  // their hidden states at t - 1 are the first rows of the block of t - 1,
+  // and their cell states can be updated in place.
+  const float* h_prev = H_0.data<float>();
+  TIndex offset = 0;
+  for (int t = 0; t < T; ++t) {
+    float* h = out + offset * D;
+    LSTMStep(
+        bs[t],
+        D,
+        t,
+        T,
+        nullptr,
+        W_h.data<float>(),
+        h_prev,
+        c,
+        gates + offset * G,
+        c,
+        h,
+        &context_);
+    // The hidden state of the sequences that end at this timestep.
+    const int next = t + 1 < T ? bs[t + 1] : 0;
+    context_.Copy<float, CPUContext, CPUContext>(
+        (bs[t] - next) * D, h + next * D, h_last + next * D);
+    h_prev = h;
+    offset += bs[t];
+  }
+  return true;
+}
+
+bool StackedLSTMOp::RunOnDevice() {
+  const auto& X = Input(INPUT);
+  const auto& seqLengths = Input(SEQ_LENGTHS);
+  const auto& H_0 = Input(HIDDEN_INPUT);
+  const auto& C_0 = Input(CELL_INPUT);
+  CAFFE_ENFORCE_EQ(
+      (InputSize() - CELL_INPUT - 1) % 3,
+      0,
+      "Every layer needs an input weight, a recurrent weight and a bias");
+  numLayers_ = (InputSize() - CELL_INPUT - 1) / 3;
+  CAFFE_ENFORCE_GT(numLayers_, 0);
+  CAFFE_ENFORCE_EQ(X.ndim(), 3, "INPUT must be T x N x input_size");
+  const int T = X.dim32(0);
+  const int N = X.dim32(1);
+  const int I = X.dim32(2);
+  CAFFE_ENFORCE_EQ(H_0.ndim(), 3, "HIDDEN_INPUT must be L x N x D");
+  CAFFE_ENFORCE_EQ(H_0.dim32(0), numLayers_);
+  CAFFE_ENFORCE_EQ(H_0.dim32(1), N);
+  const int D = H_0.dim32(2);
+  const int G = 4 * D;
+  CAFFE_ENFORCE(C_0.dims() == H_0.dims(), "CELL_INPUT must be L x N x D");
+  CAFFE_ENFORCE_EQ(seqLengths.size(), N, "SEQ_LENGTHS must have N entries");
+  for (int l = 0; l < numLayers_; ++l) {
+    const auto& W_x = Input(CELL_INPUT + 1 + 3 * l);
+    const auto& W_h = Input(CELL_INPUT + 2 + 3 * l);
+    const auto& b = Input(CELL_INPUT + 3 + 3 * l);
+    CAFFE_ENFORCE_EQ(W_x.ndim(), 2);
+    CAFFE_ENFORCE_EQ(W_x.dim32(0), G, "Bad input weight of layer ", l);
+    CAFFE_ENFORCE_EQ(
+        W_x.dim32(1), l == 0 ? I : D, "Bad input weight of layer ", l);
+    CAFFE_ENFORCE_EQ(W_h.ndim(), 2);
+    CAFFE_ENFORCE_EQ(W_h.dim32(0), G, "Bad recurrent weight of layer ", l);
+    CAFFE_ENFORCE_EQ(W_h.dim32(1), D, "Bad recurrent weight of layer ", l);
+    CAFFE_ENFORCE_EQ(b.size(), G, "Bad bias of layer ", l);
+  }
+
+  Output(OUTPUT)->Resize(T, N, D);
+  Output(HIDDEN_OUTPUT)->Resize(numLayers_, N, D);
+  Output(CELL_OUTPUT)->Resize(numLayers_, N, D);
+  if (T == 0) {
+    Output(HIDDEN_OUTPUT)->CopyFrom(H_0, &context_);
+    Output(CELL_OUTPUT)->CopyFrom(C_0, &context_);
+    return true;
+  }
+  maxLength_ = MaxLength(seqLengths);
+  // The cell state of timestep t is in slot t % 2, starting from the initial
+  // state in slot 1.
+  cells_.Resize(numLayers_, 2, N, D);
+  float* cells = cells_.mutable_data<float>();
+  for (int l = 0; l < numLayers_; ++l) {
+    context_.Copy<float, CPUContext, CPUContext>(
+        N * D, C_0.data<float>() + l * N * D, cells + (2 * l + 1) * N * D);
+  }
+  if (numLayers_ > 1 && ThreadPool::Default()->EffectiveNumThreads() > 1) {
+    RunWavefront(T, N, I, D);
+  } else {
+    RunLayers(T, N, I, D);
+  }
+  float* C_T = Output(CELL_OUTPUT)->mutable_data<float>();
+  for (int l = 0; l < numLayers_; ++l) {
+    context_.Copy<float, CPUContext, CPUContext>(
+        N * D, cells + (2 * l + (T - 1) % 2) * N * D, C_T + l * N * D);
+  }
+  return true;
+}
+
+void StackedLSTMOp::RunLayers(
+    const int T,
+    const int N,
+    const int I,
+    const int D) {
+  const int G = 4 * D;
+  const int32_t* lengths = Input(SEQ_LENGTHS).data<int32_t>();
+  const float* H_0 = Input(HIDDEN_INPUT).data<float>();
+  float* H_T = Output(HIDDEN_OUTPUT)->mutable_data<float>();
+  float* cells = cells_.mutable_data<float>();
+  gates_.Resize(T, N, G);
+  float* gates = gates_.mutable_data<float>();
+  // The outputs of the layers below the last one alternate between two
+  // buffers.
+  hidden_.Resize(std::min(numLayers_ - 1, 2), T, N, D);
+  const float* input = Input(INPUT).data<float>();
+  int inputSize = I;
+  for (int l = 0; l < numLayers_; ++l) {
+    float* output = l == numLayers_ - 1
+        ? Output(OUTPUT)->mutable_data<float>()
+        : hidden_.mutable_data<float>() + (l % 2) * T * N * D;
+    ProjectInput(
+        T * N, G, inputSize, input, InputWeight(l), Bias(l), gates, &context_);
+    const float* h_prev = H_0 + l * N * D;
+    float* c = cells + 2 * l * N * D;
+    for (int t = 0; t < T; ++t) {
+      float* h = output + t * N * D;
+      LSTMStep(
+          N,
+          D,
+          t,
+          maxLength_,
+          lengths,
+          RecurrentWeight(l),
+          h_prev,
+          c + ((t + 1) % 2) * N * D,
+          gates + t * N * G,
+          c + (t % 2) * N * D,
+          h,
+          &context_);
+      h_prev = h;
+    }
+    context_.Copy<float, CPUContext, CPUContext>(
+        N * D, h_prev, H_T + l * N * D);
+    input = output;
+    inputSize = D;
+  }
+}
+
+void StackedLSTMOp::RunWavefront(
+    const int T,
+    const int N,
+    const int I,
+    const int D) {
+  const int L = numLayers_;
+  const int G = 4 * D;
+  const int32_t* lengths = Input(SEQ_LENGTHS).data<int32_t>();
+  const float* H_0 = Input(HIDDEN_INPUT).data<float>();
+  float* H_T = Output(HIDDEN_OUTPUT)->mutable_data<float>();
+  float* output = Output(OUTPUT)->mutable_data<float>();
+  float* cells = cells_.mutable_data<float>();
+  // The gates of all the timesteps of the first layer, whose input projection
+  // is done beforehand, followed by the gates of the timestep in flight of
+  // every other layer.
+  gates_.Resize(T + L - 1, N, G);
+  float* gates = gates_.mutable_data<float>();
+  ProjectInput(
+      T * N,
+      G,
+      I,
+      Input(INPUT).data<float>(),
+      InputWeight(0),
+      Bias(0),
+      gates,
+      &context_);
+  // The outputs of the layers below the last one, of timestep t in slot
+  // t % 2: cell (l, t) reads timestep t of layer l - 1 while cell (l - 1,
+  // t + 1) of the same wavefront writes the other slot.
+  hidden_.Resize(L - 1, 2, N, D);
+  float* hidden = hidden_.mutable_data<float>();
+  auto h_of = [&](const int l, const int t) {
+    return l == L - 1 ? output + t * N * D : hidden + (2 * l + t % 2) * N * D;
+  };
+  auto cell = [&](const size_t i, const int w) {
+    const int l = std::max(0, w - T + 1) + i;
+    const int t = w - l;
+    float* gates_t = gates + t * N * G;
+    if (l > 0) {
+      gates_t = gates + (T + l - 1) * N * G;
+      ProjectInput(
+          N, G, D, h_of(l - 1, t), InputWeight(l), Bias(l), gates_t, &context_);
+    }
+    float* c = cells + 2 * l * N * D;
+    float* h = h_of(l, t);
+    LSTMStep(
+        N,
+        D,
+        t,
+        maxLength_,
+        lengths,
+        RecurrentWeight(l),
+        t == 0 ? H_0 + l * N * D : h_of(l, t - 1),
+        c + ((t + 1) % 2) * N * D,
+        gates_t,
+        c + (t % 2) * N * D,
+        h,
+        &context_);
+    if (t == T - 1) {
+      context_.Copy<float, CPUContext, CPUContext>(N * D, h, H_T + l * N * D);
+    }
+  };
+  for (int w = 0; w < T + L - 1; ++w) {
+    const int cellsInWave = std::min(L, w + 1) - std::max(0, w - T + 1);
+    ThreadPool::Default()->Run(
+        [&](const size_t i) { cell(i, w); }, cellsInWave);
+  }
+}
+
+namespace {
+
+REGISTER_CPU_OPERATOR(LSTM, LSTMOp);
+OPERATOR_SCHEMA(LSTM)
+    .NumInputs(7)
+    .NumOutputs(3)
+    .SetDoc(R"DOC(
+Runs an LSTM layer over a sequence on the CPU, for inference. Given the
+input X (T x N x input_size), the sequence lengths (N), the input and
+recurrent weights W_x (4D x input_size) and W_h (4D x D), the bias b (4D) and
+the initial hidden and cell states (1 x N x D), computes for every timestep t
+
+    gates = X[t] * W_x^T + hidden[t - 1] * W_h^T + b
+
+and applies the gates as LSTMUnit does, in the order input, forget, output
+and cell gates. This is the same as a RecurrentNetwork with an FC + Sum +
+LSTMUnit step net and the input projected beforehand, but the input
+projection of all the timesteps is a single matrix product, and sigmoid and
+tanh are computed with fast approximations that are accurate to a few ulps.
+
+As for LSTMUnit, a batch item past its sequence length keeps its cell state
+and outputs a zero hidden state.
+
+With packed=1 the input is a batch of N sequences in the layout of
+PackSequences, (total_length x input_size), and the second input is the
+batch_sizes output of PackSequences instead of the sequence lengths. Every
+timestep then only runs on the sequences that have it. The output is in the
+packed layout as well, and the initial and final states are in the order of
+the sorted sequences. The hidden output is the hidden state of every sequence
+at its own last timestep.
+
+There is no gradient; train with RecurrentNetwork and LSTMUnit.
+)DOC")
+    .Arg(
+        "packed",
+        "(bool, default false) If set, the input and output are in the "
+        "layout of PackSequences, and the second input is its batch_sizes.")
+    .Input(0, "input", "T x N x input_size input sequence")
+    .Input(1, "seq_lengths", "N int32 sequence lengths")
+    .Input(2, "input_weight", "4D x input_size weights of the input")
+    .Input(3, "recurrent_weight", "4D x D weights of the hidden state")
+    .Input(4, "bias", "4D bias of the gates")
+    .Input(5, "hidden_input", "1 x N x D initial hidden state")
+    .Input(6, "cell_input", "1 x N x D initial cell state")
+    .Output(0, "output", "T x N x D hidden states of all the timesteps")
+    .Output(1, "hidden_output", "1 x N x D hidden state of the last timestep")
+    .Output(2, "cell_output", "1 x N x D cell state of the last timestep");
+SHOULD_NOT_DO_GRADIENT(LSTM);
+
+REGISTER_CPU_OPERATOR(StackedLSTM, StackedLSTMOp);
+OPERATOR_SCHEMA(StackedLSTM)
+    .NumInputs([](int n) { return n >= 7 && (n - 4) % 3 == 0; })
+    .NumOutputs(3)
+    .SetDoc(R"DOC(
+Runs a stack of L LSTM layers over a sequence on the CPU, for inference, the
+output of every layer being the input of the next one. Every layer computes
+the same as the LSTM operator. The layers share the hidden size D; the first
+one takes an input of input_size, the others the output of the layer below.
+
+Timestep t of layer l only depends on timestep t of layer l - 1 and on
+timestep t - 1 of layer l. When the CPU thread pool has several threads, the
+(layer, timestep) cells run on diagonal wavefronts, all the cells with
+l + t = w in parallel, so that up to L threads do work where a chain of LSTM
+operators runs one layer at a time. With a single thread the layers run one
+after another.
+
+The inputs are followed by the input weight (4D x input_size or 4D x D), the
+recurrent weight (4D x D) and the bias (4D) of every layer, from the bottom
+one.
+
+There is no gradient; train with RecurrentNetwork and LSTMUnit.
+)DOC")
+    .Input(0, "input", "T x N x input_size input sequence")
+    .Input(1, "seq_lengths", "N int32 sequence lengths")
+    .Input(2, "hidden_input", "L x N x D initial hidden states of the layers")
+    .Input(3, "cell_input", "L x N x D initial cell states of the layers")
+    .Output(0, "output", "T x N x D hidden states of the last layer")
+    .Output(1, "hidden_output", "L x N x D last hidden states of the layers")
+    .Output(2, "cell_output", "L x N x D last cell states of the layers");
+SHOULD_NOT_DO_GRADIENT(StackedLSTM);
+
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,121 @@
+#ifndef CAFFE2_OPERATORS_LSTM_OP_H_
+#define CAFFE2_OPERATORS_LSTM_OP_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// LSTMOp runs a whole LSTM layer over a sequence on the CPU, for inference.
+// It computes the same activations as a RecurrentNetwork whose step net is
+// FC + Sum + LSTMUnit, without the step net: the input projection of all the
+// timesteps is a single GEMM, and every timestep is then a GEMM of the
+// previous hidden state into the precomputed gates, followed by one pass of a
+// SIMD kernel that applies the gates with fast rational approximations of
+// sigmoid and tanh.
+//
+// With the packed argument the input is in the layout of PackSequences, and
+// every timestep only runs on the sequences that have it instead of on the
+// whole batch padded to the longest sequence.
+class LSTMOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  LSTMOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(bool, "packed", packed_, false) {}
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(
+      INPUT,
+      SEQ_LENGTHS,
+      INPUT_WEIGHT,
+      RECURRENT_WEIGHT,
+      BIAS,
+      HIDDEN_INPUT,
+      CELL_INPUT);
+  OUTPUT_TAGS(OUTPUT, HIDDEN_OUTPUT, CELL_OUTPUT);
+
+ private:
+  bool RunPacked();
+
+  bool packed_;
+  // The gates of all the timesteps, [T, N, 4 * D].
+  Tensor<CPUContext> gates_;
+  // The cell state of the previous timestep, [N, D].
+  Tensor<CPUContext> cell_;
+};
+
+// StackedLSTMOp runs a stack of LSTM layers, the output of every layer being
+// the input of the next one. Timestep t of layer l only depends on timestep t
+// of layer l - 1 and on timestep t - 1 of layer l, so when the CPU thread pool
+// has several threads the (layer, timestep) cells run on diagonal wavefronts:
+// all the cells with l + t = w run in parallel, which keeps up to num_layers
+// threads busy where a chain of LSTMOps would run one layer at a time. With a
+// single thread the layers run one after another instead, which lets the input
+// projection of every layer be a single GEMM over the whole sequence.
+class StackedLSTMOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  StackedLSTMOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+
+  bool RunOnDevice() override;
+
+ protected:
+  // The inputs are followed by the INPUT_WEIGHT, RECURRENT_WEIGHT and BIAS of
+  // every layer.
+  INPUT_TAGS(INPUT, SEQ_LENGTHS, HIDDEN_INPUT, CELL_INPUT);
+  OUTPUT_TAGS(OUTPUT, HIDDEN_OUTPUT, CELL_OUTPUT);
+
+ private:
+  void RunLayers(int T, int N, int I, int D);
+  void RunWavefront(int T, int N, int I, int D);
+
+  const float* InputWeight(int layer) {
+    return Input(CELL_INPUT + 1 + 3 * layer).data<float>();
+  }
+  const float* RecurrentWeight(int layer) {
+    return Input(CELL_INPUT + 2 + 3 * layer).data<float>();
+  }
+  const float* Bias(int layer) {
+    return Input(CELL_INPUT + 3 + 3 * layer).data<float>();
+  }
+
+  int numLayers_;
+  int maxLength_;
+  // The gates of the timesteps in flight.
+  Tensor<CPUContext> gates_;
+  // The outputs of all but the last layer.
+  Tensor<CPUContext> hidden_;
+  // The cell states of the last two timesteps of every layer, [L, 2, N, D].
+  Tensor<CPUContext> cells_;
+};
+
+namespace detail {
+
+// Applies the gates of one timestep of an LSTM, as LSTMUnit does, with fast
+// approximations of sigmoid and tanh: for every batch item n with
+// t < seqLengths[n], computes from the pre-activations X (N x 4D, in the
+// order input, forget, output and cell gates) and the previous cell state
+// C_prev (N x D) the new cell state C and hidden state H. Items past their
+// length keep their cell state and have a zero hidden state; all the items
+// are active if seqLengths is null. C may be C_prev.
+void LSTMGates(
+    int N,
+    int D,
+    int t,
+    const float* C_prev,
+    const float* X,
+    const int32_t* seqLengths,
+    float* C,
+    float* H);
+
+} // namespace detail
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_LSTM_OP_H_
@@ -0,0 +1,299 @@
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/operators/lstm_op.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static TensorCPU* AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(-1, 1);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+  return tensor;
+}
+
+static float Sigmoid(const float x) {
+  return 1 / (1 + std::exp(-x));
+}
+
+// Checks LSTM against a scalar reference, with batch items of different
+// lengths and a hidden size that is not a multiple of the SIMD width.
+TEST(LSTMTest, MatchesReference) {
+  Workspace ws;
+  std::mt19937 gen(1);
+  const int T = 7, N = 5, I = 6, D = 19, G = 4 * D;
+  const auto* X = AddInput({T, N, I}, "X", &gen, &ws);
+  const auto* W_x = AddInput({G, I}, "W_x", &gen, &ws);
+  const auto* W_h = AddInput({G, D}, "W_h", &gen, &ws);
+  const auto* b = AddInput({G}, "b", &gen, &ws);
+  const auto* H_0 = AddInput({1, N, D}, "H_0", &gen, &ws);
+  const auto* C_0 = AddInput({1, N, D}, "C_0", &gen, &ws);
+  auto* lengths = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+  lengths->Resize(N);
+  const vector<int32_t> seqLengths{7, 3, 0, 5, 6};
+  std::copy(
+      seqLengths.begin(), seqLengths.end(), lengths->mutable_data<int32_t>());
+  const auto def = CreateOperatorDef(
+      "LSTM",
+      "",
+      vector<string>{"X", "lengths", "W_x", "W_h", "b", "H_0", "C_0"},
+      vector<string>{"Y", "H_T", "C_T"});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  const auto& H_T = ws.GetBlob("H_T")->Get<TensorCPU>();
+  const auto& C_T = ws.GetBlob("C_T")->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), (vector<TIndex>{T, N, D}));
+  ASSERT_EQ(H_T.dims(), (vector<TIndex>{1, N, D}));
+  ASSERT_EQ(C_T.dims(), (vector<TIndex>{1, N, D}));
+
+  vector<float> h(H_0->data<float>(), H_0->data<float>() + N * D);
+  vector<float> c(C_0->data<float>(), C_0->data<float>() + N * D);
+  vector<float> gates(G);
+  for (int t = 0; t < T; ++t) {
+    for (int n = 0; n < N; ++n) {
+      for (int g = 0; g < G; ++g) {
+        float sum = b->data<float>()[g];
+        for (int i = 0; i < I; ++i) {
+          sum += X->data<float>()[(t * N + n) * I + i] *
+              W_x->data<float>()[g * I + i];
+        }
+        for (int d = 0; d < D; ++d) {
+          sum += h[n * D + d] * W_h->data<float>()[g * D + d];
+        }
+        gates[g] = sum;
+      }
+      for (int d = 0; d < D; ++d) {
+        float hidden = 0;
+        if (t < seqLengths[n]) {
+          c[n * D + d] = Sigmoid(gates[D + d]) * c[n * D + d] +
+              Sigmoid(gates[d]) * std::tanh(gates[3 * D + d]);
+          hidden = Sigmoid(gates[2 * D + d]) * std::tanh(c[n * D + d]);
+        }
+        EXPECT_NEAR(Y.data<float>()[(t * N + n) * D + d], hidden, 1e-5)
+            << t << " " << n << " " << d;
+      }
+    }
+    std::copy(
+        Y.data<float>() + t * N * D,
+        Y.data<float>() + (t + 1) * N * D,
+        h.begin());
+  }
+  for (int i = 0; i < N * D; ++i) {
+    EXPECT_EQ(H_T.data<float>()[i], h[i]);
+    EXPECT_NEAR(C_T.data<float>()[i], c[i], 1e-5);
+  }
+}
+
+// The fast sigmoid and tanh stay within a few ulps over the whole range and
+// saturate exactly.
+TEST(LSTMTest, GateApproximations) {
+  const int D = 11, N = 1;
+  const int32_t length = 1;
+  for (float x = -20; x <= 20; x += 0.01f) {
+    vector<float> X(4 * D, x), C_prev(D, 1), C(D), H(D);
+    detail::LSTMGates(
+        N, D, 0, C_prev.data(), X.data(), &length, C.data(), H.data());
+    const float c = Sigmoid(x) + Sigmoid(x) * std::tanh(x);
+    for (int d = 0; d < D; ++d) {
+      EXPECT_NEAR(C[d], c, 1e-6 * std::max(1.f, std::abs(c))) << x;
+      EXPECT_NEAR(H[d], Sigmoid(x) * std::tanh(c), 1e-6) << x;
+    }
+  }
+}
+
+// StackedLSTM computes the same as a chain of LSTMs, whichever way it
+// schedules the layers.
+TEST(LSTMTest, StackedMatchesChain) {
+  Workspace ws;
+  std::mt19937 gen(2);
+  const int T = 6, N = 3, I = 5, D = 10, L = 3, G = 4 * D;
+  AddInput({T, N, I}, "X", &gen, &ws);
+  const auto* H_0 = AddInput({L, N, D}, "H_0", &gen, &ws);
+  const auto* C_0 = AddInput({L, N, D}, "C_0", &gen, &ws);
+  auto* lengths = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+  lengths->Resize(N);
+  const vector<int32_t> seqLengths{6, 2, 4};
+  std::copy(
+      seqLengths.begin(), seqLengths.end(), lengths->mutable_data<int32_t>());
+  vector<string> inputs{"X", "lengths", "H_0", "C_0"};
+  for (int l = 0; l < L; ++l) {
+    const string layer = std::to_string(l);
+    AddInput({G, l == 0 ? I : D}, "W_x_" + layer, &gen, &ws);
+    AddInput({G, D}, "W_h_" + layer, &gen, &ws);
+    AddInput({G}, "b_" + layer, &gen, &ws);
+    for (const char* name : {"W_x_", "W_h_", "b_"}) {
+      inputs.push_back(name + layer);
+    }
+    auto* h = ws.CreateBlob("H_0_" + layer)->GetMutable<TensorCPU>();
+    h->Resize(1, N, D);
+    std::copy(
+        H_0->data<float>() + l * N * D,
+        H_0->data<float>() + (l + 1) * N * D,
+        h->mutable_data<float>());
+    auto* c = ws.CreateBlob("C_0_" + layer)->GetMutable<TensorCPU>();
+    c->Resize(1, N, D);
+    std::copy(
+        C_0->data<float>() + l * N * D,
+        C_0->data<float>() + (l + 1) * N * D,
+        c->mutable_data<float>());
+    ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+        "LSTM",
+        "",
+        vector<string>{l == 0 ? "X" : "Y_" + std::to_string(l - 1),
+                       "lengths",
+                       "W_x_" + layer,
+                       "W_h_" + layer,
+                       "b_" + layer,
+                       "H_0_" + layer,
+                       "C_0_" + layer},
+        vector<string>{"Y_" + layer, "H_T_" + layer, "C_T_" + layer})));
+  }
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "StackedLSTM", "", inputs, vector<string>{"Y", "H_T", "C_T"})));
+
+  const auto& Y = ws.GetBlob("Y")->Get<TensorCPU>();
+  const auto& expectedY =
+      ws.GetBlob("Y_" + std::to_string(L - 1))->Get<TensorCPU>();
+  ASSERT_EQ(Y.dims(), expectedY.dims());
+  for (int i = 0; i < Y.size(); ++i) {
+    EXPECT_NEAR(Y.data<float>()[i], expectedY.data<float>()[i], 1e-5) << i;
+  }
+  for (const string name : {"H_T", "C_T"}) {
+    const auto& state = ws.GetBlob(name)->Get<TensorCPU>();
+    ASSERT_EQ(state.dims(), (vector<TIndex>{L, N, D}));
+    for (int l = 0; l < L; ++l) {
+      const auto& expected =
+          ws.GetBlob(name + "_" + std::to_string(l))->Get<TensorCPU>();
+      for (int i = 0; i < N * D; ++i) {
+        EXPECT_NEAR(
+            state.data<float>()[l * N * D + i], expected.data<float>()[i], 1e-5)
+            << name << " " << l << " " << i;
+      }
+    }
+  }
+}
+
+// LSTM over sequences packed by PackSequences computes the same as over the
+// sequences padded to the longest one.
+TEST(LSTMTest, PackedMatchesPadded) {
+  Workspace ws;
+  std::mt19937 gen(3);
+  const vector<int32_t> seqLengths{3, 7, 0, 5, 7};
+  const int T = 7, N = seqLengths.size(), I = 4, D = 9, G = 4 * D;
+  const int total = std::accumulate(seqLengths.begin(), seqLengths.end(), 0);
+  const auto* data = AddInput({total, I}, "data", &gen, &ws);
+  AddInput({G, I}, "W_x", &gen, &ws);
+  AddInput({G, D}, "W_h", &gen, &ws);
+  AddInput({G}, "b", &gen, &ws);
+  const auto* H_0 = AddInput({1, N, D}, "H_0", &gen, &ws);
+  AddInput({1, N, D}, "C_0", &gen, &ws);
+  auto* lengths = ws.CreateBlob("lengths")->GetMutable<TensorCPU>();
+  lengths->Resize(N);
+  std::copy(
+      seqLengths.begin(), seqLengths.end(), lengths->mutable_data<int32_t>());
+  vector<int> starts(N + 1, 0);
+  std::partial_sum(seqLengths.begin(), seqLengths.end(), starts.begin() + 1);
+
+  // The padded input, T x N x I.
+  auto* X = ws.CreateBlob("X")->GetMutable<TensorCPU>();
+  X->Resize(T, N, I);
+  std::fill(X->mutable_data<float>(), X->mutable_data<float>() + X->size(), 0);
+  for (int n = 0; n < N; ++n) {
+    for (int t = 0; t < seqLengths[n]; ++t) {
+      std::copy(
+          data->data<float>() + (starts[n] + t) * I,
+          data->data<float>() + (starts[n] + t + 1) * I,
+          X->mutable_data<float>() + (t * N + n) * I);
+    }
+  }
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "LSTM",
+      "",
+      vector<string>{"X", "lengths", "W_x", "W_h", "b", "H_0", "C_0"},
+      vector<string>{"Y", "H_T", "C_T"})));
+
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "PackSequences",
+      "",
+      vector<string>{"lengths", "data"},
+      vector<string>{"packed", "batch_sizes", "sorted_indices"})));
+  const auto& batchSizes = ws.GetBlob("batch_sizes")->Get<TensorCPU>();
+  EXPECT_EQ(
+      vector<int>(
+          batchSizes.data<int>(), batchSizes.data<int>() + batchSizes.size()),
+      (vector<int>{4, 4, 4, 3, 3, 2, 2}));
+  const int* order = ws.GetBlob("sorted_indices")->Get<TensorCPU>().data<int>();
+  EXPECT_EQ(vector<int>(order, order + N), (vector<int>{1, 4, 3, 0, 2}));
+  // The initial states, in the order of the sorted sequences.
+  for (const string name : {"H_0", "C_0"}) {
+    const auto& state = ws.GetBlob(name)->Get<TensorCPU>();
+    auto* sorted = ws.CreateBlob(name + "_sorted")->GetMutable<TensorCPU>();
+    sorted->ResizeLike(state);
+    for (int r = 0; r < N; ++r) {
+      std::copy(
+          state.data<float>() + order[r] * D,
+          state.data<float>() + (order[r] + 1) * D,
+          sorted->mutable_data<float>() + r * D);
+    }
+  }
+  auto def = CreateOperatorDef(
+      "LSTM",
+      "",
+      vector<string>{"packed",
+                     "batch_sizes",
+                     "W_x",
+                     "W_h",
+                     "b",
+                     "H_0_sorted",
+                     "C_0_sorted"},
+      vector<string>{"packed_Y", "packed_H_T", "packed_C_T"});
+  def.add_arg()->CopyFrom(MakeArgument("packed", true));
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "UnpackSequences",
+      "",
+      vector<string>{"lengths", "packed_Y"},
+      vector<string>{"unpacked_Y"})));
+
+  const float* Y = ws.GetBlob("Y")->Get<TensorCPU>().data<float>();
+  const float* C_T = ws.GetBlob("C_T")->Get<TensorCPU>().data<float>();
+  const auto& unpackedY = ws.GetBlob("unpacked_Y")->Get<TensorCPU>();
+  const auto& packedH_T = ws.GetBlob("packed_H_T")->Get<TensorCPU>();
+  const auto& packedC_T = ws.GetBlob("packed_C_T")->Get<TensorCPU>();
+  ASSERT_EQ(unpackedY.dims(), (vector<TIndex>{total, D}));
+  for (int n = 0; n < N; ++n) {
+    for (int t = 0; t < seqLengths[n]; ++t) {
+      for (int d = 0; d < D; ++d) {
+        EXPECT_NEAR(
+            unpackedY.data<float>()[(starts[n] + t) * D + d],
+            Y[(t * N + n) * D + d],
+            1e-5)
+            << n << " " << t << " " << d;
+      }
+    }
+  }
+  for (int r = 0; r < N; ++r) {
+    const int n = order[r];
+    const float* h = seqLengths[n] == 0 ? H_0->data<float>() + n * D
+                                        : Y + ((seqLengths[n] - 1) * N + n) * D;
+    for (int d = 0; d < D; ++d) {
+      EXPECT_NEAR(packedH_T.data<float>()[r * D + d], h[d], 1e-5) << r;
+      EXPECT_NEAR(packedC_T.data<float>()[r * D + d], C_T[n * D + d], 1e-5)
+          << r;
+    }
+  }
+}
+
+} // namespace caffe2
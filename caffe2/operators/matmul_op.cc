@@ -4,6 +4,10 @@ namespace caffe2 {
 namespace {
 
 REGISTER_CPU_OPERATOR(MatMul, MatMulOp<float, CPUContext>);
+REGISTER_CPU_OPERATOR_WITH_ENGINE(
+    MatMul,
+    PACKED,
+    MatMulOp<float, CPUContext, PackedEngine>);
 
 OPERATOR_SCHEMA(MatMul)
     .NumInputs(2)
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <atomic>
 #include <limits>
 #include <mutex>
+#include <numeric>
 #include <unordered_map>
 #include <vector>
 #include "caffe2/core/operator.h"
@@ -134,8 +136,180 @@ class UnpackSegmentsOp final : public Operator<Context> {
   INPUT_TAGS(LENGTHS, DATA);
 };
 
+// The packed layout of a batch of sequences: the sequences are sorted by
+// decreasing length, ties broken by index, and stored time-major, timestep t
+// of the sequence of rank r at row offsets[t] + r. Only the first
+// batchSizes[t] ranks have a timestep t, so a recurrent op over the packed
+// layout can run every timestep on a batch without padding. Computes for
+// every rank the index of its sequence, and the batch size of every timestep.
+template <typename T>
+void ComputeSequenceLayout(
+    const T* lengths,
+    const int n,
+    vector<int>* order,
+    vector<int>* batchSizes) {
+  order->resize(n);
+  std::iota(order->begin(), order->end(), 0);
+  std::stable_sort(order->begin(), order->end(), [&](int a, int b) {
+    return lengths[a] > lengths[b];
+  });
+  batchSizes->resize(n > 0 ? lengths[(*order)[0]] : 0);
+  T shorter = 0;
+  for (int r = n - 1; r >= 0; --r) {
+    const T length = lengths[(*order)[r]];
+    CAFFE_ENFORCE_GE(length, 0, "Negative sequence length");
+    std::fill(
+        batchSizes->begin() + shorter, batchSizes->begin() + length, r + 1);
+    shorter = length;
+  }
+}
+
+// Copies every timestep of every sequence between its row in the
+// concatenation of the sequences and its row in the packed layout.
+template <typename T, class Context>
+void CopySequences(
+    const TypeMeta& meta,
+    const TIndex blockSize,
+    const T* lengths,
+    const vector<int>& order,
+    const vector<int>& batchSizes,
+    const bool pack,
+    const char* src,
+    char* dst,
+    Context* context) {
+  const TIndex blockBytes = blockSize * meta.itemsize();
+  vector<TIndex> starts(order.size() + 1, 0);
+  for (int i = 0; i < order.size(); ++i) {
+    starts[i + 1] = starts[i] + lengths[i];
+  }
+  vector<TIndex> offsets(batchSizes.size() + 1, 0);
+  for (int t = 0; t < batchSizes.size(); ++t) {
+    offsets[t + 1] = offsets[t] + batchSizes[t];
+  }
+  for (int r = 0; r < order.size(); ++r) {
+    const int i = order[r];
+    for (T t = 0; t < lengths[i]; ++t) {
+      const TIndex packedRow = offsets[t] + r;
+      const TIndex row = starts[i] + t;
+      context->template CopyItems<Context, Context>(
+          meta,
+          blockSize,
+          src + blockBytes * (pack ? row : packedRow),
+          dst + blockBytes * (pack ? packedRow : row));
+    }
+  }
+}
+
+template <class Context>
+class PackSequencesOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(PackSequencesOp)
+  USE_DISPATCH_HELPER;
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int, long>>::call(this, Input(LENGTHS));
+  }
+
+  template <typename T>
+  bool DoRunWithType() {
+    const auto& data = Input(DATA);
+    const auto& lengths = Input(LENGTHS);
+    auto* output = Output(0);
+
+    CAFFE_ENFORCE(data.ndim() >= 1, "DATA should be at least 1-D");
+    CAFFE_ENFORCE(lengths.ndim() == 1, "LENGTH should be 1-D");
+    const T* l = lengths.template data<T>();
+    CAFFE_ENFORCE_EQ(
+        std::accumulate(l, l + lengths.size(), TIndex(0)),
+        data.dim(0),
+        "LENGTH should sum up to the first dimension of DATA");
+
+    vector<int> order;
+    vector<int> batchSizes;
+    ComputeSequenceLayout(l, lengths.size(), &order, &batchSizes);
+    output->ResizeLike(data);
+    CopySequences(
+        data.meta(),
+        data.size_from_dim(1),
+        l,
+        order,
+        batchSizes,
+        true,
+        static_cast<const char*>(data.raw_data()),
+        static_cast<char*>(output->raw_mutable_data(data.meta())),
+        &context_);
+    if (OutputSize() > 1) {
+      auto* batchSizesOut = Output(1);
+      batchSizesOut->Resize(batchSizes.size());
+      std::copy(
+          batchSizes.begin(),
+          batchSizes.end(),
+          batchSizesOut->template mutable_data<int>());
+    }
+    if (OutputSize() > 2) {
+      auto* sortedIndices = Output(2);
+      sortedIndices->Resize(order.size());
+      std::copy(
+          order.begin(),
+          order.end(),
+          sortedIndices->template mutable_data<int>());
+    }
+    return true;
+  }
+
+  INPUT_TAGS(LENGTHS, DATA);
+};
+
+template <class Context>
+class UnpackSequencesOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  USE_SIMPLE_CTOR_DTOR(UnpackSequencesOp)
+  USE_DISPATCH_HELPER;
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int, long>>::call(this, Input(LENGTHS));
+  }
+
+  template <typename T>
+  bool DoRunWithType() {
+    const auto& data = Input(DATA);
+    const auto& lengths = Input(LENGTHS);
+    auto* output = Output(0);
+
+    CAFFE_ENFORCE(data.ndim() >= 1, "DATA should be at least 1-D");
+    CAFFE_ENFORCE(lengths.ndim() == 1, "LENGTH should be 1-D");
+    const T* l = lengths.template data<T>();
+    CAFFE_ENFORCE_EQ(
+        std::accumulate(l, l + lengths.size(), TIndex(0)),
+        data.dim(0),
+        "LENGTH should sum up to the first dimension of DATA");
+
+    vector<int> order;
+    vector<int> batchSizes;
+    ComputeSequenceLayout(l, lengths.size(), &order, &batchSizes);
+    output->ResizeLike(data);
+    CopySequences(
+        data.meta(),
+        data.size_from_dim(1),
+        l,
+        order,
+        batchSizes,
+        false,
+        static_cast<const char*>(data.raw_data()),
+        static_cast<char*>(output->raw_mutable_data(data.meta())),
+        &context_);
+    return true;
+  }
+
+  INPUT_TAGS(LENGTHS, DATA);
+};
+
 REGISTER_CPU_OPERATOR(PackSegments, PackSegmentsOp<CPUContext>);
 REGISTER_CPU_OPERATOR(UnpackSegments, UnpackSegmentsOp<CPUContext>);
+REGISTER_CPU_OPERATOR(PackSequences, PackSequencesOp<CPUContext>);
+REGISTER_CPU_OPERATOR(UnpackSequences, UnpackSequencesOp<CPUContext>);
 
 OPERATOR_SCHEMA(PackSegments)
     .NumInputs(2)
@@ -167,6 +341,48 @@ OPERATOR_SCHEMA(UnpackSegments)
         "1-d int/long tensor contains the length in each of the input.")
     .Input(1, "tensor", "N+1 dim Tensor.")
     .Output(0, "packed_tensor", "N dim Tesor");
+OPERATOR_SCHEMA(PackSequences)
+    .NumInputs(2)
+    .NumOutputs(1, 3)
+    .SetDoc(R"DOC(
+Packs a batch of sequences, given as the concatenation of their timesteps
+along with their lengths (as for PackSegments), without padding: the
+sequences are sorted by decreasing length, ties broken by their index, and
+laid out time-major, so that timestep t of every sequence that has one is in a
+contiguous block of rows, the sequences in sorted order. The block of
+timestep t has batch_sizes[t] rows, which is non-increasing in t.
+
+A recurrent op that consumes the packed layout (such as LSTM with packed=1)
+runs every timestep on the sequences that are still active only, instead of
+on the whole batch padded to the longest sequence.
+)DOC")
+    .Input(
+        0,
+        "lengths",
+        "1-d int/long tensor contains the length in each of the input.")
+    .Input(1, "tensor", "N dim Tensor, the concatenation of the sequences.")
+    .Output(0, "packed_tensor", "N dim Tensor, the sequences packed.")
+    .Output(
+        1,
+        "batch_sizes",
+        "1-d int tensor, the number of sequences that have each timestep.")
+    .Output(
+        2,
+        "sorted_indices",
+        "1-d int tensor, the index of the sequence of every rank in the "
+        "packed layout.");
+OPERATOR_SCHEMA(UnpackSequences)
+    .NumInputs(2)
+    .NumOutputs(1)
+    .SetDoc(
+        "Inverse of PackSequences: puts back the timesteps of the sequences "
+        "in the packed layout one sequence after the other.")
+    .Input(
+        0,
+        "lengths",
+        "1-d int/long tensor contains the length in each of the output.")
+    .Input(1, "packed_tensor", "N dim Tensor, the sequences packed.")
+    .Output(0, "tensor", "N dim Tensor, the concatenation of the sequences.");
 
 class GetPackSegmentsGradient : public GradientMakerBase {
   using GradientMakerBase::GradientMakerBase;
@@ -193,5 +409,29 @@ class GetUnpackSegmentsGradient : public GradientMakerBase {
   }
 };
 REGISTER_GRADIENT(UnpackSegments, GetUnpackSegmentsGradient);
+
+class GetPackSequencesGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "UnpackSequences",
+        "",
+        vector<string>{I(0), GO(0)},
+        vector<string>{GI(1)});
+  }
+};
+REGISTER_GRADIENT(PackSequences, GetPackSequencesGradient);
+
+class GetUnpackSequencesGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    return SingleGradientDef(
+        "PackSequences",
+        "",
+        vector<string>{I(0), GO(0)},
+        vector<string>{GI(1)});
+  }
+};
+REGISTER_GRADIENT(UnpackSequences, GetUnpackSequencesGradient);
 }
 } // namespace
@@ -2,12 +2,25 @@
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
 #include "caffe2/utils/mkl_utils.h"
-
-#ifdef CAFFE2_HAS_MKL_SGEMM_PACK
+#include "caffe2/utils/packed_gemm.h"
 
 namespace caffe2 {
 
+namespace {
+uint32_t Hash(const float* ptr, size_t n) {
+  uint32_t hash = 0;
+  const uint32_t* ptr_i = reinterpret_cast<const uint32_t*>(ptr);
+  for (int i = 0; i < n; ++i) {
+    hash ^= ptr_i[i];
+  }
+  return hash;
+}
+}  // namespace
+
+#ifdef CAFFE2_HAS_MKL_SGEMM_PACK
+
 CAFFE_KNOWN_TYPE(mkl::MKLPackedMatrix);
 
 namespace mkl {
@@ -17,7 +30,8 @@ class PackedFCOp final : public Operator<CPUContext> {
   USE_OPERATOR_FUNCTIONS(CPUContext);
   PackedFCOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<CPUContext>(operator_def, ws),
-        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)) {}
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        relu_(OperatorBase::GetSingleArgument<int32_t>("relu", 0)) {}
   ~PackedFCOp() {}
 
   bool RunOnDevice() override {
@@ -99,19 +113,16 @@ class PackedFCOp final : public Operator<CPUContext> {
         1,
         Y->template mutable_data<float>(),
         &context_);
+    if (relu_) {
+      EigenVectorArrayMap<float> Y_vec(Y->template mutable_data<float>(), M * N);
+      Y_vec = Y_vec.cwiseMax(0.f);
+    }
     return true;
   }
 
  protected:
-  uint32_t Hash(const float* ptr, size_t n) {
-    uint32_t hash = 0;
-    const uint32_t* ptr_i = reinterpret_cast<const uint32_t*>(ptr);
-    for (int i = 0; i < n; ++i) {
-      hash ^= ptr_i[i];
-    }
-    return hash;
-  }
   size_t axis_{1};
+  bool relu_;
   uint32_t hash_{0};
   Tensor<CPUContext> bias_multiplier_;
   std::unique_ptr<MKLPackedMatrix> local_packed_matrix_;
@@ -121,19 +132,149 @@ class PackedFCOp final : public Operator<CPUContext> {
 
 REGISTER_CPU_OPERATOR(PackedFC, mkl::PackedFCOp);
 
+#endif // CAFFE2_HAS_MKL_SGEMM_PACK
+
+CAFFE_KNOWN_TYPE(math::PackedGemmMatrixB);
+
+// PackedFCOp is the BLAS independent version of the packed FC operator. It
+// runs on the PackedEngine gemm, with W packed once into the engine's cache
+// blocked layout, either on the first run or ahead of time by PackFCWeight.
+// The bias add and the optional ReLU are fused into the gemm epilogue.
+class PackedFCOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  PackedFCOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        axis_(OperatorBase::GetSingleArgument<int32_t>("axis", 1)),
+        relu_(OperatorBase::GetSingleArgument<int32_t>("relu", 0)) {}
+  ~PackedFCOp() {}
+
+  bool RunOnDevice() override {
+    const auto& X = Input(0);
+    const auto& b = Input(2);
+    auto* Y = Output(0);
+    CAFFE_ENFORCE(b.ndim() == 1, b.ndim());
+    const auto canonical_axis = X.canonical_axis_index(axis_);
+    const int M = X.size_to_dim(canonical_axis);
+    const int K = X.size_from_dim(canonical_axis);
+    const int N = b.size();
+
+    const math::PackedGemmMatrixB* packed_w = nullptr;
+    if (OperatorBase::InputIsType<TensorCPU>(1)) {
+      const auto& W = Input(1);
+      CAFFE_ENFORCE_EQ(W.ndim(), 2);
+      CAFFE_ENFORCE_EQ(W.dim32(0), N);
+      CAFFE_ENFORCE_EQ(W.dim32(1), K);
+      // As with the MKL PackedFC, the operator is stateful and assumes that W
+      // never changes after the first run; this is only checked in debug mode.
+      DCHECK(hash_ == 0 || hash_ == Hash(W.data<float>(), W.size()))
+          << "PackedFCOp is currently stateful: you should not change the "
+             "weight during runtime. This is only sanity-checked in debug "
+             "mode for speed considerations.";
+      if (local_packed_w_.empty() || local_packed_w_.K() != K ||
+          local_packed_w_.N() != N) {
+        // Y = X * W^T, so the gemm's B is W transposed.
+        local_packed_w_.Pack(CblasTrans, K, N, W.data<float>(), K);
+#ifndef NDEBUG
+        hash_ = Hash(W.data<float>(), W.size());
+#endif
+      }
+      packed_w = &local_packed_w_;
+    } else {
+      packed_w = &OperatorBase::Input<math::PackedGemmMatrixB>(1);
+    }
+    CAFFE_ENFORCE_EQ(packed_w->K(), K);
+    CAFFE_ENFORCE_EQ(packed_w->N(), N);
+
+    Y_shape_cache_ = X.dims();
+    Y_shape_cache_.resize(canonical_axis + 1);
+    Y_shape_cache_[canonical_axis] = N;
+    Y->Resize(Y_shape_cache_);
+
+    math::PackedGemm(
+        CblasNoTrans,
+        M,
+        N,
+        K,
+        1,
+        X.data<float>(),
+        K,
+        *packed_w,
+        0,
+        Y->mutable_data<float>(),
+        N,
+        b.data<float>(),
+        relu_,
+        &context_);
+    return true;
+  }
+
+ protected:
+  size_t axis_{1};
+  bool relu_;
+  uint32_t hash_{0};
+  vector<TIndex> Y_shape_cache_;
+  math::PackedGemmMatrixB local_packed_w_;
+};
+
+// Packs the (N x K) weight of an FC layer into the PackedEngine layout, so
+// that PackedFC can use it directly without keeping a private copy.
+class PackFCWeightOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  PackFCWeightOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws) {}
+  ~PackFCWeightOp() {}
+
+  bool RunOnDevice() override {
+    const auto& W = Input(0);
+    CAFFE_ENFORCE_EQ(W.ndim(), 2);
+    const int N = W.dim32(0);
+    const int K = W.dim32(1);
+    OperatorBase::Output<math::PackedGemmMatrixB>(0)->Pack(
+        CblasTrans, K, N, W.data<float>(), K);
+    return true;
+  }
+};
+
+#ifndef CAFFE2_HAS_MKL_SGEMM_PACK
+REGISTER_CPU_OPERATOR(PackedFC, PackedFCOp);
+#endif // CAFFE2_HAS_MKL_SGEMM_PACK
+REGISTER_CPU_OPERATOR_WITH_ENGINE(PackedFC, PACKED, PackedFCOp);
+REGISTER_CPU_OPERATOR(PackFCWeight, PackFCWeightOp);
+
 OPERATOR_SCHEMA(PackedFC).NumInputs(3).NumOutputs(1).SetDoc(R"DOC(
 Computes the result of passing an input vector X into a fully connected
 layer with 2D weight matrix W and 1D bias vector b. This is essentially the
 same as the FC operator but allows one to pack the weight matrix for more
 efficient inference. See the schema for the FC op for details.
 
+W can either be a regular (N x K) tensor, which is packed on the first run,
+or the output of PackFCWeight. With MKL, the default engine packs through MKL's
+packed sgemm; the PACKED engine (the default when MKL is not available) uses
+caffe2's own packed gemm and fuses the bias add and the ReLU into it.
+
 Unlike many other operators in Caffe2, this operator is stateful: it assumes
 that the input weight matrix W never changes, so it is only suitable for
 inference time when the weight matrix never gets updated by any other ops.
 Due to performance considerations, this is not checked in non-debug builds.
-)DOC");
+)DOC")
+    .Arg("axis", "(int32_t) default to 1; describes the axis of the inputs.")
+    .Arg("relu", "(int32_t) default to 0; if 1, applies ReLU to the output.")
+    .Input(0, "X", "input data, flattened to 2D (M x K) at axis")
+    .Input(1, "W", "(N x K) weight tensor, or the output of PackFCWeight")
+    .Input(2, "b", "1D blob containing bias vector")
+    .Output(0, "Y", "output tensor");
+
+OPERATOR_SCHEMA(PackFCWeight).NumInputs(1).NumOutputs(1).SetDoc(R"DOC(
+Packs the (N x K) weight matrix of an FC layer into the cache blocked layout
+used by PackedFC with the PACKED engine, so that the packing is done once ahead
+of time, for example in the init net of a predictor.
+)DOC")
+    .Input(0, "W", "(N x K) weight tensor")
+    .Output(0, "packed_W", "the packed weight, to be used as input 1 of "
+            "PackedFC");
 
 SHOULD_NOT_DO_GRADIENT(PackedFC);
+SHOULD_NOT_DO_GRADIENT(PackFCWeight);
 } // namespace caffe2
-
-#endif // CAFFE2_HAS_MKL_SGEMM_PACK
@@ -0,0 +1,110 @@
+#include <algorithm>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/math.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static void AddInput(
+    const vector<TIndex>& shape,
+    const vector<float>& values,
+    const string& name,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  CHECK_EQ(tensor->size(), values.size());
+  std::copy(values.begin(), values.end(), tensor->mutable_data<float>());
+}
+
+static void FillInputs(const int M, const int N, const int K, Workspace* ws) {
+  vector<float> X(M * K), W(N * K), B(N);
+  for (int i = 0; i < X.size(); ++i) {
+    X[i] = (i % 7) * 0.5f - 1.f;
+  }
+  for (int i = 0; i < W.size(); ++i) {
+    W[i] = (i % 5) * 0.25f - 0.5f;
+  }
+  for (int i = 0; i < B.size(); ++i) {
+    B[i] = (i % 3) - 1.f;
+  }
+  AddInput(vector<TIndex>{M, K}, X, "X", ws);
+  AddInput(vector<TIndex>{N, K}, W, "W", ws);
+  AddInput(vector<TIndex>{N}, B, "B", ws);
+}
+
+static void CheckFCRelu(
+    const int M,
+    const int N,
+    const int K,
+    const bool relu,
+    Workspace* ws) {
+  const auto& X = ws->GetBlob("X")->Get<TensorCPU>();
+  const auto& W = ws->GetBlob("W")->Get<TensorCPU>();
+  const auto& B = ws->GetBlob("B")->Get<TensorCPU>();
+  const auto& Y = ws->GetBlob("Y")->Get<TensorCPU>();
+  ASSERT_EQ(Y.ndim(), 2);
+  ASSERT_EQ(Y.dim32(0), M);
+  ASSERT_EQ(Y.dim32(1), N);
+  for (int i = 0; i < M; ++i) {
+    for (int j = 0; j < N; ++j) {
+      float expected = B.data<float>()[j];
+      for (int k = 0; k < K; ++k) {
+        expected += X.data<float>()[i * K + k] * W.data<float>()[j * K + k];
+      }
+      if (relu) {
+        expected = std::max(expected, 0.f);
+      }
+      EXPECT_NEAR(Y.data<float>()[i * N + j], expected, 1e-3) << i << " " << j;
+    }
+  }
+}
+
+TEST(PackedFCTest, PacksOnFirstRun) {
+  const int M = 9, N = 21, K = 300;
+  Workspace ws;
+  FillInputs(M, N, K, &ws);
+  OperatorDef def;
+  def.set_type("PackedFC");
+  def.set_engine("PACKED");
+  def.add_input("X");
+  def.add_input("W");
+  def.add_input("B");
+  def.add_output("Y");
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  ASSERT_NE(nullptr, op.get());
+  // Running twice exercises the cached packed weight.
+  EXPECT_TRUE(op->Run());
+  EXPECT_TRUE(op->Run());
+  CheckFCRelu(M, N, K, false, &ws);
+}
+
+TEST(PackedFCTest, PrePackedWeightWithRelu) {
+  const int M = 4, N = 10, K = 13;
+  Workspace ws;
+  FillInputs(M, N, K, &ws);
+  OperatorDef pack_def;
+  pack_def.set_type("PackFCWeight");
+  pack_def.add_input("W");
+  pack_def.add_output("W_packed");
+  unique_ptr<OperatorBase> pack_op(CreateOperator(pack_def, &ws));
+  ASSERT_NE(nullptr, pack_op.get());
+  EXPECT_TRUE(pack_op->Run());
+
+  OperatorDef def;
+  def.set_type("PackedFC");
+  def.set_engine("PACKED");
+  def.add_input("X");
+  def.add_input("W_packed");
+  def.add_input("B");
+  def.add_output("Y");
+  Argument* relu = def.add_arg();
+  relu->set_name("relu");
+  relu->set_i(1);
+  unique_ptr<OperatorBase> op(CreateOperator(def, &ws));
+  ASSERT_NE(nullptr, op.get());
+  EXPECT_TRUE(op->Run());
+  CheckFCRelu(M, N, K, true, &ws);
+}
+
+}  // namespace caffe2
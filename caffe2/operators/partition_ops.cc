@@ -5,6 +5,10 @@ namespace {
 
 REGISTER_CPU_OPERATOR(Partition, PartitionOp);
 REGISTER_CPU_OPERATOR(LengthsPartition, LengthsPartitionOp);
+REGISTER_CPU_OPERATOR(PartitionWithPermutation, PartitionWithPermutationOp);
+REGISTER_CPU_OPERATOR(
+    LengthsPartitionWithPermutation,
+    LengthsPartitionWithPermutationOp);
 
 OPERATOR_SCHEMA(Shard)
     .NumInputsOutputs([](int in, int out) {
@@ -85,10 +89,74 @@ X_0_part_0, X_1_part_0, ..., X_N-1_part_0, X_0_part_1, ..., X_N-1_part_K-1
         "Output Shards. The number of output shards has to be a "
         "multiple of the number of input shards.");
 
+OPERATOR_SCHEMA(PartitionWithPermutation)
+    .NumInputsOutputs([](int in, int out) {
+      return in > 0 && out > 1 && (out - 1) % in == 0;
+    })
+    .SetDoc(R"DOC(
+Same as Partition, with an extra last output: the position of every element of
+the first input in the concatenation of its shards, in shard order. The
+number of partitions is derived as ((num_output - 1) / num_input).
+
+Results computed per shard and concatenated in shard order can then be put
+back in the order of the input with a single Gather on the permutation,
+instead of sorting them back.
+
+Outputs are ordered as
+X_0_part_0, X_1_part_0, ..., X_N-1_part_0, X_0_part_1, ..., X_N-1_part_K-1,
+permutation
+)DOC")
+    .Arg(
+        "pack_first_input",
+        "(int, default 0) If set, the operator transforms "
+        "the first tensor values as floor(X_ij / num_partitions)")
+    .Input(
+        0,
+        "input",
+        "Input tensor containing data to be sharded. The "
+        "number of input tensors might be greater than 1 but must have the "
+        "same shape as the previous tensors.")
+    .Output(
+        0,
+        "shards",
+        "Output Shards, followed by the 1-D int64 permutation, with an entry "
+        "per element of the first input.");
+
+OPERATOR_SCHEMA(LengthsPartitionWithPermutation)
+    .NumInputsOutputs([](int in, int out) {
+      return in >= 2 && out > 1 && (out - 1) % in == 0;
+    })
+    .SetDoc(R"DOC(
+Same as LengthsPartition, with an extra last output: the position of every
+element of the second input in the concatenation of its shards, in shard
+order. The number of partitions is derived as ((num_output - 1) / num_input).
+
+Outputs are ordered as
+X_0_part_0, X_1_part_0, ..., X_N-1_part_0, X_0_part_1, ..., X_N-1_part_K-1,
+permutation
+)DOC")
+    .Arg(
+        "pack_first_input",
+        "(int, default 0) If set, the operator transforms "
+        "the first tensor values as floor(X_ij / num_partitions)")
+    .Input(
+        0,
+        "input",
+        "Input tensor containing data to be sharded. The "
+        "number of input tensors might be greater than 1 but must have the "
+        "same shape as the previous tensors.")
+    .Output(
+        0,
+        "shards",
+        "Output Shards, followed by the 1-D int64 permutation, with an entry "
+        "per element of the second input.");
+
 // This should actually have gradient, but for now nothing uses it.
 // Because gradient computation right now is not input/output aware it can't be
 // GRADIENT_NOT_IMPLEMENTEDYET
 NO_GRADIENT(Sharding);
 NO_GRADIENT(ShardingLengths);
+NO_GRADIENT(PartitionWithPermutation);
+NO_GRADIENT(LengthsPartitionWithPermutation);
 } // namespace
 } // namespace caffe2
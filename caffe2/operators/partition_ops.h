@@ -1,46 +1,74 @@
 #ifndef CAFFE2_OPERATORS_PARTITION_OPS_H_
 #define CAFFE2_OPERATORS_PARTITION_OPS_H_
 
+#include <algorithm>
+#include <cstring>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/utils/parallel_partition.h"
+#include "caffe2/utils/thread_pool.h"
 
 namespace caffe2 {
 
+// Shard of value among partitions shards.
+template <typename Index>
+inline int ShardOf(const Index value, const int partitions) {
+  // TODO: support other partition functions
+  int shard = value % partitions;
+  // equivalent to `if (shard < 0) shard += partitions;`
+  shard += partitions & (shard >> (sizeof(int) * 8 - 1));
+  return shard;
+}
+
+// Both passes over the input, counting the shards and then copying every
+// element to its shard, are split in chunks across the CPU thread pool: the
+// chunks are counted in parallel, a prefix sum over the counts gives every
+// chunk its offsets in each shard, and every chunk then copies its elements
+// straight to their final place. Elements keep their order within a shard.
 class PartitionOpBase : public Operator<CPUContext> {
  public:
   USE_OPERATOR_FUNCTIONS(CPUContext);
 
-  PartitionOpBase(const OperatorDef& operator_def, Workspace* ws)
+  PartitionOpBase(
+      const OperatorDef& operator_def,
+      Workspace* ws,
+      bool output_permutation)
       : Operator<CPUContext>(operator_def, ws),
-        OP_SINGLE_ARG(int, "pack_first_input", pack_first_input_, 0) {}
+        OP_SINGLE_ARG(int, "pack_first_input", pack_first_input_, 0),
+        output_permutation_(output_permutation) {}
 
  protected:
-  template <typename Index>
-  void ApplyPartition(bool skipFirstArgument) {
+  // Number of partitions, from the number of outputs of every input and the
+  // optional permutation output.
+  int NumPartitions() {
+    const int numShardOutputs = OutputSize() - output_permutation_;
     CAFFE_ENFORCE_EQ(
-        OutputSize() % InputSize(),
+        numShardOutputs % InputSize(),
         0,
         "Output number must be a multiple of input number");
-    int partitions = OutputSize() / InputSize();
+    const int partitions = numShardOutputs / InputSize();
+    CAFFE_ENFORCE_GT(partitions, 0, "Invalid number of partitions");
+    return partitions;
+  }
+
+  template <typename Index>
+  void ApplyPartition(bool skipFirstArgument) {
+    int partitions = NumPartitions();
     int inputSize = InputSize();
     int mainInputIndex = skipFirstArgument;
-    CAFFE_ENFORCE_GT(partitions, 0, "Invalid number of partitions");
 
     auto& main_input = Input(mainInputIndex);
     TIndex size = main_input.size();
     const Index* data = main_input.template data<Index>();
-    counts_.assign(partitions, 0);
-    for (TIndex p = 0; p < size; p++) {
-      // TODO: support other partition functions
-      int shard = data[p] % partitions;
-      // equivalent to `if (shard < 0) shard += partitions;`
-      shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-      ++counts_[shard];
-    }
+    const auto shard_of = [data, partitions](const TIndex p) {
+      return ShardOf(data[p], partitions);
+    };
+    ParallelPartitionCount(
+        size, partitions, shard_of, &chunk_offsets_, &starts_);
 
     raw_datas_.resize(inputSize);
-    block_sizes_.resize(inputSize);
-    metas_.resize(inputSize);
+    block_bytes_.resize(inputSize);
     out_datas_.resize(OutputSize());
     for (int i = mainInputIndex; i < inputSize; ++i) {
       auto& input = Input(i);
@@ -67,53 +95,61 @@ class PartitionOpBase : public Operator<CPUContext> {
             i);
       }
       raw_datas_[i] = input.raw_data();
-      block_sizes_[i] = input.size_from_dim(main_input.ndim());
-      metas_[i] = input.meta();
+      block_bytes_[i] =
+          input.size_from_dim(main_input.ndim()) * input.meta().itemsize();
       // shape = partition_size + suffix of input dims
       vector<TIndex> shape(
           input.dims().begin() + main_input.ndim() - 1, input.dims().end());
       for (int j = 0; j < partitions; ++j) {
         int out_idx = i + j * inputSize;
         auto output = Output(out_idx);
-        shape[0] = counts_[j];
+        shape[0] = starts_[j + 1] - starts_[j];
         output->Resize(shape);
         out_datas_[out_idx] = output->raw_mutable_data(input.meta());
       }
     }
-
-    counts_.assign(partitions, 0);
-    for (TIndex p = 0; p < size; p++) {
-      // TODO: support other partition functions
-      int shard = data[p] % partitions;
-      // equivalent to `if (shard < 0) shard += partitions;`
-      shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-      TIndex idx = counts_[shard]++;
-
-      // special case first input
-      static_cast<Index*>(out_datas_[shard * inputSize + mainInputIndex])[idx] =
-          pack_first_input_ ? ((data[p] - shard) / partitions) : data[p];
-
-      int baseIndex = shard * inputSize;
-      for (int i = mainInputIndex + 1; i < inputSize; ++i) {
-        auto bs = block_sizes_[i];
-        auto meta = metas_[i];
-        // special case for small bs?
-        context_.template CopyItems<CPUContext, CPUContext>(
-            meta,
-            bs,
-            static_cast<const char*>(raw_datas_[i]) + p * bs * meta.itemsize(),
-            static_cast<char*>(out_datas_[baseIndex + i]) +
-                idx * bs * meta.itemsize());
-      }
+    int64_t* permutation = nullptr;
+    if (output_permutation_) {
+      auto* output = Output(OutputSize() - 1);
+      output->Resize(size);
+      permutation = output->template mutable_data<int64_t>();
     }
+
+    ParallelPartitionScatter(
+        size,
+        partitions,
+        shard_of,
+        &chunk_offsets_,
+        [&](const TIndex p, const int shard, const TIndex q) {
+          const TIndex idx = q - starts_[shard];
+          // special case first input
+          static_cast<Index*>(
+              out_datas_[shard * inputSize + mainInputIndex])[idx] =
+              pack_first_input_ ? ((data[p] - shard) / partitions) : data[p];
+
+          int baseIndex = shard * inputSize;
+          for (int i = mainInputIndex + 1; i < inputSize; ++i) {
+            const auto bytes = block_bytes_[i];
+            std::memcpy(
+                static_cast<char*>(out_datas_[baseIndex + i]) + idx * bytes,
+                static_cast<const char*>(raw_datas_[i]) + p * bytes,
+                bytes);
+          }
+          if (permutation) {
+            permutation[p] = q;
+          }
+        });
   }
 
   bool pack_first_input_;
+  // Whether the last output is the position of every element in the
+  // concatenation of the shards.
+  bool output_permutation_;
 
   // use member fields to reuse memory
-  vector<TIndex> counts_;
-  vector<TIndex> block_sizes_;
-  vector<TypeMeta> metas_;
+  vector<TIndex> chunk_offsets_;
+  vector<TIndex> starts_;
+  vector<TIndex> block_bytes_;
   vector<const void*> raw_datas_;
   vector<void*> out_datas_;
 };
@@ -123,12 +159,19 @@ class PartitionOp : public PartitionOpBase {
   USE_DISPATCH_HELPER;
 
   PartitionOp(const OperatorDef& operator_def, Workspace* ws)
-      : PartitionOpBase(operator_def, ws) {}
+      : PartitionOpBase(operator_def, ws, false) {}
 
   bool RunOnDevice() override {
     return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(0));
   }
 
+ protected:
+  PartitionOp(
+      const OperatorDef& operator_def,
+      Workspace* ws,
+      bool output_permutation)
+      : PartitionOpBase(operator_def, ws, output_permutation) {}
+
  private:
   template <typename Index>
   bool DoRunWithType() {
@@ -139,25 +182,34 @@ class PartitionOp : public PartitionOpBase {
   DISABLE_COPY_AND_ASSIGN(PartitionOp);
 };
 
+class PartitionWithPermutationOp final : public PartitionOp {
+ public:
+  PartitionWithPermutationOp(const OperatorDef& operator_def, Workspace* ws)
+      : PartitionOp(operator_def, ws, true) {}
+};
+
 class LengthsPartitionOp : public PartitionOpBase {
  public:
   USE_DISPATCH_HELPER;
 
   LengthsPartitionOp(const OperatorDef& operator_def, Workspace* ws)
-      : PartitionOpBase(operator_def, ws) {}
+      : PartitionOpBase(operator_def, ws, false) {}
 
   bool RunOnDevice() override {
     return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(this, Input(1));
   }
 
+ protected:
+  LengthsPartitionOp(
+      const OperatorDef& operator_def,
+      Workspace* ws,
+      bool output_permutation)
+      : PartitionOpBase(operator_def, ws, output_permutation) {}
+
  private:
   template <typename Index>
   bool DoRunWithType() {
-    CAFFE_ENFORCE(
-        OutputSize() % InputSize() == 0,
-        "Output number must be a multiple of input number");
-    int partitions = OutputSize() / InputSize();
-    CAFFE_ENFORCE_GT(partitions, 0, "Invalid number of partitions");
+    int partitions = NumPartitions();
     CAFFE_ENFORCE_EQ(
         Input(1).ndim(),
         1,
@@ -181,33 +233,53 @@ class LengthsPartitionOp : public PartitionOpBase {
       out_length_[i] = output.template mutable_data<int32_t>();
     }
 
-    int total_length = 0;
+    element_starts_.resize(elements + 1);
+    TIndex total_length = 0;
     for (int i = 0; i < elements; ++i) {
+      CAFFE_ENFORCE_GE(lengths_data[i], 0, "Lengths must be non-negative");
+      element_starts_[i] = total_length;
       total_length += lengths_data[i];
     }
+    element_starts_[elements] = total_length;
     CAFFE_ENFORCE(
         total_length == size,
         "Total length is not matching to the number of elements");
 
-    int index = 0;
-    for (int i = 0; i < elements; ++i) {
-      for (int j = 0; j < partitions; ++j) {
-        out_length_[j][i] = 0;
-      }
-      for (int j = 0; j < lengths_data[i]; ++j, ++index) {
-        // TODO: support other partition functions
-        int shard = data[index] % partitions;
-        // equivalent to `if (shard < 0) shard += partitions;`
-        shard += partitions & (shard >> (sizeof(int) * 8 - 1));
-        ++out_length_[shard][i];
-      }
-    }
+    // Splits the elements across the CPU thread pool, in tasks of about
+    // kParallelPartitionChunkSize indices.
+    const TIndex num_tasks = std::max<TIndex>(
+        1, std::min<TIndex>(elements, size / kParallelPartitionChunkSize));
+    ThreadPool::Default()->Run(
+        [&](size_t t) {
+          const TIndex begin = elements * t / num_tasks;
+          const TIndex end = elements * (t + 1) / num_tasks;
+          for (TIndex i = begin; i < end; ++i) {
+            for (int j = 0; j < partitions; ++j) {
+              out_length_[j][i] = 0;
+            }
+            for (TIndex index = element_starts_[i];
+                 index < element_starts_[i + 1];
+                 ++index) {
+              ++out_length_[ShardOf(data[index], partitions)][i];
+            }
+          }
+        },
+        num_tasks);
     return true;
   }
 
   DISABLE_COPY_AND_ASSIGN(LengthsPartitionOp);
 
   vector<int32_t*> out_length_;
+  vector<TIndex> element_starts_;
+};
+
+class LengthsPartitionWithPermutationOp final : public LengthsPartitionOp {
+ public:
+  LengthsPartitionWithPermutationOp(
+      const OperatorDef& operator_def,
+      Workspace* ws)
+      : LengthsPartitionOp(operator_def, ws, true) {}
 };
 
 } // namespace caffe2
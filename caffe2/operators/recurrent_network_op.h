@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
@@ -105,27 +107,61 @@ void initializeScratch(
       ->Resize(std::vector<TIndex>{seqLength, batchSize, scratch.sizePerStep});
 }
 
+// A link with its blobs resolved to tensors. The tensors are looked up once
+// per sequence and then reused at every timestep, instead of looking the blobs
+// up by name for every link and timestep.
+template <typename Context>
+struct ResolvedLink {
+  Tensor<Context>* internal;
+  Tensor<Context>* external;
+  int32_t offset;
+};
+
+template <typename Context>
+void resolveLinks(
+    const std::vector<Link>& links,
+    Workspace* ws,
+    std::vector<ResolvedLink<Context>>* resolved) {
+  resolved->clear();
+  for (const auto& link : links) {
+    VLOG(1) << "Linking: " << link.internal << " to: " << link.external
+            << " at offset: " << link.offset;
+    ResolvedLink<Context> r;
+    r.internal = CHECK_NOTNULL(ws->CreateBlob(link.internal))
+                     ->template GetMutable<Tensor<Context>>();
+    r.external = CHECK_NOTNULL(ws->GetBlob(link.external))
+                     ->template GetMutable<Tensor<Context>>();
+    r.offset = link.offset;
+    resolved->push_back(r);
+  }
+}
+
 template <typename T, typename Context>
-void applyLink(const Link& link, size_t t, Workspace* ws) {
-  VLOG(1) << "Linking: " << link.internal << " to: " << link.external
-          << " at offset: " << link.offset;
-  auto* internalTensor = CHECK_NOTNULL(ws->CreateBlob(link.internal))
-                             ->template GetMutable<Tensor<Context>>();
-  auto* externalTensor = CHECK_NOTNULL(ws->GetBlob(link.external))
-                             ->template GetMutable<Tensor<Context>>();
+void applyLink(const ResolvedLink<Context>& link, size_t t) {
+  auto* internalTensor = link.internal;
+  auto* externalTensor = link.external;
   CHECK_GT(externalTensor->size(), 0);
   const TIndex externalTimestepSize =
       externalTensor->size() / externalTensor->dim(0);
   auto* externalData = externalTensor->template mutable_data<T>() +
       (t + link.offset) * externalTimestepSize;
-  auto internalDims = externalTensor->dims();
-  // Single timestep
-  internalDims[0] = 1;
-  internalTensor->Resize(internalDims);
+  // Single timestep. The step net usually leaves the shape alone, so it is
+  // only set again when it has changed.
+  const auto& externalDims = externalTensor->dims();
+  const auto& internalDims = internalTensor->dims();
+  if (internalDims.size() != externalDims.size() || internalDims[0] != 1 ||
+      !std::equal(
+          externalDims.begin() + 1,
+          externalDims.end(),
+          internalDims.begin() + 1)) {
+    auto dims = externalDims;
+    dims[0] = 1;
+    internalTensor->Resize(dims);
+  }
   internalTensor->ShareExternalPointer(externalData, externalTimestepSize);
 }
 
-void extractLinks(
+inline void extractLinks(
     OperatorBase* op,
     const std::string& internalArg,
     const std::string& externalArg,
@@ -275,15 +311,17 @@ class RecurrentNetworkOp final : public Operator<Context> {
       detail::initializeScratch<Context>(scratch, seqLen, batchSize, &ws_);
     }
 
+    detail::resolveLinks<Context>(links_, &ws_, &resolvedLinks_);
+    auto* timestep = CHECK_NOTNULL(ws_.GetBlob(timestep_))
+                         ->template GetMutable<TensorCPU>()
+                         ->template mutable_data<int32_t>();
     for (auto t = 0; t < seqLen; ++t) {
-      for (const auto& link : links_) {
-        detail::applyLink<T, Context>(link, t, &ws_);
+      for (const auto& link : resolvedLinks_) {
+        detail::applyLink<T, Context>(link, t);
       }
       // Since we have a SimpleNet, there are no races here.
-      CHECK_NOTNULL(ws_.GetBlob(timestep_))
-          ->template GetMutable<TensorCPU>()
-          ->template mutable_data<int32_t>()[0] = t;
-      stepNet_->RunAsync();
+      timestep[0] = t;
+      CAFFE_ENFORCE(stepNet_->RunAsync(), "Step net failed at timestep ", t);
     }
 
     for (const auto& alias : aliases_) {
@@ -298,6 +336,7 @@ class RecurrentNetworkOp final : public Operator<Context> {
   Workspace ws_;
   std::vector<detail::Scratch> scratches_;
   std::vector<detail::Link> links_;
+  std::vector<detail::ResolvedLink<Context>> resolvedLinks_;
   std::vector<detail::OffsetAlias> aliases_;
   std::vector<detail::RecurrentInput> recurrentInputs_;
   std::string timestep_;
@@ -478,12 +517,34 @@ class RecurrentNetworkGradientOp final : public Operator<Context> {
       detail::initializeScratch<Context>(scratch, seqLen, batchSize, &ws_);
     }
 
-    auto accumulateParameterGradients = [&]() {
-      for (const auto& param : params_) {
-        const auto& g = CHECK_NOTNULL(ws_.GetBlob(param.grad))
+    // The gradients and accumulated gradients of the parameters, and the
+    // recurrent gradients with the external gradients they accumulate.
+    paramGrads_.clear();
+    for (const auto& param : params_) {
+      const auto* g = &CHECK_NOTNULL(ws_.GetBlob(param.grad))
+                           ->template Get<Tensor<Context>>();
+      auto* ag = CHECK_NOTNULL(ws_.GetBlob(param.accGrad))
+                     ->template GetMutable<Tensor<Context>>();
+      paramGrads_.emplace_back(g, ag);
+    }
+    inputGrads_.clear();
+    for (const auto& rg : recurrentGradients_) {
+      if (rg.externalGrad.empty()) {
+        continue;
+      }
+      auto* g = CHECK_NOTNULL(ws_.GetBlob(rg.grad))
+                    ->template GetMutable<Tensor<Context>>();
+      const auto* og = &CHECK_NOTNULL(ws_.GetBlob(rg.externalGrad))
                             ->template Get<Tensor<Context>>();
-        auto* ag = CHECK_NOTNULL(ws_.GetBlob(param.accGrad))
-                       ->template GetMutable<Tensor<Context>>();
+      // g[T+offset] += og[T]
+      CHECK_EQ(g->size() / g->dim(0), og->size() / og->dim(0));
+      inputGrads_.push_back(InputGradient{g, og, rg.offset});
+    }
+
+    auto accumulateParameterGradients = [&]() {
+      for (const auto& grads : paramGrads_) {
+        const auto& g = *grads.first;
+        auto* ag = grads.second;
         CAFFE_ENFORCE(ag->dims() == g.dims());
         math::Add<T, Context>(
             g.size(),
@@ -496,42 +557,36 @@ class RecurrentNetworkGradientOp final : public Operator<Context> {
 
     auto accumulateInputGradients = [&](int t) {
       // Input gradients
-      for (const auto& rg : recurrentGradients_) {
-        if (rg.externalGrad.empty()) {
-          continue;
-        }
-        VLOG(1) << "Accumulating into: " << rg.grad << " from "
-                << rg.externalGrad << " at time: " << t
-                << ", offset: " << rg.offset;
-        auto* g = CHECK_NOTNULL(ws_.GetBlob(rg.grad))
-                      ->template GetMutable<Tensor<Context>>();
-        const auto& og = CHECK_NOTNULL(ws_.GetBlob(rg.externalGrad))
-                             ->template Get<Tensor<Context>>();
+      for (const auto& ig : inputGrads_) {
+        VLOG(1) << "Accumulating input gradient at time: " << t
+                << ", offset: " << ig.offset;
+        auto* g = ig.grad;
+        const auto& og = *ig.externalGrad;
 
         // g[T+offset] += og[T]
-        CHECK_EQ(g->size() / g->dim(0), og.size() / og.dim(0));
         const auto timestep = g->size() / g->dim(0);
-        CHECK_EQ(timestep, og.size() / og.dim(0));
         math::Add<T, Context>(
             timestep,
             og.template data<T>() + t * timestep,
-            g->template data<T>() + (t + rg.offset) * timestep,
-            g->template mutable_data<T>() + (t + rg.offset) * timestep,
+            g->template data<T>() + (t + ig.offset) * timestep,
+            g->template mutable_data<T>() + (t + ig.offset) * timestep,
             &context_);
       }
     };
 
+    detail::resolveLinks<Context>(links_, &ws_, &resolvedLinks_);
+    auto* timestep = CHECK_NOTNULL(ws_.GetBlob(timestep_))
+                         ->template GetMutable<TensorCPU>()
+                         ->template mutable_data<int32_t>();
     for (int32_t t = seqLen - 1; t >= 0; --t) {
       VLOG(1) << "Running step: " << t;
       accumulateInputGradients(t);
-      for (const auto& link : links_) {
-        detail::applyLink<T, Context>(link, t, &ws_);
+      for (const auto& link : resolvedLinks_) {
+        detail::applyLink<T, Context>(link, t);
       }
       // Since we have a SimpleNet, there are no races here.
-      ws_.GetBlob(timestep_)
-          ->template GetMutable<TensorCPU>()
-          ->template mutable_data<int32_t>()[0] = t;
-      stepNet_->RunAsync();
+      timestep[0] = t;
+      CAFFE_ENFORCE(stepNet_->RunAsync(), "Step net failed at timestep ", t);
       accumulateParameterGradients();
     }
 
@@ -555,10 +610,20 @@ class RecurrentNetworkGradientOp final : public Operator<Context> {
   Workspace ws_;
   std::vector<detail::Scratch> scratches_;
   std::vector<detail::Link> links_;
+  std::vector<detail::ResolvedLink<Context>> resolvedLinks_;
   std::vector<detail::Param> params_;
   std::vector<detail::RecurrentGradient> recurrentGradients_;
   std::vector<detail::OffsetAlias> aliases_;
   std::vector<int32_t> recurrentSizes_;
   std::string timestep_;
+
+  // Resolved once per sequence, see RunOnDevice.
+  struct InputGradient {
+    Tensor<Context>* grad;
+    const Tensor<Context>* externalGrad;
+    int32_t offset;
+  };
+  std::vector<std::pair<const Tensor<Context>*, Tensor<Context>*>> paramGrads_;
+  std::vector<InputGradient> inputGrads_;
 };
 }
@@ -1,12 +1,94 @@
+#include <algorithm>
 #include <cstdio>
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
 #include "caffe2/operators/reducer_functors.h"
+#include "caffe2/utils/embedding_lookup.h"
+#include "caffe2/utils/parallel_partition.h"
+#include "caffe2/utils/thread_pool.h"
 
 namespace caffe2 {
 
+////////////////////////////////////////////////////////////////////////////////
+// Parallel execution of the segment ops. Each task of the thread pool owns a
+// range of segments and reduces them on its own, so no two tasks write the
+// same output slice and every segment is reduced in the same order as in a
+// sequential loop.
+////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Approximate number of input elements reduced by one task.
+constexpr TIndex kSegmentReductionGrain = 1 << 15;
+
+// Returns the number of tasks to split a reduction of work input elements
+// into: one per kSegmentReductionGrain elements, and at most num_threads if it
+// is positive, or the threads of the CPU thread pool otherwise.
+int SegmentReductionTasks(const TIndex work, const int num_threads) {
+  const int max_tasks = num_threads > 0
+      ? num_threads
+      : ThreadPool::Default()->EffectiveNumThreads();
+  return std::max<TIndex>(
+      1, std::min<TIndex>(max_tasks, work / kSegmentReductionGrain));
+}
+
+// Documents the num_threads argument that every parallel segment op takes.
+void AddNumThreadsArg(OpSchema& schema) {
+  schema.Arg(
+      "num_threads",
+      "Optional maximum number of CPU threads to split the segments across. "
+      "Defaults to the threads of the CPU thread pool; 1 runs sequentially.");
+}
+
+// Returns the start of every segment of sorted segment ids without gaps,
+// followed by n.
+template <typename SIndex>
+vector<TIndex> SortedSegmentStarts(const SIndex* s_ids, const TIndex n) {
+  vector<TIndex> starts;
+  if (n > 0) {
+    CHECK_EQ(0, s_ids[0]) << "Indices must be sorted and not have gaps";
+    starts.push_back(0);
+  }
+  for (TIndex i = 1; i < n; ++i) {
+    if (s_ids[i] != s_ids[i - 1]) {
+      CHECK_EQ(s_ids[i - 1] + 1, s_ids[i])
+          << "Indices must be sorted and not have gaps";
+      starts.push_back(i);
+    }
+  }
+  starts.push_back(n);
+  return starts;
+}
+
+// Calls f(begin, end) on consecutive ranges of the segments, where segment s
+// covers the rows starts[s] to starts[s + 1] - 1, in num_tasks tasks that get
+// about the same number of rows.
+template <typename F>
+void ForEachSegmentRange(
+    const vector<TIndex>& starts,
+    const int num_tasks,
+    const F& f) {
+  const TIndex num_segments = starts.size() - 1;
+  if (num_tasks <= 1) {
+    f(0, num_segments);
+    return;
+  }
+  const TIndex num_rows = starts.back();
+  // The first segment that starts at or after the rows of task t.
+  const auto first_segment = [&](const TIndex t) -> TIndex {
+    return std::lower_bound(
+               starts.begin(), starts.end() - 1, t * num_rows / num_tasks) -
+        starts.begin();
+  };
+  ThreadPool::Default()->Run(
+      [&](size_t t) { f(first_segment(t), first_segment(t + 1)); },
+      num_tasks);
+}
+
+} // namespace
+
 ////////////////////////////////////////////////////////////////////////////////
 // Range reducer ops: leverage that input segment is continuous and allow
 // reducer functors to do something special
@@ -24,7 +106,10 @@ template <typename T, typename SIndex, class Context, class RangeReducer>
 class AbstractSortedSegmentRangeOp : public Operator<Context> {
  public:
   USE_OPERATOR_CONTEXT_FUNCTIONS;
-  USE_SIMPLE_CTOR_DTOR(AbstractSortedSegmentRangeOp);
+
+  AbstractSortedSegmentRangeOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        OP_SINGLE_ARG(int, "num_threads", num_threads_, 0) {}
 
   bool RunOnDevice() override {
     auto& data = Input(DATA);
@@ -53,30 +138,28 @@ class AbstractSortedSegmentRangeOp : public Operator<Context> {
     TIndex block_size = data.size() / N;
 
     // Assume the segments are sorted and there are no gaps
-    CHECK_EQ(0, s_ids[0]) << "Indices must be sorted and not have gaps";
-    for (TIndex i = 0; i < N;) {
-      TIndex start = i;
-      for (++i; i < N && s_ids[start] == s_ids[i]; ++i)
-        ;
-
-      RangeReducer()(
-          block_size,
-          i - start,
-          d + block_size * start,
-          out + block_size * s_ids[start],
-          &context_);
-
-      // check correctness of the next segment
-      if (i < N) {
-        CHECK_EQ(s_ids[start] + 1, s_ids[i])
-            << "Indices must be sorted and not have gaps";
-      }
-    }
+    const vector<TIndex> starts = SortedSegmentStarts(s_ids, N);
+    ForEachSegmentRange(
+        starts,
+        SegmentReductionTasks(N * block_size, num_threads_),
+        [&](const TIndex begin, const TIndex end) {
+          for (TIndex s = begin; s < end; ++s) {
+            RangeReducer()(
+                block_size,
+                starts[s + 1] - starts[s],
+                d + block_size * starts[s],
+                out + block_size * s,
+                &context_);
+          }
+        });
     return true;
   }
 
   static constexpr int kNumInputs = 2;
   INPUT_TAGS(DATA, SEGMENT_IDS);
+
+ private:
+  int num_threads_;
 };
 
 template <
@@ -170,6 +253,7 @@ i.e. `SEGMENT_IDS[-1]+1`. Other dimensions are inherited from the input tensor.
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
+    AddNumThreadsArg(schema);
     schema.Input(0, "DATA", "Input tensor to be aggregated");
     schema.Input(
         1,
@@ -423,6 +507,10 @@ UnsortedSegment{op} but as if all input slices belong to a single segment.
  *   # P+1 if SparseFused == false:
  *   P+1 or P+2: SEGMENT_IDS - sorted segment ids 1-D vector
  *
+ * Args:
+ *   num_threads - the maximum number of CPU threads to split the segments
+ *                 across, or 0 (default) for the threads of the thread pool.
+ *
  * Output:
  *   Tensor with first dimension of K, where K is the max segment id + 1. Rest
  *   of dimensions are decided by reducer but usually are the same size as extra
@@ -437,7 +525,10 @@ template <
 class AbstractSortedSegmentOp : public Operator<Context> {
  public:
   USE_OPERATOR_CONTEXT_FUNCTIONS;
-  USE_SIMPLE_CTOR_DTOR(AbstractSortedSegmentOp);
+
+  AbstractSortedSegmentOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        OP_SINGLE_ARG(int, "num_threads", num_threads_, 0) {}
 
   bool RunOnDevice() override {
     // If more complicated fixed size logic becomes necessary, it can be moved
@@ -498,34 +589,31 @@ class AbstractSortedSegmentOp : public Operator<Context> {
     TIndex out_block_size = output->size_from_dim(1);
 
     // Assume the segments are sorted and there are no gaps
-    CHECK_EQ(0, s_ids[0]) << "Indices must be sorted and not have gaps";
-    for (TIndex i = 0; i < N;) {
-      TIndex start = i;
-
-      Reducer r(ctx, out + out_block_size * s_ids[start], &context_);
-      for (; i < N && s_ids[start] == s_ids[i]; ++i) {
-        TIndex idx;
-        if (SparseFused) { // static if
-          CAFFE_ENFORCE(
-              0 <= idxs[i] && idxs[i] < M,
-              "Index out of bounds: ",
-              idxs[i],
-              ", range 0 to ",
-              M);
-          idx = idxs[i];
-        } else {
-          idx = i;
-        }
-        r.template process<FixedSize>(
-            ctx, d + in_block_size * idx, i, &context_);
-      }
-
-      // check correctness of the next segment
-      if (i < N) {
-        CHECK_EQ(s_ids[start] + 1, s_ids[i])
-            << "Indices must be sorted and not have gaps";
-      }
-    }
+    const vector<TIndex> starts = SortedSegmentStarts(s_ids, N);
+    ForEachSegmentRange(
+        starts,
+        SegmentReductionTasks(N * in_block_size, num_threads_),
+        [&](const TIndex begin, const TIndex end) {
+          for (TIndex s = begin; s < end; ++s) {
+            Reducer r(ctx, out + out_block_size * s, &context_);
+            for (TIndex i = starts[s]; i < starts[s + 1]; ++i) {
+              TIndex idx;
+              if (SparseFused) { // static if
+                CAFFE_ENFORCE(
+                    0 <= idxs[i] && idxs[i] < M,
+                    "Index out of bounds: ",
+                    idxs[i],
+                    ", range 0 to ",
+                    M);
+                idx = idxs[i];
+              } else {
+                idx = i;
+              }
+              r.template process<FixedSize>(
+                  ctx, d + in_block_size * idx, i, &context_);
+            }
+          }
+        });
     return true;
   }
 
@@ -535,6 +623,9 @@ class AbstractSortedSegmentOp : public Operator<Context> {
   };
   static constexpr int kSelfInputs = SparseFused ? 2 : 1;
   static constexpr int kNumInputs = Reducer::kInputCount + kSelfInputs;
+
+ private:
+  int num_threads_;
 };
 
 // Gradient actually doesn't depend on whether sparse lookup is fused or not
@@ -669,6 +760,7 @@ i.e. `SEGMENT_IDS[-1]+1`. Other dimensions are inherited from the input tensor.
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
+    AddNumThreadsArg(schema);
     schema.Input(0, "DATA", "Input tensor, slices of which are aggregated.");
     schema.Input(
         Reducer::kInputCount,
@@ -721,6 +813,7 @@ i.e. `SEGMENT_IDS[-1]+1`. Other dimensions are inherited from the input tensor.
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
+    AddNumThreadsArg(schema);
     schema.Input(0, "DATA", "Input tensor, slices of which are aggregated.");
     schema.Input(
         Reducer::kInputCount,
@@ -778,6 +871,8 @@ i.e. `SEGMENT_IDS[-1]+1`. Other dimensions are inherited from the input tensor.
  * Args:
  *   num_segments - allows to override the dimension of the output. If not set
  *                  it would be inferred from segment_ids tensor.
+ *   num_threads - the maximum number of CPU threads to split the segments
+ *                 across, or 0 (default) for the threads of the thread pool.
  *
  *
  * Output:
@@ -797,7 +892,8 @@ class AbstractUnsortedSegmentOp : public Operator<Context> {
 
   AbstractUnsortedSegmentOp(const OperatorDef& operator_def, Workspace* ws)
       : Operator<Context>(operator_def, ws),
-        OP_SINGLE_ARG(int, "num_segments", num_segments_, -1) {}
+        OP_SINGLE_ARG(int, "num_segments", num_segments_, -1),
+        OP_SINGLE_ARG(int, "num_threads", num_threads_, 0) {}
 
   bool RunOnDevice() override {
     // If more complicated fixed size logic becomes necessary, it can be moved
@@ -864,6 +960,61 @@ class AbstractUnsortedSegmentOp : public Operator<Context> {
     TIndex out_block_size = output->size_from_dim(1);
     T* out = output->template mutable_data<T>();
 
+    const int num_tasks = std::min<TIndex>(
+        SegmentReductionTasks(N * in_block_size, num_threads_), K);
+    if (num_tasks > 1) {
+      // Task t owns the segments s with s * num_tasks / K == t, and reduces
+      // the rows of its segments in their order in the input.
+      vector<TIndex> positions;
+      vector<TIndex> task_starts;
+      ParallelPartition(
+          N,
+          num_tasks,
+          [&](const TIndex i) -> int {
+            const TIndex s_id = s_ids[i];
+            // Out of range ids are reported by the task that gets them.
+            return 0 <= s_id && s_id < K ? s_id * num_tasks / K : 0;
+          },
+          &positions,
+          &task_starts);
+      ThreadPool::Default()->Run(
+          [&](size_t t) {
+            const TIndex first = (t * K + num_tasks - 1) / num_tasks;
+            const TIndex last = ((t + 1) * K + num_tasks - 1) / num_tasks;
+            vector<Reducer> reducers;
+            reducers.reserve(last - first);
+            for (TIndex s = first; s < last; ++s) {
+              reducers.emplace_back(ctx, out + out_block_size * s, &context_);
+            }
+            for (TIndex p = task_starts[t]; p < task_starts[t + 1]; ++p) {
+              const TIndex i = positions[p];
+              const TIndex s_id = s_ids[i];
+              CAFFE_ENFORCE(
+                  first <= s_id && s_id < last,
+                  "Segment id out of range: ",
+                  s_id,
+                  ", range 0 to ",
+                  K);
+              TIndex idx;
+              if (SparseFused) { // static if
+                CAFFE_ENFORCE(
+                    0 <= idxs[i] && idxs[i] < M,
+                    "Index out of bounds: ",
+                    idxs[i],
+                    ", range 0 to ",
+                    M);
+                idx = idxs[i];
+              } else {
+                idx = i;
+              }
+              reducers[s_id - first].template process<FixedSize>(
+                  ctx, d + in_block_size * idx, i, &context_);
+            }
+          },
+          num_tasks);
+      return true;
+    }
+
     reducers_.clear();
     reducers_.reserve(K);
     for (TIndex i = 0; i < K; ++i) {
@@ -907,6 +1058,7 @@ class AbstractUnsortedSegmentOp : public Operator<Context> {
 
  private:
   TIndex num_segments_;
+  int num_threads_;
   // member field to reuse memory
   vector<Reducer> reducers_;
 };
@@ -1015,6 +1167,7 @@ tensor.
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
+    AddNumThreadsArg(schema);
     schema.Arg(
         "num_segments",
         "Optional int argument specifying the number of output segments and "
@@ -1077,6 +1230,7 @@ tensor.
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
+    AddNumThreadsArg(schema);
     schema.Input(0, "DATA", "Input tensor, slices of which are aggregated.");
     schema.Input(
         Reducer::kInputCount,
@@ -1111,6 +1265,16 @@ tensor.
       true /*SparseFused*/>;
 };
 
+// Reducers for which the SparseLengths ops run the specialized
+// EmbeddingLookup kernel instead of calling the reducer once per index.
+template <class Reducer>
+struct UsesEmbeddingLookup : std::false_type {};
+template <>
+struct UsesEmbeddingLookup<SumReducer<float, CPUContext>> : std::true_type {};
+template <>
+struct UsesEmbeddingLookup<WeightedSumReducer<float, CPUContext>>
+    : std::true_type {};
+
 /**
  * @brief Segment reduction op with optional fused embedding lookup
  *
@@ -1158,6 +1322,64 @@ class AbstractLengthsOp : public Operator<Context> {
 
   template <int FixedSize>
   bool DoRunWithValue() {
+    return DoRunWithValue<FixedSize>(std::integral_constant<
+                                     bool,
+                                     SparseFused &&
+                                         UsesEmbeddingLookup<Reducer>::value>());
+  }
+
+  // Fast path for SparseLengthsSum and SparseLengthsWeightedSum.
+  template <int FixedSize>
+  bool DoRunWithValue(std::true_type /* uses EmbeddingLookup */) {
+    auto& dataInput = Input(0);
+    auto& indicesInput = Input(INDICES);
+    auto& lengthsInput = Input(LENGTHS);
+    auto* output = Output(0);
+    CAFFE_ENFORCE_EQ(1, indicesInput.ndim(), "INDICES must be a vector");
+    CAFFE_ENFORCE_EQ(1, lengthsInput.ndim(), "LENGTHS must be a vector");
+    CAFFE_ENFORCE_GT(dataInput.ndim(), 0, "DATA must be at least 1-D");
+    const TIndex indexSize = indicesInput.dim(0);
+    const float* weights = nullptr;
+    if (Reducer::kInputCount == 2) {
+      auto& weightsInput = Input(1);
+      CAFFE_ENFORCE_EQ(1, weightsInput.ndim(), "SCALARS must be a vector");
+      CAFFE_ENFORCE_EQ(
+          indexSize,
+          weightsInput.dim(0),
+          "Input 1 must have have the same first dim as INDICES");
+      weights = weightsInput.template data<float>();
+    }
+    vector<TIndex> shape = dataInput.dims();
+    shape[0] = lengthsInput.dim(0);
+    output->Resize(shape);
+    if (dataInput.template IsType<float16>()) {
+      RunEmbeddingLookup(dataInput.template data<float16>(), weights);
+    } else {
+      RunEmbeddingLookup(dataInput.template data<float>(), weights);
+    }
+    return true;
+  }
+
+  template <typename InType>
+  void RunEmbeddingLookup(const InType* data, const float* weights) {
+    auto& dataInput = Input(0);
+    auto& lengthsInput = Input(LENGTHS);
+    EmbeddingLookup(
+        dataInput.size_from_dim(1),
+        lengthsInput.dim(0),
+        Input(INDICES).dim(0),
+        dataInput.dim(0),
+        data,
+        Input(INDICES).template data<TIndex>(),
+        lengthsInput.template data<int>(),
+        weights,
+        nullptr,
+        false,
+        Output(0)->template mutable_data<float>());
+  }
+
+  template <int FixedSize>
+  bool DoRunWithValue(std::false_type /* uses EmbeddingLookup */) {
     auto& dataInput = Input(0);
     auto& lengthsInput = Input(LENGTHS);
     auto* output = Output(0);
@@ -1421,6 +1643,10 @@ to match INDICES size.
 The first dimension of the output is equal to the number of input segment,
 i.e. `len(LENGTHS)`. Other dimensions are inherited from the input tensor.
 
+On CPU, DATA may also be a float16 tensor, which halves the memory used by
+large embedding tables. Its slices are converted as they are read and the
+output is float.
+
 {op_doc}
   )DOC";
   static void PopulateSchema(OpSchema& schema) {
@@ -0,0 +1,185 @@
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+TensorCPU* CreateTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<T>();
+  return tensor;
+}
+
+// Runs SparseLengths(Weighted)Sum on random inputs and compares the output
+// with a naive evaluation.
+void CheckSparseLengthsSum(
+    const int num_rows,
+    const int block_size,
+    const int num_segments,
+    const bool weighted) {
+  Workspace ws;
+  std::mt19937 gen(num_rows + block_size);
+  std::uniform_real_distribution<float> value(-1, 1);
+  std::uniform_int_distribution<int> length(0, 30);
+  std::uniform_int_distribution<TIndex> index(0, num_rows - 1);
+
+  auto* data = CreateTensor<float>(&ws, "data", {num_rows, block_size});
+  for (int i = 0; i < data->size(); ++i) {
+    data->mutable_data<float>()[i] = value(gen);
+  }
+  auto* lengths = CreateTensor<int>(&ws, "lengths", {num_segments});
+  int num_indices = 0;
+  for (int i = 0; i < num_segments; ++i) {
+    lengths->mutable_data<int>()[i] = length(gen);
+    num_indices += lengths->data<int>()[i];
+  }
+  auto* indices = CreateTensor<TIndex>(&ws, "indices", {num_indices});
+  auto* weights = CreateTensor<float>(&ws, "weights", {num_indices});
+  for (int i = 0; i < num_indices; ++i) {
+    indices->mutable_data<TIndex>()[i] = index(gen);
+    weights->mutable_data<float>()[i] = value(gen);
+  }
+
+  const auto def = weighted
+      ? CreateOperatorDef(
+            "SparseLengthsWeightedSum",
+            "",
+            vector<string>{"data", "weights", "indices", "lengths"},
+            vector<string>{"output"})
+      : CreateOperatorDef(
+            "SparseLengthsSum",
+            "",
+            vector<string>{"data", "indices", "lengths"},
+            vector<string>{"output"});
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+  const auto& output = ws.GetBlob("output")->Get<TensorCPU>();
+  ASSERT_EQ(output.dims(), (vector<TIndex>{num_segments, block_size}));
+
+  int i = 0;
+  for (int m = 0; m < num_segments; ++m) {
+    vector<float> expected(block_size, 0);
+    for (int l = 0; l < lengths->data<int>()[m]; ++l, ++i) {
+      const TIndex idx = indices->data<TIndex>()[i];
+      const float w = weighted ? weights->data<float>()[i] : 1;
+      for (int k = 0; k < block_size; ++k) {
+        expected[k] += w * data->data<float>()[idx * block_size + k];
+      }
+    }
+    for (int k = 0; k < block_size; ++k) {
+      EXPECT_NEAR(output.data<float>()[m * block_size + k], expected[k], 1e-4);
+    }
+  }
+}
+
+} // namespace
+
+TEST(SegmentReductionTest, SparseLengthsSum) {
+  CheckSparseLengthsSum(100, 64, 10, false);
+  CheckSparseLengthsSum(100, 7, 10, false);
+  // Enough work to be split across threads.
+  CheckSparseLengthsSum(5000, 32, 2000, false);
+  CheckSparseLengthsSum(5000, 13, 4000, false);
+}
+
+TEST(SegmentReductionTest, SparseLengthsWeightedSum) {
+  CheckSparseLengthsSum(100, 128, 10, true);
+  CheckSparseLengthsSum(5000, 64, 2000, true);
+}
+
+TEST(SegmentReductionTest, SparseLengthsSumChecksIndices) {
+  Workspace ws;
+  CreateTensor<float>(&ws, "data", {4, 16});
+  auto* indices = CreateTensor<TIndex>(&ws, "indices", {3});
+  indices->mutable_data<TIndex>()[0] = 0;
+  indices->mutable_data<TIndex>()[1] = 4;
+  indices->mutable_data<TIndex>()[2] = 1;
+  auto* lengths = CreateTensor<int>(&ws, "lengths", {1});
+  lengths->mutable_data<int>()[0] = 3;
+  const auto def = CreateOperatorDef(
+      "SparseLengthsSum",
+      "",
+      vector<string>{"data", "indices", "lengths"},
+      vector<string>{"output"});
+  EXPECT_THROW(ws.RunOperatorOnce(def), EnforceNotMet);
+  lengths->mutable_data<int>()[0] = 2;
+  indices->mutable_data<TIndex>()[1] = 3;
+  EXPECT_THROW(ws.RunOperatorOnce(def), EnforceNotMet);
+}
+
+TEST(SegmentReductionTest, ParallelSegmentOps) {
+  Workspace ws;
+  const int N = 20000;
+  const int D = 16;
+  std::mt19937 gen(N);
+  std::uniform_real_distribution<float> value(-1, 1);
+  std::uniform_int_distribution<int> index(0, N - 1);
+  std::uniform_int_distribution<int> segment(0, 999);
+  auto* data = CreateTensor<float>(&ws, "data", {N, D});
+  for (int i = 0; i < data->size(); ++i) {
+    data->mutable_data<float>()[i] = value(gen);
+  }
+  auto* scalars = CreateTensor<float>(&ws, "scalars", {N});
+  auto* indices = CreateTensor<TIndex>(&ws, "indices", {N});
+  auto* sorted_ids = CreateTensor<int>(&ws, "sorted_ids", {N});
+  auto* unsorted_ids = CreateTensor<int>(&ws, "unsorted_ids", {N});
+  // Sorted segments of 1 to 40 rows.
+  std::uniform_int_distribution<int> length(1, 40);
+  int sorted_id = 0;
+  int left = length(gen);
+  for (int i = 0; i < N; ++i) {
+    scalars->mutable_data<float>()[i] = value(gen);
+    indices->mutable_data<TIndex>()[i] = index(gen);
+    unsorted_ids->mutable_data<int>()[i] = segment(gen);
+    if (left-- == 0) {
+      ++sorted_id;
+      left = length(gen) - 1;
+    }
+    sorted_ids->mutable_data<int>()[i] = sorted_id;
+  }
+
+  const vector<std::pair<string, vector<string>>> ops = {
+      {"SortedSegmentSum", {"data", "sorted_ids"}},
+      {"SortedSegmentWeightedSum", {"data", "scalars", "sorted_ids"}},
+      {"SparseSortedSegmentSum", {"data", "indices", "sorted_ids"}},
+      {"SparseSortedSegmentWeightedSum",
+       {"data", "scalars", "indices", "sorted_ids"}},
+      {"UnsortedSegmentSum", {"data", "unsorted_ids"}},
+      {"UnsortedSegmentWeightedSum", {"data", "scalars", "unsorted_ids"}},
+      {"SparseUnsortedSegmentSum", {"data", "indices", "unsorted_ids"}},
+      {"SparseUnsortedSegmentWeightedSum",
+       {"data", "scalars", "indices", "unsorted_ids"}},
+      {"SortedSegmentRangeSum", {"data", "sorted_ids"}},
+      {"SortedSegmentRangeMax", {"data", "sorted_ids"}},
+      {"SortedSegmentRangeLogSumExp", {"data", "sorted_ids"}},
+  };
+  for (const auto& op : ops) {
+    for (const int num_threads : {1, 4}) {
+      auto def = CreateOperatorDef(
+          op.first,
+          "",
+          op.second,
+          vector<string>{"output_" + caffe2::to_string(num_threads)});
+      def.add_arg()->CopyFrom(MakeArgument("num_threads", num_threads));
+      ASSERT_TRUE(ws.RunOperatorOnce(def)) << op.first;
+    }
+    // Every segment is reduced in the same order, so the results are equal.
+    const auto& expected = ws.GetBlob("output_1")->Get<TensorCPU>();
+    const auto& output = ws.GetBlob("output_4")->Get<TensorCPU>();
+    ASSERT_EQ(expected.dims(), output.dims()) << op.first;
+    for (int i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(expected.data<float>()[i], output.data<float>()[i])
+          << op.first << " " << i;
+    }
+  }
+}
+
+} // namespace caffe2
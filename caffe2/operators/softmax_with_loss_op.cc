@@ -0,0 +1,395 @@
+#include "caffe2/operators/softmax_with_loss_op.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+#if defined(__AVX2__)
+// exp(x) as 2^n * exp(r), with n = round(x / log(2)) and a polynomial for
+// exp(r) on [-log(2) / 2, log(2) / 2], accurate to a couple of ulps. Inputs
+// below -87 or so flush to 0.
+constexpr float kExpHi = 88.f;
+constexpr float kExpLo = -88.3762626647949f;
+constexpr float kLog2e = 1.44269504088896341f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpP0 = 1.9875691500e-4f;
+constexpr float kExpP1 = 1.3981999507e-3f;
+constexpr float kExpP2 = 8.3334519073e-3f;
+constexpr float kExpP3 = 4.1665795894e-2f;
+constexpr float kExpP4 = 1.6666665459e-1f;
+constexpr float kExpP5 = 5.0000001201e-1f;
+
+inline float FastExp(float x) {
+  x = std::max(kExpLo, std::min(kExpHi, x));
+  const float n = std::floor(x * kLog2e + 0.5f);
+  x = x - n * kLn2Hi - n * kLn2Lo;
+  float y = x * kExpP0 + kExpP1;
+  y = y * x + kExpP2;
+  y = y * x + kExpP3;
+  y = y * x + kExpP4;
+  y = y * x + kExpP5;
+  y = y * x * x + x + 1;
+  const int32_t bits = (static_cast<int32_t>(n) + 127) << 23;
+  float pow2n;
+  memcpy(&pow2n, &bits, sizeof(pow2n));
+  return y * pow2n;
+}
+
+inline __m256 FastExp(__m256 x) {
+  x = _mm256_max_ps(
+      _mm256_set1_ps(kExpLo), _mm256_min_ps(_mm256_set1_ps(kExpHi), x));
+  const __m256 n = _mm256_floor_ps(_mm256_fmadd_ps(
+      x, _mm256_set1_ps(kLog2e), _mm256_set1_ps(0.5f)));
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), x);
+  x = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), x);
+  __m256 y = _mm256_fmadd_ps(
+      x, _mm256_set1_ps(kExpP0), _mm256_set1_ps(kExpP1));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(kExpP2));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(kExpP3));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(kExpP4));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(kExpP5));
+  y = _mm256_fmadd_ps(
+      _mm256_mul_ps(y, x), x, _mm256_add_ps(x, _mm256_set1_ps(1.f)));
+  const __m256i bits = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(y, _mm256_castsi256_ps(bits));
+}
+
+inline float HorizontalSum(const __m256 v) {
+  float lanes[8];
+  _mm256_storeu_ps(lanes, v);
+  float sum = 0;
+  for (int k = 0; k < 8; ++k) {
+    sum += lanes[k];
+  }
+  return sum;
+}
+
+// Computes the softmax P of a row X of D logits in two passes, along with the
+// loss of the row: -log(P[label]), or the cross entropy against the label
+// probabilities Q if Q is not null. The first pass computes the max m of the
+// row and the sum s of exp(X - m) at once: every lane keeps its own, and
+// rescales its sum whenever its max grows.
+float SoftmaxRowWithLoss(
+    const int D,
+    const float* X,
+    const int label,
+    const float* Q,
+    float* P) {
+  __m256 mv = _mm256_set1_ps(-FLT_MAX);
+  __m256 sv = _mm256_setzero_ps();
+  int j = 0;
+  for (; j + 8 <= D; j += 8) {
+    const __m256 x = _mm256_loadu_ps(X + j);
+    const __m256 greater = _mm256_cmp_ps(x, mv, _CMP_GT_OQ);
+    // exp(-|x - m|) scales the old sum if x is the new max, and is the new
+    // term of the sum otherwise.
+    const __m256 e =
+        FastExp(_mm256_sub_ps(_mm256_min_ps(x, mv), _mm256_max_ps(x, mv)));
+    sv = _mm256_blendv_ps(
+        _mm256_add_ps(sv, e),
+        _mm256_fmadd_ps(sv, e, _mm256_set1_ps(1.f)),
+        greater);
+    mv = _mm256_max_ps(mv, x);
+  }
+  float lanesMax[8];
+  float lanesSum[8];
+  _mm256_storeu_ps(lanesMax, mv);
+  _mm256_storeu_ps(lanesSum, sv);
+  float m = *std::max_element(lanesMax, lanesMax + 8);
+  for (; j < D; ++j) {
+    m = std::max(m, X[j]);
+  }
+  float s = 0;
+  for (int k = 0; k < 8; ++k) {
+    s += lanesSum[k] * FastExp(lanesMax[k] - m);
+  }
+  for (j = D - D % 8; j < D; ++j) {
+    s += FastExp(X[j] - m);
+  }
+
+  const float logSumExp = m + std::log(s);
+  mv = _mm256_set1_ps(m);
+  const __m256 invSum = _mm256_set1_ps(1 / s);
+  __m256 dot = _mm256_setzero_ps();
+  __m256 mass = _mm256_setzero_ps();
+  for (j = 0; j + 8 <= D; j += 8) {
+    const __m256 x = _mm256_loadu_ps(X + j);
+    _mm256_storeu_ps(
+        P + j, _mm256_mul_ps(FastExp(_mm256_sub_ps(x, mv)), invSum));
+    if (Q != nullptr) {
+      const __m256 q = _mm256_loadu_ps(Q + j);
+      dot = _mm256_fmadd_ps(q, x, dot);
+      mass = _mm256_add_ps(mass, q);
+    }
+  }
+  float tailDot = 0;
+  float tailMass = 0;
+  for (; j < D; ++j) {
+    P[j] = FastExp(X[j] - m) / s;
+    if (Q != nullptr) {
+      tailDot += Q[j] * X[j];
+      tailMass += Q[j];
+    }
+  }
+  if (Q == nullptr) {
+    return logSumExp - X[label];
+  }
+  // -sum(Q * log(P)) = sum(Q) * logSumExp - sum(Q * X).
+  return (HorizontalSum(mass) + tailMass) * logSumExp -
+      (HorizontalSum(dot) + tailDot);
+}
+#else
+// Computes the softmax P of a row X of D logits with Eigen's vectorized exp,
+// along with the loss of the row: -log(P[label]), or the cross entropy against
+// the label probabilities Q if Q is not null.
+float SoftmaxRowWithLoss(
+    const int D,
+    const float* X,
+    const int label,
+    const float* Q,
+    float* P) {
+  ConstEigenVectorArrayMap<float> x(X, D);
+  EigenVectorArrayMap<float> p(P, D);
+  const float m = x.maxCoeff();
+  p = (x - m).exp();
+  const float s = p.sum();
+  p *= 1 / s;
+  const float logSumExp = m + std::log(s);
+  if (Q == nullptr) {
+    return logSumExp - X[label];
+  }
+  // -sum(Q * log(P)) = sum(Q) * logSumExp - sum(Q * X).
+  ConstEigenVectorArrayMap<float> q(Q, D);
+  return q.sum() * logSumExp - (q * x).sum();
+}
+#endif
+
+// Runs fn(begin, end) on ranges of rows of D elements across the CPU thread
+// pool, with enough rows in every range to amortize the dispatch.
+template <typename Fn>
+void ForEachRowRange(const int N, const int D, Fn fn) {
+  constexpr int kMinElementsPerTask = 1 << 14;
+  const int rowsPerTask = std::max(1, kMinElementsPerTask / std::max(D, 1));
+  const int tasks = (N + rowsPerTask - 1) / rowsPerTask;
+  if (tasks <= 1) {
+    fn(0, N);
+    return;
+  }
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const int begin = task * rowsPerTask;
+        fn(begin, std::min(N, begin + rowsPerTask));
+      },
+      tasks);
+}
+
+} // namespace
+
+bool SoftmaxWithLossOp::RunOnDevice() {
+  const auto& X = Input(LOGITS);
+  const auto& labels = Input(LABELS);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "LOGITS must be N x D");
+  const int N = X.dim32(0);
+  const int D = X.dim32(1);
+  CAFFE_ENFORCE_GT(D, 0, "LOGITS must have at least one class");
+  const float* Q = nullptr;
+  const int* L = nullptr;
+  if (labelProb_) {
+    CAFFE_ENFORCE(
+        labels.dims() == X.dims(), "LABELS must be N x D probabilities");
+    Q = labels.data<float>();
+  } else {
+    CAFFE_ENFORCE(
+        (labels.ndim() == 1 || (labels.ndim() == 2 && labels.dim32(1) == 1)) &&
+            labels.dim32(0) == N,
+        "LABELS must be N integer labels");
+    L = labels.data<int>();
+    for (int i = 0; i < N; ++i) {
+      CAFFE_ENFORCE(
+          L[i] >= 0 && L[i] < D,
+          "Label ",
+          L[i],
+          " out of range of the ",
+          D,
+          " classes");
+    }
+  }
+  const float* weights = nullptr;
+  if (InputSize() > WEIGHTS) {
+    CAFFE_ENFORCE_EQ(Input(WEIGHTS).size(), N, "WEIGHTS must have N entries");
+    weights = Input(WEIGHTS).data<float>();
+  }
+
+  auto* P = Output(SOFTMAX);
+  auto* avgLoss = Output(AVG_LOSS);
+  P->ResizeLike(X);
+  avgLoss->Resize(vector<TIndex>());
+  losses_.Resize(N);
+  const float* Xdata = X.data<float>();
+  float* Pdata = P->mutable_data<float>();
+  float* losses = losses_.mutable_data<float>();
+  ForEachRowRange(N, D, [&](const int begin, const int end) {
+    for (int i = begin; i < end; ++i) {
+      losses[i] = SoftmaxRowWithLoss(
+          D,
+          Xdata + i * D,
+          L != nullptr ? L[i] : 0,
+          Q != nullptr ? Q + i * D : nullptr,
+          Pdata + i * D);
+    }
+  });
+
+  // Sums up in order, so that the loss does not depend on the threads.
+  float loss = 0;
+  float totalWeight = N;
+  if (weights != nullptr) {
+    totalWeight = 0;
+    for (int i = 0; i < N; ++i) {
+      loss += weights[i] * losses[i];
+      totalWeight += weights[i];
+    }
+  } else {
+    for (int i = 0; i < N; ++i) {
+      loss += losses[i];
+    }
+  }
+  avgLoss->mutable_data<float>()[0] =
+      totalWeight > 0 ? scale_ * loss / totalWeight : 0;
+  return true;
+}
+
+bool SoftmaxWithLossGradientOp::RunOnDevice() {
+  const auto& X = Input(LOGITS);
+  const auto& labels = Input(LABELS);
+  // The weights come before the probabilities if the forward op had some.
+  const bool weighted = InputSize() == 5;
+  const auto& P = Input(InputSize() - 2);
+  const auto& dAvgLoss = Input(InputSize() - 1);
+  CAFFE_ENFORCE_EQ(X.ndim(), 2, "LOGITS must be N x D");
+  CAFFE_ENFORCE(P.dims() == X.dims(), "The softmax must be N x D");
+  CAFFE_ENFORCE_EQ(dAvgLoss.size(), 1);
+  const int N = X.dim32(0);
+  const int D = X.dim32(1);
+  if (labelProb_) {
+    CAFFE_ENFORCE(
+        labels.dims() == X.dims(), "LABELS must be N x D probabilities");
+  } else {
+    CAFFE_ENFORCE_EQ(labels.size(), N, "LABELS must be N integer labels");
+  }
+  const float* weights = nullptr;
+  float totalWeight = N;
+  if (weighted) {
+    CAFFE_ENFORCE_EQ(Input(2).size(), N, "WEIGHTS must have N entries");
+    weights = Input(2).data<float>();
+    totalWeight = 0;
+    for (int i = 0; i < N; ++i) {
+      totalWeight += weights[i];
+    }
+  }
+
+  auto* dX = Output(0);
+  dX->ResizeLike(X);
+  const float* Pdata = P.data<float>();
+  float* dXdata = dX->mutable_data<float>();
+  const float scale = totalWeight > 0
+      ? scale_ * dAvgLoss.data<float>()[0] / totalWeight
+      : 0;
+  const float* Q = labelProb_ ? labels.data<float>() : nullptr;
+  const int* L = labelProb_ ? nullptr : labels.data<int>();
+  ForEachRowRange(N, D, [&](const int begin, const int end) {
+    for (int i = begin; i < end; ++i) {
+      const float rowScale = weights != nullptr ? weights[i] * scale : scale;
+      const float* p = Pdata + i * D;
+      float* dx = dXdata + i * D;
+      if (Q != nullptr) {
+        // The loss is sum(Q) * logSumExp - sum(Q * X), so the softmax is
+        // scaled by the mass of the row, which need not be 1.
+        const float* q = Q + i * D;
+        float mass = 0;
+        for (int j = 0; j < D; ++j) {
+          mass += q[j];
+        }
+        for (int j = 0; j < D; ++j) {
+          dx[j] = (mass * p[j] - q[j]) * rowScale;
+        }
+      } else {
+        for (int j = 0; j < D; ++j) {
+          dx[j] = p[j] * rowScale;
+        }
+        dx[L[i]] -= rowScale;
+      }
+    }
+  });
+  return true;
+}
+
+namespace {
+
+REGISTER_CPU_OPERATOR(SoftmaxWithLoss, SoftmaxWithLossOp);
+REGISTER_CPU_OPERATOR(SoftmaxWithLossGradient, SoftmaxWithLossGradientOp);
+
+OPERATOR_SCHEMA(SoftmaxWithLoss)
+    .NumInputs(2, 3)
+    .NumOutputs(2)
+    .SetDoc(R"DOC(
+Combined Softmax and cross entropy loss: computes the softmax P of the logits
+(N x D), and the loss averaged over the batch
+
+    avg_loss = scale * sum_i(weight_i * loss_i) / sum_i(weight_i)
+
+where loss_i is -log(P[i, label_i]) for integer labels, or the cross entropy
+-sum_j(label[i, j] * log(P[i, j])) for label probabilities. The rows of label
+probabilities need not sum to 1. The weights are all 1 if they are not given.
+
+This is the same as Softmax, LabelCrossEntropy (or CrossEntropy) and
+AveragedLoss, but the logits are read twice instead of five times, the loss
+is computed from the log-sum-exp of the logits, which is exact even where the
+probabilities underflow, and the gradient is a single pass.
+)DOC")
+    .Arg(
+        "scale",
+        "(float, default 1.0) Multiplies the loss, and thus its gradient.")
+    .Arg(
+        "label_prob",
+        "(bool, default false) If set, the labels are N x D probabilities "
+        "rather than N integer labels.")
+    .Input(0, "logits", "N x D unscaled log probabilities")
+    .Input(1, "labels", "N int32 labels, or N x D probabilities")
+    .Input(2, "weight_tensor", "Optional N weights of the rows")
+    .Output(0, "softmax", "N x D softmax of the logits")
+    .Output(1, "avg_loss", "Scalar averaged loss");
+// Input: X, labels, [weights], P, d_avg_loss. Output: dX.
+OPERATOR_SCHEMA(SoftmaxWithLossGradient).NumInputs(4, 5).NumOutputs(1);
+
+class GetSoftmaxWithLossGradient : public GradientMakerBase {
+  using GradientMakerBase::GradientMakerBase;
+  vector<OperatorDef> GetGradientDefs() override {
+    vector<string> inputs{I(0), I(1)};
+    if (def_.input_size() == 3) {
+      inputs.push_back(I(2));
+    }
+    inputs.push_back(O(0));
+    inputs.push_back(GO(1));
+    return SingleGradientDef(
+        "SoftmaxWithLossGradient", "", inputs, vector<string>{GI(0)});
+  }
+};
+REGISTER_GRADIENT(SoftmaxWithLoss, GetSoftmaxWithLossGradient);
+
+} // namespace
+
+} // namespace caffe2
@@ -0,0 +1,63 @@
+#ifndef CAFFE2_OPERATORS_SOFTMAX_WITH_LOSS_OP_H_
+#define CAFFE2_OPERATORS_SOFTMAX_WITH_LOSS_OP_H_
+
+#include "caffe2/core/context.h"
+#include "caffe2/core/logging.h"
+#include "caffe2/core/operator.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// SoftmaxWithLossOp computes the softmax of the logits and the averaged cross
+// entropy loss against the labels together, which Softmax, LabelCrossEntropy
+// and AveragedLoss do in five passes over the logits. With AVX2 every row is
+// read twice: a first pass computes its max and the sum of the exponentials at
+// once, rescaling the sum whenever the max grows, and a second pass writes the
+// probabilities and accumulates the loss. The rows are split across the CPU
+// thread pool.
+class SoftmaxWithLossOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SoftmaxWithLossOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(float, "scale", scale_, 1.),
+        OP_SINGLE_ARG(bool, "label_prob", labelProb_, false) {}
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(LOGITS, LABELS, WEIGHTS);
+  OUTPUT_TAGS(SOFTMAX, AVG_LOSS);
+
+ private:
+  float scale_;
+  bool labelProb_;
+  // The loss of every row.
+  Tensor<CPUContext> losses_;
+};
+
+// SoftmaxWithLossGradientOp computes the gradient of the logits in a single
+// pass over the probabilities. Its inputs are the logits, the labels, the
+// weights if the forward op had some, the probabilities and the gradient of
+// the averaged loss.
+class SoftmaxWithLossGradientOp final : public Operator<CPUContext> {
+ public:
+  USE_OPERATOR_FUNCTIONS(CPUContext);
+  SoftmaxWithLossGradientOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<CPUContext>(operator_def, ws),
+        OP_SINGLE_ARG(float, "scale", scale_, 1.),
+        OP_SINGLE_ARG(bool, "label_prob", labelProb_, false) {}
+
+  bool RunOnDevice() override;
+
+ protected:
+  INPUT_TAGS(LOGITS, LABELS);
+
+ private:
+  float scale_;
+  bool labelProb_;
+};
+
+} // namespace caffe2
+
+#endif // CAFFE2_OPERATORS_SOFTMAX_WITH_LOSS_OP_H_
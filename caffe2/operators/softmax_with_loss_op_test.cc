@@ -0,0 +1,203 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/core/operator_gradient.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static TensorCPU* AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    const float range,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(-range, range);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+  return tensor;
+}
+
+// Computes the softmax and the loss of every row in double precision, and
+// checks the outputs of SoftmaxWithLoss and of its gradient against them.
+// Unless normalized, the odd rows of label probabilities do not sum to 1.
+static void CheckSoftmaxWithLoss(
+    const int N,
+    const int D,
+    const float range,
+    const bool labelProb,
+    const bool weighted,
+    const bool normalized = true) {
+  Workspace ws;
+  std::mt19937 gen(N * D);
+  const auto* X = AddInput({N, D}, "X", range, &gen, &ws);
+  auto* labels = ws.CreateBlob("labels")->GetMutable<TensorCPU>();
+  if (labelProb) {
+    AddInput({N, D}, "labels", 1, &gen, &ws);
+    float* q = labels->mutable_data<float>();
+    for (int i = 0; i < N; ++i) {
+      float sum = 0;
+      for (int j = 0; j < D; ++j) {
+        q[i * D + j] = std::abs(q[i * D + j]);
+        sum += q[i * D + j];
+      }
+      for (int j = 0; j < D && (normalized || i % 2 == 0); ++j) {
+        q[i * D + j] /= sum;
+      }
+    }
+  } else {
+    labels->Resize(N);
+    std::uniform_int_distribution<int> label(0, D - 1);
+    for (int i = 0; i < N; ++i) {
+      labels->mutable_data<int>()[i] = label(gen);
+    }
+  }
+  vector<string> inputs{"X", "labels"};
+  vector<float> weights(N, 1);
+  if (weighted) {
+    auto* w = AddInput({N}, "weights", 1, &gen, &ws);
+    for (int i = 0; i < N; ++i) {
+      weights[i] = w->mutable_data<float>()[i] += 1;
+    }
+    inputs.push_back("weights");
+  }
+  OperatorDef def = CreateOperatorDef(
+      "SoftmaxWithLoss", "", inputs, vector<string>{"P", "avg_loss"});
+  def.add_arg()->CopyFrom(MakeArgument("scale", 0.5f));
+  def.add_arg()->CopyFrom(MakeArgument("label_prob", labelProb));
+  ASSERT_TRUE(ws.RunOperatorOnce(def));
+
+  const float* x = X->data<float>();
+  const float* P = ws.GetBlob("P")->Get<TensorCPU>().data<float>();
+  double loss = 0;
+  double totalWeight = 0;
+  vector<double> expectedP(N * D);
+  for (int i = 0; i < N; ++i) {
+    const double m = *std::max_element(x + i * D, x + (i + 1) * D);
+    double sum = 0;
+    for (int j = 0; j < D; ++j) {
+      sum += std::exp(x[i * D + j] - m);
+    }
+    const double logSumExp = m + std::log(sum);
+    for (int j = 0; j < D; ++j) {
+      expectedP[i * D + j] = std::exp(x[i * D + j] - logSumExp);
+      EXPECT_NEAR(P[i * D + j], expectedP[i * D + j], 1e-6) << i << " " << j;
+    }
+    double rowLoss = 0;
+    if (labelProb) {
+      for (int j = 0; j < D; ++j) {
+        rowLoss +=
+            labels->data<float>()[i * D + j] * (logSumExp - x[i * D + j]);
+      }
+    } else {
+      rowLoss = logSumExp - x[i * D + labels->data<int>()[i]];
+    }
+    loss += weights[i] * rowLoss;
+    totalWeight += weights[i];
+  }
+  const float avgLoss =
+      ws.GetBlob("avg_loss")->Get<TensorCPU>().data<float>()[0];
+  EXPECT_NEAR(avgLoss, 0.5 * loss / totalWeight, 1e-5 * std::abs(loss));
+
+  auto* dAvgLoss = ws.CreateBlob("avg_loss_grad")->GetMutable<TensorCPU>();
+  dAvgLoss->Resize(vector<TIndex>());
+  dAvgLoss->mutable_data<float>()[0] = 3;
+  vector<GradientWrapper> gradients(2);
+  gradients[1].dense_ = "avg_loss_grad";
+  for (const auto& gradientDef : GetGradientForOp(def, gradients).ops_) {
+    ASSERT_TRUE(ws.RunOperatorOnce(gradientDef));
+  }
+  // The gradient of sum(Q) * logSumExp - sum(Q * X) is sum(Q) * P - Q.
+  const float* dX = ws.GetBlob("X_grad")->Get<TensorCPU>().data<float>();
+  for (int i = 0; i < N; ++i) {
+    double mass = 1;
+    if (labelProb) {
+      mass = 0;
+      for (int j = 0; j < D; ++j) {
+        mass += labels->data<float>()[i * D + j];
+      }
+    }
+    for (int j = 0; j < D; ++j) {
+      const double y = labelProb ? labels->data<float>()[i * D + j]
+                                 : labels->data<int>()[i] == j;
+      EXPECT_NEAR(
+          dX[i * D + j],
+          (mass * expectedP[i * D + j] - y) * 1.5 * weights[i] / totalWeight,
+          1e-6)
+          << i << " " << j;
+    }
+  }
+}
+
+TEST(SoftmaxWithLossTest, Labels) {
+  CheckSoftmaxWithLoss(5, 3, 4, false, false);
+  CheckSoftmaxWithLoss(40, 1000, 10, false, true);
+}
+
+TEST(SoftmaxWithLossTest, LabelProbabilities) {
+  CheckSoftmaxWithLoss(7, 13, 4, true, false);
+  CheckSoftmaxWithLoss(40, 1001, 10, true, true);
+}
+
+TEST(SoftmaxWithLossTest, UnnormalizedLabelProbabilities) {
+  CheckSoftmaxWithLoss(7, 13, 4, true, false, false);
+  CheckSoftmaxWithLoss(40, 1001, 10, true, true, false);
+}
+
+// Checks the gradient for label probabilities that do not sum to 1 against
+// central differences of the loss.
+TEST(SoftmaxWithLossTest, UnnormalizedLabelProbabilitiesGradientCheck) {
+  const int N = 2, D = 5;
+  Workspace ws;
+  std::mt19937 gen(7);
+  auto* X = AddInput({N, D}, "X", 2, &gen, &ws);
+  auto* labels = AddInput({N, D}, "labels", 1, &gen, &ws);
+  for (int i = 0; i < N * D; ++i) {
+    labels->mutable_data<float>()[i] = std::abs(labels->data<float>()[i]);
+  }
+  OperatorDef def = CreateOperatorDef(
+      "SoftmaxWithLoss",
+      "",
+      vector<string>{"X", "labels"},
+      vector<string>{"P", "avg_loss"});
+  def.add_arg()->CopyFrom(MakeArgument("label_prob", true));
+  auto loss = [&]() {
+    EXPECT_TRUE(ws.RunOperatorOnce(def));
+    return ws.GetBlob("avg_loss")->Get<TensorCPU>().data<float>()[0];
+  };
+  loss();
+  auto* dAvgLoss = ws.CreateBlob("avg_loss_grad")->GetMutable<TensorCPU>();
+  dAvgLoss->Resize(vector<TIndex>());
+  dAvgLoss->mutable_data<float>()[0] = 1;
+  vector<GradientWrapper> gradients(2);
+  gradients[1].dense_ = "avg_loss_grad";
+  for (const auto& gradientDef : GetGradientForOp(def, gradients).ops_) {
+    ASSERT_TRUE(ws.RunOperatorOnce(gradientDef));
+  }
+  const float* dX = ws.GetBlob("X_grad")->Get<TensorCPU>().data<float>();
+
+  const float step = 1e-2;
+  float* x = X->mutable_data<float>();
+  for (int k = 0; k < N * D; ++k) {
+    const float original = x[k];
+    x[k] = original + step;
+    const float lossPlus = loss();
+    x[k] = original - step;
+    const float lossMinus = loss();
+    x[k] = original;
+    EXPECT_NEAR(dX[k], (lossPlus - lossMinus) / (2 * step), 1e-3) << k;
+  }
+}
+
+// The loss is finite for logits whose probabilities underflow.
+TEST(SoftmaxWithLossTest, LargeLogits) {
+  CheckSoftmaxWithLoss(6, 37, 300, false, false);
+}
+
+} // namespace caffe2
@@ -1,7 +1,84 @@
 #include "caffe2/operators/spatial_batch_norm_op.h"
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "caffe2/utils/thread_pool.h"
+
 namespace caffe2 {
 
+namespace {
+
+// Every task of the parallel loops covers at least this many elements, to
+// amortize the dispatch and to keep the blocks that are read twice in cache.
+constexpr int kMinElementsPerTask = 1 << 14;
+
+// The number of items of width elements in every task. It does not depend on
+// the number of threads, so neither do the partial sums of the tasks.
+int ItemsPerTask(const int width) {
+  return std::max(1, kMinElementsPerTask / std::max(width, 1));
+}
+
+// The number of channels in every task of the NCHW loops, in which every task
+// owns whole channels. The results of a channel do not depend on how the
+// channels are split, so there are just enough tasks to balance the threads.
+int ChannelsPerTask(const int C, const int channelSize) {
+  constexpr int kTasksPerThread = 4;
+  const int tasks =
+      kTasksPerThread * ThreadPool::Default()->EffectiveNumThreads();
+  return std::max(ItemsPerTask(channelSize), (C + tasks - 1) / tasks);
+}
+
+int NumTasks(const int n, const int itemsPerTask) {
+  return (n + itemsPerTask - 1) / itemsPerTask;
+}
+
+// Runs fn(task, begin, end) on ranges of itemsPerTask items of [0, n) across
+// the CPU thread pool.
+template <typename Fn>
+void ParallelFor(const int n, const int itemsPerTask, Fn fn) {
+  const int tasks = NumTasks(n, itemsPerTask);
+  if (tasks == 0) {
+    return;
+  }
+  if (tasks == 1) {
+    fn(0, 0, n);
+    return;
+  }
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const int begin = task * itemsPerTask;
+        fn(task, begin, std::min(n, begin + itemsPerTask));
+      },
+      tasks);
+}
+
+// The mean and the sum of the squared deviations of a set of values, which
+// Add() merges with those of another set (Chan et al.), so that every block
+// of the input is read only while it is in cache.
+struct Moments {
+  double count = 0;
+  double mean = 0;
+  double m2 = 0;
+
+  void Add(
+      const double otherCount,
+      const double otherMean,
+      const double otherM2) {
+    const double total = count + otherCount;
+    if (total == 0) {
+      return;
+    }
+    const double delta = otherMean - mean;
+    mean += delta * otherCount / total;
+    m2 += otherM2 + delta * delta * count * otherCount / total;
+    count = total;
+  }
+};
+
+} // namespace
+
 template <>
 bool SpatialBNOp<CPUContext>::RunOnDevice() {
   const auto& X = Input(INPUT);
@@ -13,127 +90,168 @@ bool SpatialBNOp<CPUContext>::RunOnDevice() {
   const int C = (order_ == StorageOrder::NCHW ? X.dim32(1) : X.dim32(3));
   const int H = (order_ == StorageOrder::NCHW ? X.dim32(2) : X.dim32(1));
   const int W = (order_ == StorageOrder::NCHW ? X.dim32(3) : X.dim32(2));
+  const int HxW = H * W;
   DCHECK_EQ(scale.ndim(), 1);
   DCHECK_EQ(bias.ndim(), 1);
   DCHECK_EQ(scale.dim32(0), C);
   DCHECK_EQ(bias.dim32(0), C);
+  if (order_ != StorageOrder::NCHW && order_ != StorageOrder::NHWC) {
+    CAFFE_THROW("Unknown storage order: ", order_);
+  }
 
-  ConstEigenVectorArrayMap<float> scale_arr(scale.data<float>(), C);
-  ConstEigenVectorArrayMap<float> bias_arr(bias.data<float>(), C);
-
+  const float* scale_data = scale.data<float>();
+  const float* bias_data = bias.data<float>();
+  const float* X_data = X.data<float>();
   auto* Y = Output(OUTPUT);
   Y->ResizeLike(X);
+  float* Y_data = Y->mutable_data<float>();
 
-  if (!is_test_) {
-    // training mode
-    // Get the mean and variance.
-    // Note that, to be consistent with cudnn, we will output saved inverse
-    // std as output 5, but we will still use the same storage place to
-    // compute var as well. The inverse is going to be carried out at the end
-    // of the op.
-    Output(SAVED_MEAN)->Resize(C);
-    Output(SAVED_INV_VAR)->Resize(C);
-    EigenVectorArrayMap<float> mean(
-        Output(SAVED_MEAN)->mutable_data<float>(), C);
-    EigenVectorArrayMap<float> var(
-        Output(SAVED_INV_VAR)->mutable_data<float>(), C);
-
-    mean.setZero();
-    var.setZero();
-    switch (order_) {
-      case StorageOrder::NCHW: {
-        ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-        for (int nc = 0; nc < N * C; ++nc) {
-          mean(nc % C) += X_arr.col(nc).sum();
-        }
-        mean /= N * H * W;
-        for (int nc = 0; nc < N * C; ++nc) {
-          var(nc % C) += (X_arr.col(nc) - mean(nc % C)).matrix().squaredNorm();
-        }
-        var /= N * H * W;
-        break;
+  // The output is computed as Y = X * new_scale + new_bias, with
+  //   new_scale = scale * inv_std
+  //   new_bias = bias - mean * inv_std * scale
+  // in the same pass over every block.
+  new_scale_.Resize(C);
+  new_bias_.Resize(C);
+  float* new_scale = new_scale_.mutable_data<float>();
+  float* new_bias = new_bias_.mutable_data<float>();
+  auto applyNCHW = [&](const int c_begin, const int c_end) {
+    for (int n = 0; n < N; ++n) {
+      for (int c = c_begin; c < c_end; ++c) {
+        const int offset = (n * C + c) * HxW;
+        EigenVectorArrayMap<float>(Y_data + offset, HxW) =
+            ConstEigenVectorArrayMap<float>(X_data + offset, HxW) *
+                new_scale[c] +
+            new_bias[c];
       }
-      case StorageOrder::NHWC: {
-        ConstEigenArrayMap<float> X_arr(X.data<float>(), C, N * H * W);
-        for (int i = 0; i < N * H * W; ++i) {
-          mean += X_arr.col(i);
-        }
-        mean /= N * H * W;
-        for (int i = 0; i < N * H * W; ++i) {
-          var += (X_arr.col(i) - mean) * (X_arr.col(i) - mean);
-        }
-        var /= N * H * W;
-        break;
-      }
-      default:
-        CAFFE_THROW("Unknown storage order: ", order_);
-    }
-
-    // Compute the running mean and running inv variance.
-    auto* running_mean = Output(RUNNING_MEAN);
-    auto* running_var = Output(RUNNING_VAR);
-    // Check if they are initialized
-    if (!running_mean->size()) {
-      running_mean->Resize(C);
-      EigenVectorArrayMap<float>(running_mean->mutable_data<float>(), C) = 0;
     }
-    if (!running_var->size()) {
-      running_var->Resize(C);
-      EigenVectorArrayMap<float>(running_var->mutable_data<float>(), C) = 0;
+  };
+  auto applyNHWC = [&](const int begin, const int end) {
+    ConstEigenVectorArrayMap<float> new_scale_arr(new_scale, C);
+    ConstEigenVectorArrayMap<float> new_bias_arr(new_bias, C);
+    for (int i = begin; i < end; ++i) {
+      EigenVectorArrayMap<float>(Y_data + i * C, C) =
+          ConstEigenVectorArrayMap<float>(X_data + i * C, C) * new_scale_arr +
+          new_bias_arr;
     }
-    EigenVectorArrayMap<float> running_mean_arr(
-        running_mean->mutable_data<float>(), C);
-    EigenVectorArrayMap<float> running_var_arr(
-        running_var->mutable_data<float>(), C);
-    running_mean_arr = running_mean_arr * momentum_ + mean * (1. - momentum_);
-    running_var_arr = running_var_arr * momentum_ + var * (1. - momentum_);
-  }
+  };
 
-  // Regardless of training or testing, we will apply the estimated mean
-  // and standard deviation to the input. For testing, they are
-  // specified directly by the input, and for training, they are computed
-  // by the op.
-  Eigen::Array<float, Eigen::Dynamic, 1> inv_std(C);
   if (is_test_) {
+    ConstEigenVectorArrayMap<float> mean_arr(Input(EST_MEAN).data<float>(), C);
     ConstEigenVectorArrayMap<float> var_arr(Input(EST_VAR).data<float>(), C);
-    inv_std = (var_arr + epsilon_).sqrt().inverse();
-  } else {
-    EigenVectorArrayMap<float> saved_inv_std(
-        Output(SAVED_INV_VAR)->mutable_data<float>(), C);
-    saved_inv_std = (saved_inv_std + epsilon_).inverse().sqrt();
-    inv_std = saved_inv_std;
-  }
-  ConstEigenVectorArrayMap<float> mean_arr(
-      is_test_ ? Input(EST_MEAN).data<float>()
-               : Output(SAVED_MEAN)->data<float>(),
-      C);
-  // We can fuse the output computation as follows:
-  //   ((x - est_mean) * (inv_var) * scale + bias
-  // to
-  //   (x * inv_var * scale) + (bias - est_mean * inv_var * scale)
-  Eigen::Array<float, Eigen::Dynamic, 1> new_scale = inv_std * scale_arr;
-  Eigen::Array<float, Eigen::Dynamic, 1> new_bias =
-      bias_arr - mean_arr * inv_std * scale_arr;
-  switch (order_) {
-    case StorageOrder::NHWC: {
-      EigenArrayMap<float>(Y->mutable_data<float>(), C, N * H * W) =
-          (ConstEigenArrayMap<float>(X.data<float>(), C, N * H * W).colwise() *
-           new_scale)
-              .colwise() +
-          new_bias;
-      break;
+    EigenVectorArrayMap<float> new_scale_arr(new_scale, C);
+    new_scale_arr = (var_arr + epsilon_).sqrt().inverse() *
+        ConstEigenVectorArrayMap<float>(scale_data, C);
+    EigenVectorArrayMap<float>(new_bias, C) =
+        ConstEigenVectorArrayMap<float>(bias_data, C) -
+        mean_arr * new_scale_arr;
+    if (order_ == StorageOrder::NCHW) {
+      ParallelFor(C, ChannelsPerTask(C, N * HxW), [&](int, int begin, int end) {
+        applyNCHW(begin, end);
+      });
+    } else {
+      ParallelFor(N * HxW, ItemsPerTask(C), [&](int, int begin, int end) {
+        applyNHWC(begin, end);
+      });
     }
-    case StorageOrder::NCHW: {
-      EigenArrayMap<float> Y_arr(Y->mutable_data<float>(), H * W, N * C);
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-      for (int nc = 0; nc < N * C; ++nc) {
-        Y_arr.col(nc) = X_arr.col(nc) * new_scale(nc % C) + new_bias(nc % C);
+    return true;
+  }
+
+  // Training mode. To be consistent with cudnn, the inverse std is saved as
+  // output 5.
+  auto* saved_mean = Output(SAVED_MEAN);
+  auto* saved_inv_std = Output(SAVED_INV_VAR);
+  saved_mean->Resize(C);
+  saved_inv_std->Resize(C);
+  float* saved_mean_data = saved_mean->mutable_data<float>();
+  float* saved_inv_std_data = saved_inv_std->mutable_data<float>();
+  // Compute the running mean and running variance, which start at zero.
+  auto* running_mean = Output(RUNNING_MEAN);
+  auto* running_var = Output(RUNNING_VAR);
+  if (!running_mean->size()) {
+    running_mean->Resize(C);
+    EigenVectorArrayMap<float>(running_mean->mutable_data<float>(), C) = 0;
+  }
+  if (!running_var->size()) {
+    running_var->Resize(C);
+    EigenVectorArrayMap<float>(running_var->mutable_data<float>(), C) = 0;
+  }
+  float* running_mean_data = running_mean->mutable_data<float>();
+  float* running_var_data = running_var->mutable_data<float>();
+  auto finishChannel = [&](const int c, const Moments& moments) {
+    const float mean = moments.mean;
+    const float var = moments.count > 0 ? moments.m2 / moments.count : 0;
+    const float inv_std = 1. / std::sqrt(var + epsilon_);
+    saved_mean_data[c] = mean;
+    saved_inv_std_data[c] = inv_std;
+    running_mean_data[c] =
+        running_mean_data[c] * momentum_ + mean * (1. - momentum_);
+    running_var_data[c] =
+        running_var_data[c] * momentum_ + var * (1. - momentum_);
+    new_scale[c] = scale_data[c] * inv_std;
+    new_bias[c] = bias_data[c] - mean * new_scale[c];
+  };
+
+  if (order_ == StorageOrder::NCHW) {
+    // Every task walks the planes of its channels image by image, merging
+    // the moments of the planes of every channel before normalizing them.
+    ParallelFor(C, ChannelsPerTask(C, N * HxW), [&](int, int begin, int end) {
+      std::vector<Moments> moments(end - begin);
+      for (int n = 0; n < N && HxW > 0; ++n) {
+        for (int c = begin; c < end; ++c) {
+          ConstEigenVectorArrayMap<float> plane(
+              X_data + (n * C + c) * HxW, HxW);
+          const float mean = plane.sum() / HxW;
+          moments[c - begin].Add(HxW, mean, (plane - mean).square().sum());
+        }
+      }
+      for (int c = begin; c < end; ++c) {
+        finishChannel(c, moments[c - begin]);
       }
-      break;
+      applyNCHW(begin, end);
+    });
+    return true;
+  }
+
+  // NHWC: every task computes the moments of its range of pixels, which are
+  // merged in order before a second parallel pass normalizes the pixels.
+  const int NxHxW = N * HxW;
+  const int pixelsPerTask = ItemsPerTask(C);
+  const int tasks = NumTasks(NxHxW, pixelsPerTask);
+  partial_.Resize(2 * tasks, C);
+  float* partial_data = partial_.mutable_data<float>();
+  ParallelFor(NxHxW, pixelsPerTask, [&](int task, int begin, int end) {
+    // A single pass accumulates the deviations from the first pixel of the
+    // range, which keeps the sum of their squares accurate when the mean is
+    // large compared to the spread.
+    ConstEigenVectorArrayMap<float> X0(X_data + begin * C, C);
+    EigenVectorArrayMap<float> sum(partial_data + 2 * task * C, C);
+    EigenVectorArrayMap<float> sumsq(partial_data + (2 * task + 1) * C, C);
+    sum.setZero();
+    sumsq.setZero();
+    for (int i = begin + 1; i < end; ++i) {
+      const auto delta =
+          ConstEigenVectorArrayMap<float>(X_data + i * C, C) - X0;
+      sum += delta;
+      sumsq += delta.square();
+    }
+    // The mean and the sum of the squared deviations from it.
+    const int count = end - begin;
+    sumsq = (sumsq - sum * sum / count).max(0.f);
+    sum = X0 + sum / count;
+  });
+  for (int c = 0; c < C; ++c) {
+    Moments moments;
+    for (int task = 0; task < tasks; ++task) {
+      moments.Add(
+          std::min(pixelsPerTask, NxHxW - task * pixelsPerTask),
+          partial_data[2 * task * C + c],
+          partial_data[(2 * task + 1) * C + c]);
     }
-    default:
-      CAFFE_THROW("Unknown storage order: ", order_);
+    finishChannel(c, moments);
   }
+  ParallelFor(NxHxW, pixelsPerTask, [&](int, int begin, int end) {
+    applyNHWC(begin, end);
+  });
   return true;
 }
 
@@ -148,13 +266,19 @@ bool SpatialBNGradientOp<CPUContext>::RunOnDevice() {
   const int C = (order_ == StorageOrder::NCHW ? X.dim32(1) : X.dim32(3));
   const int H = (order_ == StorageOrder::NCHW ? X.dim32(2) : X.dim32(1));
   const int W = (order_ == StorageOrder::NCHW ? X.dim32(3) : X.dim32(2));
+  const int HxW = H * W;
+  const int NxHxW = N * HxW;
   DCHECK_EQ(scale.ndim(), 1);
   DCHECK_EQ(scale.dim32(0), C);
+  if (order_ != StorageOrder::NCHW && order_ != StorageOrder::NHWC) {
+    CAFFE_THROW("Unknown storage order: ", order_);
+  }
 
-  ConstEigenVectorArrayMap<float> scale_arr(scale.data<float>(), C);
-  ConstEigenVectorArrayMap<float> mean_arr(Input(SAVED_MEAN).data<float>(), C);
-  ConstEigenVectorArrayMap<float> inv_var_arr(
-      Input(SAVED_INV_VAR).data<float>(), C);
+  const float* scale_data = scale.data<float>();
+  const float* mean_data = Input(SAVED_MEAN).data<float>();
+  const float* inv_std_data = Input(SAVED_INV_VAR).data<float>();
+  const float* X_data = X.data<float>();
+  const float* dY_data = dY.data<float>();
 
   auto* dX = Output(INPUT_GRAD);
   auto* dScale = Output(SCALE_GRAD);
@@ -162,65 +286,98 @@ bool SpatialBNGradientOp<CPUContext>::RunOnDevice() {
   dX->ResizeLike(X);
   dScale->ResizeLike(scale);
   dBias->ResizeLike(scale);
+  float* dX_data = dX->mutable_data<float>();
+  float* dScale_data = dScale->mutable_data<float>();
+  float* dBias_data = dBias->mutable_data<float>();
 
   // dBias = np.sum(dY, axis=0)
-  // dScale = np.sum((X - mean) / inv_std * dy, axis=0)
-  // dX = (1. / N) * scale * inv_var * (N * dY - np.sum(dY, axis=0) - (X - mean)
-  //   * inv_var * inv_var * np.sum(dY * (X - mean), axis=0))
-
-  EigenVectorArrayMap<float> dBias_arr(dBias->mutable_data<float>(), C);
-  EigenVectorArrayMap<float> dScale_arr(dScale->mutable_data<float>(), C);
-
-  dBias_arr.setZero();
-  dScale_arr.setZero();
-
-  const auto scaleInvVarNHW = scale_arr * inv_var_arr / (N * H * W);
-
-  switch (order_) {
-    case StorageOrder::NCHW: {
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), H * W, N * C);
-      ConstEigenArrayMap<float> dY_arr(dY.data<float>(), H * W, N * C);
-      EigenArrayMap<float> dX_arr(dX->mutable_data<float>(), H * W, N * C);
-      dX_arr.setZero();
-
-      for (int nc = 0; nc < N * C; ++nc) {
-        int c = nc % C;
-        dBias_arr(c) += dY_arr.col(nc).sum();
-        dScale_arr(c) +=
-            ((X_arr.col(nc) - mean_arr(c)) * inv_var_arr(c) * dY_arr.col(nc))
-                .sum();
+  // dScale = np.sum((X - mean) * inv_std * dY, axis=0)
+  // dX = (1. / N) * scale * inv_std * (N * dY - dBias - (X - mean)
+  //   * inv_std * dScale)
+  // which the second pass computes as dX = dY * a + X * b + c with
+  //   a = scale * inv_std
+  //   b = -a * inv_std * dScale / N
+  //   c = -a * dBias / N - b * mean
+  coefficients_.Resize(3, C);
+  float* a = coefficients_.mutable_data<float>();
+  float* b = a + C;
+  float* c0 = b + C;
+  auto finishChannel = [&](
+      const int c, const double dYSum, const double dYXSum) {
+    dBias_data[c] = dYSum;
+    dScale_data[c] = dYXSum * inv_std_data[c];
+    a[c] = scale_data[c] * inv_std_data[c];
+    b[c] = NxHxW > 0 ? -a[c] * inv_std_data[c] * dScale_data[c] / NxHxW : 0;
+    c0[c] = NxHxW > 0
+        ? -a[c] * dBias_data[c] / NxHxW - b[c] * mean_data[c]
+        : 0;
+  };
+
+  if (order_ == StorageOrder::NCHW) {
+    ParallelFor(C, ChannelsPerTask(C, NxHxW), [&](int, int begin, int end) {
+      std::vector<double> dYSum(end - begin), dYXSum(end - begin);
+      for (int n = 0; n < N; ++n) {
+        for (int c = begin; c < end; ++c) {
+          const int offset = (n * C + c) * HxW;
+          ConstEigenVectorArrayMap<float> X_plane(X_data + offset, HxW);
+          ConstEigenVectorArrayMap<float> dY_plane(dY_data + offset, HxW);
+          dYSum[c - begin] += dY_plane.sum();
+          dYXSum[c - begin] += ((X_plane - mean_data[c]) * dY_plane).sum();
+        }
       }
-      for (int nc = 0; nc < N * C; ++nc) {
-        int c = nc % C;
-        dX_arr.col(nc) += scaleInvVarNHW(c) *
-            (dY_arr.col(nc) * N * H * W - dBias_arr(c) -
-             (X_arr.col(nc) - mean_arr[c]) * dScale_arr(c) * inv_var_arr(c));
+      for (int c = begin; c < end; ++c) {
+        finishChannel(c, dYSum[c - begin], dYXSum[c - begin]);
       }
-      break;
-    }
-    case StorageOrder::NHWC: {
-      ConstEigenArrayMap<float> X_arr(X.data<float>(), C, N * H * W);
-      ConstEigenArrayMap<float> dY_arr(dY.data<float>(), C, N * H * W);
-      EigenArrayMap<float> dX_arr(dX->mutable_data<float>(), C, N * H * W);
-      dX_arr.setZero();
-
-      const auto dYRowSum = dY_arr.rowwise().sum();
-      const auto XMinusMean = X_arr.colwise() - mean_arr;
-      const auto dYMulXMinusMeanRowSum = (dY_arr * XMinusMean).rowwise().sum();
-      const auto invVarSqr = inv_var_arr * inv_var_arr;
-      for (int nhw = 0; nhw < N * H * W; ++nhw) {
-        dBias_arr += dY_arr.col(nhw);
-        dScale_arr +=
-            (X_arr.col(nhw) - mean_arr) * inv_var_arr * dY_arr.col(nhw);
-        dX_arr.col(nhw) += scaleInvVarNHW *
-            (dY_arr.col(nhw) * N * H * W - dYRowSum -
-             XMinusMean.col(nhw) * invVarSqr * dYMulXMinusMeanRowSum);
+      for (int n = 0; n < N; ++n) {
+        for (int c = begin; c < end; ++c) {
+          const int offset = (n * C + c) * HxW;
+          EigenVectorArrayMap<float>(dX_data + offset, HxW) =
+              ConstEigenVectorArrayMap<float>(dY_data + offset, HxW) * a[c] +
+              ConstEigenVectorArrayMap<float>(X_data + offset, HxW) * b[c] +
+              c0[c];
+        }
       }
-      break;
+    });
+    return true;
+  }
+
+  // NHWC: the sums of every range of pixels are added up in order.
+  const int pixelsPerTask = ItemsPerTask(C);
+  const int tasks = NumTasks(NxHxW, pixelsPerTask);
+  partial_.Resize(2 * tasks, C);
+  float* partial_data = partial_.mutable_data<float>();
+  ConstEigenVectorArrayMap<float> mean_arr(mean_data, C);
+  ParallelFor(NxHxW, pixelsPerTask, [&](int task, int begin, int end) {
+    ConstEigenArrayMap<float> X_block(X_data + begin * C, C, end - begin);
+    ConstEigenArrayMap<float> dY_block(dY_data + begin * C, C, end - begin);
+    EigenVectorArrayMap<float> dYSum(partial_data + 2 * task * C, C);
+    EigenVectorArrayMap<float> dYXSum(partial_data + (2 * task + 1) * C, C);
+    dYSum.setZero();
+    dYXSum.setZero();
+    for (int i = 0; i < end - begin; ++i) {
+      dYSum += dY_block.col(i);
+      dYXSum += (X_block.col(i) - mean_arr) * dY_block.col(i);
+    }
+  });
+  for (int c = 0; c < C; ++c) {
+    double dYSum = 0;
+    double dYXSum = 0;
+    for (int task = 0; task < tasks; ++task) {
+      dYSum += partial_data[2 * task * C + c];
+      dYXSum += partial_data[(2 * task + 1) * C + c];
     }
-    default:
-      CAFFE_THROW("Unknown storage order: ", order_);
+    finishChannel(c, dYSum, dYXSum);
   }
+  ConstEigenVectorArrayMap<float> a_arr(a, C);
+  ConstEigenVectorArrayMap<float> b_arr(b, C);
+  ConstEigenVectorArrayMap<float> c0_arr(c0, C);
+  ParallelFor(NxHxW, pixelsPerTask, [&](int, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+      EigenVectorArrayMap<float>(dX_data + i * C, C) =
+          ConstEigenVectorArrayMap<float>(dY_data + i * C, C) * a_arr +
+          ConstEigenVectorArrayMap<float>(X_data + i * C, C) * b_arr + c0_arr;
+    }
+  });
   return true;
 }
 
@@ -38,6 +38,12 @@ class SpatialBNOp : public Operator<Context> {
   StorageOrder order_;
   INPUT_TAGS(INPUT, SCALE, BIAS, EST_MEAN, EST_VAR);
   OUTPUT_TAGS(OUTPUT, RUNNING_MEAN, RUNNING_VAR, SAVED_MEAN, SAVED_INV_VAR);
+
+  // The per-channel scale and bias that the CPU op applies to the input, and
+  // the per-task moments of the NHWC statistics.
+  Tensor<Context> new_scale_;
+  Tensor<Context> new_bias_;
+  Tensor<Context> partial_;
 };
 
 template <class Context>
@@ -66,6 +72,11 @@ class SpatialBNGradientOp : public Operator<Context> {
 
   INPUT_TAGS(INPUT, SCALE, OUTPUT_GRAD, SAVED_MEAN, SAVED_INV_VAR);
   OUTPUT_TAGS(INPUT_GRAD, SCALE_GRAD, BIAS_GRAD);
+
+  // The per-channel coefficients of dX in the CPU op, and the per-task sums
+  // of the NHWC gradient.
+  Tensor<Context> coefficients_;
+  Tensor<Context> partial_;
 };
 
 }  // namespace caffe2
@@ -0,0 +1,146 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+static TensorCPU* AddInput(
+    const vector<TIndex>& shape,
+    const string& name,
+    std::mt19937* gen,
+    Workspace* ws) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(shape);
+  std::uniform_real_distribution<float> dist(-1, 3);
+  float* data = tensor->mutable_data<float>();
+  for (int i = 0; i < tensor->size(); ++i) {
+    data[i] = dist(*gen);
+  }
+  return tensor;
+}
+
+static const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+// Checks SpatialBN and its gradient in training and test mode against a
+// reference computed in double, with shapes that split into several tasks.
+static void CheckSpatialBN(
+    const string& order,
+    const int N,
+    const int C,
+    const int H,
+    const int W) {
+  Workspace ws;
+  std::mt19937 gen(11);
+  const bool nchw = order == "NCHW";
+  const vector<TIndex> shape =
+      nchw ? vector<TIndex>{N, C, H, W} : vector<TIndex>{N, H, W, C};
+  AddInput(shape, "X", &gen, &ws);
+  AddInput(shape, "dY", &gen, &ws);
+  AddInput({C}, "scale", &gen, &ws);
+  AddInput({C}, "bias", &gen, &ws);
+  AddInput({C}, "mean", &gen, &ws);
+  auto* var = AddInput({C}, "var", &gen, &ws);
+  for (int c = 0; c < C; ++c) {
+    var->mutable_data<float>()[c] += 2;
+  }
+  const float epsilon = 1e-3, momentum = 0.8;
+  const vector<float> runningMean(Data(&ws, "mean"), Data(&ws, "mean") + C);
+  const vector<float> runningVar(Data(&ws, "var"), Data(&ws, "var") + C);
+
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SpatialBN",
+      "",
+      vector<string>{"X", "scale", "bias", "mean", "var"},
+      vector<string>{"Y_test"},
+      vector<Argument>{MakeArgument("is_test", 1),
+                       MakeArgument("epsilon", epsilon),
+                       MakeArgument("order", order)})));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SpatialBN",
+      "",
+      vector<string>{"X", "scale", "bias", "mean", "var"},
+      vector<string>{"Y", "mean", "var", "saved_mean", "saved_inv_std"},
+      vector<Argument>{MakeArgument("epsilon", epsilon),
+                       MakeArgument("momentum", momentum),
+                       MakeArgument("order", order)})));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SpatialBNGradient",
+      "",
+      vector<string>{"X", "scale", "dY", "saved_mean", "saved_inv_std"},
+      vector<string>{"dX", "dscale", "dbias"},
+      vector<Argument>{MakeArgument("epsilon", epsilon),
+                       MakeArgument("order", order)})));
+
+  const int HxW = H * W, count = N * HxW;
+  auto index = [&](int n, int c, int i) {
+    return nchw ? (n * C + c) * HxW + i : (n * HxW + i) * C + c;
+  };
+  const float* X = Data(&ws, "X");
+  const float* dY = Data(&ws, "dY");
+  const float* scale = Data(&ws, "scale");
+  const float* bias = Data(&ws, "bias");
+  for (int c = 0; c < C; ++c) {
+    double mean = 0, var = 0, dBias = 0, dScale = 0;
+    for (int n = 0; n < N; ++n) {
+      for (int i = 0; i < HxW; ++i) {
+        mean += X[index(n, c, i)];
+      }
+    }
+    mean /= count;
+    for (int n = 0; n < N; ++n) {
+      for (int i = 0; i < HxW; ++i) {
+        const double x = X[index(n, c, i)] - mean;
+        var += x * x;
+        dBias += dY[index(n, c, i)];
+        dScale += x * dY[index(n, c, i)];
+      }
+    }
+    var /= count;
+    const double invStd = 1 / std::sqrt(var + epsilon);
+    dScale *= invStd;
+    EXPECT_NEAR(Data(&ws, "saved_mean")[c], mean, 1e-5);
+    EXPECT_NEAR(Data(&ws, "saved_inv_std")[c], invStd, 1e-5);
+    EXPECT_NEAR(
+        Data(&ws, "mean")[c],
+        runningMean[c] * momentum + mean * (1 - momentum),
+        1e-5);
+    EXPECT_NEAR(
+        Data(&ws, "var")[c],
+        runningVar[c] * momentum + var * (1 - momentum),
+        1e-5);
+    EXPECT_NEAR(Data(&ws, "dbias")[c], dBias, 1e-5 * count);
+    EXPECT_NEAR(Data(&ws, "dscale")[c], dScale, 1e-5 * count);
+    const double testInvStd = 1 / std::sqrt(runningVar[c] + epsilon);
+    for (int n = 0; n < N; ++n) {
+      for (int i = 0; i < HxW; ++i) {
+        const int j = index(n, c, i);
+        const double x = X[j] - mean;
+        EXPECT_NEAR(Data(&ws, "Y")[j], x * invStd * scale[c] + bias[c], 1e-4);
+        EXPECT_NEAR(
+            Data(&ws, "Y_test")[j],
+            (X[j] - runningMean[c]) * testInvStd * scale[c] + bias[c],
+            1e-4);
+        const double dX = scale[c] * invStd / count *
+            (count * dY[j] - dBias - x * invStd * dScale);
+        EXPECT_NEAR(Data(&ws, "dX")[j], dX, 1e-4);
+      }
+    }
+  }
+}
+
+TEST(SpatialBNTest, NCHW) {
+  CheckSpatialBN("NCHW", 3, 5, 40, 40);
+  CheckSpatialBN("NCHW", 2, 64, 3, 3);
+}
+
+TEST(SpatialBNTest, NHWC) {
+  CheckSpatialBN("NHWC", 2, 3, 70, 70);
+  CheckSpatialBN("NHWC", 2, 64, 3, 3);
+}
+
+} // namespace caffe2
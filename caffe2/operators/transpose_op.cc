@@ -2,32 +2,19 @@
 
 namespace caffe2 {
 
-#define COMPILE_TIME_MAX_TRANSPOSE_DIMS 10
-
 template <>
 template <typename T>
 bool TransposeOp<CPUContext>::DoRunWithType() {
-  int from_inds[COMPILE_TIME_MAX_TRANSPOSE_DIMS] = {0};
   const auto& input = Input(0);
   auto* output = Output(0);
-  size_t count = input.size();
-  const auto& from_counts = input.dims();
-  const auto& to_counts = output->dims();
-  int num_axes = from_counts.size();
-  const T* from_data = input.template data<T>();
-  T* to_data = output->template mutable_data<T>();
-  for (size_t index = 0; index < count; index++) {
-    size_t from_index = index, to_index = 0;
-    for (int i = num_axes - 1; i >= 0; --i) {
-      from_inds[i] = from_index % from_counts[i];
-      from_index = from_index / from_counts[i];
-    }
-    for (int i = 0; i < num_axes - 1; ++i) {
-      to_index = (to_index + from_inds[axes_[i]]) * to_counts[i + 1];
-    }
-    to_index += from_inds[axes_[num_axes - 1]];
-    *(to_data + to_index) = *(from_data + index);
-  }
+  const vector<int> dims(input.dims().begin(), input.dims().end());
+  math::Transpose<T, CPUContext>(
+      dims.size(),
+      dims.data(),
+      axes_.data(),
+      input.template data<T>(),
+      output->template mutable_data<T>(),
+      &context_);
   return true;
 }
 
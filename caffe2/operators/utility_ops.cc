@@ -215,6 +215,9 @@ consequences if the input tensor is accessed concurrently by different op
 on individual slice level, e.g. X_0 scaled by weight_0 but without any
 updates applied.
 
+Large updates are split across the CPU thread pool by destination slice, so
+repeated indices are safe and the result matches a sequential loop.
+
 Currently only works on CPU because of access to INDICES.
 )DOC")
     .Input(0, "X_0", "Tensor to be updated.")
@@ -246,7 +249,8 @@ N. If M is the total size of X_0 and K is the size of INDICES then X_i is
 assumed to be of shape K x (M / N) regardless of the real shape.
 
 Note: Each update in INDICES is applied independently which means that if
-duplicated elements are present in INDICES arbitrary one will win.
+duplicated elements are present in INDICES arbitrary one will win. On CPU the
+last one wins.
 
 Currently only works on CPU because of access to INDICES.
 )DOC")
@@ -393,6 +397,9 @@ OPERATOR_SCHEMA(Unique)
     .SetDoc(R"DOC(
 Deduplicates input indices vector and optionally produces reverse remapping.
 There's no guarantees on the ordering of the output indices.
+
+Large inputs are partitioned by a hash of the indices and the partitions are
+deduplicated in parallel on the CPU thread pool.
 )DOC")
     .Input(0, "indices", "1D tensor of int32 or int64 indices.")
     .Output(0, "unique_indices", "1D tensor of deduped entries.");
@@ -3,11 +3,14 @@
 
 #include <fstream>
 #include <sstream>
+#include <type_traits>
 
 #include "caffe2/core/context.h"
 #include "caffe2/core/logging.h"
 #include "caffe2/core/operator.h"
+#include "caffe2/utils/gather_scatter.h"
 #include "caffe2/utils/math.h"
+#include "caffe2/utils/radix_unique.h"
 
 namespace caffe2 {
 
@@ -382,6 +385,10 @@ class WeightedSumOp : public Operator<Context> {
  * on individual slice level, e.g. X_0 scaled by weight_0 but without any
  * updates applied.
  *
+ * On CPU, large updates are split across the thread pool by destination
+ * slice, so repeated indices are safe and give the same result as a
+ * sequential loop.
+ *
  * For now really works only on CPU because of INDICES access
  */
 template <typename T, class Context>
@@ -421,6 +428,28 @@ class ScatterWeightedSumOp : public Operator<Context> {
     T* data = output->template mutable_data<T>();
     const Index* idxs = indices.template data<Index>();
     T w0 = *weight0.template data<T>();
+    if (std::is_same<T, float>::value &&
+        std::is_same<Context, CPUContext>::value) {
+      std::vector<std::pair<const float*, float>> updates;
+      for (int inp = 3; inp < InputSize(); inp += 2) {
+        auto& X = Input(inp);
+        auto& weight = Input(inp + 1);
+        CAFFE_ENFORCE_EQ(X.size(), block_size * K);
+        CAFFE_ENFORCE_EQ(weight.size(), 1);
+        updates.emplace_back(
+            reinterpret_cast<const float*>(X.template data<T>()),
+            *weight.template data<T>());
+      }
+      ScatterWeightedSumRows(
+          block_size,
+          K,
+          N,
+          idxs,
+          w0,
+          updates,
+          reinterpret_cast<float*>(data));
+      return true;
+    }
     // It's most likely a constant so exact comparison is fine
     if (w0 != 1.0) {
       for (int i = 0; i < K; ++i) {
@@ -478,7 +507,8 @@ class ScatterWeightedSumOp : public Operator<Context> {
  * assumed to be of shape K x (M / N) regardless of the real shape.
  *
  * Note: Each update in INDICES is applied independently which means that if
- * duplicated elements are present in INDICES arbitrary one will win.
+ * duplicated elements are present in INDICES arbitrary one will win. On CPU
+ * the last one wins.
  *
  * For now really works only on CPU because of INDICES access
  */
@@ -522,7 +552,16 @@ class ScatterAssignOp : public Operator<Context> {
     T* data = output->template mutable_data<T>();
     const Index* idxs = indices.template data<Index>();
     const T* slicesData = slices.template data<T>();
-#pragma omp parallel for
+    if (std::is_same<Context, CPUContext>::value) {
+      ScatterAssignRows(
+          block_size * sizeof(T),
+          K,
+          N,
+          reinterpret_cast<const char*>(slicesData),
+          idxs,
+          reinterpret_cast<char*>(data));
+      return;
+    }
     for (int i = 0; i < K; ++i) {
       Index idx = idxs[i];
       // double-checking the indices, but it's fine as it's DCHECK only
@@ -1123,7 +1162,6 @@ class GatherOp : public Operator<Context> {
   template <typename Index>
   bool DoRunWithType() {
     // If we endup using it on GPU doing O(N) memcpy is probably not best :)
-    // TODO: implement prefetching if it starts mattering (TF does it)
     auto& data = Input(DATA);
     auto& indices = Input(INDICES);
     auto* output = Output(0);
@@ -1144,6 +1182,10 @@ class GatherOp : public Operator<Context> {
     const Index* idxs = indices.template data<Index>();
     auto out = static_cast<char*>(output->raw_mutable_data(data.meta()));
 
+    if (std::is_same<Context, CPUContext>::value && !data.meta().copy()) {
+      GatherRows(block_bytesize, N, data.dim(0), src_base, idxs, out);
+      return true;
+    }
     for (int i = 0; i < N; ++i) {
       auto src = src_base + idxs[i] * block_bytesize;
       context_.template CopyItems<Context, Context>(
@@ -1262,8 +1304,6 @@ class UniqueOp : public Operator<Context> {
   }
 
  private:
-  vector<int> order_;
-
   template <typename T>
   void DoRun() {
     auto& inputTensor = Input(0);
@@ -1279,30 +1319,14 @@ class UniqueOp : public Operator<Context> {
       remapping = remappingTensor->template mutable_data<int>();
     }
 
-    const T* input = inputTensor.template data<T>();
-    // TODO(dzhulgakov): if perf becomes an issue consider doing hash table
-    // instead of sorting
-    order_.resize(N);
-    std::iota(order_.begin(), order_.end(), 0);
-    std::sort(order_.begin(), order_.end(), [input](const int x, const int y) {
-      return input[x] < input[y];
-    });
-    int K = N;
-    for (int i = 1; i < N; ++i) {
-      K -= input[order_[i]] == input[order_[i - 1]];
-    }
-    uniqueTensor->Resize(K);
-    T* unique = uniqueTensor->template mutable_data<T>();
-    K = 0;
-    T prev = -1;
-    for (int i = 0; i < N; ++i) {
-      if (i == 0 || prev != input[order_[i]]) {
-        prev = unique[K++] = input[order_[i]];
-      }
-      if (remapping) {
-        remapping[order_[i]] = K - 1;
-      }
-    }
+    vector<T> unique;
+    RadixPartitionedUnique(
+        inputTensor.template data<T>(), N, &unique, remapping, nullptr);
+    uniqueTensor->Resize(unique.size());
+    std::copy(
+        unique.begin(),
+        unique.end(),
+        uniqueTensor->template mutable_data<T>());
   }
 
  public:
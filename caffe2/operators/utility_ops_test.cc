@@ -1,4 +1,6 @@
 #include <iostream>
+#include <random>
+#include <unordered_set>
 
 #include "caffe2/core/flags.h"
 #include "caffe2/operators/utility_ops.h"
@@ -51,4 +53,157 @@ TEST(UtilityOpTest, testEnsureCPUOutput) {
   }
 }
 
+TEST(UtilityOpTest, testUniqueAndFindDuplicateElements) {
+  // The small input is deduplicated as one partition and the large one is
+  // partitioned; most of the large one repeats a few hot ids.
+  for (const int n : {1000, 300000}) {
+    Workspace ws;
+    std::mt19937 gen(n);
+    std::uniform_int_distribution<int64_t> cold(-(1LL << 40), 1LL << 40);
+    std::uniform_int_distribution<int64_t> hot(0, 9);
+    std::bernoulli_distribution is_hot(0.7);
+    auto* input = ws.CreateBlob("input")->GetMutable<TensorCPU>();
+    input->Resize(n);
+    int64_t* input_data = input->mutable_data<int64_t>();
+    for (int i = 0; i < n; ++i) {
+      input_data[i] = is_hot(gen) ? hot(gen) : cold(gen) % (n / 2);
+    }
+
+    unique_ptr<OperatorBase> op(CreateOperator(
+        CreateOperatorDef(
+            "Unique",
+            "",
+            vector<string>{"input"},
+            vector<string>{"unique", "remapping"}),
+        &ws));
+    ASSERT_TRUE(op->Run());
+    const auto& unique = ws.GetBlob("unique")->Get<TensorCPU>();
+    const auto& remapping = ws.GetBlob("remapping")->Get<TensorCPU>();
+    const std::unordered_set<int64_t> expected(input_data, input_data + n);
+    const std::unordered_set<int64_t> found(
+        unique.data<int64_t>(), unique.data<int64_t>() + unique.size());
+    EXPECT_EQ(expected.size(), unique.size());
+    EXPECT_EQ(expected, found);
+    ASSERT_EQ(n, remapping.size());
+    for (int i = 0; i < n; ++i) {
+      ASSERT_EQ(input_data[i], unique.data<int64_t>()[remapping.data<int>()[i]]);
+    }
+
+    op = CreateOperator(
+        CreateOperatorDef(
+            "FindDuplicateElements",
+            "",
+            vector<string>{"input"},
+            vector<string>{"duplicates"}),
+        &ws);
+    ASSERT_TRUE(op->Run());
+    const auto& duplicates = ws.GetBlob("duplicates")->Get<TensorCPU>();
+    std::vector<int64_t> expected_duplicates;
+    std::unordered_set<int64_t> seen;
+    for (int i = 0; i < n; ++i) {
+      if (!seen.insert(input_data[i]).second) {
+        expected_duplicates.push_back(i);
+      }
+    }
+    EXPECT_EQ(
+        expected_duplicates,
+        std::vector<int64_t>(
+            duplicates.data<int64_t>(),
+            duplicates.data<int64_t>() + duplicates.size()));
+  }
+}
+
+TEST(UtilityOpTest, testGatherAndScatter) {
+  // The small case runs on one thread and the large one is split across the
+  // thread pool. Indices repeat, so rows get several updates.
+  for (const int K : {50, 100000}) {
+    Workspace ws;
+    const int N = 1000;
+    const int D = 37;
+    std::mt19937 gen(K);
+    std::uniform_real_distribution<float> value(-1, 1);
+    std::uniform_int_distribution<int> index(0, N - 1);
+    auto* data = ws.CreateBlob("data")->GetMutable<TensorCPU>();
+    data->Resize(N, D);
+    for (int i = 0; i < data->size(); ++i) {
+      data->mutable_data<float>()[i] = value(gen);
+    }
+    const vector<float> original(
+        data->data<float>(), data->data<float>() + data->size());
+    auto* indices = ws.CreateBlob("indices")->GetMutable<TensorCPU>();
+    indices->Resize(K);
+    auto* slices = ws.CreateBlob("slices")->GetMutable<TensorCPU>();
+    slices->Resize(K, D);
+    for (int i = 0; i < K; ++i) {
+      indices->mutable_data<int>()[i] = index(gen);
+    }
+    for (int i = 0; i < slices->size(); ++i) {
+      slices->mutable_data<float>()[i] = value(gen);
+    }
+    const int* idxs = indices->data<int>();
+    const float* x = slices->data<float>();
+    auto* w0 = ws.CreateBlob("w0")->GetMutable<TensorCPU>();
+    w0->Resize(1);
+    w0->mutable_data<float>()[0] = 0.99f;
+    auto* w1 = ws.CreateBlob("w1")->GetMutable<TensorCPU>();
+    w1->Resize(1);
+    w1->mutable_data<float>()[0] = -0.5f;
+
+    ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+        "Gather",
+        "",
+        vector<string>{"data", "indices"},
+        vector<string>{"gathered"})));
+    const auto& gathered = ws.GetBlob("gathered")->Get<TensorCPU>();
+    ASSERT_EQ((vector<TIndex>{K, D}), gathered.dims());
+    for (int i = 0; i < K; ++i) {
+      for (int k = 0; k < D; ++k) {
+        ASSERT_EQ(
+            original[idxs[i] * D + k], gathered.data<float>()[i * D + k]);
+      }
+    }
+
+    vector<float> expected = original;
+    for (int i = 0; i < K; ++i) {
+      for (int k = 0; k < D; ++k) {
+        expected[idxs[i] * D + k] *= 0.99f;
+      }
+    }
+    for (int i = 0; i < K; ++i) {
+      for (int k = 0; k < D; ++k) {
+        expected[idxs[i] * D + k] += -0.5f * x[i * D + k];
+      }
+    }
+    ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+        "ScatterWeightedSum",
+        "",
+        vector<string>{"data", "w0", "indices", "slices", "w1"},
+        vector<string>{"data"})));
+    for (int i = 0; i < N * D; ++i) {
+      ASSERT_NEAR(expected[i], data->data<float>()[i], 1e-5) << i;
+    }
+
+    for (int i = 0; i < K; ++i) {
+      std::copy(x + i * D, x + (i + 1) * D, expected.begin() + idxs[i] * D);
+    }
+    ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+        "ScatterAssign",
+        "",
+        vector<string>{"data", "indices", "slices"},
+        vector<string>{"data"})));
+    for (int i = 0; i < N * D; ++i) {
+      ASSERT_EQ(expected[i], data->data<float>()[i]) << i;
+    }
+
+    indices->mutable_data<int>()[K / 2] = N;
+    EXPECT_THROW(
+        ws.RunOperatorOnce(CreateOperatorDef(
+            "Gather",
+            "",
+            vector<string>{"data", "indices"},
+            vector<string>{"gathered"})),
+        EnforceNotMet);
+  }
+}
+
 } // namespace caffe2
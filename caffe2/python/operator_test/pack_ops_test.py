@@ -41,3 +41,27 @@ class TestTensorPackOps(TestCase):
         workspace.RunOperatorOnce(core.CreateOperator(
             'UnpackSegments', ['l', 't'], ['newd']))
         assert((workspace.FetchBlob('newd') == workspace.FetchBlob('d')).all())
+
+    def test_pack_sequences(self):
+        lengths = np.array([2, 0, 3, 1, 3], dtype=np.int32)
+        data = np.arange(9 * 2, dtype=np.float32).reshape(9, 2)
+        workspace.FeedBlob('l', lengths)
+        workspace.FeedBlob('d', data)
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'PackSequences', ['l', 'd'], ['p', 'batch_sizes', 'order']))
+
+        # Sorted by decreasing length, ties broken by index, time-major.
+        order = [2, 4, 0, 3, 1]
+        starts = np.concatenate([[0], np.cumsum(lengths)])
+        expected = [
+            data[starts[i] + t]
+            for t in range(lengths.max()) for i in order if t < lengths[i]
+        ]
+        np.testing.assert_array_equal(workspace.FetchBlob('p'), expected)
+        np.testing.assert_array_equal(
+            workspace.FetchBlob('batch_sizes'), [4, 3, 2])
+        np.testing.assert_array_equal(workspace.FetchBlob('order'), order)
+
+        workspace.RunOperatorOnce(core.CreateOperator(
+            'UnpackSequences', ['l', 'p'], ['newd']))
+        np.testing.assert_array_equal(workspace.FetchBlob('newd'), data)
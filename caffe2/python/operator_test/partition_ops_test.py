@@ -159,3 +159,41 @@ class TestPartitionOps(TestCase):
                 np.testing.assert_array_equal(
                     expected, workspace.FetchBlob(name)
                 )
+
+    def testPartitionWithPermutation(self):
+        for op_type in ['Partition', 'LengthsPartition']:
+            for parts in [1, 3, 7]:
+                ids = np.random.randint(-1000, 1000, 100000).astype(np.int64)
+                values = rand_array(100000, 3)
+                ins = ['ids', 'values']
+                if op_type == 'LengthsPartition':
+                    lengths = np.full(1000, 100, dtype=np.int32)
+                    workspace.FeedBlob('lengths', lengths)
+                    ins = ['lengths'] + ins
+                workspace.FeedBlob('ids', ids)
+                workspace.FeedBlob('values', values)
+                outs = [
+                    '{}_p{}'.format(name, i)
+                    for i in range(parts) for name in ins
+                ]
+                workspace.RunOperatorOnce(
+                    core.CreateOperator(op_type, ins, outs))
+                workspace.RunOperatorOnce(core.CreateOperator(
+                    op_type + 'WithPermutation', ins,
+                    ['perm_' + out for out in outs] + ['permutation']))
+                for out in outs:
+                    np.testing.assert_array_equal(
+                        workspace.FetchBlob(out),
+                        workspace.FetchBlob('perm_' + out))
+
+                # Gathering the concatenated shards by the permutation gives
+                # back the inputs.
+                permutation = workspace.FetchBlob('permutation')
+                self.assertEqual(permutation.dtype, np.int64)
+                np.testing.assert_array_equal(
+                    np.sort(permutation), np.arange(len(ids)))
+                for name, x in [('ids', ids), ('values', values)]:
+                    concat = np.concatenate([
+                        workspace.FetchBlob('{}_p{}'.format(name, i))
+                        for i in range(parts)])
+                    np.testing.assert_array_equal(concat[permutation], x)
@@ -39,6 +39,10 @@ Given inputs (param, history, indices, grad, lr), runs the dense AdaGrad
 update on (param, grad, history[indices], lr), and returns (new_param,
 new_history) as in the dense case.
 
+The slices of grad with the same index are summed first, so that every row is
+updated once and the result does not depend on their order. Rows are updated
+in parallel on the CPU thread pool.
+
 )DOC")
     .Input(0, "param", "Parameters to be updated")
     .Input(1, "moment", "Moment history")
@@ -49,7 +53,69 @@ new_history) as in the dense case.
     .Output(1, "output_moment_1", "Updated moment")
     .Arg("epsilon", "Default 1e-5");
 
+REGISTER_CPU_OPERATOR(
+    RowWiseSparseAdagrad,
+    RowWiseSparseAdagradOp<float, CPUContext>);
+OPERATOR_SCHEMA(RowWiseSparseAdagrad)
+    .NumInputs(5)
+    .NumOutputs(2)
+    .AllowInplace({{0, 0}, {1, 1}})
+    .SetDoc(R"DOC(
+
+Variation of SparseAdagrad that keeps a single history value per row of param
+instead of one per element, which saves almost all the memory of the history
+of large embedding tables. Given inputs (param, history, indices, grad, lr),
+for every distinct index i with the summed gradient slice g, computes
+
+    new_history[i] = history[i] + mean(square(g))
+    new_param[i] = param[i] + learning_rate * g / (sqrt(new_history[i]) + epsilon)
+
+and returns (new_param, new_history).
+
+)DOC")
+    .Input(0, "param", "Parameters to be updated")
+    .Input(1, "moment", "Moment history, a vector with an element per row")
+    .Input(2, "indices", "Sparse indices")
+    .Input(3, "grad", "Gradient computed")
+    .Input(4, "lr", "learning rate")
+    .Output(0, "output_param", "Updated parameters")
+    .Output(1, "output_moment_1", "Updated moment")
+    .Arg("epsilon", "Default 1e-5");
+
+REGISTER_CPU_OPERATOR(
+    SparseAdagradFusedWithSparseLengthsSumGradient,
+    SparseAdagradFusedWithSparseLengthsSumGradientOp<float, CPUContext>);
+OPERATOR_SCHEMA(SparseAdagradFusedWithSparseLengthsSumGradient)
+    .NumInputs(6)
+    .NumOutputs(2)
+    .AllowInplace({{0, 0}, {1, 1}})
+    .SetDoc(R"DOC(
+
+Fused SparseLengthsSumGradient and SparseAdagrad. Given inputs (param,
+history, indices, grad, lr, lengths), where grad is the gradient of the
+output of SparseLengthsSum(param, indices, lengths), with a row per segment,
+runs SparseAdagrad on param with every index taking the gradient row of its
+segment, and returns (new_param, new_history).
+
+The result is the same as running SparseLengthsSumGradient and then
+SparseAdagrad, but the [len(indices), block_size] gradient of the embedding
+rows is never written out: rows of indices that appear once are read straight
+from grad, and only repeated indices get a summed row.
+
+)DOC")
+    .Input(0, "param", "Parameters to be updated")
+    .Input(1, "moment", "Moment history")
+    .Input(2, "indices", "Sparse indices, the INDICES of SparseLengthsSum")
+    .Input(3, "grad", "Gradient of the output of SparseLengthsSum")
+    .Input(4, "lr", "learning rate")
+    .Input(5, "lengths", "The LENGTHS of SparseLengthsSum, int32")
+    .Output(0, "output_param", "Updated parameters")
+    .Output(1, "output_moment_1", "Updated moment")
+    .Arg("epsilon", "Default 1e-5");
+
 SHOULD_NOT_DO_GRADIENT(Adagrad);
 SHOULD_NOT_DO_GRADIENT(SparseAdagrad);
+SHOULD_NOT_DO_GRADIENT(RowWiseSparseAdagrad);
+SHOULD_NOT_DO_GRADIENT(SparseAdagradFusedWithSparseLengthsSumGradient);
 }
 }
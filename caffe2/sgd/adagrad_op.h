@@ -1,6 +1,7 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/sgd/sparse_update.h"
 
 namespace caffe2 {
 
@@ -87,6 +88,7 @@ class SparseAdagradOp final : public Operator<Context> {
 
   template <typename SIndex>
   bool DoRunWithType() {
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_1).size());
     const auto* lr = Input(LR).template data<T>();
     Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
     Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
@@ -105,27 +107,87 @@ class SparseAdagradOp final : public Operator<Context> {
     }
 
     auto block_size = Input(GRAD).size_from_dim(1);
-    for (auto i = 0; i < n; ++i) {
-      auto idx = indices[i];
-      if (block_size == 1) {
-        float gi = gradIn[i];
-        float hi = momentOut[idx] = momentIn[idx] + gi * gi;
-        paramOut[idx] = paramIn[idx] + lr[0] * gi / (std::sqrt(hi) + epsilon_);
-      } else {
-        auto offsetI = i * block_size;
-        auto offsetIdx = idx * block_size;
-        adagrad_compute(
-            block_size,
-            paramIn + offsetIdx,
-            gradIn + offsetI,
-            momentIn + offsetIdx,
-            paramOut + offsetIdx,
-            momentOut + offsetIdx,
-            epsilon_,
-            lr[0],
-            &context_);
-      }
+    DeduplicatedSparseGradient<SIndex> grad(n, block_size, indices, gradIn);
+    grad.CheckBounds(Input(PARAM).size() / block_size);
+    const float lr0 = lr[0];
+    ParallelForRows(grad.size(), block_size, [&](const TIndex u) {
+      auto offsetIdx = grad.index(u) * block_size;
+      adagrad_update_row(
+          block_size,
+          paramIn + offsetIdx,
+          grad.grad(u),
+          momentIn + offsetIdx,
+          paramOut + offsetIdx,
+          momentOut + offsetIdx,
+          epsilon_,
+          lr0);
+    });
+    return true;
+  }
+
+ protected:
+  T epsilon_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
+
+template <typename T, class Context>
+class RowWiseSparseAdagradOp final : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  RowWiseSparseAdagradOp(const OperatorDef& operator_def, Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    CAFFE_ENFORCE_GT(Input(PARAM).ndim(), 0);
+    CAFFE_ENFORCE_EQ(
+        Input(PARAM).dim(0),
+        Input(MOMENT_1).size(),
+        "RowWiseSparseAdagrad keeps one moment per row of the parameters");
+    const auto* lr = Input(LR).template data<T>();
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+
+    auto n = Input(GRAD).dim(0);
+
+    const auto* indices = Input(INDICES).template data<SIndex>();
+    const auto* gradIn = Input(GRAD).template data<T>();
+    const auto* paramIn = Input(PARAM).template data<T>();
+    const auto* momentIn = Input(MOMENT_1).template data<T>();
+    auto* paramOut = Output(OUTPUT_PARAM)->template mutable_data<T>();
+    auto* momentOut = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
+
+    if (n == 0) {
+      return true;
     }
+
+    auto block_size = Input(GRAD).size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, Input(PARAM).size_from_dim(1));
+    DeduplicatedSparseGradient<SIndex> grad(n, block_size, indices, gradIn);
+    grad.CheckBounds(Input(PARAM).dim(0));
+    const float lr0 = lr[0];
+    ParallelForRows(grad.size(), block_size, [&](const TIndex u) {
+      const auto idx = grad.index(u);
+      const float* g = grad.grad(u);
+      float squares = 0;
+      for (TIndex k = 0; k < block_size; ++k) {
+        squares += g[k] * g[k];
+      }
+      const float hi = momentOut[idx] = momentIn[idx] + squares / block_size;
+      const float step = lr0 / (std::sqrt(hi) + epsilon_);
+      const float* w = paramIn + idx * block_size;
+      float* nw = paramOut + idx * block_size;
+      for (TIndex k = 0; k < block_size; ++k) {
+        nw[k] = w[k] + step * g[k];
+      }
+    });
     return true;
   }
 
@@ -134,4 +196,95 @@ class SparseAdagradOp final : public Operator<Context> {
   INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR);
   OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
 };
+
+// SparseLengthsSumGradient followed by SparseAdagrad in a single pass. Index i
+// of segment s has the gradient row s of GRAD, so the rows are read straight
+// from the output gradient instead of being copied to a [num_indices,
+// block_size] tensor first.
+template <typename T, class Context>
+class SparseAdagradFusedWithSparseLengthsSumGradientOp final
+    : public Operator<Context> {
+ public:
+  USE_OPERATOR_CONTEXT_FUNCTIONS;
+  SparseAdagradFusedWithSparseLengthsSumGradientOp(
+      const OperatorDef& operator_def,
+      Workspace* ws)
+      : Operator<Context>(operator_def, ws),
+        epsilon_(OperatorBase::GetSingleArgument<float>("epsilon", 1e-5)) {}
+
+  bool RunOnDevice() override {
+    return DispatchHelper<TensorTypes<int32_t, int64_t>>::call(
+        this, Input(INDICES));
+  }
+
+  template <typename SIndex>
+  bool DoRunWithType() {
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_GT(Input(PARAM).ndim(), 0);
+    CAFFE_ENFORCE_EQ(1, Input(INDICES).ndim(), "INDICES must be a vector");
+    CAFFE_ENFORCE_EQ(1, Input(LENGTHS).ndim(), "LENGTHS must be a vector");
+    CAFFE_ENFORCE_GT(Input(GRAD).ndim(), 0);
+    CAFFE_ENFORCE_EQ(
+        Input(LENGTHS).dim(0),
+        Input(GRAD).dim(0),
+        "GRAD must have a row per segment");
+    const auto* lr = Input(LR).template data<T>();
+    Output(OUTPUT_PARAM)->ResizeLike(Input(PARAM));
+    Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
+
+    const auto n = Input(INDICES).dim(0);
+    const auto num_segments = Input(LENGTHS).dim(0);
+    const auto* indices = Input(INDICES).template data<SIndex>();
+    const auto* lengths = Input(LENGTHS).template data<int>();
+    const auto* gradIn = Input(GRAD).template data<T>();
+    const auto* paramIn = Input(PARAM).template data<T>();
+    const auto* momentIn = Input(MOMENT_1).template data<T>();
+    auto* paramOut = Output(OUTPUT_PARAM)->template mutable_data<T>();
+    auto* momentOut = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
+
+    const auto block_size = Input(GRAD).size_from_dim(1);
+    CAFFE_ENFORCE_EQ(block_size, Input(PARAM).size_from_dim(1));
+
+    segments_.resize(n);
+    TIndex i = 0;
+    for (TIndex s = 0; s < num_segments; ++s) {
+      CAFFE_ENFORCE_GE(lengths[s], 0);
+      CAFFE_ENFORCE_LE(
+          i + lengths[s], n, "The lengths add up to more than the indices");
+      std::fill(segments_.begin() + i, segments_.begin() + i + lengths[s], s);
+      i += lengths[s];
+    }
+    CAFFE_ENFORCE_EQ(i, n, "The lengths must add up to the number of indices");
+    if (n == 0) {
+      return true;
+    }
+
+    DeduplicatedSparseGradient<SIndex> grad(
+        n, block_size, indices, [&](const TIndex j) {
+          return gradIn + segments_[j] * block_size;
+        });
+    grad.CheckBounds(Input(PARAM).dim(0));
+    const float lr0 = lr[0];
+    ParallelForRows(grad.size(), block_size, [&](const TIndex u) {
+      auto offsetIdx = grad.index(u) * block_size;
+      adagrad_update_row(
+          block_size,
+          paramIn + offsetIdx,
+          grad.grad(u),
+          momentIn + offsetIdx,
+          paramOut + offsetIdx,
+          momentOut + offsetIdx,
+          epsilon_,
+          lr0);
+    });
+    return true;
+  }
+
+ protected:
+  T epsilon_;
+  // Segment of every index.
+  std::vector<TIndex> segments_;
+  INPUT_TAGS(PARAM, MOMENT_1, INDICES, GRAD, LR, LENGTHS);
+  OUTPUT_TAGS(OUTPUT_PARAM, OUTPUT_MOMENT_1);
+};
 }
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+TensorCPU* CreateTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<T>();
+  return tensor;
+}
+
+// Fills the float tensor name of ws with values drawn from [min, max), and
+// returns a copy of them.
+vector<float> FillTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    const float min,
+    const float max,
+    std::mt19937* gen) {
+  auto* tensor = CreateTensor<float>(ws, name, dims);
+  std::uniform_real_distribution<float> value(min, max);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+  return vector<float>(
+      tensor->data<float>(), tensor->data<float>() + tensor->size());
+}
+
+void SetIndices(Workspace* ws, const vector<TIndex>& values) {
+  auto* indices = CreateTensor<TIndex>(ws, "indices", {TIndex(values.size())});
+  std::copy(values.begin(), values.end(), indices->mutable_data<TIndex>());
+}
+
+const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+// Sums the rows of grad, a [indices.size(), block_size] matrix, by index into
+// a [num_rows, block_size] matrix, and marks the rows that have an index.
+void SumByIndex(
+    const vector<TIndex>& indices,
+    const vector<float>& grad,
+    const int num_rows,
+    const int block_size,
+    vector<double>* sums,
+    vector<bool>* touched) {
+  sums->assign(num_rows * block_size, 0);
+  touched->assign(num_rows, false);
+  for (int i = 0; i < indices.size(); ++i) {
+    (*touched)[indices[i]] = true;
+    for (int k = 0; k < block_size; ++k) {
+      (*sums)[indices[i] * block_size + k] += grad[i * block_size + k];
+    }
+  }
+}
+
+// Draws num_indices indices in [0, num_rows), and forces some repeats.
+vector<TIndex> RandomIndices(
+    const int num_indices,
+    const int num_rows,
+    std::mt19937* gen) {
+  std::uniform_int_distribution<TIndex> index(0, num_rows - 1);
+  vector<TIndex> indices(num_indices);
+  for (auto& i : indices) {
+    i = index(*gen);
+  }
+  for (int i = 1; i < num_indices; i += 3) {
+    indices[i] = indices[i - 1];
+  }
+  return indices;
+}
+
+const float kLR = -0.1, kEpsilon = 1e-5;
+
+// Runs SparseAdagrad in place on random inputs, and compares it with the
+// dense update of every row by the sum of its slices of grad.
+void CheckSparseAdagrad(
+    const int num_rows,
+    const int block_size,
+    const int num_indices) {
+  Workspace ws;
+  std::mt19937 gen(num_rows + num_indices);
+  const auto param =
+      FillTensor(&ws, "param", {num_rows, block_size}, -1, 1, &gen);
+  const auto moment =
+      FillTensor(&ws, "moment", {num_rows, block_size}, 0, 1, &gen);
+  const auto indices = RandomIndices(num_indices, num_rows, &gen);
+  SetIndices(&ws, indices);
+  const auto grad =
+      FillTensor(&ws, "grad", {num_indices, block_size}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = kLR;
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SparseAdagrad",
+      "",
+      vector<string>{"param", "moment", "indices", "grad", "lr"},
+      vector<string>{"param", "moment"},
+      vector<Argument>{MakeArgument<float>("epsilon", kEpsilon)})));
+
+  vector<double> sums;
+  vector<bool> touched;
+  SumByIndex(indices, grad, num_rows, block_size, &sums, &touched);
+  for (int i = 0; i < num_rows * block_size; ++i) {
+    double h = moment[i], w = param[i];
+    if (touched[i / block_size]) {
+      h += sums[i] * sums[i];
+      w += kLR * sums[i] / (std::sqrt(h) + kEpsilon);
+    }
+    EXPECT_NEAR(Data(&ws, "moment")[i], h, 1e-4);
+    EXPECT_NEAR(Data(&ws, "param")[i], w, 1e-4);
+  }
+}
+
+// The same for RowWiseSparseAdagrad, whose moment is the running sum of the
+// mean square of the summed slices of every row.
+void CheckRowWiseSparseAdagrad(
+    const int num_rows,
+    const int block_size,
+    const int num_indices) {
+  Workspace ws;
+  std::mt19937 gen(num_rows + num_indices);
+  const auto param =
+      FillTensor(&ws, "param", {num_rows, block_size}, -1, 1, &gen);
+  const auto moment = FillTensor(&ws, "moment", {num_rows}, 0, 1, &gen);
+  const auto indices = RandomIndices(num_indices, num_rows, &gen);
+  SetIndices(&ws, indices);
+  const auto grad =
+      FillTensor(&ws, "grad", {num_indices, block_size}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = kLR;
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "RowWiseSparseAdagrad",
+      "",
+      vector<string>{"param", "moment", "indices", "grad", "lr"},
+      vector<string>{"param", "moment"},
+      vector<Argument>{MakeArgument<float>("epsilon", kEpsilon)})));
+
+  vector<double> sums;
+  vector<bool> touched;
+  SumByIndex(indices, grad, num_rows, block_size, &sums, &touched);
+  for (int r = 0; r < num_rows; ++r) {
+    double h = moment[r];
+    if (touched[r]) {
+      double squares = 0;
+      for (int k = 0; k < block_size; ++k) {
+        squares += sums[r * block_size + k] * sums[r * block_size + k];
+      }
+      h += squares / block_size;
+    }
+    EXPECT_NEAR(Data(&ws, "moment")[r], h, 1e-4);
+    for (int k = 0; k < block_size; ++k) {
+      const int i = r * block_size + k;
+      const double w = touched[r]
+          ? param[i] + kLR * sums[i] / (std::sqrt(h) + kEpsilon)
+          : param[i];
+      EXPECT_NEAR(Data(&ws, "param")[i], w, 1e-4);
+    }
+  }
+}
+
+// Runs SparseAdagradFusedWithSparseLengthsSumGradient and, on a copy of param
+// and moment, SparseLengthsSumGradient followed by SparseAdagrad, and checks
+// that both give the same result. Every third segment is empty.
+void CheckSparseAdagradFused(
+    const int num_rows,
+    const int block_size,
+    const int num_segments) {
+  Workspace ws;
+  std::mt19937 gen(num_rows + num_segments);
+  const auto param =
+      FillTensor(&ws, "param", {num_rows, block_size}, -1, 1, &gen);
+  const auto moment =
+      FillTensor(&ws, "moment", {num_rows, block_size}, 0, 1, &gen);
+  auto* param_ref =
+      CreateTensor<float>(&ws, "param_ref", {num_rows, block_size});
+  std::copy(param.begin(), param.end(), param_ref->mutable_data<float>());
+  auto* moment_ref =
+      CreateTensor<float>(&ws, "moment_ref", {num_rows, block_size});
+  std::copy(moment.begin(), moment.end(), moment_ref->mutable_data<float>());
+  auto* lengths = CreateTensor<int>(&ws, "lengths", {num_segments});
+  std::uniform_int_distribution<int> length(1, 6);
+  int num_indices = 0;
+  for (int s = 0; s < num_segments; ++s) {
+    lengths->mutable_data<int>()[s] = s % 3 == 1 ? 0 : length(gen);
+    num_indices += lengths->data<int>()[s];
+  }
+  SetIndices(&ws, RandomIndices(num_indices, num_rows, &gen));
+  FillTensor(&ws, "grad", {num_segments, block_size}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = kLR;
+  const vector<Argument> args{MakeArgument<float>("epsilon", kEpsilon)};
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SparseAdagradFusedWithSparseLengthsSumGradient",
+      "",
+      vector<string>{"param", "moment", "indices", "grad", "lr", "lengths"},
+      vector<string>{"param", "moment"},
+      args)));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SparseLengthsSumGradient",
+      "",
+      vector<string>{"grad", "lengths"},
+      vector<string>{"indices_grad"})));
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SparseAdagrad",
+      "",
+      vector<string>{
+          "param_ref", "moment_ref", "indices", "indices_grad", "lr"},
+      vector<string>{"param_ref", "moment_ref"},
+      args)));
+
+  for (int i = 0; i < num_rows * block_size; ++i) {
+    EXPECT_NEAR(Data(&ws, "moment")[i], Data(&ws, "moment_ref")[i], 1e-5);
+    EXPECT_NEAR(Data(&ws, "param")[i], Data(&ws, "param_ref")[i], 1e-5);
+  }
+}
+
+} // namespace
+
+TEST(SparseAdagradTest, SumsRepeatedIndices) {
+  CheckSparseAdagrad(10, 5, 12);
+  // A block of 9 also covers the vector loop and its tail.
+  CheckSparseAdagrad(7, 9, 20);
+}
+
+TEST(SparseAdagradTest, SplitsManyRowsAcrossThreads) {
+  // Several tasks of ParallelForRows, on both unique and summed rows.
+  CheckSparseAdagrad(3000, 32, 4000);
+}
+
+TEST(RowWiseSparseAdagradTest, SumsRepeatedIndices) {
+  CheckRowWiseSparseAdagrad(10, 5, 12);
+  CheckRowWiseSparseAdagrad(3000, 32, 4000);
+}
+
+TEST(RowWiseSparseAdagradTest, NeedsAMomentPerRow) {
+  Workspace ws;
+  std::mt19937 gen(1);
+  FillTensor(&ws, "param", {4, 3}, -1, 1, &gen);
+  FillTensor(&ws, "moment", {4, 3}, 0, 1, &gen);
+  SetIndices(&ws, {1, 2});
+  FillTensor(&ws, "grad", {2, 3}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = kLR;
+  const auto def = CreateOperatorDef(
+      "RowWiseSparseAdagrad",
+      "",
+      vector<string>{"param", "moment", "indices", "grad", "lr"},
+      vector<string>{"param", "moment"});
+  EXPECT_THROW(ws.RunOperatorOnce(def), EnforceNotMet);
+}
+
+TEST(SparseAdagradFusedWithSparseLengthsSumGradientTest, MatchesUnfused) {
+  CheckSparseAdagradFused(10, 5, 6);
+  CheckSparseAdagradFused(7, 9, 12);
+  CheckSparseAdagradFused(2000, 32, 1500);
+}
+
+TEST(SparseAdagradFusedWithSparseLengthsSumGradientTest, ChecksLengths) {
+  Workspace ws;
+  std::mt19937 gen(1);
+  FillTensor(&ws, "param", {4, 3}, -1, 1, &gen);
+  FillTensor(&ws, "moment", {4, 3}, 0, 1, &gen);
+  SetIndices(&ws, {1, 2, 1});
+  FillTensor(&ws, "grad", {2, 3}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = kLR;
+  const auto def = CreateOperatorDef(
+      "SparseAdagradFusedWithSparseLengthsSumGradient",
+      "",
+      vector<string>{"param", "moment", "indices", "grad", "lr", "lengths"},
+      vector<string>{"param", "moment"});
+  // The lengths add up to fewer, then more, than the 3 indices.
+  for (const auto& values : {vector<int>{1, 1}, vector<int>{2, 2}}) {
+    auto* lengths = CreateTensor<int>(&ws, "lengths", {2});
+    std::copy(values.begin(), values.end(), lengths->mutable_data<int>());
+    EXPECT_THROW(ws.RunOperatorOnce(def), EnforceNotMet);
+  }
+}
+
+} // namespace caffe2
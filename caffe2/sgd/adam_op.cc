@@ -51,6 +51,10 @@ Given inputs (param, moment1, moment2, indices, grad, lr, iter), runs the dense
 Adam on on (param, moment1[indices], momemnt2[indices], lr, iter) and returns
 (new_param, new_moment1, new_moment2) as in dense case
 
+The slices of grad with the same index are summed first, so that every row is
+updated once and the result does not depend on their order. Rows are updated
+in parallel on the CPU thread pool.
+
 )DOC")
     .Input(0, "param", "Parameters to be updated")
     .Input(1, "moment_1", "First moment history")
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "caffe2/core/operator.h"
+#include "caffe2/sgd/sparse_update.h"
 
 namespace caffe2 {
 
@@ -133,8 +134,9 @@ class SparseAdamOp final : public Operator<Context> {
     Output(OUTPUT_MOMENT_1)->ResizeLike(Input(MOMENT_1));
     Output(OUTPUT_MOMENT_2)->ResizeLike(Input(MOMENT_2));
 
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_1).size());
+    CAFFE_ENFORCE_EQ(Input(PARAM).size(), Input(MOMENT_2).size());
     auto n = Input(GRAD).dim(0);
-    auto block_size = Input(GRAD).size() / n;
 
     const auto* paramIn = Input(PARAM).template data<T>();
     const auto* indices = Input(INDICES).template data<SIndex>();
@@ -145,37 +147,30 @@ class SparseAdamOp final : public Operator<Context> {
     auto* moment1Out = Output(OUTPUT_MOMENT_1)->template mutable_data<T>();
     auto* moment2Out = Output(OUTPUT_MOMENT_2)->template mutable_data<T>();
 
-    for (auto i = 0; i < n; ++i) {
-      auto idx = indices[i];
-      if (block_size == 1) {
-        float gi = gradIn[i];
-        float mi = moment1Out[idx] =
-            moment1In[idx] * beta1_ + gi * (1 - beta1_);
-        float vi = moment2Out[idx] =
-            moment2In[idx] * beta2_ + gi * gi * (1 - beta2_);
-        paramOut[idx] =
-            paramIn[idx] + lr[0] * correction * mi / (sqrt(vi) + epsilon_);
-
-      } else {
-        auto offsetI = i * block_size;
-        auto offsetIdx = idx * block_size;
-        adam_compute(
-            block_size,
-            paramIn + offsetIdx,
-            gradIn + offsetI,
-            moment1In + offsetIdx,
-            moment2In + offsetIdx,
-            paramOut + offsetIdx,
-            moment1Out + offsetIdx,
-            moment2Out + offsetIdx,
-            beta1_,
-            beta2_,
-            epsilon_,
-            correction,
-            lr,
-            &context_);
-      }
+    if (n == 0) {
+      return true;
     }
+
+    auto block_size = Input(GRAD).size() / n;
+    DeduplicatedSparseGradient<SIndex> grad(n, block_size, indices, gradIn);
+    grad.CheckBounds(Input(PARAM).size() / block_size);
+    const float step = lr[0] * correction;
+    ParallelForRows(grad.size(), block_size, [&](const TIndex u) {
+      auto offsetIdx = grad.index(u) * block_size;
+      adam_update_row(
+          block_size,
+          paramIn + offsetIdx,
+          grad.grad(u),
+          moment1In + offsetIdx,
+          moment2In + offsetIdx,
+          paramOut + offsetIdx,
+          moment1Out + offsetIdx,
+          moment2Out + offsetIdx,
+          beta1_,
+          beta2_,
+          epsilon_,
+          step);
+    });
     return true;
   }
 
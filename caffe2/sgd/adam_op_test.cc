@@ -0,0 +1,116 @@
+#include <cmath>
+#include <random>
+
+#include "caffe2/core/operator.h"
+#include "caffe2/utils/proto_utils.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+
+template <typename T>
+TensorCPU* CreateTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims) {
+  auto* tensor = ws->CreateBlob(name)->GetMutable<TensorCPU>();
+  tensor->Resize(dims);
+  tensor->mutable_data<T>();
+  return tensor;
+}
+
+// Fills the float tensor name of ws with values drawn from [min, max), and
+// returns a copy of them.
+vector<float> FillTensor(
+    Workspace* ws,
+    const string& name,
+    const vector<TIndex>& dims,
+    const float min,
+    const float max,
+    std::mt19937* gen) {
+  auto* tensor = CreateTensor<float>(ws, name, dims);
+  std::uniform_real_distribution<float> value(min, max);
+  for (int i = 0; i < tensor->size(); ++i) {
+    tensor->mutable_data<float>()[i] = value(*gen);
+  }
+  return vector<float>(
+      tensor->data<float>(), tensor->data<float>() + tensor->size());
+}
+
+const float* Data(Workspace* ws, const string& name) {
+  return ws->GetBlob(name)->Get<TensorCPU>().data<float>();
+}
+
+// Runs SparseAdam in place on random inputs with every third index repeating
+// the previous one, and compares it with the dense update of every row by the
+// sum of its slices of grad.
+void CheckSparseAdam(
+    const int num_rows,
+    const int block_size,
+    const int num_indices) {
+  const float lr = -0.1, beta1 = 0.8, beta2 = 0.95, epsilon = 1e-5;
+  const int64_t iter = 3;
+  Workspace ws;
+  std::mt19937 gen(num_rows + num_indices);
+  const auto param =
+      FillTensor(&ws, "param", {num_rows, block_size}, -1, 1, &gen);
+  const auto m = FillTensor(&ws, "m", {num_rows, block_size}, -1, 1, &gen);
+  const auto v = FillTensor(&ws, "v", {num_rows, block_size}, 0, 1, &gen);
+  auto* indices = CreateTensor<TIndex>(&ws, "indices", {num_indices});
+  std::uniform_int_distribution<TIndex> index(0, num_rows - 1);
+  for (int i = 0; i < num_indices; ++i) {
+    indices->mutable_data<TIndex>()[i] =
+        i % 3 == 1 ? indices->data<TIndex>()[i - 1] : index(gen);
+  }
+  const auto grad =
+      FillTensor(&ws, "grad", {num_indices, block_size}, -1, 1, &gen);
+  CreateTensor<float>(&ws, "lr", {1})->mutable_data<float>()[0] = lr;
+  CreateTensor<int64_t>(&ws, "iter", {1})->mutable_data<int64_t>()[0] = iter;
+  ASSERT_TRUE(ws.RunOperatorOnce(CreateOperatorDef(
+      "SparseAdam",
+      "",
+      vector<string>{"param", "m", "v", "indices", "grad", "lr", "iter"},
+      vector<string>{"param", "m", "v"},
+      vector<Argument>{MakeArgument<float>("beta1", beta1),
+                       MakeArgument<float>("beta2", beta2),
+                       MakeArgument<float>("epsilon", epsilon)})));
+
+  vector<double> sums(num_rows * block_size, 0);
+  vector<bool> touched(num_rows, false);
+  for (int i = 0; i < num_indices; ++i) {
+    const TIndex idx = indices->data<TIndex>()[i];
+    touched[idx] = true;
+    for (int k = 0; k < block_size; ++k) {
+      sums[idx * block_size + k] += grad[i * block_size + k];
+    }
+  }
+  const double correction = std::sqrt(1 - std::pow(beta2, iter + 1)) /
+      (1 - std::pow(beta1, iter + 1));
+  for (int i = 0; i < num_rows * block_size; ++i) {
+    double mi = m[i], vi = v[i], w = param[i];
+    if (touched[i / block_size]) {
+      mi = mi * beta1 + sums[i] * (1 - beta1);
+      vi = vi * beta2 + sums[i] * sums[i] * (1 - beta2);
+      w += lr * correction * mi / (std::sqrt(vi) + epsilon);
+    }
+    EXPECT_NEAR(Data(&ws, "m")[i], mi, 1e-4);
+    EXPECT_NEAR(Data(&ws, "v")[i], vi, 1e-4);
+    EXPECT_NEAR(Data(&ws, "param")[i], w, 1e-4);
+  }
+}
+
+} // namespace
+
+TEST(SparseAdamTest, SumsRepeatedIndices) {
+  CheckSparseAdam(10, 5, 12);
+  // A block of 9 also covers the vector loop and its tail.
+  CheckSparseAdam(7, 9, 20);
+}
+
+TEST(SparseAdamTest, SplitsManyRowsAcrossThreads) {
+  // Several tasks of ParallelForRows, on both unique and summed rows.
+  CheckSparseAdam(3000, 32, 4000);
+}
+
+} // namespace caffe2
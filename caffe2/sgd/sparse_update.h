@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/logging.h"
+#include "caffe2/core/tensor.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+// Calls f(u) for u in [0, num_rows), splitting the rows of block_size
+// elements across the CPU thread pool when there is enough work.
+template <typename F>
+void ParallelForRows(
+    const TIndex num_rows,
+    const TIndex block_size,
+    const F& f) {
+  constexpr TIndex kGrain = 1 << 14;
+  const TIndex rows_per_task =
+      std::max<TIndex>(kGrain / std::max<TIndex>(block_size, 1), 1);
+  const TIndex num_tasks = (num_rows + rows_per_task - 1) / rows_per_task;
+  if (num_tasks <= 1) {
+    for (TIndex u = 0; u < num_rows; ++u) {
+      f(u);
+    }
+    return;
+  }
+  ThreadPool::Default()->Run(
+      [&](size_t t) {
+        const TIndex end =
+            std::min<TIndex>((t + 1) * rows_per_task, num_rows);
+        for (TIndex u = t * rows_per_task; u < end; ++u) {
+          f(u);
+        }
+      },
+      num_tasks);
+}
+
+// The slices of a sparse gradient grouped by index. Every distinct index
+// appears once, in increasing order, with the sum of its slices. Each row of
+// the parameters then gets a single update, the result does not depend on
+// the order of repeated indices, and the rows can be updated in parallel.
+template <typename SIndex>
+class DeduplicatedSparseGradient {
+ public:
+  // Slice i is row i of grad, a [n, block_size] tensor.
+  DeduplicatedSparseGradient(
+      const TIndex n,
+      const TIndex block_size,
+      const SIndex* indices,
+      const float* grad)
+      : DeduplicatedSparseGradient(
+            n,
+            block_size,
+            indices,
+            [grad, block_size](const TIndex i) {
+              return grad + i * block_size;
+            }) {}
+
+  // Slice i is row_of(i), which lets several indices share a slice without
+  // materializing the full gradient.
+  template <typename RowOf>
+  DeduplicatedSparseGradient(
+      const TIndex n,
+      const TIndex block_size,
+      const SIndex* indices,
+      const RowOf& row_of) {
+    std::vector<std::pair<SIndex, TIndex>> sorted(n);
+    for (TIndex i = 0; i < n; ++i) {
+      sorted[i] = std::make_pair(indices[i], i);
+    }
+    // Ties are broken by position, so repeated slices are summed in order.
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<TIndex> starts;
+    TIndex num_summed_rows = 0;
+    for (TIndex i = 0; i < n; ++i) {
+      if (i == 0 || sorted[i].first != sorted[i - 1].first) {
+        starts.push_back(i);
+      } else if (starts.back() == i - 1) {
+        ++num_summed_rows;
+      }
+    }
+    starts.push_back(n);
+
+    const TIndex num_unique = starts.size() - 1;
+    indices_.resize(num_unique);
+    rows_.resize(num_unique);
+    sums_.resize(num_summed_rows * block_size);
+    std::vector<float*> sum_rows(num_unique, nullptr);
+    float* next_sum = sums_.data();
+    for (TIndex u = 0; u < num_unique; ++u) {
+      indices_[u] = sorted[starts[u]].first;
+      if (starts[u + 1] - starts[u] == 1) {
+        rows_[u] = row_of(sorted[starts[u]].second);
+      } else {
+        rows_[u] = sum_rows[u] = next_sum;
+        next_sum += block_size;
+      }
+    }
+    if (num_summed_rows > 0) {
+      ParallelForRows(num_unique, block_size, [&](const TIndex u) {
+        float* sum = sum_rows[u];
+        if (!sum) {
+          return;
+        }
+        std::fill(sum, sum + block_size, 0.f);
+        for (TIndex i = starts[u]; i < starts[u + 1]; ++i) {
+          const float* row = row_of(sorted[i].second);
+          for (TIndex k = 0; k < block_size; ++k) {
+            sum[k] += row[k];
+          }
+        }
+      });
+    }
+  }
+
+  TIndex size() const {
+    return indices_.size();
+  }
+  SIndex index(const TIndex u) const {
+    return indices_[u];
+  }
+  const float* grad(const TIndex u) const {
+    return rows_[u];
+  }
+
+  // Throws unless all the indices are in [0, num_rows).
+  void CheckBounds(const TIndex num_rows) const {
+    if (indices_.empty()) {
+      return;
+    }
+    CAFFE_ENFORCE(
+        0 <= indices_.front() && indices_.back() < num_rows,
+        "Index out of bounds: ",
+        indices_.front() < 0 ? indices_.front() : indices_.back(),
+        ", range 0 to ",
+        num_rows);
+  }
+
+ private:
+  std::vector<SIndex> indices_;
+  std::vector<const float*> rows_;
+  std::vector<float> sums_;
+};
+
+// Adagrad update of a row, the same as adagrad_compute with lr already read.
+inline void adagrad_update_row(
+    const TIndex N,
+    const float* w,
+    const float* g,
+    const float* h,
+    float* nw,
+    float* nh,
+    const float epsilon,
+    const float lr) {
+  TIndex i = 0;
+#if defined(__AVX__)
+  const __m256 veps = _mm256_set1_ps(epsilon);
+  const __m256 vlr = _mm256_set1_ps(lr);
+  for (; i + 8 <= N; i += 8) {
+    const __m256 gi = _mm256_loadu_ps(g + i);
+    const __m256 hi =
+        _mm256_add_ps(_mm256_loadu_ps(h + i), _mm256_mul_ps(gi, gi));
+    _mm256_storeu_ps(nh + i, hi);
+    const __m256 step = _mm256_div_ps(
+        _mm256_mul_ps(vlr, gi), _mm256_add_ps(_mm256_sqrt_ps(hi), veps));
+    _mm256_storeu_ps(nw + i, _mm256_add_ps(_mm256_loadu_ps(w + i), step));
+  }
+#endif
+  for (; i < N; ++i) {
+    const float gi = g[i];
+    const float hi = nh[i] = h[i] + gi * gi;
+    nw[i] = w[i] + lr * gi / (std::sqrt(hi) + epsilon);
+  }
+}
+
+// Adam update of a row, the same as adam_compute with lr * correction
+// already folded into lr.
+inline void adam_update_row(
+    const TIndex N,
+    const float* w,
+    const float* g,
+    const float* m,
+    const float* v,
+    float* nw,
+    float* nm,
+    float* nv,
+    const float beta1,
+    const float beta2,
+    const float eps_hat,
+    const float lr) {
+  TIndex i = 0;
+#if defined(__AVX__)
+  const __m256 vb1 = _mm256_set1_ps(beta1);
+  const __m256 vb1c = _mm256_set1_ps(1 - beta1);
+  const __m256 vb2 = _mm256_set1_ps(beta2);
+  const __m256 vb2c = _mm256_set1_ps(1 - beta2);
+  const __m256 veps = _mm256_set1_ps(eps_hat);
+  const __m256 vlr = _mm256_set1_ps(lr);
+  for (; i + 8 <= N; i += 8) {
+    const __m256 gi = _mm256_loadu_ps(g + i);
+    const __m256 mi = _mm256_add_ps(
+        _mm256_mul_ps(_mm256_loadu_ps(m + i), vb1), _mm256_mul_ps(gi, vb1c));
+    const __m256 vi = _mm256_add_ps(
+        _mm256_mul_ps(_mm256_loadu_ps(v + i), vb2),
+        _mm256_mul_ps(_mm256_mul_ps(gi, gi), vb2c));
+    _mm256_storeu_ps(nm + i, mi);
+    _mm256_storeu_ps(nv + i, vi);
+    const __m256 step = _mm256_div_ps(
+        _mm256_mul_ps(vlr, mi), _mm256_add_ps(_mm256_sqrt_ps(vi), veps));
+    _mm256_storeu_ps(nw + i, _mm256_add_ps(_mm256_loadu_ps(w + i), step));
+  }
+#endif
+  for (; i < N; ++i) {
+    const float gi = g[i];
+    const float mi = nm[i] = m[i] * beta1 + gi * (1 - beta1);
+    const float vi = nv[i] = v[i] * beta2 + gi * gi * (1 - beta2);
+    nw[i] = w[i] + lr * mi / (std::sqrt(vi) + eps_hat);
+  }
+}
+
+} // namespace caffe2
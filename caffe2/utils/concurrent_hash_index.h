@@ -0,0 +1,371 @@
+#ifndef CAFFE2_UTILS_CONCURRENT_HASH_INDEX_H_
+#define CAFFE2_UTILS_CONCURRENT_HASH_INDEX_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable> // NOLINT
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex> // NOLINT
+#include <thread> // NOLINT
+#include <type_traits>
+
+#include "caffe2/core/logging.h"
+
+namespace caffe2 {
+
+// ConcurrentHashIndex maps integer keys to consecutive ids 1, 2, 3, ... in the
+// order in which they are first seen, like the Index used by IndexGet, and is
+// meant to be shared by many threads.
+//
+// Keys live in a flat open-addressing table with linear probing. Lookups take
+// no lock: they read the slots with atomic loads. A missing key is inserted by
+// claiming an empty slot with a compare-and-swap on its key; the thread that
+// wins then takes the next id and publishes it in the slot, and threads that
+// meet a claimed slot whose id is not published yet wait for it. Ids are only
+// taken by the winner, so they stay consecutive under contention.
+//
+// The table doubles when it gets half full. Growing needs exclusive access:
+// every batch of lookups registers itself once, and a thread that grows the
+// table waits for the registered batches to finish and holds new ones back
+// until the new table is in place. Growth is rare, so lookups in the steady
+// state only touch the slots they probe and a per-batch counter.
+template <typename K>
+class ConcurrentHashIndex {
+  static_assert(std::is_integral<K>::value, "Keys must be integers");
+
+ public:
+  using Value = int64_t;
+
+  explicit ConcurrentHashIndex(const Value max_elements)
+      : max_elements_(max_elements),
+        table_(new Table(kInitialCapacity)),
+        next_id_(1) {}
+
+  ~ConcurrentHashIndex() {
+    delete table_.load();
+  }
+
+  // Writes the ids of the keys into values. If insert is set, unknown keys
+  // get new ids, and it throws if that would reach max_elements. Otherwise
+  // unknown keys get 0.
+  void Get(const K* keys, Value* values, const size_t num_keys, bool insert) {
+    size_t i = 0;
+    while (i < num_keys) {
+      Table* table = nullptr;
+      {
+        BatchGuard guard(this, &table);
+        for (; i < num_keys; ++i) {
+          if (!Find(table, keys[i], insert, &values[i])) {
+            break;
+          }
+        }
+      }
+      if (i < num_keys) {
+        Grow(table);
+      }
+    }
+  }
+
+  // Replaces the content with keys, which get the ids 1 to num_keys. Throws
+  // if a key is repeated.
+  void Load(const K* keys, const size_t num_keys) {
+    CAFFE_ENFORCE(
+        num_keys <= max_elements_,
+        "Cannot load index: Tensor is larger than max_elements.");
+    size_t capacity = kInitialCapacity;
+    while (capacity / 2 < num_keys + 1) {
+      capacity *= 2;
+    }
+    std::unique_ptr<Table> table(new Table(capacity));
+    for (size_t i = 0; i < num_keys; ++i) {
+      CAFFE_ENFORCE(
+          InsertUnique(table.get(), keys[i], i + 1),
+          "Repeated elements found: cannot load into dictionary.");
+    }
+    Exclusive([&]() {
+      delete table_.exchange(table.release());
+      next_id_ = num_keys + 1;
+    });
+  }
+
+  // Calls allocate(Size() - 1) to get an array for the keys, and writes the
+  // key of id i to its element i - 1.
+  template <typename F>
+  void Store(const F& allocate) {
+    Exclusive([&]() {
+      K* keys = allocate(next_id_.load() - 1);
+      Table* table = table_.load();
+      if (table->has_empty_key && table->empty_key_value > 0) {
+        keys[table->empty_key_value - 1] = kEmpty;
+      }
+      for (size_t s = 0; s < table->capacity; ++s) {
+        const Value value = table->slots[s].value.load();
+        if (value > 0) {
+          keys[value - 1] = table->slots[s].key.load();
+        }
+      }
+    });
+  }
+
+  // One more than the number of keys.
+  Value Size() const {
+    return next_id_.load();
+  }
+
+ private:
+  // Marks empty slots. The key that has this value is kept out of the slots.
+  static constexpr K kEmpty = std::numeric_limits<K>::min();
+  // Id of a claimed slot whose id is not published yet.
+  static constexpr Value kPending = 0;
+  // Id of a claimed slot whose key could not be inserted.
+  static constexpr Value kFull = -1;
+  static constexpr size_t kInitialCapacity = 1024;
+
+  struct Slot {
+    std::atomic<K> key;
+    std::atomic<Value> value;
+  };
+
+  struct Table {
+    explicit Table(const size_t capacity)
+        : capacity(capacity), slots(new Slot[capacity]), claimed(0) {
+      for (size_t s = 0; s < capacity; ++s) {
+        slots[s].key.store(kEmpty, std::memory_order_relaxed);
+        slots[s].value.store(kPending, std::memory_order_relaxed);
+      }
+      empty_key_value.store(kPending, std::memory_order_relaxed);
+      has_empty_key.store(false, std::memory_order_relaxed);
+    }
+
+    const size_t capacity;
+    std::unique_ptr<Slot[]> slots;
+    // Number of claimed slots, and of the slots about to be claimed.
+    std::atomic<size_t> claimed;
+    std::atomic<bool> has_empty_key;
+    std::atomic<Value> empty_key_value;
+  };
+
+  static size_t Hash(const K key) {
+    // Finalizer of MurmurHash3, so that structured ids spread over the table.
+    uint64_t h = static_cast<uint64_t>(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb3fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+  }
+
+  // Returns the id of a claimed slot once it is published. Keys that could
+  // not be inserted are unknown, so they are an error only when inserting.
+  static Value WaitForId(const std::atomic<Value>& value, const bool insert) {
+    Value v;
+    while ((v = value.load(std::memory_order_acquire)) == kPending) {
+      std::this_thread::yield();
+    }
+    if (v == kFull) {
+      CAFFE_ENFORCE(!insert, "Dict max size reached");
+      return 0;
+    }
+    return v;
+  }
+
+  // Takes the next id, or returns kFull if max_elements is reached.
+  Value NextId() {
+    Value id = next_id_.load();
+    while (id < max_elements_) {
+      if (next_id_.compare_exchange_weak(id, id + 1)) {
+        return id;
+      }
+    }
+    return kFull;
+  }
+
+  // Publishes the id of a slot claimed by this thread.
+  Value Publish(std::atomic<Value>* value) {
+    const Value id = NextId();
+    value->store(id, std::memory_order_release);
+    CAFFE_ENFORCE(id != kFull, "Dict max size reached");
+    return id;
+  }
+
+  // Looks key up in table and writes its id to value. Returns false, without
+  // writing anything, if key has to be inserted and table is too full.
+  bool Find(Table* table, const K key, const bool insert, Value* value) {
+    if (key == kEmpty) {
+      if (!table->has_empty_key.load(std::memory_order_acquire)) {
+        bool expected = false;
+        if (!insert) {
+          *value = 0;
+          return true;
+        }
+        if (table->has_empty_key.compare_exchange_strong(expected, true)) {
+          *value = Publish(&table->empty_key_value);
+          return true;
+        }
+      }
+      *value = WaitForId(table->empty_key_value, insert);
+      return true;
+    }
+
+    const size_t mask = table->capacity - 1;
+    bool reserved = false;
+    for (size_t s = Hash(key) & mask;; s = (s + 1) & mask) {
+      Slot& slot = table->slots[s];
+      K found = slot.key.load(std::memory_order_acquire);
+      if (found == kEmpty) {
+        if (!insert) {
+          *value = 0;
+          return true;
+        }
+        if (!reserved) {
+          if (table->claimed.fetch_add(1) >= table->capacity / 2) {
+            table->claimed.fetch_sub(1);
+            return false;
+          }
+          reserved = true;
+        }
+        if (slot.key.compare_exchange_strong(found, key)) {
+          *value = Publish(&slot.value);
+          return true;
+        }
+        // Another thread claimed the slot first; found is its key.
+      }
+      if (found == key) {
+        if (reserved) {
+          table->claimed.fetch_sub(1);
+        }
+        *value = WaitForId(slot.value, insert);
+        return true;
+      }
+    }
+  }
+
+  // Inserts a key known to be new into a table owned by the calling thread.
+  static bool InsertUnique(Table* table, const K key, const Value value) {
+    if (key == kEmpty) {
+      if (table->has_empty_key.load()) {
+        return false;
+      }
+      table->has_empty_key.store(true);
+      table->empty_key_value.store(value);
+      return true;
+    }
+    const size_t mask = table->capacity - 1;
+    for (size_t s = Hash(key) & mask;; s = (s + 1) & mask) {
+      Slot& slot = table->slots[s];
+      const K found = slot.key.load(std::memory_order_relaxed);
+      if (found == key) {
+        return false;
+      }
+      if (found == kEmpty) {
+        slot.key.store(key, std::memory_order_relaxed);
+        slot.value.store(value, std::memory_order_relaxed);
+        table->claimed.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+  }
+
+  // Registers a batch of lookups for its lifetime and gives its table.
+  class BatchGuard {
+   public:
+    BatchGuard(ConcurrentHashIndex* index, Table** table) : index_(index) {
+      *table = index_->Enter();
+    }
+    ~BatchGuard() {
+      index_->Exit();
+    }
+
+   private:
+    ConcurrentHashIndex* index_;
+  };
+
+  // Registers a batch of lookups and returns the current table.
+  Table* Enter() {
+    while (true) {
+      active_.fetch_add(1);
+      if (!exclusive_.load()) {
+        return table_.load();
+      }
+      Exit();
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return !exclusive_.load(); });
+    }
+  }
+
+  void Exit() {
+    if (active_.fetch_sub(1) == 1 && exclusive_.load()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      cv_.notify_all();
+    }
+  }
+
+  // Runs f once no batch of lookups is running, holding new ones back.
+  template <typename F>
+  void Exclusive(const F& f) {
+    std::lock_guard<std::mutex> exclusive_lock(exclusive_mutex_);
+    std::unique_lock<std::mutex> lock(mutex_);
+    exclusive_.store(true);
+    cv_.wait(lock, [this]() { return active_.load() == 0; });
+    try {
+      f();
+    } catch (...) {
+      exclusive_.store(false);
+      cv_.notify_all();
+      throw;
+    }
+    exclusive_.store(false);
+    cv_.notify_all();
+  }
+
+  // Doubles the capacity of table, unless another thread already replaced it.
+  void Grow(Table* table) {
+    Exclusive([&]() {
+      Table* old_table = table_.load();
+      if (old_table != table) {
+        return;
+      }
+      std::unique_ptr<Table> new_table(new Table(old_table->capacity * 2));
+      new_table->has_empty_key.store(old_table->has_empty_key.load());
+      new_table->empty_key_value.store(old_table->empty_key_value.load());
+      for (size_t s = 0; s < old_table->capacity; ++s) {
+        const K key = old_table->slots[s].key.load();
+        if (key != kEmpty) {
+          InsertUnique(new_table.get(), key, old_table->slots[s].value.load());
+        }
+      }
+      table_.store(new_table.release());
+      delete old_table;
+    });
+  }
+
+  const Value max_elements_;
+  std::atomic<Table*> table_;
+  std::atomic<Value> next_id_;
+  std::atomic<int> active_{0};
+  std::atomic<bool> exclusive_{false};
+  // Serializes the exclusive sections.
+  std::mutex exclusive_mutex_;
+  // Guards the waits on cv_ for exclusive_ and active_.
+  std::mutex mutex_;
+  std::condition_variable cv_;
+
+  DISABLE_COPY_AND_ASSIGN(ConcurrentHashIndex);
+};
+
+template <typename K>
+constexpr K ConcurrentHashIndex<K>::kEmpty;
+template <typename K>
+constexpr typename ConcurrentHashIndex<K>::Value
+    ConcurrentHashIndex<K>::kPending;
+template <typename K>
+constexpr typename ConcurrentHashIndex<K>::Value ConcurrentHashIndex<K>::kFull;
+template <typename K>
+constexpr size_t ConcurrentHashIndex<K>::kInitialCapacity;
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_CONCURRENT_HASH_INDEX_H_
@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <limits>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "caffe2/utils/concurrent_hash_index.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(ConcurrentHashIndexTest, SequentialGet) {
+  ConcurrentHashIndex<int64_t> index(100);
+  const int64_t keys[] = {7, -3, 7, std::numeric_limits<int64_t>::min(), -3};
+  int64_t values[5];
+  index.Get(keys, values, 5, true);
+  EXPECT_EQ(1, values[0]);
+  EXPECT_EQ(2, values[1]);
+  EXPECT_EQ(1, values[2]);
+  EXPECT_EQ(3, values[3]);
+  EXPECT_EQ(2, values[4]);
+  EXPECT_EQ(4, index.Size());
+
+  const int64_t more_keys[] = {-3, 8};
+  index.Get(more_keys, values, 2, false);
+  EXPECT_EQ(2, values[0]);
+  EXPECT_EQ(0, values[1]);
+  EXPECT_EQ(4, index.Size());
+}
+
+TEST(ConcurrentHashIndexTest, GrowsPastInitialCapacity) {
+  ConcurrentHashIndex<int32_t> index(std::numeric_limits<int32_t>::max());
+  std::vector<int32_t> keys(100000);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = i * 4096;
+  }
+  std::vector<int64_t> values(keys.size());
+  index.Get(keys.data(), values.data(), keys.size(), true);
+  for (int i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(i + 1, values[i]);
+  }
+  index.Get(keys.data(), values.data(), keys.size(), false);
+  for (int i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(i + 1, values[i]);
+  }
+}
+
+TEST(ConcurrentHashIndexTest, MaxElements) {
+  ConcurrentHashIndex<int32_t> index(3);
+  const int32_t keys[] = {1, 2, 3};
+  int64_t values[3];
+  EXPECT_THROW(index.Get(keys, values, 3, true), EnforceNotMet);
+  EXPECT_EQ(3, index.Size());
+  // Known keys are still found, and the key that did not fit is unknown.
+  index.Get(keys, values, 3, false);
+  EXPECT_EQ(1, values[0]);
+  EXPECT_EQ(2, values[1]);
+  EXPECT_EQ(0, values[2]);
+}
+
+TEST(ConcurrentHashIndexTest, LoadStore) {
+  ConcurrentHashIndex<int64_t> index(10);
+  const int64_t keys[] = {5, std::numeric_limits<int64_t>::min(), -1, 9};
+  index.Load(keys, 4);
+  EXPECT_EQ(5, index.Size());
+  const int64_t new_keys[] = {9, 11};
+  int64_t values[2];
+  index.Get(new_keys, values, 2, true);
+  EXPECT_EQ(4, values[0]);
+  EXPECT_EQ(5, values[1]);
+
+  std::vector<int64_t> stored;
+  index.Store([&stored](int64_t size) {
+    stored.resize(size);
+    return stored.data();
+  });
+  EXPECT_EQ((std::vector<int64_t>{5, keys[1], -1, 9, 11}), stored);
+
+  const int64_t repeated[] = {1, 2, 1};
+  EXPECT_THROW(index.Load(repeated, 3), EnforceNotMet);
+  const int64_t too_many[11] = {0};
+  EXPECT_THROW(index.Load(too_many, 11), EnforceNotMet);
+}
+
+TEST(ConcurrentHashIndexTest, ConcurrentGet) {
+  const int kNumThreads = 8;
+  const int kNumKeys = 50000;
+  ConcurrentHashIndex<int64_t> index(std::numeric_limits<int64_t>::max());
+  // Every thread looks up the same keys, in a different order.
+  std::vector<std::vector<int64_t>> keys(kNumThreads);
+  std::vector<std::vector<int64_t>> values(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    for (int i = 0; i < kNumKeys; ++i) {
+      keys[t].push_back(((i * 7919 + t * 104729) % kNumKeys) * 1000003LL);
+    }
+    values[t].resize(kNumKeys);
+    threads.emplace_back([&index, &keys, &values, t]() {
+      // Small batches, so that growth interleaves with lookups.
+      for (int i = 0; i < kNumKeys; i += 100) {
+        index.Get(&keys[t][i], &values[t][i], 100, true);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(kNumKeys + 1, index.Size());
+
+  std::vector<int64_t> ids(kNumKeys + 1, 0);
+  for (int t = 0; t < kNumThreads; ++t) {
+    for (int i = 0; i < kNumKeys; ++i) {
+      const int64_t key_index = keys[t][i] / 1000003LL;
+      if (ids[key_index] == 0) {
+        ids[key_index] = values[t][i];
+      }
+      EXPECT_EQ(ids[key_index], values[t][i]);
+    }
+  }
+  std::vector<int64_t> sorted_ids(ids.begin(), ids.begin() + kNumKeys);
+  std::sort(sorted_ids.begin(), sorted_ids.end());
+  for (int i = 0; i < kNumKeys; ++i) {
+    EXPECT_EQ(i + 1, sorted_ids[i]);
+  }
+}
+
+}  // namespace caffe2
@@ -0,0 +1,297 @@
+#include "caffe2/utils/embedding_lookup.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX__) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/fp16.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+// How many indices ahead the rows are prefetched. Rows of an embedding table
+// are almost never in cache, so this has to cover the memory latency.
+constexpr TIndex kPrefetchDistance = 16;
+// Bytes per cache line.
+constexpr TIndex kLineBytes = 64;
+// Approximate number of elements accumulated by one task of the thread pool.
+constexpr TIndex kGrain = 1 << 16;
+
+inline void PrefetchBytes(const void* ptr, const TIndex bytes) {
+#if defined(__GNUC__)
+  const char* p = static_cast<const char*>(ptr);
+  for (TIndex k = 0; k < bytes; k += kLineBytes) {
+    __builtin_prefetch(p + k);
+  }
+#endif
+}
+
+template <typename InType>
+inline void PrefetchRow(
+    const InType* input,
+    const float* scale_bias,
+    const TIndex idx,
+    const TIndex block_size) {
+  PrefetchBytes(input + idx * block_size, block_size * sizeof(InType));
+  if (std::is_same<InType, uint8_t>::value) {
+    PrefetchBytes(scale_bias + 2 * idx, 2 * sizeof(float));
+  }
+}
+
+// Adds w times a row of the table to sum. scale_bias points to the scale and
+// bias of the row for quantized tables.
+inline void AccumulateRow(
+    const TIndex block_size,
+    const float w,
+    const float* row,
+    const float* /* scale_bias */,
+    float* sum) {
+  for (TIndex k = 0; k < block_size; ++k) {
+    sum[k] += w * row[k];
+  }
+}
+
+inline void AccumulateRow(
+    const TIndex block_size,
+    const float w,
+    const float16* row,
+    const float* /* scale_bias */,
+    float* sum) {
+  TIndex k = 0;
+#if defined(__AVX__) && defined(__F16C__)
+  const __m256 vw = _mm256_set1_ps(w);
+  for (; k + 8 <= block_size; k += 8) {
+    const __m256 x = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + k)));
+    _mm256_storeu_ps(
+        sum + k, _mm256_add_ps(_mm256_loadu_ps(sum + k), _mm256_mul_ps(vw, x)));
+  }
+#endif
+  for (; k < block_size; ++k) {
+    sum[k] += w * Fp16ToFloat(row[k]);
+  }
+}
+
+inline void AccumulateRow(
+    const TIndex block_size,
+    const float w,
+    const uint8_t* row,
+    const float* scale_bias,
+    float* sum) {
+  const float scale = w * scale_bias[0];
+  const float bias = w * scale_bias[1];
+  for (TIndex k = 0; k < block_size; ++k) {
+    sum[k] += scale * row[k] + bias;
+  }
+}
+
+template <typename IndexType>
+inline TIndex CheckedIndex(
+    const IndexType* indices,
+    const TIndex i,
+    const TIndex data_size) {
+  const TIndex idx = indices[i];
+  CAFFE_ENFORCE(
+      0 <= idx && idx < data_size,
+      "Index ",
+      i,
+      " is out of bounds: ",
+      idx,
+      ", range 0 to ",
+      data_size);
+  return idx;
+}
+
+// Pools segments [begin, end). kBlockSize is the block size if it is known at
+// compile time, in which case the sums are kept in registers, or -1.
+template <int kBlockSize, typename IndexType, typename InType>
+void PoolSegments(
+    const TIndex begin,
+    const TIndex end,
+    const TIndex* offsets,
+    const TIndex dynamic_block_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const InType* input,
+    const IndexType* indices,
+    const float* weights,
+    const float* scale_bias,
+    const bool normalize_by_lengths,
+    float* out) {
+  const TIndex block_size = kBlockSize > 0 ? kBlockSize : dynamic_block_size;
+  for (TIndex m = begin; m < end; ++m) {
+    float fixed_sum[kBlockSize > 0 ? kBlockSize : 1];
+    float* sum = kBlockSize > 0 ? fixed_sum : out + m * block_size;
+    std::fill(sum, sum + block_size, 0.f);
+    for (TIndex i = offsets[m]; i < offsets[m + 1]; ++i) {
+      const TIndex ahead = i + kPrefetchDistance;
+      if (ahead < index_size) {
+        const TIndex next = indices[ahead];
+        if (0 <= next && next < data_size) {
+          PrefetchRow(input, scale_bias, next, block_size);
+        }
+      }
+      const TIndex idx = CheckedIndex(indices, i, data_size);
+      AccumulateRow(
+          block_size,
+          weights ? weights[i] : 1.f,
+          input + idx * block_size,
+          scale_bias ? scale_bias + 2 * idx : nullptr,
+          sum);
+    }
+    const TIndex length = offsets[m + 1] - offsets[m];
+    if (normalize_by_lengths && length > 0) {
+      const float inv_length = 1.f / length;
+      for (TIndex k = 0; k < block_size; ++k) {
+        sum[k] *= inv_length;
+      }
+    }
+    if (kBlockSize > 0) {
+      memcpy(out + m * block_size, sum, block_size * sizeof(float));
+    }
+  }
+}
+
+template <typename IndexType, typename InType>
+void PoolSegmentsDispatch(
+    const TIndex begin,
+    const TIndex end,
+    const TIndex* offsets,
+    const TIndex block_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const InType* input,
+    const IndexType* indices,
+    const float* weights,
+    const float* scale_bias,
+    const bool normalize_by_lengths,
+    float* out) {
+#define CAFFE2_POOL_SEGMENTS(size)                                            \
+  PoolSegments<size, IndexType, InType>(                                      \
+      begin,                                                                  \
+      end,                                                                    \
+      offsets,                                                                \
+      block_size,                                                             \
+      index_size,                                                             \
+      data_size,                                                              \
+      input,                                                                  \
+      indices,                                                                \
+      weights,                                                                \
+      scale_bias,                                                             \
+      normalize_by_lengths,                                                   \
+      out)
+  switch (block_size) {
+    case 16:
+      CAFFE2_POOL_SEGMENTS(16);
+      break;
+    case 32:
+      CAFFE2_POOL_SEGMENTS(32);
+      break;
+    case 64:
+      CAFFE2_POOL_SEGMENTS(64);
+      break;
+    case 128:
+      CAFFE2_POOL_SEGMENTS(128);
+      break;
+    default:
+      CAFFE2_POOL_SEGMENTS(-1);
+  }
+#undef CAFFE2_POOL_SEGMENTS
+}
+
+} // namespace
+
+template <typename IndexType, typename InType>
+void EmbeddingLookup(
+    const TIndex block_size,
+    const TIndex output_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const InType* input,
+    const IndexType* indices,
+    const int* lengths,
+    const float* weights,
+    const float* scale_bias,
+    bool normalize_by_lengths,
+    float* out) {
+  if (std::is_same<InType, uint8_t>::value) {
+    CAFFE_ENFORCE(scale_bias, "Quantized tables need their scale and bias");
+  } else {
+    scale_bias = nullptr;
+  }
+  std::vector<TIndex> offsets(output_size + 1);
+  offsets[0] = 0;
+  for (TIndex m = 0; m < output_size; ++m) {
+    CAFFE_ENFORCE_GE(lengths[m], 0, "Negative length of segment ", m);
+    offsets[m + 1] = offsets[m] + lengths[m];
+  }
+  CAFFE_ENFORCE(
+      offsets[output_size] == index_size,
+      offsets[output_size],
+      " != ",
+      index_size);
+
+  // Split the segments into tasks with about the same number of indices.
+  const TIndex work = index_size * std::max<TIndex>(block_size, 1);
+  const TIndex num_tasks =
+      std::max<TIndex>(std::min(work / kGrain, output_size), 1);
+  auto task = [&](size_t t) {
+    // First segment that starts at or after the n-th share of the indices.
+    auto segment_at = [&](const TIndex n) {
+      const TIndex target = index_size * n / num_tasks;
+      return std::lower_bound(offsets.begin(), offsets.end() - 1, target) -
+          offsets.begin();
+    };
+    const TIndex begin = t == 0 ? 0 : segment_at(t);
+    const TIndex end = t + 1 == num_tasks ? output_size : segment_at(t + 1);
+    PoolSegmentsDispatch(
+        begin,
+        end,
+        offsets.data(),
+        block_size,
+        index_size,
+        data_size,
+        input,
+        indices,
+        weights,
+        scale_bias,
+        normalize_by_lengths,
+        out);
+  };
+  if (num_tasks == 1) {
+    task(0);
+  } else {
+    ThreadPool::Default()->Run(task, num_tasks);
+  }
+}
+
+#define CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(IndexType, InType) \
+  template void EmbeddingLookup<IndexType, InType>(            \
+      const TIndex block_size,                                 \
+      const TIndex output_size,                                \
+      const TIndex index_size,                                 \
+      const TIndex data_size,                                  \
+      const InType* input,                                     \
+      const IndexType* indices,                                \
+      const int* lengths,                                      \
+      const float* weights,                                    \
+      const float* scale_bias,                                 \
+      bool normalize_by_lengths,                               \
+      float* out);
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int32_t, float)
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int64_t, float)
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int32_t, float16)
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int64_t, float16)
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int32_t, uint8_t)
+CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP(int64_t, uint8_t)
+#undef CAFFE2_INSTANTIATE_EMBEDDING_LOOKUP
+
+} // namespace caffe2
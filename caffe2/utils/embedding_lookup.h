@@ -0,0 +1,44 @@
+#ifndef CAFFE2_UTILS_EMBEDDING_LOOKUP_H_
+#define CAFFE2_UTILS_EMBEDDING_LOOKUP_H_
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// Pools rows of an embedding table, as SparseLengthsSum,
+// SparseLengthsWeightedSum and SparseLengthsMean do:
+//
+//   out[m] = sum over the lengths[m] indices i of segment m of
+//            weights[i] * input[indices[i]]
+//
+// where input is a data_size x block_size table and weights may be null, in
+// which case all the weights are 1. If normalize_by_lengths is set, out[m] is
+// divided by lengths[m] when it is positive.
+//
+// InType is float, float16, or uint8_t for row-wise quantized tables, where
+// row r stands for scale_bias[2 * r] * input[r] + scale_bias[2 * r + 1];
+// scale_bias is ignored for the other types. Rows are converted to float as
+// they are read and accumulated in float.
+//
+// The rows of upcoming indices are prefetched, the common block sizes have
+// unrolled kernels, and segments are split across the CPU thread pool.
+// Throws if an index is out of range or if the lengths do not add up to
+// index_size.
+template <typename IndexType, typename InType>
+void EmbeddingLookup(
+    const TIndex block_size,
+    const TIndex output_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const InType* input,
+    const IndexType* indices,
+    const int* lengths,
+    const float* weights,
+    const float* scale_bias,
+    bool normalize_by_lengths,
+    float* out);
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_EMBEDDING_LOOKUP_H_
@@ -0,0 +1,89 @@
+#ifndef CAFFE2_UTILS_FP16_H_
+#define CAFFE2_UTILS_FP16_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "caffe2/core/types.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+// Conversions between float and the IEEE half precision float16 on the CPU.
+// They use the F16C instructions when the compiler targets them and exact
+// bit manipulation otherwise; float to half rounds to nearest even.
+
+namespace caffe2 {
+
+namespace fp16_detail {
+
+inline float FloatFromBits(const uint32_t bits) {
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+inline uint32_t FloatToBits(const float f) {
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  return bits;
+}
+
+} // namespace fp16_detail
+
+inline float Fp16ToFloat(const float16 h) {
+#if defined(__F16C__)
+  return _cvtsh_ss(h.x);
+#else
+  using fp16_detail::FloatFromBits;
+  using fp16_detail::FloatToBits;
+  const uint32_t w = static_cast<uint32_t>(h.x) << 16;
+  const uint32_t sign = w & 0x80000000u;
+  const uint32_t two_w = w + w;
+  // Normal numbers: move the exponent and mantissa in place and rebias the
+  // exponent by scaling with 2^-112.
+  const float normalized =
+      FloatFromBits((two_w >> 4) + (0xE0u << 23)) * FloatFromBits(0x07800000u);
+  // Denormal numbers: build 0.5 + mantissa * 2^-24 and subtract 0.5.
+  const float denormalized =
+      FloatFromBits((two_w >> 17) | (126u << 23)) - 0.5f;
+  return FloatFromBits(
+      sign |
+      (two_w < (1u << 27) ? FloatToBits(denormalized)
+                          : FloatToBits(normalized)));
+#endif
+}
+
+inline float16 FloatToFp16(const float f) {
+  float16 h;
+#if defined(__F16C__)
+  h.x = _cvtss_sh(f, 0 /* round to nearest even */);
+#else
+  using fp16_detail::FloatFromBits;
+  using fp16_detail::FloatToBits;
+  // Scaling by 2^112 and then 2^-110 overflows the values too large for half
+  // to infinity and lets the FPU do the rounding of the mantissa.
+  float base = (std::fabs(f) * FloatFromBits(0x77800000u)) *
+      FloatFromBits(0x08800000u);
+  const uint32_t w = FloatToBits(f);
+  const uint32_t shl1_w = w + w;
+  const uint32_t sign = w & 0x80000000u;
+  uint32_t bias = shl1_w & 0xFF000000u;
+  if (bias < 0x71000000u) {
+    bias = 0x71000000u;
+  }
+  base = FloatFromBits((bias >> 1) + 0x07800000u) + base;
+  const uint32_t bits = FloatToBits(base);
+  const uint32_t exp_bits = (bits >> 13) & 0x00007C00u;
+  const uint32_t mantissa_bits = bits & 0x00000FFFu;
+  h.x = static_cast<uint16_t>(
+      (sign >> 16) | (shl1_w > 0xFF000000u ? 0x7E00u : exp_bits + mantissa_bits));
+#endif
+  return h;
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_FP16_H_
@@ -0,0 +1,315 @@
+#include "caffe2/utils/gather_scatter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/parallel_partition.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+// How many indices ahead the rows are prefetched.
+constexpr TIndex kPrefetchDistance = 8;
+// Bytes per cache line.
+constexpr TIndex kLineBytes = 64;
+// Approximate number of bytes of rows moved by one task of the thread pool.
+constexpr TIndex kGrainBytes = 1 << 18;
+
+inline void PrefetchBytes(const void* ptr, const TIndex bytes) {
+#if defined(__GNUC__)
+  const char* p = static_cast<const char*>(ptr);
+  for (TIndex k = 0; k < bytes; k += kLineBytes) {
+    __builtin_prefetch(p + k);
+  }
+#endif
+}
+
+inline void PrefetchBytesForWrite(void* ptr, const TIndex bytes) {
+#if defined(__GNUC__)
+  char* p = static_cast<char*>(ptr);
+  for (TIndex k = 0; k < bytes; k += kLineBytes) {
+    __builtin_prefetch(p + k, 1);
+  }
+#endif
+}
+
+template <typename Index>
+inline TIndex CheckedIndex(
+    const Index* indices,
+    const TIndex i,
+    const TIndex data_size) {
+  const TIndex idx = indices[i];
+  CAFFE_ENFORCE(
+      0 <= idx && idx < data_size,
+      "Index ",
+      i,
+      " is out of bounds: ",
+      idx,
+      ", range 0 to ",
+      data_size);
+  return idx;
+}
+
+// Returns the index of the upcoming position to prefetch, or -1 if there is
+// none or it is out of bounds.
+template <typename Index>
+inline TIndex AheadIndex(
+    const Index* indices,
+    const TIndex* positions,
+    const TIndex p,
+    const TIndex end,
+    const TIndex data_size) {
+  const TIndex ahead = p + kPrefetchDistance;
+  if (ahead >= end) {
+    return -1;
+  }
+  const TIndex idx = indices[positions ? positions[ahead] : ahead];
+  return 0 <= idx && idx < data_size ? idx : -1;
+}
+
+inline void CopyRow(const TIndex bytes, const char* src, char* dst) {
+  TIndex k = 0;
+#if defined(__AVX__)
+  for (; k + 64 <= bytes; k += 64) {
+    const __m256i a =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k));
+    const __m256i b =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 32));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k), a);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + k + 32), b);
+  }
+  for (; k + 32 <= bytes; k += 32) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dst + k),
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k)));
+  }
+#endif
+  if (k < bytes) {
+    std::memcpy(dst + k, src + k, bytes - k);
+  }
+}
+
+inline void ScaleRow(const TIndex n, const float a, float* y) {
+  TIndex k = 0;
+#if defined(__AVX__)
+  const __m256 va = _mm256_set1_ps(a);
+  for (; k + 8 <= n; k += 8) {
+    _mm256_storeu_ps(y + k, _mm256_mul_ps(va, _mm256_loadu_ps(y + k)));
+  }
+#endif
+  for (; k < n; ++k) {
+    y[k] *= a;
+  }
+}
+
+inline void AxpyRow(const TIndex n, const float a, const float* x, float* y) {
+  TIndex k = 0;
+#if defined(__AVX__)
+  const __m256 va = _mm256_set1_ps(a);
+  for (; k + 16 <= n; k += 16) {
+    const __m256 y0 = _mm256_add_ps(
+        _mm256_loadu_ps(y + k), _mm256_mul_ps(va, _mm256_loadu_ps(x + k)));
+    const __m256 y1 = _mm256_add_ps(
+        _mm256_loadu_ps(y + k + 8),
+        _mm256_mul_ps(va, _mm256_loadu_ps(x + k + 8)));
+    _mm256_storeu_ps(y + k, y0);
+    _mm256_storeu_ps(y + k + 8, y1);
+  }
+  for (; k + 8 <= n; k += 8) {
+    _mm256_storeu_ps(
+        y + k,
+        _mm256_add_ps(
+            _mm256_loadu_ps(y + k), _mm256_mul_ps(va, _mm256_loadu_ps(x + k))));
+  }
+#endif
+  for (; k < n; ++k) {
+    y[k] += a * x[k];
+  }
+}
+
+// Number of tasks for moving bytes bytes of rows, at most one per thread.
+int NumTasks(const TIndex bytes) {
+  const TIndex tasks = (bytes + kGrainBytes - 1) / kGrainBytes;
+  return std::max<TIndex>(
+      1,
+      std::min<TIndex>(tasks, ThreadPool::Default()->EffectiveNumThreads()));
+}
+
+template <typename Index>
+inline int OwnerOf(const Index idx, const int num_tasks) {
+  return (static_cast<uint64_t>(idx) * 0x9E3779B97F4A7C15ULL >> 32) %
+      num_tasks;
+}
+
+// Runs f(positions, begin, end) over the positions [0, index_size), where a
+// null positions stands for the identity. With several tasks, every task
+// gets the positions of the rows it owns, in order, so that no two tasks
+// write the same row.
+template <typename Index, typename F>
+void RunByOwner(
+    const Index* indices,
+    const TIndex index_size,
+    const TIndex bytes,
+    const F& f) {
+  const int num_tasks = NumTasks(bytes);
+  if (num_tasks == 1) {
+    f(nullptr, 0, index_size);
+    return;
+  }
+  std::vector<TIndex> positions;
+  std::vector<TIndex> starts;
+  ParallelPartition(
+      index_size,
+      num_tasks,
+      [&](const TIndex i) { return OwnerOf(indices[i], num_tasks); },
+      &positions,
+      &starts);
+  ThreadPool::Default()->Run(
+      [&](size_t t) { f(positions.data(), starts[t], starts[t + 1]); },
+      num_tasks);
+}
+
+} // namespace
+
+template <typename Index>
+void GatherRows(
+    const TIndex block_bytes,
+    const TIndex index_size,
+    const TIndex data_size,
+    const char* data,
+    const Index* indices,
+    char* out) {
+  const auto task = [&](const TIndex begin, const TIndex end) {
+    for (TIndex i = begin; i < end; ++i) {
+      const TIndex ahead = AheadIndex(indices, nullptr, i, end, data_size);
+      if (ahead >= 0) {
+        PrefetchBytes(data + ahead * block_bytes, block_bytes);
+      }
+      const TIndex idx = CheckedIndex(indices, i, data_size);
+      CopyRow(block_bytes, data + idx * block_bytes, out + i * block_bytes);
+    }
+  };
+  const TIndex num_tasks = std::min<TIndex>(
+      index_size,
+      (index_size * block_bytes + kGrainBytes - 1) / kGrainBytes);
+  if (num_tasks <= 1) {
+    task(0, index_size);
+    return;
+  }
+  const TIndex per_task = (index_size + num_tasks - 1) / num_tasks;
+  ThreadPool::Default()->Run(
+      [&](size_t t) {
+        task(t * per_task, std::min<TIndex>(index_size, (t + 1) * per_task));
+      },
+      num_tasks);
+}
+
+template <typename Index>
+void ScatterAssignRows(
+    const TIndex block_bytes,
+    const TIndex index_size,
+    const TIndex data_size,
+    const char* slices,
+    const Index* indices,
+    char* data) {
+  RunByOwner(
+      indices,
+      index_size,
+      index_size * block_bytes,
+      [&](const TIndex* positions, const TIndex begin, const TIndex end) {
+        for (TIndex p = begin; p < end; ++p) {
+          const TIndex ahead =
+              AheadIndex(indices, positions, p, end, data_size);
+          if (ahead >= 0) {
+            PrefetchBytesForWrite(data + ahead * block_bytes, block_bytes);
+          }
+          const TIndex i = positions ? positions[p] : p;
+          const TIndex idx = CheckedIndex(indices, i, data_size);
+          CopyRow(
+              block_bytes, slices + i * block_bytes, data + idx * block_bytes);
+        }
+      });
+}
+
+template <typename Index>
+void ScatterWeightedSumRows(
+    const TIndex block_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const Index* indices,
+    const float w0,
+    const std::vector<std::pair<const float*, float>>& updates,
+    float* data) {
+  const TIndex bytes =
+      index_size * block_size * sizeof(float) * (updates.size() + 1);
+  RunByOwner(
+      indices,
+      index_size,
+      bytes,
+      [&](const TIndex* positions, const TIndex begin, const TIndex end) {
+        // Scales first and then adds the updates one input at a time, as a
+        // sequential loop over the inputs would.
+        for (int u = -1; u < static_cast<int>(updates.size()); ++u) {
+          if (u < 0 && w0 == 1.0f) {
+            continue;
+          }
+          for (TIndex p = begin; p < end; ++p) {
+            const TIndex ahead =
+                AheadIndex(indices, positions, p, end, data_size);
+            if (ahead >= 0) {
+              PrefetchBytesForWrite(
+                  data + ahead * block_size, block_size * sizeof(float));
+            }
+            const TIndex i = positions ? positions[p] : p;
+            float* row =
+                data + CheckedIndex(indices, i, data_size) * block_size;
+            if (u < 0) {
+              ScaleRow(block_size, w0, row);
+            } else {
+              AxpyRow(
+                  block_size,
+                  updates[u].second,
+                  updates[u].first + i * block_size,
+                  row);
+            }
+          }
+        }
+      });
+}
+
+#define CAFFE2_INSTANTIATE_GATHER_SCATTER(Index)                   \
+  template void GatherRows<Index>(                                 \
+      const TIndex block_bytes,                                    \
+      const TIndex index_size,                                     \
+      const TIndex data_size,                                      \
+      const char* data,                                            \
+      const Index* indices,                                        \
+      char* out);                                                  \
+  template void ScatterAssignRows<Index>(                          \
+      const TIndex block_bytes,                                    \
+      const TIndex index_size,                                     \
+      const TIndex data_size,                                      \
+      const char* slices,                                          \
+      const Index* indices,                                        \
+      char* data);                                                 \
+  template void ScatterWeightedSumRows<Index>(                     \
+      const TIndex block_size,                                     \
+      const TIndex index_size,                                     \
+      const TIndex data_size,                                      \
+      const Index* indices,                                        \
+      const float w0,                                              \
+      const std::vector<std::pair<const float*, float>>& updates, \
+      float* data);
+CAFFE2_INSTANTIATE_GATHER_SCATTER(int32_t)
+CAFFE2_INSTANTIATE_GATHER_SCATTER(int64_t)
+#undef CAFFE2_INSTANTIATE_GATHER_SCATTER
+
+} // namespace caffe2
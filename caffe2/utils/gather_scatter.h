@@ -0,0 +1,61 @@
+#ifndef CAFFE2_UTILS_GATHER_SCATTER_H_
+#define CAFFE2_UTILS_GATHER_SCATTER_H_
+
+#include <utility>
+#include <vector>
+
+#include "caffe2/core/common.h"
+#include "caffe2/core/tensor.h"
+
+namespace caffe2 {
+
+// CPU kernels of Gather, ScatterAssign and ScatterWeightedSum on tables of
+// data_size rows. The rows of upcoming indices are prefetched, rows are copied
+// and accumulated with unrolled SIMD loops, and large index lists are split
+// across the CPU thread pool. All of them throw if an index is not in
+// [0, data_size).
+
+// Copies row indices[i] of data to row i of out, for i in [0, index_size).
+// Rows are block_bytes bytes of plain data.
+template <typename Index>
+void GatherRows(
+    const TIndex block_bytes,
+    const TIndex index_size,
+    const TIndex data_size,
+    const char* data,
+    const Index* indices,
+    char* out);
+
+// Copies row i of slices to row indices[i] of data, for i in [0, index_size).
+// Rows are block_bytes bytes of plain data. A row with repeated indices gets
+// the last of its slices.
+template <typename Index>
+void ScatterAssignRows(
+    const TIndex block_bytes,
+    const TIndex index_size,
+    const TIndex data_size,
+    const char* slices,
+    const Index* indices,
+    char* data);
+
+// For i in [0, index_size), scales row indices[i] of data by w0, and then for
+// every (x, w) in updates, adds w times row i of x to row indices[i] of data.
+// Rows are block_size floats. Repeated indices are applied once per
+// occurrence, in the same order as a sequential loop, so the result does not
+// depend on the number of threads.
+//
+// The rows are split across the threads by a hash of their index, so that
+// updates of the same row never race.
+template <typename Index>
+void ScatterWeightedSumRows(
+    const TIndex block_size,
+    const TIndex index_size,
+    const TIndex data_size,
+    const Index* indices,
+    const float w0,
+    const std::vector<std::pair<const float*, float>>& updates,
+    float* data);
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_GATHER_SCATTER_H_
@@ -0,0 +1,196 @@
+#include "caffe2/utils/int8_gemm.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+namespace math {
+
+namespace {
+
+// The padding of the rows of the packed matrices, one AVX2 register of int16.
+constexpr int kKAlignment = 16;
+// The size of the blocks of C computed by a task of the thread pool, and of
+// the tiles computed by a kernel call within it.
+constexpr int kRowsPerTask = 16;
+constexpr int kColumnsPerTask = 64;
+constexpr int kTileRows = 2;
+constexpr int kTileColumns = 4;
+
+#if defined(__AVX2__)
+// Returns the sums of the eight lanes of a, b, c and d.
+inline __m128i HorizontalSums(__m256i a, __m256i b, __m256i c, __m256i d) {
+  const __m256i sums = _mm256_hadd_epi32(
+      _mm256_hadd_epi32(a, b), _mm256_hadd_epi32(c, d));
+  return _mm_add_epi32(
+      _mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+}
+#endif
+
+// Computes the dot products of the padded rows a[0] and a[1] with the padded
+// rows b[0..3], of paddedK values each.
+void DotTile(
+    const int16_t* const a[kTileRows],
+    const int16_t* const b[kTileColumns],
+    const int paddedK,
+    int32_t out[kTileRows][kTileColumns]) {
+#if defined(__AVX2__)
+  __m256i acc[kTileRows][kTileColumns];
+  for (int r = 0; r < kTileRows; ++r) {
+    for (int c = 0; c < kTileColumns; ++c) {
+      acc[r][c] = _mm256_setzero_si256();
+    }
+  }
+  for (int k = 0; k < paddedK; k += kKAlignment) {
+    const __m256i a0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[0] + k));
+    const __m256i a1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a[1] + k));
+    for (int c = 0; c < kTileColumns; ++c) {
+      const __m256i bc =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b[c] + k));
+      acc[0][c] = _mm256_add_epi32(acc[0][c], _mm256_madd_epi16(a0, bc));
+      acc[1][c] = _mm256_add_epi32(acc[1][c], _mm256_madd_epi16(a1, bc));
+    }
+  }
+  for (int r = 0; r < kTileRows; ++r) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out[r]),
+        HorizontalSums(acc[r][0], acc[r][1], acc[r][2], acc[r][3]));
+  }
+#else
+  for (int r = 0; r < kTileRows; ++r) {
+    for (int c = 0; c < kTileColumns; ++c) {
+      int32_t sum = 0;
+      for (int k = 0; k < paddedK; ++k) {
+        sum += static_cast<int32_t>(a[r][k]) * b[c][k];
+      }
+      out[r][c] = sum;
+    }
+  }
+#endif
+}
+
+} // namespace
+
+void Int8GemmMatrixB::Pack(
+    const int N,
+    const int K,
+    const float* B,
+    const int ldb) {
+  N_ = N;
+  K_ = K;
+  paddedK_ = (K + kKAlignment - 1) / kKAlignment * kKAlignment;
+  data_.assign(static_cast<size_t>(N) * paddedK_, 0);
+  scales_.resize(N);
+  for (int j = 0; j < N; ++j) {
+    const float* row = B + static_cast<size_t>(j) * ldb;
+    float max = 0;
+    for (int k = 0; k < K; ++k) {
+      max = std::max(max, std::abs(row[k]));
+    }
+    scales_[j] = max > 0 ? max / 127 : 1;
+    const float inverse_scale = 1 / scales_[j];
+    int16_t* packed = data_.data() + static_cast<size_t>(j) * paddedK_;
+    for (int k = 0; k < K; ++k) {
+      packed[k] = static_cast<int16_t>(std::min(
+          127.f, std::max(-127.f, std::nearbyint(row[k] * inverse_scale))));
+    }
+  }
+}
+
+void Int8Gemm(
+    const int M,
+    const int N,
+    const int K,
+    const uint8_t* A,
+    const int lda,
+    const QuantizationParams& a_params,
+    const Int8GemmMatrixB& B,
+    const float* bias,
+    const QuantizationParams& c_params,
+    const bool relu,
+    uint8_t* C,
+    const int ldc,
+    CPUContext* /*context*/) {
+  CAFFE_ENFORCE_EQ(B.N(), N);
+  CAFFE_ENFORCE_EQ(B.K(), K);
+  if (M == 0 || N == 0) {
+    return;
+  }
+  // The bias in int32 at the scale of the products, and the factors from that
+  // scale to the one of C.
+  std::vector<int32_t> int_bias(N);
+  std::vector<float> multiplier(N);
+  for (int j = 0; j < N; ++j) {
+    const float product_scale = a_params.scale * B.Scale(j);
+    int_bias[j] =
+        bias ? static_cast<int32_t>(std::nearbyint(bias[j] / product_scale))
+             : 0;
+    multiplier[j] = product_scale / c_params.scale;
+  }
+  const float c_zero_point = c_params.zero_point;
+  const float c_min = relu ? c_zero_point : 0;
+  const int paddedK = B.PaddedK();
+  const int row_tasks = (M + kRowsPerTask - 1) / kRowsPerTask;
+  const int column_tasks = (N + kColumnsPerTask - 1) / kColumnsPerTask;
+
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const int i_begin = task / column_tasks * kRowsPerTask;
+        const int i_end = std::min(M, i_begin + kRowsPerTask);
+        const int j_begin = task % column_tasks * kColumnsPerTask;
+        const int j_end = std::min(N, j_begin + kColumnsPerTask);
+        // The rows of the task minus the zero point of A, widened and padded
+        // like the rows of B.
+        std::vector<int16_t> rows(
+            static_cast<size_t>(i_end - i_begin) * paddedK, 0);
+        for (int i = i_begin; i < i_end; ++i) {
+          const uint8_t* a = A + static_cast<size_t>(i) * lda;
+          int16_t* row = &rows[static_cast<size_t>(i - i_begin) * paddedK];
+          for (int k = 0; k < K; ++k) {
+            row[k] = static_cast<int16_t>(a[k] - a_params.zero_point);
+          }
+        }
+        // The last tiles repeat the last row or column as needed, and only
+        // store the outputs that exist.
+        for (int i = i_begin; i < i_end; i += kTileRows) {
+          const int16_t* a[kTileRows];
+          for (int r = 0; r < kTileRows; ++r) {
+            a[r] = &rows[static_cast<size_t>(std::min(i + r, i_end - 1) -
+                                             i_begin) *
+                         paddedK];
+          }
+          for (int j = j_begin; j < j_end; j += kTileColumns) {
+            const int16_t* b[kTileColumns];
+            for (int c = 0; c < kTileColumns; ++c) {
+              b[c] = B.Row(std::min(j + c, j_end - 1));
+            }
+            int32_t out[kTileRows][kTileColumns];
+            DotTile(a, b, paddedK, out);
+            for (int r = 0; r < kTileRows && i + r < i_end; ++r) {
+              uint8_t* c_row = C + static_cast<size_t>(i + r) * ldc;
+              for (int c = 0; c < kTileColumns && j + c < j_end; ++c) {
+                const float value =
+                    std::nearbyint(
+                        (out[r][c] + int_bias[j + c]) * multiplier[j + c]) +
+                    c_zero_point;
+                c_row[j + c] = static_cast<uint8_t>(
+                    std::min(255.f, std::max(c_min, value)));
+              }
+            }
+          }
+        }
+      },
+      static_cast<size_t>(row_tasks) * column_tasks);
+}
+
+} // namespace math
+} // namespace caffe2
@@ -0,0 +1,81 @@
+#ifndef CAFFE2_UTILS_INT8_GEMM_H_
+#define CAFFE2_UTILS_INT8_GEMM_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/utils/quantization.h"
+
+namespace caffe2 {
+namespace math {
+
+// Int8GemmMatrixB holds the quantized weights of a layer, one row of K values
+// per output. Every row j is quantized symmetrically to int8 values in
+// [-127, 127] with its own scale, Scale(j) = max_k |B[j][k]| / 127. The values
+// are stored widened to int16, with the rows padded with zeros to a multiple of
+// 16 values, which is the layout the Int8Gemm kernels read.
+class Int8GemmMatrixB {
+ public:
+  Int8GemmMatrixB() {}
+
+  // Quantizes and packs the N x K float matrix B, of leading dimension ldb.
+  void Pack(const int N, const int K, const float* B, const int ldb);
+
+  int N() const {
+    return N_;
+  }
+  int K() const {
+    return K_;
+  }
+  bool empty() const {
+    return data_.empty();
+  }
+  float Scale(const int j) const {
+    return scales_[j];
+  }
+  // Returns the padded row j.
+  const int16_t* Row(const int j) const {
+    return data_.data() + static_cast<size_t>(j) * paddedK_;
+  }
+  int PaddedK() const {
+    return paddedK_;
+  }
+
+ private:
+  int N_ = 0;
+  int K_ = 0;
+  int paddedK_ = 0;
+  std::vector<int16_t> data_;
+  std::vector<float> scales_;
+};
+
+// Computes the quantized C = act(A * B^T + bias), where A is an M x K uint8
+// matrix of leading dimension lda quantized with a_params, B holds N packed
+// rows of K weights, bias is an N dimensional float vector (or null), and C is
+// an M x N uint8 matrix of leading dimension ldc quantized with c_params. If
+// relu is true, act(x) = max(x, 0), otherwise act is the identity.
+//
+// The products are accumulated exactly in int32 (with AVX2, 16 at a time with
+// _mm256_madd_epi16), the bias is added at the scale of the products, and
+// every output is requantized to uint8 right after its dot product. The rows
+// and columns of C are split across the CPU thread pool.
+void Int8Gemm(
+    const int M,
+    const int N,
+    const int K,
+    const uint8_t* A,
+    const int lda,
+    const QuantizationParams& a_params,
+    const Int8GemmMatrixB& B,
+    const float* bias,
+    const QuantizationParams& c_params,
+    const bool relu,
+    uint8_t* C,
+    const int ldc,
+    CPUContext* context);
+
+} // namespace math
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_INT8_GEMM_H_
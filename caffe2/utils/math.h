@@ -24,6 +24,12 @@ namespace caffe2 {
 // engine specified.
 class DefaultEngine {};
 
+// Engine tag for caffe2's built-in blocked SGEMM (see utils/packed_gemm.cc).
+// It does its own packing and runs on the caffe2 CPU thread pool, so it does
+// not depend on the BLAS library that is linked in. Operators templated on an
+// Engine expose it under the "PACKED" engine name.
+class PackedEngine {};
+
 // Common Eigen types that we will often use
 template <typename T>
 using EigenMatrixMap =
@@ -239,6 +245,17 @@ void Col2im(
     T* data_im,
     Context* context);
 
+// Transposes the ndim dimensional tensor X of shape x_dims into Y, so that
+// dimension i of Y is dimension axes[i] of X, as numpy.transpose does.
+template <typename T, class Context>
+void Transpose(
+    const int ndim,
+    const int* x_dims,
+    const int* axes,
+    const T* X,
+    T* Y,
+    Context* context);
+
 template <class Context>
 void CopyMatrix(const size_t item_size, const int M, const int N, const void* A,
                 const int lda, void* B, const int ldb, Context* context);
@@ -14,7 +14,9 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <algorithm>
 #include <atomic>
+#include <cmath>
 #include <random>
 
 #ifdef CAFFE2_USE_MKL
@@ -23,6 +25,7 @@
 
 #include "caffe2/utils/math.h"
 #include "caffe2/core/context.h"
+#include "caffe2/utils/philox_random.h"
 #include "Eigen/Core"
 #include "Eigen/Dense"
 
@@ -555,35 +558,82 @@ void Not<bool, CPUContext>(
 #undef CAFFE2_DEFINE_BINARY_OP
 #undef CAFFE2_INSTANTIATE_BINARY_OP
 
+namespace {
+// Values of the Philox stream converted at once by PhiloxFill, a multiple of 4
+// so that every batch but the last starts on a block boundary.
+constexpr size_t kPhiloxBatchSize = 256;
+
+// Fills r[0, n) in parallel from the Philox stream of the context, element i
+// from value i of the stream. f(bits, size, out) converts a batch of size
+// values; bits holds the values at the same positions, rounded up to an even
+// count for transforms that consume pairs.
+template <typename T, typename F>
+void PhiloxFill(const int n, T* r, CPUContext* context, F f) {
+  ParallelForPhilox(
+      n,
+      context->PhiloxGenerator(n),
+      [&](PhiloxRandom* generator, const size_t begin, const size_t end) {
+        uint32_t bits[kPhiloxBatchSize];
+        for (size_t i = begin; i < end; i += kPhiloxBatchSize) {
+          const size_t size = std::min(kPhiloxBatchSize, end - i);
+          generator->Generate((size + 1) / 2 * 2, bits);
+          f(bits, size, r + i);
+        }
+      });
+}
+} // namespace
+
 template <>
 void RandUniform<float, CPUContext>(
     const int n, const float a, const float b, float* r,
     CPUContext* context) {
-  std::uniform_real_distribution<float> distribution(a, b);
-  for (int i = 0; i < n; ++i) {
-    r[i] = distribution(context->RandGenerator());
-  }
+  PhiloxFill(n, r, context, [=](const uint32_t* bits, size_t size, float* out) {
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = a + (b - a) * PhiloxUniform(bits[i]);
+    }
+  });
 }
 
 template <>
 void RandUniform<int, CPUContext>(
     const int n, const int a, const int b, int* r,
     CPUContext* context) {
-  std::uniform_int_distribution<int> distribution(a, b);
-  for (int i = 0; i < n; ++i) {
-    r[i] = distribution(context->RandGenerator());
-  }
+  CAFFE_ENFORCE_LE(a, b);
+  // Scales 32 random bits to [a, b]: the bias is below range / 2^32.
+  const uint64_t range = static_cast<int64_t>(b) - a + 1;
+  PhiloxFill(n, r, context, [=](const uint32_t* bits, size_t size, int* out) {
+    for (size_t i = 0; i < size; ++i) {
+      out[i] = a + static_cast<int64_t>((bits[i] * range) >> 32);
+    }
+  });
 }
 
-
 template <>
 void RandGaussian<float, CPUContext>(
     const int n, const float mean, const float std, float* r,
     CPUContext* context) {
-  std::normal_distribution<float> distribution(mean, std);
-  for (int i = 0; i < n; ++i) {
-    r[i] = distribution(context->RandGenerator());
-  }
+  // Box-Muller transform of pairs of uniforms, the first of them in (0, 1].
+  PhiloxFill(n, r, context, [=](const uint32_t* bits, size_t size, float* out) {
+    const size_t pairs = (size + 1) / 2;
+    float radius[kPhiloxBatchSize / 2], cos[kPhiloxBatchSize / 2];
+    float sin[kPhiloxBatchSize / 2];
+    for (size_t i = 0; i < pairs; ++i) {
+      radius[i] = PhiloxUniform(bits[2 * i]) + 1.0f / (1 << 24);
+      cos[i] = 2 * static_cast<float>(M_PI) * PhiloxUniform(bits[2 * i + 1]);
+    }
+    EigenVectorArrayMap<float> radiusArray(radius, pairs);
+    EigenVectorArrayMap<float> cosArray(cos, pairs);
+    radiusArray = std * (-2 * radiusArray.log()).sqrt();
+    EigenVectorArrayMap<float>(sin, pairs) = cosArray.sin();
+    cosArray = cosArray.cos();
+    for (size_t i = 0; i < size / 2; ++i) {
+      out[2 * i] = mean + radius[i] * cos[i];
+      out[2 * i + 1] = mean + radius[i] * sin[i];
+    }
+    if (size % 2) {
+      out[size - 1] = mean + radius[pairs - 1] * cos[pairs - 1];
+    }
+  });
 }
 
 template<>
@@ -181,6 +181,118 @@ TEST(MathTest, GemvTrans) {
   }
 }
 
-}  // namespace caffe2
+TEST(MathTest, PackedGemmMatchesDefaultEngine) {
+  DeviceOption option;
+  CPUContext cpu_context(option);
+  // Sizes that are not multiples of any of the blocking parameters, and a K
+  // larger than one K block.
+  const int M = 37, N = 53, K = 600;
+  const CBLAS_TRANSPOSE kTrans[] = {CblasNoTrans, CblasTrans};
+  for (const auto trans_a : kTrans) {
+    for (const auto trans_b : kTrans) {
+      TensorCPU A(std::vector<int>{M, K});
+      TensorCPU B(std::vector<int>{K, N});
+      TensorCPU Y(std::vector<int>{M, N});
+      TensorCPU Y_packed(std::vector<int>{M, N});
+      float* a = A.mutable_data<float>();
+      float* b = B.mutable_data<float>();
+      for (int i = 0; i < A.size(); ++i) {
+        a[i] = (i % 17) * 0.125f - 1;
+      }
+      for (int i = 0; i < B.size(); ++i) {
+        b[i] = (i % 13) * 0.25f - 1.5f;
+      }
+      for (const float beta : {0.f, 0.5f}) {
+        math::Set<float, CPUContext>(
+            Y.size(), 1, Y.mutable_data<float>(), &cpu_context);
+        math::Set<float, CPUContext>(
+            Y_packed.size(), 1, Y_packed.mutable_data<float>(), &cpu_context);
+        math::Gemm<float, CPUContext>(
+            trans_a, trans_b, M, N, K, 0.5, a, b, beta,
+            Y.mutable_data<float>(), &cpu_context);
+        math::Gemm<float, CPUContext, PackedEngine>(
+            trans_a, trans_b, M, N, K, 0.5, a, b, beta,
+            Y_packed.mutable_data<float>(), &cpu_context);
+        for (int i = 0; i < Y.size(); ++i) {
+          EXPECT_NEAR(Y.data<float>()[i], Y_packed.data<float>()[i], 1e-3)
+              << i;
+        }
+      }
+    }
+  }
+}
+
+TEST(MathTest, PackedGemmWithLeadingDimensions) {
+  DeviceOption option;
+  CPUContext cpu_context(option);
+  // Multiplies the top-left 3x4 and 4x5 sub-matrices of wider matrices.
+  std::vector<float> A(3 * 10, 1);
+  std::vector<float> B(4 * 20, 2);
+  std::vector<float> C(3 * 7, -1);
+  math::Gemm<float, CPUContext, PackedEngine>(
+      CblasNoTrans, CblasNoTrans, 3, 5, 4, 1, A.data(), 10, B.data(), 0, 20,
+      C.data(), 7, &cpu_context);
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 7; ++j) {
+      EXPECT_EQ(C[i * 7 + j], j < 5 ? 8 : -1) << i << " " << j;
+    }
+  }
+}
 
+namespace {
 
+template <typename T>
+void CheckTranspose(const vector<int>& dims, const vector<int>& axes) {
+  const int ndim = dims.size();
+  int size = 1;
+  for (const int d : dims) {
+    size *= d;
+  }
+  vector<T> x(size), y(size, -1);
+  for (int i = 0; i < size; ++i) {
+    x[i] = i;
+  }
+  CPUContext context;
+  math::Transpose<T, CPUContext>(
+      ndim, dims.data(), axes.data(), x.data(), y.data(), &context);
+  vector<int> y_dims(ndim);
+  for (int i = 0; i < ndim; ++i) {
+    y_dims[i] = dims[axes[i]];
+  }
+  vector<int> x_index(ndim);
+  for (int i = 0; i < size; ++i) {
+    // Multi-index of element i of y, mapped back to x.
+    int rest = i;
+    for (int k = ndim - 1; k >= 0; --k) {
+      x_index[axes[k]] = rest % y_dims[k];
+      rest /= y_dims[k];
+    }
+    int x_offset = 0;
+    for (int k = 0; k < ndim; ++k) {
+      x_offset = x_offset * dims[k] + x_index[k];
+    }
+    ASSERT_EQ(y[i], x[x_offset]) << i;
+  }
+}
+
+} // namespace
+
+TEST(MathTest, Transpose) {
+  CheckTranspose<float>({17, 29}, {1, 0});
+  CheckTranspose<float>({64, 96}, {1, 0});
+  CheckTranspose<float>({2, 3, 4, 5}, {0, 2, 3, 1});
+  CheckTranspose<float>({2, 3, 4, 5}, {0, 3, 1, 2});
+  CheckTranspose<float>({2, 3, 4, 5}, {3, 2, 1, 0});
+  CheckTranspose<float>({2, 3, 4, 5}, {1, 0, 2, 3});
+  CheckTranspose<float>({2, 1, 4, 1}, {3, 2, 1, 0});
+  CheckTranspose<float>({3, 4, 5}, {0, 1, 2});
+  CheckTranspose<float>({1}, {0});
+  // Large enough to be split across threads.
+  CheckTranspose<float>({4, 35, 33, 31}, {0, 2, 3, 1});
+  CheckTranspose<float>({300, 7, 150}, {1, 0, 2});
+  CheckTranspose<int>({13, 9, 17}, {2, 0, 1});
+  CheckTranspose<double>({13, 9, 17}, {2, 1, 0});
+  CheckTranspose<long>({8, 16, 3}, {1, 0, 2});
+}
+
+}  // namespace caffe2
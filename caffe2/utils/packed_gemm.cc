@@ -0,0 +1,598 @@
+// Implements the PackedEngine for math::Gemm<float, CPUContext>: a blocked
+// SGEMM with its own packing and register-tiled micro-kernels, so that FC /
+// MatMul performance does not depend on which BLAS (if any) is linked in, and
+// so that its threading goes through the caffe2 CPU thread pool instead of a
+// BLAS-private one.
+//
+// The structure follows the usual GotoBLAS / BLIS layering:
+//   - op(B) is processed in kKC x kNC blocks that are packed into kNR-wide
+//     column panels,
+//   - op(A) is processed in kMC x kKC blocks that are packed into kMR-high row
+//     panels,
+//   - a kMR x kNR micro-kernel multiplies one A panel with one B panel while
+//     keeping the whole C tile in registers.
+// The micro-kernel is selected at compile time: AVX-512 (6x32), AVX2 + FMA
+// (6x16), or a portable one (4x8) that the compiler can auto-vectorize. Build
+// with the matching CFLAGS (e.g. -mavx2 -mfma) to get the SIMD kernels.
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/core/context.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/packed_gemm.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+namespace math {
+
+namespace {
+
+#if defined(__AVX512F__)
+constexpr int kMR = 6;
+constexpr int kNR = 32;
+#elif defined(__AVX2__) && defined(__FMA__)
+constexpr int kMR = 6;
+constexpr int kNR = 16;
+#else
+constexpr int kMR = 4;
+constexpr int kNR = 8;
+#endif
+// Cache blocking sizes: a packed kMC x kKC block of A stays in L2, a kKC x kNR
+// panel of B stays in L1, and a kKC x kNC block of B is shared by all threads.
+constexpr int kMC = 72;
+constexpr int kKC = 256;
+constexpr int kNC = 2048;
+static_assert(kMC % kMR == 0, "kMC must be a multiple of kMR.");
+static_assert(kNC % kNR == 0, "kNC must be a multiple of kNR.");
+// Problems with fewer flops than this are run on the calling thread only.
+constexpr double kMinParallelFlops = 1 << 21;
+
+inline int DivUp(const int a, const int b) {
+  return (a + b - 1) / b;
+}
+
+// Computes c = alpha * a * b + beta * c for a kMR x kNR tile of c, where a is a
+// packed kMR-high panel and b a packed kNR-wide panel of depth kc. As for the
+// rest of caffe2's gemm, beta == 0 overwrites c even if it holds NaNs.
+#if defined(__AVX512F__)
+
+inline void StoreRow(
+    __m512 lo,
+    __m512 hi,
+    const float alpha,
+    const float beta,
+    float* c) {
+  const __m512 valpha = _mm512_set1_ps(alpha);
+  lo = _mm512_mul_ps(lo, valpha);
+  hi = _mm512_mul_ps(hi, valpha);
+  if (beta != 0) {
+    const __m512 vbeta = _mm512_set1_ps(beta);
+    lo = _mm512_fmadd_ps(vbeta, _mm512_loadu_ps(c), lo);
+    hi = _mm512_fmadd_ps(vbeta, _mm512_loadu_ps(c + 16), hi);
+  }
+  _mm512_storeu_ps(c, lo);
+  _mm512_storeu_ps(c + 16, hi);
+}
+
+void MicroKernel(
+    const int kc,
+    const float* a,
+    const float* b,
+    const float alpha,
+    const float beta,
+    float* c,
+    const int ldc) {
+  __m512 c00 = _mm512_setzero_ps(), c01 = _mm512_setzero_ps();
+  __m512 c10 = _mm512_setzero_ps(), c11 = _mm512_setzero_ps();
+  __m512 c20 = _mm512_setzero_ps(), c21 = _mm512_setzero_ps();
+  __m512 c30 = _mm512_setzero_ps(), c31 = _mm512_setzero_ps();
+  __m512 c40 = _mm512_setzero_ps(), c41 = _mm512_setzero_ps();
+  __m512 c50 = _mm512_setzero_ps(), c51 = _mm512_setzero_ps();
+  for (int p = 0; p < kc; ++p) {
+    const __m512 b0 = _mm512_loadu_ps(b);
+    const __m512 b1 = _mm512_loadu_ps(b + 16);
+#define CAFFE2_GEMM_FMA_ROW(i)                      \
+  {                                                 \
+    const __m512 ai = _mm512_set1_ps(a[i]);         \
+    c##i##0 = _mm512_fmadd_ps(ai, b0, c##i##0);     \
+    c##i##1 = _mm512_fmadd_ps(ai, b1, c##i##1);     \
+  }
+    CAFFE2_GEMM_FMA_ROW(0)
+    CAFFE2_GEMM_FMA_ROW(1)
+    CAFFE2_GEMM_FMA_ROW(2)
+    CAFFE2_GEMM_FMA_ROW(3)
+    CAFFE2_GEMM_FMA_ROW(4)
+    CAFFE2_GEMM_FMA_ROW(5)
+#undef CAFFE2_GEMM_FMA_ROW
+    a += kMR;
+    b += kNR;
+  }
+  StoreRow(c00, c01, alpha, beta, c);
+  StoreRow(c10, c11, alpha, beta, c + ldc);
+  StoreRow(c20, c21, alpha, beta, c + 2 * ldc);
+  StoreRow(c30, c31, alpha, beta, c + 3 * ldc);
+  StoreRow(c40, c41, alpha, beta, c + 4 * ldc);
+  StoreRow(c50, c51, alpha, beta, c + 5 * ldc);
+}
+
+#elif defined(__AVX2__) && defined(__FMA__)
+
+inline void StoreRow(
+    __m256 lo,
+    __m256 hi,
+    const float alpha,
+    const float beta,
+    float* c) {
+  const __m256 valpha = _mm256_set1_ps(alpha);
+  lo = _mm256_mul_ps(lo, valpha);
+  hi = _mm256_mul_ps(hi, valpha);
+  if (beta != 0) {
+    const __m256 vbeta = _mm256_set1_ps(beta);
+    lo = _mm256_fmadd_ps(vbeta, _mm256_loadu_ps(c), lo);
+    hi = _mm256_fmadd_ps(vbeta, _mm256_loadu_ps(c + 8), hi);
+  }
+  _mm256_storeu_ps(c, lo);
+  _mm256_storeu_ps(c + 8, hi);
+}
+
+void MicroKernel(
+    const int kc,
+    const float* a,
+    const float* b,
+    const float alpha,
+    const float beta,
+    float* c,
+    const int ldc) {
+  __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+  __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+  __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+  __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+  __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+  __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+  for (int p = 0; p < kc; ++p) {
+    const __m256 b0 = _mm256_loadu_ps(b);
+    const __m256 b1 = _mm256_loadu_ps(b + 8);
+#define CAFFE2_GEMM_FMA_ROW(i)                      \
+  {                                                 \
+    const __m256 ai = _mm256_broadcast_ss(a + i);   \
+    c##i##0 = _mm256_fmadd_ps(ai, b0, c##i##0);     \
+    c##i##1 = _mm256_fmadd_ps(ai, b1, c##i##1);     \
+  }
+    CAFFE2_GEMM_FMA_ROW(0)
+    CAFFE2_GEMM_FMA_ROW(1)
+    CAFFE2_GEMM_FMA_ROW(2)
+    CAFFE2_GEMM_FMA_ROW(3)
+    CAFFE2_GEMM_FMA_ROW(4)
+    CAFFE2_GEMM_FMA_ROW(5)
+#undef CAFFE2_GEMM_FMA_ROW
+    a += kMR;
+    b += kNR;
+  }
+  StoreRow(c00, c01, alpha, beta, c);
+  StoreRow(c10, c11, alpha, beta, c + ldc);
+  StoreRow(c20, c21, alpha, beta, c + 2 * ldc);
+  StoreRow(c30, c31, alpha, beta, c + 3 * ldc);
+  StoreRow(c40, c41, alpha, beta, c + 4 * ldc);
+  StoreRow(c50, c51, alpha, beta, c + 5 * ldc);
+}
+
+#else
+
+void MicroKernel(
+    const int kc,
+    const float* a,
+    const float* b,
+    const float alpha,
+    const float beta,
+    float* c,
+    const int ldc) {
+  float acc[kMR][kNR] = {};
+  for (int p = 0; p < kc; ++p) {
+    for (int i = 0; i < kMR; ++i) {
+      const float ai = a[i];
+      for (int j = 0; j < kNR; ++j) {
+        acc[i][j] += ai * b[j];
+      }
+    }
+    a += kMR;
+    b += kNR;
+  }
+  for (int i = 0; i < kMR; ++i) {
+    float* c_row = c + i * ldc;
+    if (beta == 0) {
+      for (int j = 0; j < kNR; ++j) {
+        c_row[j] = alpha * acc[i][j];
+      }
+    } else {
+      for (int j = 0; j < kNR; ++j) {
+        c_row[j] = alpha * acc[i][j] + beta * c_row[j];
+      }
+    }
+  }
+}
+
+#endif
+
+// Runs the micro-kernel on a tile that may be smaller than kMR x kNR at the
+// bottom / right border of C.
+void EdgeKernel(
+    const int mr,
+    const int nr,
+    const int kc,
+    const float* a,
+    const float* b,
+    const float alpha,
+    const float beta,
+    float* c,
+    const int ldc) {
+  float tile[kMR * kNR];
+  MicroKernel(kc, a, b, alpha, 0, tile, kNR);
+  for (int i = 0; i < mr; ++i) {
+    float* c_row = c + i * ldc;
+    const float* tile_row = tile + i * kNR;
+    if (beta == 0) {
+      for (int j = 0; j < nr; ++j) {
+        c_row[j] = tile_row[j];
+      }
+    } else {
+      for (int j = 0; j < nr; ++j) {
+        c_row[j] = tile_row[j] + beta * c_row[j];
+      }
+    }
+  }
+}
+
+// Packs the mc x kc block of op(A) starting at (i0, p0) into kMR-high panels
+// laid out as [panel][p][i], zero-padding the last panel.
+void PackA(
+    const CBLAS_TRANSPOSE TransA,
+    const float* A,
+    const int lda,
+    const int i0,
+    const int mc,
+    const int p0,
+    const int kc,
+    float* dst) {
+  for (int ir = 0; ir < mc; ir += kMR) {
+    const int mr = std::min(kMR, mc - ir);
+    if (TransA == CblasNoTrans) {
+      for (int i = 0; i < mr; ++i) {
+        const float* src = A + (i0 + ir + i) * lda + p0;
+        for (int p = 0; p < kc; ++p) {
+          dst[p * kMR + i] = src[p];
+        }
+      }
+    } else {
+      for (int p = 0; p < kc; ++p) {
+        const float* src = A + (p0 + p) * lda + i0 + ir;
+        for (int i = 0; i < mr; ++i) {
+          dst[p * kMR + i] = src[i];
+        }
+      }
+    }
+    for (int i = mr; i < kMR; ++i) {
+      for (int p = 0; p < kc; ++p) {
+        dst[p * kMR + i] = 0;
+      }
+    }
+    dst += kMR * kc;
+  }
+}
+
+// Packs the kc x nr panel of op(B) starting at (p0, j0) as [p][j], zero-padding
+// it to kNR columns.
+void PackBPanel(
+    const CBLAS_TRANSPOSE TransB,
+    const float* B,
+    const int ldb,
+    const int p0,
+    const int kc,
+    const int j0,
+    const int nr,
+    float* dst) {
+  if (TransB == CblasNoTrans) {
+    for (int p = 0; p < kc; ++p) {
+      const float* src = B + (p0 + p) * ldb + j0;
+      for (int j = 0; j < nr; ++j) {
+        dst[p * kNR + j] = src[j];
+      }
+    }
+  } else {
+    for (int j = 0; j < nr; ++j) {
+      const float* src = B + (j0 + j) * ldb + p0;
+      for (int p = 0; p < kc; ++p) {
+        dst[p * kNR + j] = src[p];
+      }
+    }
+  }
+  for (int j = nr; j < kNR; ++j) {
+    for (int p = 0; p < kc; ++p) {
+      dst[p * kNR + j] = 0;
+    }
+  }
+}
+
+// Applies the bias and ReLU of PackedGemm to a finished mr x nr tile of C.
+void Epilogue(
+    const int mr,
+    const int nr,
+    const float* bias,
+    const bool relu,
+    float* c,
+    const int ldc) {
+  for (int i = 0; i < mr; ++i) {
+    float* c_row = c + i * ldc;
+    if (bias) {
+      for (int j = 0; j < nr; ++j) {
+        c_row[j] += bias[j];
+      }
+    }
+    if (relu) {
+      for (int j = 0; j < nr; ++j) {
+        c_row[j] = std::max(c_row[j], 0.f);
+      }
+    }
+  }
+}
+
+// The gemm driver shared by the Gemm engine and PackedGemm. get_packed_b(pc,
+// kc, jc, nc, num_threads) returns the packed kc x nc block of op(B) at
+// (pc, jc); it is called by the calling thread only, once per block.
+template <class GetPackedB>
+void PackedSgemmImpl(
+    const CBLAS_TRANSPOSE TransA,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int lda,
+    const GetPackedB& get_packed_b,
+    const float beta,
+    float* C,
+    const int ldc,
+    const float* bias,
+    const bool relu) {
+  if (M == 0 || N == 0) {
+    return;
+  }
+  if (K == 0 || alpha == 0) {
+    for (int i = 0; i < M; ++i) {
+      float* c_row = C + i * ldc;
+      if (beta == 0) {
+        std::fill(c_row, c_row + N, 0.f);
+      } else {
+        for (int j = 0; j < N; ++j) {
+          c_row[j] *= beta;
+        }
+      }
+    }
+    Epilogue(M, N, bias, relu, C, ldc);
+    return;
+  }
+
+  ThreadPool* pool = ThreadPool::Default();
+  const int num_threads =
+      2.0 * M * N * K >= kMinParallelFlops ? pool->EffectiveNumThreads() : 1;
+  const int m_blocks = DivUp(M, kMC);
+
+  for (int jc = 0; jc < N; jc += kNC) {
+    const int nc = std::min(kNC, N - jc);
+    const int n_panels = DivUp(nc, kNR);
+    // Split the B panels into chunks so that there are enough (A block, B
+    // chunk) pairs to keep every thread busy even when M is small.
+    int n_chunks = 1;
+    if (num_threads > 1) {
+      n_chunks = std::min(n_panels, DivUp(4 * num_threads, m_blocks));
+    }
+    const int panels_per_chunk = DivUp(n_panels, n_chunks);
+    n_chunks = DivUp(n_panels, panels_per_chunk);
+
+    for (int pc = 0; pc < K; pc += kKC) {
+      const int kc = std::min(kKC, K - pc);
+      // Later K blocks accumulate into the result of the first one, and the
+      // epilogue runs after the last one.
+      const float beta_block = pc == 0 ? beta : 1.f;
+      const bool last_block = pc + kc == K;
+      const bool has_epilogue = last_block && (bias || relu);
+      const float* packed_b = get_packed_b(pc, kc, jc, nc, num_threads);
+
+      auto compute = [&](size_t task) {
+        const int ic = (task / n_chunks) * kMC;
+        const int mc = std::min(kMC, M - ic);
+        const int panel_begin = (task % n_chunks) * panels_per_chunk;
+        const int panel_end = std::min(n_panels, panel_begin + panels_per_chunk);
+        static thread_local std::vector<float> packed_a;
+        packed_a.resize(kMC * kKC);
+        PackA(TransA, A, lda, ic, mc, pc, kc, packed_a.data());
+        for (int panel = panel_begin; panel < panel_end; ++panel) {
+          const int jr = panel * kNR;
+          const int nr = std::min(kNR, nc - jr);
+          const float* b_panel = packed_b + panel * kc * kNR;
+          for (int ir = 0; ir < mc; ir += kMR) {
+            const int mr = std::min(kMR, mc - ir);
+            const float* a_panel = packed_a.data() + ir * kc;
+            float* c_tile = C + (ic + ir) * ldc + jc + jr;
+            if (mr == kMR && nr == kNR) {
+              MicroKernel(kc, a_panel, b_panel, alpha, beta_block, c_tile, ldc);
+            } else {
+              EdgeKernel(
+                  mr, nr, kc, a_panel, b_panel, alpha, beta_block, c_tile, ldc);
+            }
+            if (has_epilogue) {
+              Epilogue(
+                  mr, nr, bias ? bias + jc + jr : nullptr, relu, c_tile, ldc);
+            }
+          }
+        }
+      };
+
+      if (num_threads > 1) {
+        pool->Run(compute, m_blocks * n_chunks);
+      } else {
+        for (int task = 0; task < m_blocks * n_chunks; ++task) {
+          compute(task);
+        }
+      }
+    }
+  }
+}
+
+void PackedSgemm(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int lda,
+    const float* B,
+    const int ldb,
+    const float beta,
+    float* C,
+    const int ldc) {
+  // The packed B block is shared by all threads working on this call, while
+  // every thread packs the A blocks it works on into its own buffer.
+  static thread_local std::vector<float> packed_b;
+  packed_b.resize(kKC * DivUp(std::min(N, kNC), kNR) * kNR);
+  auto get_packed_b = [&](
+      const int pc, const int kc, const int jc, const int nc,
+      const int num_threads) {
+    float* packed_b_data = packed_b.data();
+    auto pack_b = [&](size_t panel) {
+      const int jr = panel * kNR;
+      PackBPanel(
+          TransB,
+          B,
+          ldb,
+          pc,
+          kc,
+          jc + jr,
+          std::min(kNR, nc - jr),
+          packed_b_data + panel * kc * kNR);
+    };
+    const int n_panels = DivUp(nc, kNR);
+    if (num_threads > 1) {
+      ThreadPool::Default()->Run(pack_b, n_panels);
+    } else {
+      for (int panel = 0; panel < n_panels; ++panel) {
+        pack_b(panel);
+      }
+    }
+    return static_cast<const float*>(packed_b_data);
+  };
+  PackedSgemmImpl(
+      TransA, M, N, K, alpha, A, lda, get_packed_b, beta, C, ldc, nullptr,
+      false);
+}
+
+}  // namespace
+
+void PackedGemmMatrixB::Pack(
+    const CBLAS_TRANSPOSE TransB,
+    const int K,
+    const int N,
+    const float* B,
+    const int ldb) {
+  K_ = K;
+  N_ = N;
+  // Blocks are stored column block by column block, and within a column block
+  // K block by K block, in the same layout PackedSgemm packs them on the fly.
+  data_.resize(static_cast<size_t>(K) * DivUp(N, kNR) * kNR);
+  for (int jc = 0; jc < N; jc += kNC) {
+    const int nc = std::min(kNC, N - jc);
+    for (int pc = 0; pc < K; pc += kKC) {
+      const int kc = std::min(kKC, K - pc);
+      float* block = data_.data() + (Block(pc, jc) - data_.data());
+      for (int jr = 0; jr < nc; jr += kNR) {
+        PackBPanel(
+            TransB,
+            B,
+            ldb,
+            pc,
+            kc,
+            jc + jr,
+            std::min(kNR, nc - jr),
+            block + (jr / kNR) * kc * kNR);
+      }
+    }
+  }
+}
+
+const float* PackedGemmMatrixB::Block(const int pc, const int jc) const {
+  // All column blocks before jc are full, so they hold jc * K_ floats; within
+  // the column block each row of op(B) takes the padded block width.
+  const int padded_nc = DivUp(std::min(kNC, N_ - jc), kNR) * kNR;
+  return data_.data() + static_cast<size_t>(jc) * K_ +
+      static_cast<size_t>(pc) * padded_nc;
+}
+
+void PackedGemm(
+    const CBLAS_TRANSPOSE TransA,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int lda,
+    const PackedGemmMatrixB& B,
+    const float beta,
+    float* C,
+    const int ldc,
+    const float* bias,
+    const bool relu,
+    CPUContext* context) {
+  CAFFE_ENFORCE_EQ(B.K(), K);
+  CAFFE_ENFORCE_EQ(B.N(), N);
+  auto get_packed_b = [&](
+      const int pc, const int kc, const int jc, const int nc,
+      const int num_threads) { return B.Block(pc, jc); };
+  PackedSgemmImpl(
+      TransA, M, N, K, alpha, A, lda, get_packed_b, beta, C, ldc, bias, relu);
+}
+
+template <>
+void Gemm<float, CPUContext, PackedEngine>(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const float* B,
+    const float beta,
+    float* C,
+    CPUContext* context) {
+  const int lda = (TransA == CblasNoTrans) ? K : M;
+  const int ldb = (TransB == CblasNoTrans) ? N : K;
+  PackedSgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, N);
+}
+
+template <>
+void Gemm<float, CPUContext, PackedEngine>(
+    const CBLAS_TRANSPOSE TransA,
+    const CBLAS_TRANSPOSE TransB,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int lda,
+    const float* B,
+    const float beta,
+    const int ldb,
+    float* C,
+    const int ldc,
+    CPUContext* context) {
+  PackedSgemm(TransA, TransB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+}  // namespace math
+}  // namespace caffe2
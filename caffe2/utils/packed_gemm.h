@@ -0,0 +1,80 @@
+#ifndef CAFFE2_UTILS_PACKED_GEMM_H_
+#define CAFFE2_UTILS_PACKED_GEMM_H_
+
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/utils/math.h"
+
+namespace caffe2 {
+namespace math {
+
+// PackedGemmMatrixB holds op(B) of a K x N gemm already laid out in the cache
+// blocked panel format used by the PackedEngine. Packing a matrix that is used
+// many times (such as the weights of an FC layer at inference time) once and
+// passing it to PackedGemm() below saves the packing pass of every call.
+class PackedGemmMatrixB {
+ public:
+  PackedGemmMatrixB() {}
+  PackedGemmMatrixB(
+      const CBLAS_TRANSPOSE TransB,
+      const int K,
+      const int N,
+      const float* B,
+      const int ldb) {
+    Pack(TransB, K, N, B, ldb);
+  }
+
+  // Packs op(B), where op(B) is K x N and B has leading dimension ldb.
+  void Pack(
+      const CBLAS_TRANSPOSE TransB,
+      const int K,
+      const int N,
+      const float* B,
+      const int ldb);
+
+  int K() const {
+    return K_;
+  }
+  int N() const {
+    return N_;
+  }
+  bool empty() const {
+    return data_.empty();
+  }
+  // Returns the packed kc x nc block of op(B) starting at (pc, jc), where pc
+  // and jc are multiples of the engine's blocking sizes.
+  const float* Block(const int pc, const int jc) const;
+
+ private:
+  int K_ = 0;
+  int N_ = 0;
+  std::vector<float> data_;
+};
+
+// Computes C = act(alpha * op(A) * B + beta * C + bias) with the PackedEngine,
+// where B is a pre-packed K x N matrix and C has size M x N. If bias is not
+// null, it is an N dimensional vector added to every row of C. If relu is
+// true, act(x) = max(x, 0), otherwise act is the identity. The bias and ReLU
+// are applied to each output tile while it is still in cache, right after its
+// last update.
+void PackedGemm(
+    const CBLAS_TRANSPOSE TransA,
+    const int M,
+    const int N,
+    const int K,
+    const float alpha,
+    const float* A,
+    const int lda,
+    const PackedGemmMatrixB& B,
+    const float beta,
+    float* C,
+    const int ldc,
+    const float* bias,
+    const bool relu,
+    CPUContext* context);
+
+}  // namespace math
+}  // namespace caffe2
+
+#endif  // CAFFE2_UTILS_PACKED_GEMM_H_
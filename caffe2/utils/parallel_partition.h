@@ -0,0 +1,106 @@
+#ifndef CAFFE2_UTILS_PARALLEL_PARTITION_H_
+#define CAFFE2_UTILS_PARALLEL_PARTITION_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "caffe2/core/tensor.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+// A stable parallel counting sort of the positions [0, size) by part, where
+// part_of(i) in [0, num_parts) is the part of position i. Chunks of positions
+// are counted in parallel on the CPU thread pool, and then every chunk writes
+// its positions in parallel at offsets computed from the counts of the chunks
+// before it. part_of is called twice per position, so it should be cheap.
+//
+// ParallelPartitionCount fills chunk_offsets and the starts of the parts:
+// part p gets the destinations (*starts)[p] to (*starts)[p + 1] - 1. After
+// the caller has made room for the parts, ParallelPartitionScatter calls
+// place(i, p, q) for every position i of part p, with q its destination.
+// Positions of the same part keep their order.
+constexpr TIndex kParallelPartitionChunkSize = 1 << 14;
+
+template <typename F>
+void ParallelPartitionCount(
+    const TIndex size,
+    const int num_parts,
+    const F& part_of,
+    std::vector<TIndex>* chunk_offsets,
+    std::vector<TIndex>* starts) {
+  constexpr TIndex kChunkSize = kParallelPartitionChunkSize;
+  const TIndex num_chunks = (size + kChunkSize - 1) / kChunkSize;
+  // counts[c * num_parts + p] is first the number of positions of chunk c in
+  // part p, and then where chunk c writes them.
+  auto& counts = *chunk_offsets;
+  counts.assign(num_chunks * num_parts, 0);
+  ThreadPool::Default()->Run(
+      [&](size_t c) {
+        TIndex* chunk_counts = &counts[c * num_parts];
+        const TIndex end = std::min<TIndex>(size, (c + 1) * kChunkSize);
+        for (TIndex i = c * kChunkSize; i < end; ++i) {
+          ++chunk_counts[part_of(i)];
+        }
+      },
+      num_chunks);
+  starts->resize(num_parts + 1);
+  TIndex offset = 0;
+  for (int p = 0; p < num_parts; ++p) {
+    (*starts)[p] = offset;
+    for (TIndex c = 0; c < num_chunks; ++c) {
+      const TIndex count = counts[c * num_parts + p];
+      counts[c * num_parts + p] = offset;
+      offset += count;
+    }
+  }
+  (*starts)[num_parts] = size;
+}
+
+template <typename F, typename G>
+void ParallelPartitionScatter(
+    const TIndex size,
+    const int num_parts,
+    const F& part_of,
+    std::vector<TIndex>* chunk_offsets,
+    const G& place) {
+  constexpr TIndex kChunkSize = kParallelPartitionChunkSize;
+  const TIndex num_chunks = (size + kChunkSize - 1) / kChunkSize;
+  ThreadPool::Default()->Run(
+      [&](size_t c) {
+        TIndex* offsets = &(*chunk_offsets)[c * num_parts];
+        const TIndex end = std::min<TIndex>(size, (c + 1) * kChunkSize);
+        for (TIndex i = c * kChunkSize; i < end; ++i) {
+          const int p = part_of(i);
+          place(i, p, offsets[p]++);
+        }
+      },
+      num_chunks);
+}
+
+// Groups the positions [0, size) by part, keeping their order within every
+// part: part p gets (*positions)[(*starts)[p]] to
+// (*positions)[(*starts)[p + 1] - 1].
+template <typename F>
+void ParallelPartition(
+    const TIndex size,
+    const int num_parts,
+    const F& part_of,
+    std::vector<TIndex>* positions,
+    std::vector<TIndex>* starts) {
+  std::vector<TIndex> chunk_offsets;
+  ParallelPartitionCount(size, num_parts, part_of, &chunk_offsets, starts);
+  positions->resize(size);
+  ParallelPartitionScatter(
+      size,
+      num_parts,
+      part_of,
+      &chunk_offsets,
+      [&](const TIndex i, const int /* p */, const TIndex q) {
+        (*positions)[q] = i;
+      });
+}
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_PARALLEL_PARTITION_H_
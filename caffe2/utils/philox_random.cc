@@ -0,0 +1,124 @@
+#include "caffe2/utils/philox_random.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+// Parallel loops do not split below this many values per task.
+constexpr size_t kMinValuesPerTask = 1 << 14;
+constexpr int kTasksPerThread = 4;
+
+#if defined(__AVX2__)
+// The high 32 bits of the products of the 32-bit lanes of x and y.
+inline __m256i MulHigh(__m256i x, __m256i y) {
+  const __m256i even = _mm256_mul_epu32(x, y);
+  const __m256i odd =
+      _mm256_mul_epu32(_mm256_srli_epi64(x, 32), _mm256_srli_epi64(y, 32));
+  return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+#endif
+} // namespace
+
+constexpr uint32_t PhiloxRandom::kMultiplier0;
+constexpr uint32_t PhiloxRandom::kMultiplier1;
+constexpr uint32_t PhiloxRandom::kWeyl0;
+constexpr uint32_t PhiloxRandom::kWeyl1;
+
+void PhiloxRandom::Generate(size_t n, uint32_t* out) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  // kLanes blocks at a time, one per lane, as long as their counters only
+  // differ in the lowest word. The rounds of kGroups independent groups of
+  // eight blocks are interleaved to hide the latency of the multiplications.
+  constexpr int kGroups = 4;
+  constexpr int kLanes = 8 * kGroups;
+  for (; i + 4 * kLanes <= n && counter_[0] <= UINT32_MAX - (kLanes - 1);
+       i += 4 * kLanes) {
+    __m256i x[kGroups][4];
+    for (int g = 0; g < kGroups; ++g) {
+      x[g][0] = _mm256_add_epi32(
+          _mm256_set1_epi32(counter_[0] + 8 * g),
+          _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+      x[g][1] = _mm256_set1_epi32(counter_[1]);
+      x[g][2] = _mm256_set1_epi32(counter_[2]);
+      x[g][3] = _mm256_set1_epi32(counter_[3]);
+    }
+    __m256i k0 = _mm256_set1_epi32(key_[0]);
+    __m256i k1 = _mm256_set1_epi32(key_[1]);
+    const __m256i multiplier0 = _mm256_set1_epi32(kMultiplier0);
+    const __m256i multiplier1 = _mm256_set1_epi32(kMultiplier1);
+    for (int round = 0; round < 10; ++round) {
+      for (int g = 0; g < kGroups; ++g) {
+        const __m256i hi0 = MulHigh(x[g][0], multiplier0);
+        const __m256i hi1 = MulHigh(x[g][2], multiplier1);
+        const __m256i lo0 = _mm256_mullo_epi32(x[g][0], multiplier0);
+        const __m256i lo1 = _mm256_mullo_epi32(x[g][2], multiplier1);
+        x[g][0] = _mm256_xor_si256(_mm256_xor_si256(hi1, x[g][1]), k0);
+        x[g][1] = lo1;
+        x[g][2] = _mm256_xor_si256(_mm256_xor_si256(hi0, x[g][3]), k1);
+        x[g][3] = lo0;
+      }
+      k0 = _mm256_add_epi32(k0, _mm256_set1_epi32(kWeyl0));
+      k1 = _mm256_add_epi32(k1, _mm256_set1_epi32(kWeyl1));
+    }
+    for (int g = 0; g < kGroups; ++g) {
+      // Transposes the words of the lanes back into blocks.
+      const __m256i t0 = _mm256_unpacklo_epi32(x[g][0], x[g][1]);
+      const __m256i t1 = _mm256_unpackhi_epi32(x[g][0], x[g][1]);
+      const __m256i t2 = _mm256_unpacklo_epi32(x[g][2], x[g][3]);
+      const __m256i t3 = _mm256_unpackhi_epi32(x[g][2], x[g][3]);
+      const __m256i b04 = _mm256_unpacklo_epi64(t0, t2);
+      const __m256i b15 = _mm256_unpackhi_epi64(t0, t2);
+      const __m256i b26 = _mm256_unpacklo_epi64(t1, t3);
+      const __m256i b37 = _mm256_unpackhi_epi64(t1, t3);
+      __m256i* y = reinterpret_cast<__m256i*>(out + i + 32 * g);
+      _mm256_storeu_si256(y, _mm256_permute2x128_si256(b04, b15, 0x20));
+      _mm256_storeu_si256(y + 1, _mm256_permute2x128_si256(b26, b37, 0x20));
+      _mm256_storeu_si256(y + 2, _mm256_permute2x128_si256(b04, b15, 0x31));
+      _mm256_storeu_si256(y + 3, _mm256_permute2x128_si256(b26, b37, 0x31));
+    }
+    counter_[0] += kLanes;
+  }
+#endif
+  for (; i < n; i += 4) {
+    const Block block = (*this)();
+    std::copy(block.begin(), block.begin() + std::min<size_t>(4, n - i),
+              out + i);
+  }
+}
+
+void ParallelForPhilox(
+    size_t n,
+    const PhiloxRandom& generator,
+    const std::function<void(PhiloxRandom*, size_t, size_t)>& fn) {
+  if (n == 0) {
+    return;
+  }
+  const size_t maxTasks =
+      ThreadPool::Default()->EffectiveNumThreads() * kTasksPerThread;
+  const size_t numTasks =
+      std::max<size_t>(1, std::min(maxTasks, n / kMinValuesPerTask));
+  // A multiple of 4, so that every task starts on a block boundary.
+  const size_t valuesPerTask = ((n + numTasks - 1) / numTasks + 3) / 4 * 4;
+  ThreadPool::Default()->Run(
+      [&](const size_t task) {
+        const size_t begin = task * valuesPerTask;
+        if (begin >= n) {
+          return;
+        }
+        PhiloxRandom taskGenerator = generator;
+        taskGenerator.Skip(begin / 4);
+        fn(&taskGenerator, begin, std::min(n, begin + valuesPerTask));
+      },
+      numTasks);
+}
+
+} // namespace caffe2
@@ -0,0 +1,96 @@
+#ifndef CAFFE2_UTILS_PHILOX_RANDOM_H_
+#define CAFFE2_UTILS_PHILOX_RANDOM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace caffe2 {
+
+// PhiloxRandom is the Philox4x32-10 counter-based random number generator of
+// Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC 2011). It
+// maps a 128-bit counter and a 64-bit key, the seed, to a block of four 32-bit
+// random values, so any position of the stream can be reached in constant time
+// with Skip(). Parallel kernels take a copy of a generator per task, skipped
+// ahead to the first element of the task, and produce the same numbers as a
+// sequential loop, whatever the number of threads.
+class PhiloxRandom {
+ public:
+  using Block = std::array<uint32_t, 4>;
+
+  // Creates a generator for the given seed, positioned at block `offset` of
+  // its stream.
+  explicit PhiloxRandom(uint64_t seed, uint64_t offset = 0)
+      : counter_{{static_cast<uint32_t>(offset),
+                  static_cast<uint32_t>(offset >> 32),
+                  0,
+                  0}},
+        key_{{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}} {
+  }
+
+  // Moves the generator forward by n blocks.
+  void Skip(uint64_t n) {
+    const uint64_t low =
+        (static_cast<uint64_t>(counter_[1]) << 32 | counter_[0]) + n;
+    if (low < n) {
+      if (++counter_[2] == 0) {
+        ++counter_[3];
+      }
+    }
+    counter_[0] = static_cast<uint32_t>(low);
+    counter_[1] = static_cast<uint32_t>(low >> 32);
+  }
+
+  // Returns the block at the current position and moves to the next one.
+  Block operator()() {
+    Block block = counter_;
+    std::array<uint32_t, 2> key = key_;
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t product0 = static_cast<uint64_t>(kMultiplier0) * block[0];
+      const uint64_t product1 = static_cast<uint64_t>(kMultiplier1) * block[2];
+      block = {{static_cast<uint32_t>(product1 >> 32) ^ block[1] ^ key[0],
+                static_cast<uint32_t>(product1),
+                static_cast<uint32_t>(product0 >> 32) ^ block[3] ^ key[1],
+                static_cast<uint32_t>(product0)}};
+      key[0] += kWeyl0;
+      key[1] += kWeyl1;
+    }
+    Skip(1);
+    return block;
+  }
+
+  // Writes the next n values of the stream to out, four per block, and moves
+  // to the block after the last one used. With AVX2, blocks are generated
+  // eight at a time, one per lane.
+  void Generate(size_t n, uint32_t* out);
+
+ private:
+  static constexpr uint32_t kMultiplier0 = 0xD2511F53;
+  static constexpr uint32_t kMultiplier1 = 0xCD9E8D57;
+  static constexpr uint32_t kWeyl0 = 0x9E3779B9;
+  static constexpr uint32_t kWeyl1 = 0xBB67AE85;
+
+  Block counter_;
+  std::array<uint32_t, 2> key_;
+};
+
+// Maps 32 random bits to a float uniformly distributed in [0, 1).
+inline float PhiloxUniform(uint32_t x) {
+  return (x >> 8) * (1.0f / (1 << 24));
+}
+
+// Runs fn(generator, begin, end) over chunks of [0, n) across the CPU thread
+// pool, where generator is a copy of `generator` skipped ahead to element
+// begin: element i always draws value i % 4 of block i / 4, so the result does
+// not depend on the number of threads. Every chunk but the last starts and
+// ends on a block boundary. The generator itself is not advanced; see
+// CPUContext::PhiloxGenerator() to reserve a fresh part of a stream.
+void ParallelForPhilox(
+    size_t n,
+    const PhiloxRandom& generator,
+    const std::function<void(PhiloxRandom*, size_t, size_t)>& fn);
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_PHILOX_RANDOM_H_
@@ -0,0 +1,149 @@
+#include <cmath>
+#include <vector>
+
+#include "caffe2/core/context.h"
+#include "caffe2/proto/caffe2.pb.h"
+#include "caffe2/utils/math.h"
+#include "caffe2/utils/philox_random.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+namespace {
+// More values than one task of a parallel loop takes, and not a multiple of
+// 4, so that the fills are split and end on a partial block.
+constexpr int kSize = 100003;
+
+std::vector<uint32_t> Sequential(uint64_t seed, int n) {
+  PhiloxRandom generator(seed);
+  std::vector<uint32_t> values;
+  while (values.size() < n) {
+    const auto block = generator();
+    values.insert(values.end(), block.begin(), block.end());
+  }
+  values.resize(n);
+  return values;
+}
+
+DeviceOption Seed(int seed) {
+  DeviceOption option;
+  option.set_random_seed(seed);
+  return option;
+}
+} // namespace
+
+TEST(PhiloxRandomTest, KnownAnswer) {
+  // From the known-answer tests of the Random123 library.
+  PhiloxRandom generator(0);
+  const auto block = generator();
+  EXPECT_EQ(block[0], 0x6627e8d5);
+  EXPECT_EQ(block[1], 0xe169c58d);
+  EXPECT_EQ(block[2], 0xbc57ac4c);
+  EXPECT_EQ(block[3], 0x9b00dbd8);
+}
+
+TEST(PhiloxRandomTest, SkipMatchesSequential) {
+  const auto expected = Sequential(7, 4 * 100);
+  for (int offset : {0, 1, 37, 99}) {
+    PhiloxRandom generator(7, offset);
+    const auto block = generator();
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(block[j], expected[4 * offset + j]);
+    }
+    PhiloxRandom skipped(7);
+    skipped.Skip(offset);
+    EXPECT_EQ(skipped(), block);
+  }
+}
+
+TEST(PhiloxRandomTest, SkipCarries) {
+  PhiloxRandom skipped(3, ~0ull);
+  skipped.Skip(2);
+  PhiloxRandom expected(3, 1);
+  // The low 64 bits wrapped around to 1 and carried into the high ones.
+  EXPECT_NE(skipped(), expected());
+}
+
+TEST(PhiloxRandomTest, GenerateMatchesSequential) {
+  const auto expected = Sequential(11, 1003);
+  PhiloxRandom generator(11);
+  std::vector<uint32_t> values(1003);
+  generator.Generate(values.size(), values.data());
+  EXPECT_EQ(values, expected);
+  // Generate moved past the partial last block.
+  PhiloxRandom next(11, (1003 + 3) / 4);
+  EXPECT_EQ(generator(), next());
+}
+
+TEST(PhiloxRandomTest, GenerateCrossesWordBoundary) {
+  // The lowest word of the counter wraps around within the values.
+  const uint64_t offset = 0xfffffff0;
+  PhiloxRandom sequential(11, offset);
+  std::vector<uint32_t> expected;
+  for (int b = 0; b < 300; ++b) {
+    const auto block = sequential();
+    expected.insert(expected.end(), block.begin(), block.end());
+  }
+  PhiloxRandom generator(11, offset);
+  std::vector<uint32_t> values(expected.size());
+  generator.Generate(values.size(), values.data());
+  EXPECT_EQ(values, expected);
+}
+
+TEST(PhiloxRandomTest, RandUniformIsElementwise) {
+  CPUContext context(Seed(5));
+  std::vector<float> r(kSize);
+  math::RandUniform<float, CPUContext>(kSize, -1, 3, r.data(), &context);
+  const auto bits = Sequential(5, kSize);
+  for (int i = 0; i < kSize; ++i) {
+    ASSERT_EQ(r[i], -1 + 4 * PhiloxUniform(bits[i])) << i;
+    ASSERT_GE(r[i], -1);
+    ASSERT_LT(r[i], 3);
+  }
+}
+
+TEST(PhiloxRandomTest, ContextStreamIsReproducible) {
+  CPUContext context(Seed(9));
+  CPUContext other(Seed(9));
+  std::vector<float> first(kSize), second(kSize), expected(kSize);
+  math::RandUniform<float, CPUContext>(kSize, 0, 1, first.data(), &context);
+  math::RandUniform<float, CPUContext>(kSize, 0, 1, second.data(), &context);
+  EXPECT_NE(first, second);
+  math::RandUniform<float, CPUContext>(kSize, 0, 1, expected.data(), &other);
+  EXPECT_EQ(first, expected);
+  math::RandUniform<float, CPUContext>(kSize, 0, 1, expected.data(), &other);
+  EXPECT_EQ(second, expected);
+}
+
+TEST(PhiloxRandomTest, RandUniformInt) {
+  CPUContext context(Seed(13));
+  std::vector<int> r(kSize);
+  math::RandUniform<int, CPUContext>(kSize, -3, 3, r.data(), &context);
+  std::vector<int> counts(7);
+  for (int value : r) {
+    ASSERT_GE(value, -3);
+    ASSERT_LE(value, 3);
+    ++counts[value + 3];
+  }
+  for (int count : counts) {
+    EXPECT_NEAR(count, kSize / 7., 0.05 * kSize / 7);
+  }
+}
+
+TEST(PhiloxRandomTest, RandGaussian) {
+  CPUContext context(Seed(17));
+  std::vector<float> r(kSize);
+  math::RandGaussian<float, CPUContext>(kSize, 2, 3, r.data(), &context);
+  double sum = 0, sumsq = 0;
+  for (float value : r) {
+    ASSERT_TRUE(std::isfinite(value));
+    sum += value;
+    sumsq += value * value;
+  }
+  const double mean = sum / kSize;
+  const double variance = sumsq / kSize - mean * mean;
+  EXPECT_NEAR(mean, 2, 0.05);
+  EXPECT_NEAR(variance, 9, 0.15);
+}
+
+} // namespace caffe2
@@ -0,0 +1,43 @@
+#include "caffe2/utils/quantization.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace caffe2 {
+
+QuantizationParams ChooseQuantizationParams(float min, float max) {
+  min = std::min(min, 0.f);
+  max = std::max(max, 0.f);
+  if (max == min) {
+    return QuantizationParams{1, 0};
+  }
+  const float scale = (max - min) / 255;
+  const int32_t zero_point = static_cast<int32_t>(
+      std::min(255.f, std::max(0.f, std::nearbyint(-min / scale))));
+  return QuantizationParams{scale, zero_point};
+}
+
+void Quantize(
+    const float* x,
+    size_t n,
+    const QuantizationParams& params,
+    uint8_t* q) {
+  const float inverse_scale = 1 / params.scale;
+  const float zero_point = params.zero_point;
+  for (size_t i = 0; i < n; ++i) {
+    const float value = std::nearbyint(x[i] * inverse_scale) + zero_point;
+    q[i] = static_cast<uint8_t>(std::min(255.f, std::max(0.f, value)));
+  }
+}
+
+void Dequantize(
+    const uint8_t* q,
+    size_t n,
+    const QuantizationParams& params,
+    float* x) {
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = params.scale * (static_cast<int32_t>(q[i]) - params.zero_point);
+  }
+}
+
+} // namespace caffe2
@@ -0,0 +1,38 @@
+#ifndef CAFFE2_UTILS_QUANTIZATION_H_
+#define CAFFE2_UTILS_QUANTIZATION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caffe2 {
+
+// The parameters of the affine uint8 quantization of real values: a value x
+// is stored as q = round(x / scale) + zero_point, clamped to [0, 255], and q
+// stands for scale * (q - zero_point).
+struct QuantizationParams {
+  float scale;
+  int32_t zero_point;
+};
+
+// Chooses the quantization of values in [min, max]. The range is widened to
+// contain 0, so that 0 is represented exactly (by zero_point) and zero padding
+// and ReLU stay exact in the quantized domain.
+QuantizationParams ChooseQuantizationParams(float min, float max);
+
+// Quantizes the n values of x to q.
+void Quantize(
+    const float* x,
+    size_t n,
+    const QuantizationParams& params,
+    uint8_t* q);
+
+// Converts the n quantized values of q back to real values in x.
+void Dequantize(
+    const uint8_t* q,
+    size_t n,
+    const QuantizationParams& params,
+    float* x);
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_QUANTIZATION_H_
@@ -0,0 +1,233 @@
+#include "caffe2/utils/radix_unique.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/thread_pool.h"
+
+namespace caffe2 {
+
+namespace {
+
+constexpr int kRadixBits = 8;
+constexpr int kNumPartitions = 1 << kRadixBits;
+// Inputs smaller than this are deduplicated as a single partition.
+constexpr int kMinPartitionedSize = 1 << 16;
+// Number of elements per task of the partitioning passes.
+constexpr int kChunkSize = 1 << 14;
+// Initial number of slots of the hash table of a partition.
+constexpr size_t kInitialCapacity = 256;
+
+// Finalizer of MurmurHash3. Its top bits pick the partition and its low bits
+// the slot in the hash table of the partition, so the two are independent.
+inline uint64_t Hash(const uint64_t key) {
+  uint64_t h = key;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb3fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+template <typename T>
+inline int PartitionOf(const T key) {
+  return Hash(static_cast<uint64_t>(key)) >> (64 - kRadixBits);
+}
+
+// Open-addressing table with linear probing from values to their position in
+// a list of distinct values. It is sized by the number of distinct values, so
+// partitions made of a few hot ids stay small.
+template <typename T>
+class UniqueTable {
+ public:
+  UniqueTable() : slots_(kInitialCapacity, -1), mask_(kInitialCapacity - 1) {}
+
+  // Returns the position of key in unique, appending it if it is new.
+  int Insert(const T key, std::vector<T>* unique) {
+    size_t s = Slot(key);
+    int id;
+    while ((id = slots_[s]) >= 0 && (*unique)[id] != key) {
+      s = (s + 1) & mask_;
+    }
+    if (id >= 0) {
+      return id;
+    }
+    id = slots_[s] = unique->size();
+    unique->push_back(key);
+    if (2 * unique->size() > slots_.size()) {
+      Grow(*unique);
+    }
+    return id;
+  }
+
+ private:
+  size_t Slot(const T key) const {
+    return Hash(static_cast<uint64_t>(key)) & mask_;
+  }
+
+  void Grow(const std::vector<T>& unique) {
+    slots_.assign(2 * slots_.size(), -1);
+    mask_ = slots_.size() - 1;
+    for (int id = 0; id < unique.size(); ++id) {
+      size_t s = Slot(unique[id]);
+      while (slots_[s] >= 0) {
+        s = (s + 1) & mask_;
+      }
+      slots_[s] = id;
+    }
+  }
+
+  // Position in unique of the value of every slot, or -1 for empty slots.
+  std::vector<int> slots_;
+  size_t mask_;
+};
+
+// Deduplicates keys[0, size) into unique, in order of first occurrence.
+// positions[i] is the position of keys[i] in the input, or i if positions is
+// null. If remapping is not null, writes the position in unique of keys[i] to
+// remapping[positions[i]]. If first_positions is not null, it gets the
+// position in the input of the first occurrence of every value.
+template <typename T>
+void UniquePartition(
+    const T* keys,
+    const int* positions,
+    const int size,
+    std::vector<T>* unique,
+    int* remapping,
+    std::vector<int>* first_positions) {
+  unique->clear();
+  if (first_positions) {
+    first_positions->clear();
+  }
+  UniqueTable<T> table;
+  for (int i = 0; i < size; ++i) {
+    const size_t num_unique = unique->size();
+    const int id = table.Insert(keys[i], unique);
+    const int position = positions ? positions[i] : i;
+    if (first_positions && id == num_unique) {
+      first_positions->push_back(position);
+    }
+    if (remapping) {
+      remapping[position] = id;
+    }
+  }
+}
+
+} // namespace
+
+template <typename T>
+void RadixPartitionedUnique(
+    const T* input,
+    const int n,
+    std::vector<T>* unique,
+    int* remapping,
+    std::vector<int>* first_positions) {
+  CAFFE_ENFORCE_GE(n, 0);
+  if (n < kMinPartitionedSize) {
+    UniquePartition(input, nullptr, n, unique, remapping, first_positions);
+    return;
+  }
+  ThreadPool* pool = ThreadPool::Default();
+  const int num_chunks = (n + kChunkSize - 1) / kChunkSize;
+
+  // counts[c * kNumPartitions + p] is first the number of elements of chunk c
+  // in partition p, and then where chunk c writes them.
+  std::vector<int> counts(num_chunks * kNumPartitions, 0);
+  pool->Run(
+      [&](size_t c) {
+        int* chunk_counts = &counts[c * kNumPartitions];
+        const int end = std::min<int>(n, (c + 1) * kChunkSize);
+        for (int i = c * kChunkSize; i < end; ++i) {
+          ++chunk_counts[PartitionOf(input[i])];
+        }
+      },
+      num_chunks);
+  std::vector<int> partition_starts(kNumPartitions + 1);
+  int offset = 0;
+  for (int p = 0; p < kNumPartitions; ++p) {
+    partition_starts[p] = offset;
+    for (int c = 0; c < num_chunks; ++c) {
+      const int count = counts[c * kNumPartitions + p];
+      counts[c * kNumPartitions + p] = offset;
+      offset += count;
+    }
+  }
+  partition_starts[kNumPartitions] = n;
+
+  // Chunks write in order, so every partition keeps the input order and its
+  // first occurrences are the first occurrences in the input.
+  std::vector<T> keys(n);
+  std::vector<int> positions(n);
+  pool->Run(
+      [&](size_t c) {
+        int* chunk_offsets = &counts[c * kNumPartitions];
+        const int end = std::min<int>(n, (c + 1) * kChunkSize);
+        for (int i = c * kChunkSize; i < end; ++i) {
+          const int o = chunk_offsets[PartitionOf(input[i])]++;
+          keys[o] = input[i];
+          positions[o] = i;
+        }
+      },
+      num_chunks);
+
+  std::vector<std::vector<T>> partition_unique(kNumPartitions);
+  std::vector<std::vector<int>> partition_first(kNumPartitions);
+  pool->Run(
+      [&](size_t p) {
+        const int start = partition_starts[p];
+        UniquePartition(
+            keys.data() + start,
+            positions.data() + start,
+            partition_starts[p + 1] - start,
+            &partition_unique[p],
+            remapping,
+            first_positions ? &partition_first[p] : nullptr);
+      },
+      kNumPartitions);
+
+  std::vector<int> unique_starts(kNumPartitions + 1, 0);
+  for (int p = 0; p < kNumPartitions; ++p) {
+    unique_starts[p + 1] = unique_starts[p] + partition_unique[p].size();
+  }
+  unique->resize(unique_starts[kNumPartitions]);
+  if (first_positions) {
+    first_positions->resize(unique_starts[kNumPartitions]);
+  }
+  pool->Run(
+      [&](size_t p) {
+        const int unique_start = unique_starts[p];
+        std::copy(
+            partition_unique[p].begin(),
+            partition_unique[p].end(),
+            unique->begin() + unique_start);
+        if (first_positions) {
+          std::copy(
+              partition_first[p].begin(),
+              partition_first[p].end(),
+              first_positions->begin() + unique_start);
+        }
+        if (remapping && unique_start > 0) {
+          for (int i = partition_starts[p]; i < partition_starts[p + 1]; ++i) {
+            remapping[positions[i]] += unique_start;
+          }
+        }
+      },
+      kNumPartitions);
+}
+
+template void RadixPartitionedUnique<int32_t>(
+    const int32_t* input,
+    const int n,
+    std::vector<int32_t>* unique,
+    int* remapping,
+    std::vector<int>* first_positions);
+template void RadixPartitionedUnique<int64_t>(
+    const int64_t* input,
+    const int n,
+    std::vector<int64_t>* unique,
+    int* remapping,
+    std::vector<int>* first_positions);
+
+} // namespace caffe2
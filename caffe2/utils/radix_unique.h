@@ -0,0 +1,34 @@
+#ifndef CAFFE2_UTILS_RADIX_UNIQUE_H_
+#define CAFFE2_UTILS_RADIX_UNIQUE_H_
+
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+// Finds the distinct values of input[0, n), as Unique and
+// FindDuplicateElements do, for integer types.
+//
+// Large inputs are split by the top bits of a hash of the values into
+// partitions that keep the input order, each partition is deduplicated with
+// its own flat hash table, and the results are concatenated; all three passes
+// are split across the CPU thread pool. Small inputs are deduplicated as a
+// single partition.
+//
+// unique gets the distinct values grouped by partition, each group in order
+// of first occurrence. The order only depends on the input. If remapping is
+// not null, remapping[i] is the position of input[i] in unique. If
+// first_positions is not null, it gets the position in input of the first
+// occurrence of every value of unique.
+template <typename T>
+void RadixPartitionedUnique(
+    const T* input,
+    const int n,
+    std::vector<T>* unique,
+    int* remapping,
+    std::vector<int>* first_positions);
+
+} // namespace caffe2
+
+#endif // CAFFE2_UTILS_RADIX_UNIQUE_H_
@@ -0,0 +1,205 @@
+#include "caffe2/utils/thread_pool.h"
+
+#include <algorithm>
+
+#include "caffe2/core/flags.h"
+#include "caffe2/core/logging.h"
+
+CAFFE2_DEFINE_int(
+    caffe2_cpu_pool_num_threads,
+    0,
+    "The number of threads used by the CPU thread pool for intra-op "
+    "parallelism, including the calling thread. 0 to use the number of "
+    "hardware threads, 1 to run all parallel loops serially.");
+
+namespace caffe2 {
+
+namespace {
+// Number of threads, process-wide, that are busy running operators or
+// parallel loops.
+std::atomic<int> gBusyThreads(0);
+// How many InterOpWorkerScope / parallel loop levels the current thread is in.
+thread_local int tlsBusyDepth = 0;
+// Whether the current thread is executing the body of a parallel loop.
+thread_local bool tlsInParallelRegion = false;
+
+void EnterBusy() {
+  if (tlsBusyDepth++ == 0) {
+    ++gBusyThreads;
+  }
+}
+
+void LeaveBusy() {
+  if (--tlsBusyDepth == 0) {
+    --gBusyThreads;
+  }
+}
+
+class BusyScope {
+ public:
+  BusyScope() {
+    EnterBusy();
+  }
+  ~BusyScope() {
+    LeaveBusy();
+  }
+};
+
+class ParallelRegionScope {
+ public:
+  ParallelRegionScope() : previous_(tlsInParallelRegion) {
+    tlsInParallelRegion = true;
+  }
+  ~ParallelRegionScope() {
+    tlsInParallelRegion = previous_;
+  }
+
+ private:
+  bool previous_;
+};
+}  // namespace
+
+int NumBusyCPUThreads() {
+  return gBusyThreads;
+}
+
+InterOpWorkerScope::InterOpWorkerScope() {
+  EnterBusy();
+}
+
+InterOpWorkerScope::~InterOpWorkerScope() {
+  LeaveBusy();
+}
+
+struct ThreadPool::Task {
+  Task(const std::function<void(size_t)>& f, size_t r, int helpers)
+      : fn(f), range(r), max_helpers(helpers), num_helpers(0), next(0) {}
+
+  // Grabs indices until the range is exhausted. The first exception stops
+  // everybody working on the task.
+  void Work() {
+    ParallelRegionScope parallel_region;
+    size_t i;
+    while ((i = next++) < range) {
+      try {
+        fn(i);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(exception_mutex);
+        if (!exception) {
+          exception = std::current_exception();
+        }
+        next = range;
+      }
+    }
+  }
+
+  const std::function<void(size_t)>& fn;
+  const size_t range;
+  const int max_helpers;
+  // Guarded by the pool mutex.
+  int num_helpers;
+  std::atomic<size_t> next;
+  std::mutex exception_mutex;
+  std::exception_ptr exception;
+};
+
+ThreadPool::ThreadPool(int num_threads)
+    : num_threads_(std::max(num_threads, 1)), stop_(false) {
+  for (int i = 1; i < num_threads_; ++i) {
+    workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+ThreadPool* ThreadPool::Default() {
+  static ThreadPool pool(
+      FLAGS_caffe2_cpu_pool_num_threads > 0
+          ? FLAGS_caffe2_cpu_pool_num_threads
+          : std::max<int>(std::thread::hardware_concurrency(), 1));
+  return &pool;
+}
+
+int ThreadPool::EffectiveNumThreads() const {
+  if (tlsInParallelRegion) {
+    return 1;
+  }
+  // The current thread counts as busy once it runs the loop.
+  const int busy = std::max(gBusyThreads + (tlsBusyDepth == 0 ? 1 : 0), 1);
+  return std::max(num_threads_ / busy, 1);
+}
+
+ThreadPool::Task* ThreadPool::FindJoinableTask() {
+  for (Task* task : tasks_) {
+    if (task->num_helpers < task->max_helpers && task->next < task->range) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::WorkerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    Task* task = nullptr;
+    work_cv_.wait(
+        lock, [&] { return stop_ || (task = FindJoinableTask()) != nullptr; });
+    if (stop_) {
+      return;
+    }
+    ++task->num_helpers;
+    lock.unlock();
+    {
+      BusyScope busy;
+      task->Work();
+    }
+    lock.lock();
+    if (--task->num_helpers == 0) {
+      done_cv_.notify_all();
+    }
+  }
+}
+
+void ThreadPool::Run(const std::function<void(size_t)>& fn, size_t range) {
+  if (range == 0) {
+    return;
+  }
+  const int num_threads = std::min<size_t>(EffectiveNumThreads(), range);
+  if (num_threads <= 1) {
+    ParallelRegionScope parallel_region;
+    for (size_t i = 0; i < range; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  BusyScope busy;
+  Task task(fn, range, num_threads - 1);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(&task);
+  }
+  work_cv_.notify_all();
+  task.Work();
+  {
+    // Make sure no new helper joins, and wait for the ones still running
+    // before the task goes out of scope.
+    std::unique_lock<std::mutex> lock(mutex_);
+    tasks_.erase(std::find(tasks_.begin(), tasks_.end(), &task));
+    done_cv_.wait(lock, [&] { return task.num_helpers == 0; });
+  }
+  if (task.exception) {
+    std::rethrow_exception(task.exception);
+  }
+}
+
+}  // namespace caffe2
@@ -0,0 +1,90 @@
+#ifndef CAFFE2_UTILS_THREAD_POOL_H_
+#define CAFFE2_UTILS_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "caffe2/core/common.h"
+
+namespace caffe2 {
+
+// ThreadPool is the intra-op parallelism engine for CPU kernels. It runs
+// fork-join parallel loops: Run(fn, range) calls fn(i) for every i in
+// [0, range), with the calling thread taking part in the work, and returns
+// once all of them finished.
+//
+// The pool cooperates with inter-op parallelism (such as the DAG net
+// workers): every thread that is currently busy running operators counts as
+// occupying one core, and a parallel loop only recruits its share of the pool,
+// roughly NumThreads() / (number of busy threads). When many DAG workers run
+// heavy kernels at the same time each of them mostly runs its own loop, and
+// when a single worker is active it gets the whole machine, so the total number
+// of running threads stays close to the number of cores either way.
+//
+// Nested parallel loops (a Run() issued from inside a Run() body) are executed
+// inline on the calling thread.
+class ThreadPool {
+ public:
+  // Creates a pool that uses up to num_threads threads for a parallel loop,
+  // including the calling thread; num_threads - 1 helper threads are spawned.
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  int NumThreads() const { return num_threads_; }
+
+  // Runs fn(i) for i in [0, range), and blocks until all of them are done. If
+  // any fn(i) throws, the remaining indices are skipped and the first
+  // exception is rethrown on the calling thread.
+  void Run(const std::function<void(size_t)>& fn, size_t range);
+
+  // Returns the number of threads a parallel loop issued right now from the
+  // current thread would use, including the current thread. Kernels can use
+  // this to decide how finely to split their work.
+  int EffectiveNumThreads() const;
+
+  // The process-wide CPU thread pool. Its size is controlled by the
+  // caffe2_cpu_pool_num_threads flag and it is created on first use.
+  static ThreadPool* Default();
+
+ private:
+  struct Task;
+  Task* FindJoinableTask();
+  void WorkerLoop();
+
+  const int num_threads_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Task*> tasks_;
+  bool stop_;
+
+  DISABLE_COPY_AND_ASSIGN(ThreadPool);
+};
+
+// Returns the number of threads that are currently busy running operators or
+// parallel loops, process-wide.
+int NumBusyCPUThreads();
+
+// InterOpWorkerScope marks the current thread as busy running operators for
+// its lifetime, so that parallel loops issued anywhere in the process account
+// for it. DAG net workers hold one while running an execution chain.
+class InterOpWorkerScope {
+ public:
+  InterOpWorkerScope();
+  ~InterOpWorkerScope();
+
+ private:
+  DISABLE_COPY_AND_ASSIGN(InterOpWorkerScope);
+};
+
+}  // namespace caffe2
+
+#endif  // CAFFE2_UTILS_THREAD_POOL_H_
@@ -0,0 +1,78 @@
+#include <atomic>
+#include <stdexcept>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "caffe2/core/logging.h"
+#include "caffe2/utils/thread_pool.h"
+#include "gtest/gtest.h"
+
+namespace caffe2 {
+
+TEST(ThreadPoolTest, RunsEveryIndexOnce) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> counts(1000);
+  for (auto& count : counts) {
+    count = 0;
+  }
+  pool.Run([&](size_t i) { ++counts[i]; }, counts.size());
+  for (const auto& count : counts) {
+    EXPECT_EQ(count, 1);
+  }
+}
+
+TEST(ThreadPoolTest, NestedRunIsInline) {
+  ThreadPool pool(4);
+  std::atomic<int> total(0);
+  pool.Run(
+      [&](size_t) {
+        const auto outer_thread = std::this_thread::get_id();
+        EXPECT_EQ(pool.EffectiveNumThreads(), 1);
+        pool.Run(
+            [&](size_t) {
+              EXPECT_EQ(std::this_thread::get_id(), outer_thread);
+              ++total;
+            },
+            10);
+      },
+      10);
+  EXPECT_EQ(total, 100);
+}
+
+TEST(ThreadPoolTest, ConcurrentCallers) {
+  ThreadPool pool(3);
+  std::atomic<int> total(0);
+  std::vector<std::thread> callers;
+  for (int i = 0; i < 4; ++i) {
+    callers.push_back(std::thread([&]() {
+      InterOpWorkerScope scope;
+      for (int iter = 0; iter < 20; ++iter) {
+        pool.Run([&](size_t) { ++total; }, 50);
+      }
+    }));
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  EXPECT_EQ(total, 4 * 20 * 50);
+  EXPECT_EQ(NumBusyCPUThreads(), 0);
+}
+
+TEST(ThreadPoolTest, PropagatesExceptions) {
+  ThreadPool pool(4);
+  EXPECT_THROW(
+      pool.Run(
+          [](size_t i) {
+            if (i == 7) {
+              throw std::runtime_error("failure");
+            }
+          },
+          100),
+      std::runtime_error);
+  // The pool is still usable afterwards.
+  std::atomic<int> total(0);
+  pool.Run([&](size_t) { ++total; }, 100);
+  EXPECT_EQ(total, 100);
+}
+
+}  // namespace caffe2